@@ -14,6 +14,11 @@ class NumaBinding {
 public:
     // 绑定当前线程到指定NUMA节点
     static bool bindThreadToNode(int nodeId) {
+        return bindThreadToNode(nodeId, nodeId);
+    }
+
+    // 绑定当前线程到 nodeId 节点, 线程的 numa 组 (目录序号) 记为 groupId, 目录和节点不一一对应时使用
+    static bool bindThreadToNode(int nodeId, int groupId) {
         try {
             cpu_set_t cpuset;
             {
@@ -30,7 +35,7 @@ public:
             if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) == -1) {
                 return false;
             }
-            localGroupId_ = nodeId;
+            localGroupId_ = groupId;
             return true;
         } catch (const std::exception&) {
             return false;
@@ -39,6 +44,12 @@ public:
 
     static int getThreadLocalGroupId() { return localGroupId_; }
 
+    // 获取系统中的NUMA节点数量
+    static int getNumaNodeCount() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return getNumaNodeCountLocked();
+    }
+
 private:
     static std::map<int, std::vector<int>> nodeCpuMap_;  // 缓存每个节点的CPU列表
     static int nodeCount_;                                // 缓存节点数量
@@ -60,8 +71,7 @@ private:
     }
 
 
-    // 获取系统中的NUMA节点数量
-    static int getNumaNodeCount() {
+    static int getNumaNodeCountLocked() {
         if (nodeCount_ == -1) {
             initNodeCount();
         }
@@ -71,7 +81,7 @@ private:
     // 获取指定节点的CPU列表
     static const std::vector<int>& getNodeCpus(int nodeId) {
         // 检查节点ID是否有效
-        if (getNumaNodeCount() <= nodeId) {
+        if (getNumaNodeCountLocked() <= nodeId) {
             return nodeCpuMap_[nodeId]; // 返回空vector
         }
 
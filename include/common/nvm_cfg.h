@@ -14,13 +14,18 @@ static constexpr int NVMDB_MAX_GROUP = 4;
 // Always greater than the number of concurrent connections
 static constexpr uint32 NVMDB_MAX_THREAD_NUM = 300;
 
-// for undo
+// for undo, 默认的 undo segment 数量, 实际数量在 InitDB 时写入 undo space header, 运行时可在线扩展
 static constexpr int NVMDB_UNDO_SEGMENT_NUM = 600;
 static_assert(NVMDB_UNDO_SEGMENT_NUM >= NVMDB_MAX_THREAD_NUM, "");
+// undo segment 数量的上限, 决定内存中 segment 数组的大小
+static constexpr int NVMDB_UNDO_MAX_SEGMENT_NUM = 8192;
+static_assert(NVMDB_UNDO_MAX_SEGMENT_NUM >= NVMDB_UNDO_SEGMENT_NUM, "");
 
 // for pactree oplog
 static constexpr int NVMDB_NUM_LOGS_PER_THREAD = 512;
-static constexpr int NVMDB_OPLOG_WORKER_THREAD_PER_GROUP = 1;
+// combiner 线程数和每个 NUMA 组的 worker 线程数的上限, 实际数量见 pactree_combiner_threads 和 pactree_workers_per_group
+static constexpr int NVMDB_OPLOG_MAX_COMBINER_THREAD = 4;
+static constexpr int NVMDB_OPLOG_MAX_WORKER_THREAD_PER_GROUP = 4;
 static constexpr int NVMDB_OPLOG_QUEUE_MAX_CAPACITY = 10000;
 
 static constexpr size_t NVM_CACHE_LINE_SIZE = 256;
@@ -45,9 +50,18 @@ public:
         return indexHint % m_dirPaths.size();
     }
 
+    // 第 dirId 个目录所在的 NUMA 节点, 绑核时使用
+    [[nodiscard]] int getNumaNodeByIndex(size_t dirId) const {
+        return m_numaNodes[dirId % m_numaNodes.size()];
+    }
+
 private:
+    // 目录所在的 NUMA 节点: 路径后缀 "@节点号" 指定, 否则由目录所在的块设备推导, 都没有时按目录序号对节点数取模
+    int resolveNumaNode(const std::string &dirPath, int configured, size_t dirId) const;
+
     // m_dirPaths 按照numa node顺序写
     std::vector<std::string> m_dirPaths;
+    std::vector<int> m_numaNodes;
 };
 
 extern std::shared_ptr<NVMDB::DirectoryConfig> g_dir_config;
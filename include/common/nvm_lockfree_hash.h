@@ -0,0 +1,175 @@
+#ifndef NVMDB_LOCKFREE_HASH_H
+#define NVMDB_LOCKFREE_HASH_H
+
+#include "common/nvm_types.h"
+#include "glog/logging.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace NVMDB {
+
+/*
+ * uint32 -> uint32 的开放寻址哈希表 (线性探测), 读不加锁, 写由调用方串行化.
+ * 每个桶是一个 64 位原子变量: 高 32 位为 key, 低 32 位为 value + 1,
+ * 低 32 位为 0 表示空桶, 为 0xFFFFFFFF 表示已删除.
+ * 扩容时发布新的桶数组, 旧数组在析构时才释放, 正在读旧数组的线程不受影响.
+ */
+class LockFreeHashMap {
+public:
+    static constexpr uint32 INVALID_VALUE = 0xFFFFFFFF;
+
+    explicit LockFreeHashMap(size_t capacity = 1024) {
+        m_buckets.store(newBuckets(capacity), std::memory_order_release);
+    }
+
+    LockFreeHashMap(const LockFreeHashMap &) = delete;
+    LockFreeHashMap &operator=(const LockFreeHashMap &) = delete;
+
+    // 找不到返回 INVALID_VALUE
+    uint32 find(uint32 key) const {
+        const Buckets *buckets = m_buckets.load(std::memory_order_acquire);
+        for (size_t i = hash(key) & buckets->m_mask;; i = (i + 1) & buckets->m_mask) {
+            uint64 entry = buckets->m_entries[i].load(std::memory_order_acquire);
+            auto low = static_cast<uint32>(entry);
+            if (low == EMPTY) {
+                return INVALID_VALUE;
+            }
+            if (static_cast<uint32>(entry >> 32) == key && low != TOMBSTONE) {
+                return low - 1;
+            }
+        }
+    }
+
+    // 插入或者覆盖, 需要与其他写操作互斥
+    void insert(uint32 key, uint32 value) {
+        DCHECK(value < TOMBSTONE - 1);
+        Buckets *buckets = m_buckets.load(std::memory_order_relaxed);
+        if ((m_used + 1) * 4 > (buckets->m_mask + 1) * 3) {
+            buckets = rehash(std::max<size_t>((m_size + 1) * 2, buckets->m_mask + 1));
+        }
+        const uint64 newEntry = (static_cast<uint64>(key) << 32) | (value + 1);
+        size_t slot = buckets->m_mask + 1;
+        for (size_t i = hash(key) & buckets->m_mask;; i = (i + 1) & buckets->m_mask) {
+            uint64 entry = buckets->m_entries[i].load(std::memory_order_relaxed);
+            auto low = static_cast<uint32>(entry);
+            if (low == EMPTY) {
+                if (slot > buckets->m_mask) {
+                    slot = i;
+                    m_used++;
+                }
+                break;
+            }
+            if (low == TOMBSTONE) {
+                if (slot > buckets->m_mask) {
+                    slot = i;
+                }
+                continue;
+            }
+            if (static_cast<uint32>(entry >> 32) == key) {
+                buckets->m_entries[i].store(newEntry, std::memory_order_release);
+                return;
+            }
+        }
+        buckets->m_entries[slot].store(newEntry, std::memory_order_release);
+        m_size++;
+    }
+
+    // 需要与其他写操作互斥
+    bool erase(uint32 key) {
+        Buckets *buckets = m_buckets.load(std::memory_order_relaxed);
+        for (size_t i = hash(key) & buckets->m_mask;; i = (i + 1) & buckets->m_mask) {
+            uint64 entry = buckets->m_entries[i].load(std::memory_order_relaxed);
+            auto low = static_cast<uint32>(entry);
+            if (low == EMPTY) {
+                return false;
+            }
+            if (static_cast<uint32>(entry >> 32) == key && low != TOMBSTONE) {
+                buckets->m_entries[i].store((static_cast<uint64>(key) << 32) | TOMBSTONE, std::memory_order_release);
+                m_size--;
+                return true;
+            }
+        }
+    }
+
+    // 需要与其他读写操作互斥
+    void clear() {
+        Buckets *buckets = m_buckets.load(std::memory_order_relaxed);
+        for (size_t i = 0; i <= buckets->m_mask; i++) {
+            buckets->m_entries[i].store(0, std::memory_order_relaxed);
+        }
+        m_used = 0;
+        m_size = 0;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+    static constexpr uint32 EMPTY = 0;
+    static constexpr uint32 TOMBSTONE = 0xFFFFFFFF;
+
+    struct Buckets {
+        size_t m_mask;
+        std::unique_ptr<std::atomic<uint64>[]> m_entries;
+    };
+
+    static inline size_t hash(uint32 key) {
+        // murmur3 finalizer
+        key ^= key >> 16;
+        key *= 0x85ebca6b;
+        key ^= key >> 13;
+        key *= 0xc2b2ae35;
+        key ^= key >> 16;
+        return key;
+    }
+
+    Buckets *newBuckets(size_t capacity) {
+        size_t size = 16;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        auto buckets = std::make_unique<Buckets>();
+        buckets->m_mask = size - 1;
+        buckets->m_entries.reset(new std::atomic<uint64>[size]);
+        for (size_t i = 0; i < size; i++) {
+            buckets->m_entries[i].store(0, std::memory_order_relaxed);
+        }
+        m_allBuckets.push_back(std::move(buckets));
+        return m_allBuckets.back().get();
+    }
+
+    // 只拷贝有效的桶, 丢弃删除标记
+    Buckets *rehash(size_t capacity) {
+        const Buckets *oldBuckets = m_buckets.load(std::memory_order_relaxed);
+        Buckets *buckets = newBuckets(capacity);
+        for (size_t i = 0; i <= oldBuckets->m_mask; i++) {
+            uint64 entry = oldBuckets->m_entries[i].load(std::memory_order_relaxed);
+            auto low = static_cast<uint32>(entry);
+            if (low == EMPTY || low == TOMBSTONE) {
+                continue;
+            }
+            size_t j = hash(static_cast<uint32>(entry >> 32)) & buckets->m_mask;
+            while (buckets->m_entries[j].load(std::memory_order_relaxed) != 0) {
+                j = (j + 1) & buckets->m_mask;
+            }
+            buckets->m_entries[j].store(entry, std::memory_order_relaxed);
+        }
+        m_used = m_size;
+        m_buckets.store(buckets, std::memory_order_release);
+        return buckets;
+    }
+
+    std::atomic<Buckets *> m_buckets{nullptr};
+    // 包括已经被替换的旧数组, 析构时统一释放
+    std::vector<std::unique_ptr<Buckets>> m_allBuckets;
+    // 非空桶数 (包括删除标记) 和有效 key 数, 只由写者修改
+    size_t m_used = 0;
+    size_t m_size = 0;
+};
+
+}  // namespace NVMDB
+
+#endif  // NVMDB_LOCKFREE_HASH_H
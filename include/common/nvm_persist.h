@@ -0,0 +1,233 @@
+#ifndef NVMDB_PERSIST_H
+#define NVMDB_PERSIST_H
+
+#include "common/nvm_types.h"
+#include <gflags/gflags.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <emmintrin.h>
+
+namespace NVMDB {
+
+/*
+ * NVM 的拷贝和刷写内核. 进程启动时根据 CPUID 选择硬件支持的最快实现,
+ * 所以在一台机器上编译的二进制可以在没有 AVX-512 或 clwb 的机器上运行.
+ */
+enum class CopyKernel : uint8 {
+    MEMCPY = 0,    // 普通写, 只用于 DRAM 模拟
+    SSE2,
+    AVX2,
+    AVX512,
+};
+
+enum class FlushKernel : uint8 {
+    NONE = 0,      // eADR 平台, cache 也在持久域中, 只需要 fence
+    CLFLUSH,
+    CLFLUSHOPT,
+    CLWB,
+};
+
+struct PersistKernels {
+    CopyKernel m_copyKind;
+    FlushKernel m_flushKind;
+    // 用非时序写拷贝 n 字节, dest 需要 64 字节对齐且 n 是 64 的倍数, 不带 fence
+    void (*m_streamCopy)(void *dest, const void *src, size_t n);
+    // 刷写 [addr, addr + n) 覆盖的所有 cache line, 不带 fence
+    void (*m_flush)(const void *addr, size_t n);
+    // 既没有刷写也没有非时序写时不需要 fence
+    bool m_fence;
+};
+
+extern PersistKernels g_persistKernels;
+
+bool CopyKernelSupported(CopyKernel kind);
+
+bool FlushKernelSupported(FlushKernel kind);
+
+/* 当前 CPU 支持的最快实现 */
+CopyKernel BestCopyKernel();
+
+FlushKernel BestFlushKernel();
+
+/* 切换内核, 硬件不支持时返回 false 并保持不变. 只能在没有并发的拷贝和刷写时调用, 如启动和测试 */
+bool SetPersistKernels(CopyKernel copyKind, FlushKernel flushKind);
+
+/*
+ * 持久域模式, 在 InitDB 和 BootStrap 时根据 --persist_mode 设置:
+ * ADR: cache 不在持久域中, 刷写 cache line 并 fence;
+ * eADR: cache 在持久域中, 只需要 fence 保证非时序写的顺序;
+ * DRAM: 在 DRAM 上模拟, 不保证持久化.
+ */
+enum class PersistMode : uint8 {
+    ADR = 0,
+    EADR,
+    DRAM,
+};
+
+DECLARE_string(persist_mode);
+
+void SetPersistMode(PersistMode mode);
+
+PersistMode GetPersistMode();
+
+/*
+ * 根据 --persist_mode 设置持久域模式, 根据 --nvm_*_latency_ns 和 --nvm_write_bandwidth_mbps 设置注入的时延,
+ * 根据 --nvm_persist_stats 打开写入统计
+ */
+void InitPersistMode();
+
+const char *PersistModeName(PersistMode mode);
+
+const char *CopyKernelName(CopyKernel kind);
+
+const char *FlushKernelName(FlushKernel kind);
+
+/*
+ * 在 DRAM 上模拟 NVM 时注入的时延 (见 --nvm_backend), 用忙等实现, 都为 0 时不注入.
+ * 读时延按读到的 cache line 计, 在读 NVM 的入口 NVMReadDelay 注入, 不区分是否命中 cache;
+ * 写时延按刷写和非时序写的 cache line 计, 带宽按每个线程的写入字节数限制.
+ */
+struct NVMDelay {
+    bool m_enabled;
+    uint32 m_readLatencyNs;
+    uint32 m_writeLatencyNs;
+    uint32 m_writeBandwidthMBps;
+};
+
+extern NVMDelay g_nvmDelay;
+
+DECLARE_int32(nvm_read_latency_ns);
+DECLARE_int32(nvm_write_latency_ns);
+DECLARE_int32(nvm_write_bandwidth_mbps);
+
+/* 只能在没有并发的读写时调用 */
+void SetNVMDelay(uint32 readLatencyNs, uint32 writeLatencyNs, uint32 writeBandwidthMBps);
+
+void InjectReadDelay(const void *addr, size_t n);
+
+void InjectWriteDelay(const void *addr, size_t n);
+
+/*
+ * NVM 写入统计, --nvm_persist_stats (默认取环境变量 NVMDB_PERSIST_STATS) 打开时在每个持久化原语中按线程累加, 由 CollectPersistStats 汇总.
+ * 写入按当前线程的 PersistTag 归到子系统, 用 PersistTagScope 在子系统入口设置.
+ * XPLine 估计: 两次 fence 之间 (或窗口满时) 写到的不同 256 字节 XPLine 个数, 即 Optane 实际写介质的粒度.
+ */
+enum class PersistTag : uint8 {
+    OTHER = 0,
+    HEAP,
+    UNDO,
+    INDEX,          // PACTree 数据节点
+    OPLOG,          // PACTree 的 split/merge 日志
+    SEARCH_LAYER,   // PDL-ART
+    META,           // tablespace 元数据
+    COUNT,
+};
+
+struct PersistStats {
+    uint64 m_flushCalls;
+    uint64 m_flushBytes;
+    uint64 m_streamBytes;
+    uint64 m_storeBytes;    // 不经过刷写的写入, 如 eADR 下 PACTree 的直接写
+    uint64 m_fences;
+    uint64 m_xplines;
+
+    uint64 LogicalBytes() const { return m_flushBytes + m_streamBytes + m_storeBytes; }
+
+    uint64 MediaBytes() const { return m_xplines * NVM_XPLINE_SIZE; }
+
+    static constexpr uint64 NVM_XPLINE_SIZE = 256;
+};
+
+DECLARE_bool(nvm_persist_stats);
+
+extern thread_local PersistTag t_persistTag;
+
+class PersistTagScope {
+public:
+    explicit PersistTagScope(PersistTag tag) : m_saved(t_persistTag) { t_persistTag = tag; }
+
+    ~PersistTagScope() { t_persistTag = m_saved; }
+
+    PersistTagScope(const PersistTagScope &) = delete;
+    PersistTagScope &operator=(const PersistTagScope &) = delete;
+
+private:
+    PersistTag m_saved;
+};
+
+/* 只能在没有并发的持久化操作时调用 */
+void SetPersistStatsEnabled(bool enabled);
+
+bool PersistStatsEnabled();
+
+/* 汇总所有线程 (包括已经退出的线程) 的统计, 按 PersistTag 下标 */
+std::vector<PersistStats> CollectPersistStats();
+
+void ResetPersistStats();
+
+/* 按子系统打印统计, txnCount 不为 0 时同时打印每个事务的平均值 */
+std::string PersistStatsReport(uint64 txnCount = 0);
+
+const char *PersistTagName(PersistTag tag);
+
+/* 时延注入和写入统计共用一个开关, 都关闭时原语只多一次判断 */
+enum class PersistEvent : uint8 {
+    READ = 0,
+    FLUSH,
+    STREAM,
+    STORE,
+    FENCE,
+};
+
+extern bool g_persistHooks;
+
+void OnPersistEvent(PersistEvent event, const void *addr, size_t n);
+
+inline void NVMReadDelay(const void *addr, size_t n) {
+    if (__builtin_expect(g_persistHooks, 0)) {
+        OnPersistEvent(PersistEvent::READ, addr, n);
+    }
+}
+
+/*
+ * 记录已经用普通写或 memcpy_no_flush_nt 写到 NVM 上的数据, 只用于统计和时延注入, 不刷出也不排序.
+ * 只有 eADR 下缓存在持久域中, 其他模式下需要持久化的写入还要 NVMFlush/NVMPersist
+ */
+inline void NVMWritten(const void *addr, size_t n) {
+    if (__builtin_expect(g_persistHooks, 0)) {
+        OnPersistEvent(PersistEvent::STORE, addr, n);
+    }
+}
+
+inline void NVMStreamCopy(void *dest, const void *src, size_t n) {
+    g_persistKernels.m_streamCopy(dest, src, n);
+    if (__builtin_expect(g_persistHooks, 0)) {
+        OnPersistEvent(PersistEvent::STREAM, dest, n);
+    }
+}
+
+inline void NVMFlush(const void *addr, size_t n) {
+    g_persistKernels.m_flush(addr, n);
+    if (__builtin_expect(g_persistHooks, 0)) {
+        OnPersistEvent(PersistEvent::FLUSH, addr, n);
+    }
+}
+
+inline void NVMFence() {
+    if (g_persistKernels.m_fence) {
+        _mm_sfence();
+    }
+    if (__builtin_expect(g_persistHooks, 0)) {
+        OnPersistEvent(PersistEvent::FENCE, nullptr, 0);
+    }
+}
+
+inline void NVMPersist(const void *addr, size_t n) {
+    NVMFlush(addr, n);
+    NVMFence();
+}
+
+}  // namespace NVMDB
+
+#endif  // NVMDB_PERSIST_H
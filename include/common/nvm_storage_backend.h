@@ -0,0 +1,48 @@
+#ifndef NVMDB_STORAGE_BACKEND_H
+#define NVMDB_STORAGE_BACKEND_H
+
+#include "common/nvm_types.h"
+#include <gflags/gflags.h>
+#include <string>
+
+namespace NVMDB {
+
+/*
+ * LogicFile 的存储后端, 由 --nvm_backend 选择, 默认取环境变量 NVMDB_BACKEND, 未设置时为 dax:
+ * dax: DAX 文件系统上的 NVM 文件, 要求映射到的是 PMem;
+ * file: 普通文件, 一般放在 tmpfs 上, 可以跨进程重启;
+ * anon: 匿名内存 (--nvm_hugepage 时优先使用 2MB 大页), 按文件名在进程内登记,
+ *       unmount 后再 mount 内容不变, 进程退出后丢失.
+ * 非 dax 后端下 DirectoryConfig 的目录都放到 --nvm_emulate_dir 下, 索引的 PMDK pool 也放在那里.
+ * 配合 --persist_mode=dram 和 --nvm_*_latency_ns 可以在没有 NVM 的机器上模拟 NVM 的时延.
+ */
+enum class StorageBackend : uint8 {
+    DAX = 0,
+    FILE,
+    ANON,
+};
+
+DECLARE_string(nvm_backend);
+DECLARE_string(nvm_emulate_dir);
+DECLARE_bool(nvm_hugepage);
+
+StorageBackend GetStorageBackend();
+
+const char *StorageBackendName(StorageBackend backend);
+
+/* 返回 name 对应的匿名 segment, 不存在时 create 为 true 则创建, 否则返回 nullptr */
+void *MapAnonSegment(const std::string &name, size_t size, bool create);
+
+bool AnonSegmentExists(const std::string &name);
+
+void FreeAnonSegment(const std::string &name);
+
+/* 释放目录 dir 下的所有匿名 segment, 相当于删除目录 */
+void FreeAnonSegments(const std::string &dir);
+
+/* 释放 segment 中 [offset, offset + len) 按页对齐的部分, 之后读到的内容为 0, 返回释放的字节数 */
+size_t PunchAnonSegment(const std::string &name, uint64 offset, uint64 len);
+
+}  // namespace NVMDB
+
+#endif  // NVMDB_STORAGE_BACKEND_H
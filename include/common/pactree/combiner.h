@@ -7,28 +7,25 @@ namespace NVMDB {
 
 constexpr int MAX_LOG_QUEUE_SIZE = 100;
 
+/*
+ * 第 shard 个 combiner: 合并所有线程 oplog 的第 shard 个分片, 广播给每个 worker, 每个 worker 只应用自己负责的 key.
+ * 多个 combiner 之间互不等待, 各自通过 g_workQueue[shard] 的一组队列和 worker 通信, 各自回收自己的合并结果
+ */
 class CombinerThread {
 public:
-    CombinerThread() = default;
+    explicit CombinerThread(int shard) : shard(shard) { }
 
     std::vector<OpStruct *> *combineLogs() {
         auto mergedLog = new std::vector<OpStruct *>;
         auto gThreadLogs = CopyGlobalThreadLogs();
-        for (auto &i : *gThreadLogs) {
-            Oplog &log = *i;
-            int qnum = log.curQ % 2;
-            log.Lock(qnum);
-            log.curQ.fetch_add(1);
-            auto op_ = log.getQ(qnum);
-            if (!op_->empty()) {
-                mergedLog->insert(std::end(*mergedLog), std::begin(*op_), std::end(*op_));
-            }
-            log.ResetQ(qnum);
-            log.Unlock(qnum);
+        for (auto log : *gThreadLogs) {
+            log->Drain(shard, mergedLog);
         }
         delete gThreadLogs;
-        std::sort(mergedLog->begin(), mergedLog->end());
-        g_combinerSplits += mergedLog->size();
+        // 按写入 oplog 的时间排序, 同一线程的 oplog 在 Drain 中已经有序, 时间相同时保持原来的顺序
+        std::stable_sort(mergedLog->begin(), mergedLog->end(),
+                         [](const OpStruct *a, const OpStruct *b) { return *a < *b; });
+        g_combinerSplits.fetch_add(mergedLog->size(), std::memory_order_relaxed);
         if (!mergedLog->empty()) {
             logQueue.push(make_pair(doneCountCombiner, mergedLog));
             doneCountCombiner++;
@@ -39,21 +36,21 @@ public:
         }
     }
 
-    void broadcastMergedLog(std::vector<OpStruct *> *mergedLog, int activeGrp) {
-        for (auto i = 0; i < activeGrp * NVMDB_OPLOG_WORKER_THREAD_PER_GROUP; i++) {
-            while (!g_workQueue[i].push(mergedLog)) {
+    void broadcastMergedLog(std::vector<OpStruct *> *mergedLog, int workerNum) {
+        for (auto i = 0; i < workerNum; i++) {
+            while (!g_workQueue[shard][i].push(mergedLog)) {
             }
         }
     }
 
-    uint64_t FreeMergedLogs(int activeGrp, bool force) {
+    uint64_t FreeMergedLogs(int workerNum, bool force) {
         if (!force && logQueue.size() < MAX_LOG_QUEUE_SIZE) {
             return 0;
         }
 
         unsigned long minDoneCountWt = ULONG_MAX;
-        for (auto i = 0; i < activeGrp * NVMDB_OPLOG_WORKER_THREAD_PER_GROUP; i++) {
-            unsigned long logDoneCount = g_WorkerThreadInst[i]->GetLogDoneCount();
+        for (auto i = 0; i < workerNum; i++) {
+            unsigned long logDoneCount = g_WorkerThreadInst[i]->GetLogDoneCount(shard);
             if (logDoneCount < minDoneCountWt)
                 minDoneCountWt = logDoneCount;
         }
@@ -70,6 +67,7 @@ public:
         return logQueue.empty();
     }
 private:
+    int shard;
     std::queue<std::pair<unsigned long, std::vector<OpStruct *> *>> logQueue;
     unsigned long doneCountCombiner{0};
 };
@@ -5,17 +5,38 @@
 
 namespace NVMDB {
 
+/*
+ * 扫描游标, 记下上一批扫描停下的数据节点. 节点合并后只标记 deleted, 运行期间不会被释放,
+ * 所以下一批直接从这个节点出发, 在它的锁下检查范围, 分裂时沿链表走到相邻节点,
+ * 只有节点被合并删除或者已经重启 (genId 变化) 时才回到 search layer 重新查找
+ */
+struct ScanCursor {
+    ListNode *m_node = nullptr;
+    uint64_t m_genId = 0;
+
+    void Reset() { m_node = nullptr; }
+};
+
 class LinkedList {
 public:
-    ListNode *Initialize();
+    ListNode *Initialize(uint16_t treeId);
 
     bool Insert(Key_t &key, Val_t value, ListNode *head);
 
     bool Lookup(Key_t &key, Val_t &value, ListNode *head) const;
 
+    // cursor 不为空时记下扫描停下的节点
     bool ScanInOrder(Key_t &startKey, Key_t &endKey,
                      ListNode *head, int maxRange, LookupSnapshot snapshot,
-                     std::vector<std::pair<Key_t, Val_t>> &result) const;
+                     std::vector<std::pair<Key_t, Val_t>> &result, ScanCursor *cursor = nullptr) const;
+
+    // 逆序扫描 [startKey, endKey), 结果按 key 从大到小排列
+    bool ScanReverse(Key_t &startKey, Key_t &endKey,
+                     ListNode *head, int maxRange, LookupSnapshot snapshot,
+                     std::vector<std::pair<Key_t, Val_t>> &result, ScanCursor *cursor = nullptr) const;
+
+    // 游标可以继续使用时返回它记下的节点, 否则返回 nullptr
+    ListNode *ResumeNode(const ScanCursor *cursor) const;
 
     static void Print(ListNode *head);
 
@@ -23,8 +44,12 @@ public:
 
     ListNode *GetHead();
 
+    // 只重做这棵树的 oplog
     void Recover(void *sl);
 
+    // 释放链表上的所有节点, 调用者保证没有并发访问, 并且这棵树的 oplog 都已经完成
+    void Destroy();
+
 private:
     // 每次启动版本+1
     uint64_t genId;
@@ -33,10 +58,7 @@ private:
 
     NVMPtr<ListNode> tailPtr;
 
-    // 500 *200
-    OpStruct oplogs[100000];
-
-    int nunOpLogs[112];
+    uint16_t treeId;
 };
 
 }  // namespace NVMDB
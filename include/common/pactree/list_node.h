@@ -22,32 +22,65 @@ enum class PACTreeWhiteBoxType {
 void SetPACTreeWhiteBoxBP(PACTreeWhiteBoxType type);
 
 constexpr int MAX_ENTRIES = 95;
+// SIMD 按 32 字节一组比较 fingerprint, 最后一组会多读 offsets 的第一个字节, 由 count 屏蔽
+constexpr int FINGERPRINT_PROBE_SLOTS = 96;
 constexpr int KV_ALIGN_BYTES = 8;
 constexpr int MAX_KV_SIZE_PER_NODE = 192 * KV_ALIGN_BYTES;
 
 #define ALIGN_ANY(size, align) (((size) + (align) - 1) / (align) * (align))
 
-struct LinePointItem {
-    uint8_t offset;        // 以8字节为粒度，所以最多表示 8 * 255 = 2KB的数据
-    uint8_t fingerPrint;  // 保留 finger print，加速 update 操作
-};
-
+/*
+ * 按 key 排序的 slot 数组. fingerprint 和 offset 分成两个连续的数组,
+ * 查找时可以用 SIMD 一次比较 32 或 64 个 fingerprint.
+ * 两个 LinePointArray 交替使用, 修改在另一个上完成后再切换 currPerm, 所以两个数组总是一起生效
+ */
 struct LinePointArray {
     uint8_t count;
     uint8_t recyclable;
-    LinePointItem linePoint[MAX_ENTRIES]{};
+    uint8_t fingerPrints[MAX_ENTRIES]{};  // 保留 finger print，加速 update 操作
+    uint8_t offsets[MAX_ENTRIES]{};       // 以8字节为粒度，所以最多表示 8 * 255 = 2KB的数据
 
     LinePointArray() : count(0), recyclable(0) {}
 
     uint8_t GetOffset(int index) const {
-        return linePoint[index].offset;
+        return offsets[index];
     }
 
     uint8_t GetFingerPrint(int index) const {
-        return linePoint[index].fingerPrint;
+        return fingerPrints[index];
+    }
+
+    void SetLinePoint(int index, uint8_t offset, uint8_t fingerPrint) {
+        offsets[index] = offset;
+        fingerPrints[index] = fingerPrint;
     }
-};  // 总共 128 字节
+
+    void MoveLinePoint(int to, int from) {
+        offsets[to] = offsets[from];
+        fingerPrints[to] = fingerPrints[from];
+    }
+};  // 总共 192 字节
 static_assert(sizeof(LinePointArray) % 64 == 0);
+static_assert(offsetof(LinePointArray, fingerPrints) + FINGERPRINT_PROBE_SLOTS <= sizeof(LinePointArray), "");
+
+/*
+ * ListNode 查找 key 时比较 fingerprint 的实现, 进程启动时选择 CPU 支持的最快实现.
+ * 结果是前 FINGERPRINT_PROBE_SLOTS 个 slot 的匹配位图, 超过 count 的部分由调用者屏蔽
+ */
+enum class FingerprintProbe : uint8_t {
+    SCALAR = 0,
+    AVX2,
+    AVX512,
+};
+
+bool FingerprintProbeSupported(FingerprintProbe kind);
+
+FingerprintProbe BestFingerprintProbe();
+
+FingerprintProbe CurrentFingerprintProbe();
+
+/* 切换实现, 硬件不支持时返回 false 并保持不变. 只能在启动和测试时调用 */
+bool SetFingerprintProbe(FingerprintProbe kind);
 
 struct KVItem {
     Val_t value;
@@ -58,7 +91,7 @@ class ListNode {
 public:
     void MakePrefix();
 
-    ListNode() : nextKv(0), currPerm(0) {}
+    ListNode() : nextKv(0), currPerm(0), treeId(0) {}
 
     bool Insert(Key_t &key, Val_t value, int duringSplit);
 
@@ -68,6 +101,10 @@ public:
     bool ScanInOrder(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot,
                      std::vector<std::pair<Key_t, Val_t>> &result, bool continueScan, bool *needPrune);
 
+    /* 逆序扫描 [startKey, upperKey), 调用之前确保 upperKey 在 (min, max] 之间, startKey 没有要求 */
+    bool ScanReverse(Key_t &startKey, Key_t &upperKey, int maxRange, LookupSnapshot snapshot,
+                     std::vector<std::pair<Key_t, Val_t>> &result, bool *needPrune);
+
     void SetCur(NVMPtr<ListNode> ptr) {
         this->curPtr = ptr;
     }
@@ -114,6 +151,10 @@ public:
         deleted = true;
     }
 
+    void SetTreeId(uint16_t id) {
+        treeId = id;
+    }
+
     void Prune(LookupSnapshot snapshot, uint64_t genId);
 
     const Key_t &GetMin() const {
@@ -141,7 +182,8 @@ private:
     uint8_t nextKv;  // 下一个 KV Item 的offset
     uint8_t currPerm;
     bool deleted;
-    uint8_t unusedVariable[5]{};  // 占位，补齐到8字节对齐
+    uint8_t unusedVariable[3]{};  // 占位，补齐到8字节对齐
+    uint16_t treeId;  // 所属的树, 分裂和合并时写到 oplog 中, 由 worker 更新这棵树的 search layer
 
     LinePointArray permutation[2];
 
@@ -166,7 +208,8 @@ private:
         currPerm = (currPerm + 1) % PERM_MOD;
     }
 
-    VarLenString *GetRemainKey(Key_t *origin_key) const;
+    // 去掉 prefix 之后的 key 写到调用者提供的 buf 中 (一般在栈上), 返回 buf
+    VarLenString *GetRemainKey(Key_t *origin_key, Key_t *buf) const;
 
     void GetOriginKey(VarLenString *remain_key, Key_t *origin_key);
 
@@ -202,15 +245,11 @@ private:
 
     void MergeEmptyNodeWithPrev(uint64_t genId);
 
-    enum class MVCCVisibility {
-        VISIBLE,
-        REMOVABLE,
-        INVISIBLE,
-    };
-
-    static MVCCVisibility CheckMVCCVisibility(KVItem *kv, LookupSnapshot snapshot);
+    static MVCCVisibility CheckMVCCVisibility(KVItem *kv, LookupSnapshot snapshot) {
+        return NVMDB::CheckMVCCVisibility(&kv->value, snapshot);
+    }
 
-    void RemoveFromPermutation(std::vector<std::pair<uint8_t, int>> &items);
+    void RemoveFromPermutation(const std::pair<uint8_t, int> *items, int itemCount);
 
     void CheckPrefix() {
         auto lpa = GetCurrPerm();
@@ -12,7 +12,7 @@ public:
     }
 
     ~PACTree() {
-        pt->~PACTreeImpl();
+        ExitPT();
         pt = nullptr;
         PMem::UnmountPMEMPool();
         LNodeReport();
@@ -31,8 +31,9 @@ public:
               int max_range,
               LookupSnapshot snapshot,
               bool reverse,
-              std::vector<std::pair<Key_t, Val_t>> &result) {
-        pt->Scan(startKey, endKey, max_range, snapshot, reverse, result);
+              std::vector<std::pair<Key_t, Val_t>> &result,
+              ScanCursor *cursor = nullptr) {
+        pt->Scan(startKey, endKey, max_range, snapshot, reverse, result, cursor);
     }
 
     void registerThread() {
@@ -43,6 +44,15 @@ public:
         pt->UnregisterThread();
     }
 
+    // 索引各自的树, 和默认树共用内存池和后台线程, 见 PACTreeImpl
+    PACTreeImpl *openIndexTree(uint32_t idxId) {
+        return OpenIndexTree(idxId);
+    }
+
+    void dropIndexTree(uint32_t idxId) {
+        DropIndexTree(idxId);
+    }
+
 private:
     PACTreeImpl *pt;
 };
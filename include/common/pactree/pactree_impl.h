@@ -4,34 +4,62 @@
 #include "common/pactree/linked_list.h"
 #include "common/pactree/search_layer.h"
 #include "common/pactree/thread_data.h"
+#include <gflags/gflags.h>
 
 namespace NVMDB {
 
-extern std::vector<SearchLayer *> g_perGrpSlPtr;
 extern std::set<ThreadData *> g_threadDataSet;
 
+// combiner 线程数和每个 NUMA 组的 worker 线程数, 在后台线程启动 (InitPT) 时生效
+DECLARE_int32(pactree_combiner_threads);
+DECLARE_int32(pactree_workers_per_group);
+
+// 树的个数上限, tree id 是注册表的下标; 0 号是默认树, 即 PACTree 接口直接读写的树
+constexpr int PACTREE_MAX_TREES = 1024;
+constexpr uint16_t PACTREE_DEFAULT_TREE = 0;
+
+/*
+ * 一棵 PACTree: 数据层的双向链表和每个 NUMA 组一个的 search layer, 整个对象放在 NVM 上.
+ * 所有的树共用内存池, oplog, combiner 和 worker 线程; 数据节点和 oplog 中记录了 tree id,
+ * worker 按 tree id 更新对应的 search layer, 重启时每棵树只重做自己的 oplog.
+ * 每个索引使用单独的一棵树 (见 OpenIndexTree), 可以单独删除并回收所有空间
+ */
 class PACTreeImpl {
 public:
-    explicit PACTreeImpl(int numGrp, root_obj *root);
-
-    ~PACTreeImpl();
+    PACTreeImpl(uint16_t treeId, int numGrp);
 
     bool Insert(Key_t &key, Val_t val);
 
-    void RegisterThread();
+    Val_t Lookup(Key_t &key, bool *found);
 
-    void UnregisterThread();
+    void Scan(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot, bool reverse,
+              std::vector<std::pair<Key_t, Val_t>> &result, ScanCursor *cursor = nullptr);
 
-    Val_t Lookup(Key_t &key, bool *found);
+    // 重启后挂载: 重新初始化 search layer, 重做这棵树的 oplog
+    void Open(int numGrp);
 
     void Recover();
 
-    void Scan(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot, bool reverse,
-              std::vector<std::pair<Key_t, Val_t>> &result);
+    // 释放所有数据节点和 search layer, 自身由调用者释放
+    void Destroy();
+
+    uint16_t TreeId() const {
+        return treeId;
+    }
+
+    SearchLayer *GetSearchLayer(int grpId) const {
+        return slPtr[grpId];
+    }
+
+    static void RegisterThread();
 
-    static SearchLayer *CreateSearchLayer(root_obj *root, int threadId);
+    static void UnregisterThread();
 
-    void Init(int numGrp, root_obj *root);
+    // 所有树共用的 worker 和 combiner 线程: pactree_combiner_threads 个 combiner 按 key 的哈希分担各线程的 oplog,
+    // 每个组 pactree_workers_per_group 个 worker 按 key 的哈希分担这个组的 search layer
+    static void StartBackgroundThreads(int numGrp);
+
+    static void StopBackgroundThreads();
 
 #ifdef PACTREE_ENABLE_STATS
     std::atomic<uint64_t> total_sl_time;
@@ -39,26 +67,51 @@ public:
 #endif
 
 protected:
-    void CreateWorkerThread(int numGrp, root_obj *root);
+    static void CreateWorkerThread(int numGrp);
 
-    void CreateCombinerThread();
+    static void CreateCombinerThread();
 
     ListNode *getJumpNode(Key_t &key);
 
 private:
     LinkedList dl;
 
+    uint16_t treeId;
+
+    int numGrp;
+
+    NVMPtr<SearchLayer> slRoot[NVMDB_MAX_GROUP];
+
+    // slRoot 的 DRAM 地址, 每次挂载时重新设置
+    SearchLayer *slPtr[NVMDB_MAX_GROUP];
+
     // CurrentOne but there should be group number of threads
-    std::vector<std::thread *> *wtArray;
+    static std::vector<std::thread *> *wtArray;
 
-    std::thread *combinerThead{};
+    static std::vector<std::thread *> *combinerArray;
 
     static volatile int totalGroupActive;
 
-    std::atomic<uint32_t> numThreads{};
+    static std::atomic<uint32_t> numThreads;
 };
 
+/* 挂载内存池, 启动后台线程, 打开注册表中所有的树并重做各自的 oplog, 返回默认树 */
 PACTreeImpl *InitPT();
 
+/* 已经写入但还没有应用到所有 search layer 的 oplog 个数, 即 search layer 落后数据层的分裂和合并个数 */
+uint64_t PendingOplogCount();
+
+/* 停止后台线程, 之后才能卸载内存池 */
+void ExitPT();
+
+/* 索引 idxId 的树, 不存在时新建并登记到注册表中 */
+PACTreeImpl *OpenIndexTree(uint32_t idxId);
+
+/* 删除索引 idxId 的树, 回收它的所有数据节点和 search layer. 调用者保证没有并发访问这个索引 */
+void DropIndexTree(uint32_t idxId);
+
+/* 按 tree id 找已经打开的树, 已经删除时返回 nullptr */
+PACTreeImpl *GetTreeById(uint16_t treeId);
+
 }  // namespace NVMDB
 #endif  // PACTREE_IMPL_H
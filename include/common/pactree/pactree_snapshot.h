@@ -10,4 +10,48 @@ struct LookupSnapshot {
     uint64 min_csn;   // 回收
 };
 
+enum class MVCCVisibility {
+    VISIBLE,
+    REMOVABLE,
+    INVISIBLE,
+};
+
+/*
+ * 索引项的 value 是删除这个 key 的事务 (TxSlot 或者 CSN), INVALID_CSN 表示没有被删除.
+ * 删除事务已经提交时把 *value 回填为它的 CSN, 不刷写, 丢失了下次再回填
+ */
+inline MVCCVisibility CheckMVCCVisibility(uint64_t *value, LookupSnapshot snapshot) {
+    if (TxInfoIsTxSlot(*value)) {
+        /* value 存的是 TxSlotPtr */
+        TransactionInfo txInfo{};
+        bool recycled = !GetTransactionInfo(*value, &txInfo);
+        if (recycled) {
+            /* 事务已提交，且slot被回收了 */
+            return MVCCVisibility::REMOVABLE;
+        }
+        DCHECK(txInfo.status != TxSlotStatus::EMPTY);
+        if (txInfo.status == TxSlotStatus::COMMITTED) {
+            /* 事务已提交 */
+            if (txInfo.csn < snapshot.min_csn) {
+                return MVCCVisibility::REMOVABLE;
+            } else {
+                *value = txInfo.csn;
+            }
+        }
+        /* 其它情况，说明删除事务正在执行，或者已经被回滚，那么 对自己是可见的，可以往下走 */
+    }
+
+    if (TxInfoIsCSN(*value)) {
+        /* 删除的事务的CSN已经回填 */
+        if (*value < snapshot.min_csn) {
+            return MVCCVisibility::REMOVABLE;
+        }
+        if (*value < snapshot.snapshot) {
+            /* 删除的事务对自己是可见的，所以该 IndexTuple 是不可见的 */
+            return MVCCVisibility::INVISIBLE;
+        }
+    }
+    return MVCCVisibility::VISIBLE;
+}
+
 }  // namespace NVMDB
@@ -2,6 +2,7 @@
 #define SEARCHLAYER_H
 
 #include "common/pdl_art/tree.h"
+#include <mutex>
 
 constexpr int DEFAULT_INSERT_NUM = 2;
 
@@ -25,6 +26,15 @@ public:
         dummyIdx = new ART_ROWEX::Tree(LoadIntKeyFunction);
     }
 
+    // 在第 nma 个 NUMA 组的内存池中建 search layer
+    explicit PDLARTIndex(int nma) {
+        PMEMoid oid;
+        PMem::allocOnGroup(nma, sizeof(ART_ROWEX::Tree), (void **)&idxPtr, &oid);
+        idx = new (idxPtr.getVaddr()) ART_ROWEX::Tree(LoadStringKeyFunction);
+        dummyIdx = new ART_ROWEX::Tree(LoadIntKeyFunction);
+        SetGroupId(nma);
+    }
+
     ~PDLARTIndex() {
         delete dummyIdx;
     }
@@ -34,6 +44,18 @@ public:
         idx->genId++;
         idx->loadKey = LoadStringKeyFunction;
         dummyIdx = new ART_ROWEX::Tree(LoadIntKeyFunction);
+        // 对象在 NVM 上, 重启后锁的状态没有意义
+        new (&minLock) std::mutex();
+    }
+
+    // 释放 ART 的所有节点和树本身, 之后这个对象所在的内存由调用者释放
+    void Destroy() {
+        idx->Destroy();
+        PMem::free((void *)idxPtr.getRawPtr());
+        idxPtr = NVMPtr<ART_ROWEX::Tree>();
+        idx = nullptr;
+        delete dummyIdx;
+        dummyIdx = nullptr;
     }
 
     void SetGroupId(int nma) {
@@ -54,8 +76,13 @@ public:
         Key k;
         SetKey(k, key);
         idx->Insert(k, reinterpret_cast<unsigned long>(ptr), t);
-        if (key < curMin)
-            curMin = key;
+        // 每个组可能有多个 worker 同时插入
+        {
+            std::lock_guard<std::mutex> guard(minLock);
+            if (key < curMin) {
+                curMin = key;
+            }
+        }
         numInserts++;
         return true;
     }
@@ -80,8 +107,11 @@ public:
     }
 
     void *lookup2(Key_t key) {
-        if (key <= curMin) {
-            return nullptr;
+        {
+            std::lock_guard<std::mutex> guard(minLock);
+            if (key <= curMin) {
+                return nullptr;
+            }
         }
         auto t = dummyIdx->GetThreadInfo();
         Key endKey;
@@ -102,10 +132,12 @@ public:
 private:
     Key minKey;
     Key_t curMin;
+    // 保护 curMin, 每个 search layer 一把
+    std::mutex minLock;
     NVMPtr<ART_ROWEX::Tree> idxPtr;
     ART_ROWEX::Tree *idx{nullptr};
     ART_ROWEX::Tree *dummyIdx{nullptr};
-    uint32_t numInserts{0};
+    std::atomic<uint32_t> numInserts{0};
 };
 
 using SearchLayer = PDLARTIndex;
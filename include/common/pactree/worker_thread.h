@@ -7,32 +7,43 @@ namespace NVMDB {
 
 extern int g_lockCapacity;
 
+/*
+ * 第 id 个 worker 负责第 id % activeGrp 个组的 search layer 中 OplogWorkerOf(hash) == id / activeGrp 的 key,
+ * 依次处理每个 combiner 发来的合并结果. 同一个 key 只由一个 combiner 和每组一个 worker 处理, 保持写入的顺序
+ */
 class WorkerThread {
 public:
     unsigned long opcount{0};
 
     WorkerThread(int id, int activeGrp);
 
+    // 应用每个 combiner 队列中的一个合并结果, 没有任何结果时返回 false
     bool ApplyOperation();
 
     bool IsWorkQueueEmpty() const {
-        return !workQueue->read_available();
+        for (int i = 0; i < g_oplogCombinerNum; i++) {
+            if (g_workQueue[i][workerThreadId].read_available()) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    unsigned long GetLogDoneCount() const {
-        return logDoneCount;
+    // 已经处理完的第 shard 个 combiner 的合并结果个数
+    unsigned long GetLogDoneCount(int shard) const {
+        return logDoneCount[shard].load(std::memory_order_acquire);
     }
 
     void FreeListNodes(uint64_t removeCount);
 
 private:
-    boost::lockfree::spsc_queue<std::vector<OpStruct *> *, boost::lockfree::capacity<LOCK_CAPACITY>> *workQueue;
+    void ApplyMergedLog(const std::vector<OpStruct *> &oplog);
 
     int workerThreadId{0};
 
     int activeGrp{0};
 
-    unsigned long logDoneCount{0};
+    std::atomic<unsigned long> logDoneCount[NVMDB_OPLOG_MAX_COMBINER_THREAD];
 
     std::queue<std::pair<uint64_t, void *>> *freeQueue;
 };
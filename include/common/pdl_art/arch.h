@@ -9,6 +9,7 @@
 #include <pthread.h>
 #include <ctime>
 #include <cerrno>
+#include "common/nvm_persist.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,8 +42,10 @@ static inline void __attribute__((__always_inline__)) smp_rmb(void) {
     __asm__ __volatile__("lfence" ::: "memory");
 }
 
+// x86 上普通写之间本来就有序, sfence 只用于刷写和非时序写, 所以交给持久域模式决定
 static inline void __attribute__((__always_inline__)) smp_wmb(void) {
-    __asm__ __volatile__("sfence" ::: "memory");
+    NVMDB::NVMFence();
+    __asm__ __volatile__("" ::: "memory");
 }
 
 static inline void __attribute__((__always_inline__)) barrier(void) {
@@ -122,15 +125,9 @@ static inline uint64_t __attribute__((__always_inline__)) read_tscp(void) {
 #define cache_prefetchw_mid(__ptr) __builtin_prefetch((void *)__ptr, 1, 2)
 
 #define cache_prefetchw_low(__ptr) __builtin_prefetch((void *)__ptr, 1, 0)
-#ifdef NO_CLWB
-static inline void clwb(volatile void *p) {
-    asm volatile("clflush (%0)" ::"r"(p));
-}
-#else
 static inline void clwb(volatile void *p) {
-    asm volatile(".byte 0x66; xsaveopt %0" : "+m"(p));
+    NVMDB::NVMFlush(const_cast<void *>(p), 1);
 }
-#endif
 
 #ifdef __cplusplus
 }
@@ -13,12 +13,13 @@
 constexpr int QNUM_SIZE = 2;
 constexpr int LOCK_CAPACITY = 10000;
 
+/*
+ * 每个线程一个 oplog. 按 key 的哈希 (OpStruct::hash) 分成 combiner 线程数个分片, 第 i 个 combiner 只合并第 i 个分片,
+ * 同一个 key 的 oplog 总是由同一个 combiner 按顺序交给 worker. 每个分片两个队列轮流使用, combiner 取走一个时线程写另一个
+ */
 class Oplog {
 public:
-    std::atomic<unsigned long> curQ{};
     Oplog();
-    void ResetQ(int qnum);
-    std::vector<OpStruct *> *getQ(int qnum);
     static Oplog *GetPerThreadInstance() {
         return perThreadLog;
     }
@@ -28,34 +29,55 @@ public:
     static Oplog *GetOpLog();
     static void EnqPerThreadLog(OpStruct *ops);
     void Enq(OpStruct *ops);
-    void Lock(int qnum) {
-        qLock[qnum].lock();
-    }
-    void Unlock(int qnum) {
-        qLock[qnum].unlock();
-    }
+    // combiner 取走分片 shard 当前的队列, 追加到 out 中
+    void Drain(int shard, std::vector<OpStruct *> *out);
     bool Empty() {
-        for (int i = 0; i < QNUM_SIZE; i++) {
-            Lock(i);
-            if (!op_[i].empty()) {
-                Unlock(i);
-                return false;
+        for (auto &shard : shards) {
+            for (int i = 0; i < QNUM_SIZE; i++) {
+                std::lock_guard<std::mutex> guard(shard.qLock[i]);
+                if (!shard.op_[i].empty()) {
+                    return false;
+                }
             }
-            Unlock(i);
         }
         return true;
     }
-    static void WriteOpLog(OpStruct *oplog, OpStruct::Operation op, const Key_t& key, void *oldNodeRawPtr, uint16_t poolId,
-                           const Key_t& newKey, Val_t newVal);
+    static void WriteOpLog(OpStruct *oplog, uint16_t treeId, OpStruct::Operation op, const Key_t& key,
+                           void *oldNodeRawPtr, uint16_t poolId, const Key_t& newKey, Val_t newVal);
     static OpStruct *allocOpLog();
 private:
-    std::mutex qLock[2];
-    std::vector<OpStruct *> oplog1;
-    std::vector<OpStruct *> oplog2;
-    std::vector<std::vector<OpStruct *>> op_{oplog1, oplog2};
+    struct Shard {
+        std::atomic<unsigned long> curQ{};
+        std::mutex qLock[QNUM_SIZE];
+        std::vector<OpStruct *> op_[QNUM_SIZE];
+    };
+    Shard shards[NVMDB::NVMDB_OPLOG_MAX_COMBINER_THREAD];
     static thread_local Oplog *perThreadLog;
 };
 
+/* key 的哈希, 存在 OpStruct::hash 中, 决定 oplog 由哪个 combiner 合并, 由每个组的哪个 worker 应用 */
+inline uint8_t OplogKeyHash(const Key_t &key) {
+    constexpr uint32_t FNV_OFFSET = 2166136261U;
+    constexpr uint32_t FNV_PRIME = 16777619U;
+    uint32_t hash = FNV_OFFSET;
+    for (int i = 0; i < key.keyLength; i++) {
+        hash = (hash ^ static_cast<uint8_t>(key.data[i])) * FNV_PRIME;
+    }
+    return static_cast<uint8_t>(hash ^ (hash >> 8) ^ (hash >> 16) ^ (hash >> 24));
+}
+
+/* 运行中的 combiner 个数和每组 worker 个数, 后台线程启动时设置 */
+extern int g_oplogCombinerNum;
+extern int g_oplogWorkersPerGroup;
+
+inline int OplogCombinerOf(uint8_t hash) {
+    return hash % g_oplogCombinerNum;
+}
+
+inline int OplogWorkerOf(uint8_t hash) {
+    return (hash / g_oplogCombinerNum) % g_oplogWorkersPerGroup;
+}
+
 struct ThreadLogMgr {
 public:
     int logCnt;
@@ -69,11 +91,15 @@ extern void InitGlobalLogMgr();
 extern void RegisterThreadLogMgr();
 extern void ReleaseThreadLogMgr();
 
-extern std::set<Oplog *> g_perThreadLog;
-extern boost::lockfree::spsc_queue<std::vector<OpStruct *> *, boost::lockfree::capacity<LOCK_CAPACITY>>
-    g_workQueue[NVMDB::NVMDB_MAX_GROUP * NVMDB::NVMDB_OPLOG_WORKER_THREAD_PER_GROUP];
-extern std::atomic<int> g_numSplits;
-extern int g_combinerSplits;
+using OplogWorkQueue = boost::lockfree::spsc_queue<std::vector<OpStruct *> *, boost::lockfree::capacity<LOCK_CAPACITY>>;
+
+/* 第 c 个 combiner 到第 w 个 worker 的队列是 g_workQueue[c][w] */
+extern OplogWorkQueue g_workQueue[NVMDB::NVMDB_OPLOG_MAX_COMBINER_THREAD]
+                                 [NVMDB::NVMDB_MAX_GROUP * NVMDB::NVMDB_OPLOG_MAX_WORKER_THREAD_PER_GROUP];
+extern std::atomic<uint64_t> g_combinerSplits;
+// 写入和已经应用到所有 search layer 的 oplog 个数, 两者之差是 search layer 落后的 oplog 个数
+extern std::atomic<uint64_t> g_oplogEnqueued;
+extern std::atomic<uint64_t> g_oplogApplied;
 extern std::set<Oplog *> *CopyGlobalThreadLogs();
 
 #endif
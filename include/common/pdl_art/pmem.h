@@ -4,6 +4,7 @@
 #include "common/pdl_art/arch.h"
 #include "common/pdl_art/op_log.h"
 #include "common/nvm_utils.h"
+#include "common/nvm_persist.h"
 #include <mutex>
 
 #define MASK 0x8000FFFFFFFFFFFF
@@ -25,12 +26,20 @@ public:
     static void *getBaseOf(int poolId);
 
     static void alloc(size_t size, void **p, PMEMoid *oid);
+    // 在指定 NUMA 组的内存池中分配, 用于在创建者之外的组上建 search layer
+    static void allocOnGroup(int grpId, size_t size, void **p, PMEMoid *oid);
     static void free(void *pptr);
     static void freeVaddr(void *vaddr);
 
     static void *getOpLog(int i);
+
+    // 除 log 之外所有已经挂载的内存池中已分配对象的总字节数, 只用于统计和测试
+    static size_t UsedBytes();
 };
 
-static inline void flushToNVM(char *data, size_t sz) {}
+// PDL-ART 和 PACTree 的刷写, 按照 --persist_mode 刷写 cache line 或者什么都不做
+static inline void flushToNVM(char *data, size_t sz) {
+    NVMDB::NVMFlush(data, sz);
+}
 
 #endif
@@ -145,6 +145,7 @@ public:
     uint8_t hash;                       // 1
     Step step;                          // 4
     std::atomic<uint8_t> searchLayers;  // 1
+    uint16_t treeId;                    // 2, 节点所属的树, 见 PACTreeImpl
     Key_t key;                          //  8
     void *oldNodePtr;                   // old node_ptr 8
     PMEMoid newNodeOid;                 // new node_ptr 16
@@ -38,6 +38,10 @@ public:
                                              LoadKeyFunction loadKey);
 
     void Recover();
+
+    // 释放所有内部节点, 叶子是外部的指针, 不释放. 调用者保证没有并发访问
+    void Destroy();
+
     explicit Tree(LoadKeyFunction loadKey);
 
     Tree(const Tree &) = delete;
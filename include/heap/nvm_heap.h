@@ -5,6 +5,8 @@
 
 namespace NVMDB {
 
+DECLARE_bool(heap_prefault);
+
 void HeapCreate(const std::shared_ptr<DirectoryConfig>& dirConfig);
 
 void HeapBootStrap(const std::shared_ptr<DirectoryConfig>& dirConfig);
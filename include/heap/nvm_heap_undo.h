@@ -12,14 +12,18 @@ UndoRecPtr PrepareUpdateUndo(Transaction *tx, uint32 segHead, RowId rowid, const
 
 UndoRecPtr PrepareDeleteUndo(Transaction *tx, uint32 segHead, RowId rowid, const NVMTuple& old_tuple);
 
-void UndoInsert(const UndoRecord *undo);
+void UndoInsert(const UndoRecord *undo, UndoRecPtr undoPtr);
 
-void UndoUpdate(const UndoRecord *undo);
+// 如果对应的行已经不是 undoPtr 生成的版本 (已被按需回滚), 则跳过
+void UndoUpdate(const UndoRecord *undo, UndoRecPtr undoPtr);
 
-void UndoDelete(const UndoRecord *undo);
+void UndoDelete(const UndoRecord *undo, UndoRecPtr undoPtr);
 
 void UndoUpdate(const UndoRecord *undo, NVMTuple *tuple, char* rowData);
 
+// 调用者需持有行锁; 将崩溃事务在该行上写入的所有版本回滚, 只修复这一行
+void UndoTupleRollBack(NVMTuple *tuple, UndoRecord *undoRecordCache);
+
 }  // namespace NVMDB
 
 #endif  // NVMDB_HEAP_UNDO_H
\ No newline at end of file
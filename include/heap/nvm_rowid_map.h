@@ -7,6 +7,7 @@
 #include "common/nvm_spinlock.h"
 #include <atomic>
 #include <functional>
+#include <vector>
 
 namespace NVMDB {
 
@@ -27,6 +28,7 @@ public:
     template <typename T=NVMTuple>
     T *loadDRAMCache(size_t tupleSize) {
         // prefetch_from_nvm(m_nvmAddr, tupleSize);
+        NVMReadDelay(m_nvmAddr, tupleSize);
         return reinterpret_cast<T *>(m_nvmAddr);
         //        DCHECK(tupleSize <= MAX_TUPLE_LEN);
         //        // 防止段错误, 重新加载tuple
@@ -41,22 +43,13 @@ public:
         //        return reinterpret_cast<T *>(m_dramCache.data());
     }
 
-    void flushToNVM() {
-        //        if (unlikely(m_dramCache.empty())) {
-        //            LOG(ERROR) << "DRAM cache is empty!";
-        //            return;
-        //        }
-        //        errno_t ret = memcpy_s(m_nvmAddr, m_dramCache.size(), m_dramCache.data(), m_dramCache.size());
-        //        SecureRetCheck(ret);
+    // tuple 已经直接写在 NVM 上, 这里只刷写 cache line, 提交时统一 fence
+    void flushToNVM(size_t tupleSize) {
+        NVMFlush(m_nvmAddr, tupleSize);
     }
 
     void flushHeaderToNVM() {
-        //        if (unlikely(m_dramCache.size() < NVMTupleHeadSize)) {
-        //            LOG(ERROR) << "DRAM cache is empty!";
-        //            return;
-        //        }
-        //        errno_t ret = memcpy_s(m_nvmAddr, NVMTupleHeadSize, m_dramCache.data(), NVMTupleHeadSize);
-        //        SecureRetCheck(ret);
+        NVMFlush(m_nvmAddr, NVMTupleHeadSize);
     }
 
     void flushTxnInfoToNVM() {
@@ -192,10 +185,24 @@ public:
 
     inline uint32 GetRowLen() const { return m_rowLen; }
 
+    inline uint32 GetSlotLen() const { return m_rowidMgr->getSlotLen(); }
+
     RowId getUpperRowId() const { return m_rowidMgr->getUpperRowId(); }
 
+    // 每个 extent 的行数, RowId / 这个值是 extent 在 segment 中的序号
+    inline uint32 GetTuplesPerExtent() const { return m_rowidMgr->getTuplesPerExtent(); }
+
+    // 第 leafExtentId 个 extent 所在的目录, 没有分配时返回 -1
+    inline int GetLeafExtentSpaceId(uint32 leafExtentId) const { return m_rowidMgr->getLeafExtentSpaceId(leafExtentId); }
+
+    // 清空 heap segment 中所有行, 之后需通过 DropRowIdMap 丢弃这个 RowIdMap
+    void ResetLeafExtents() { m_rowidMgr->resetLeafExtents(); }
+
     RowIdMapEntry *GetEntry(RowId rowId, bool isRead);
 
+    // 返回 entries 中属于这个 RowIdMap 的 entry 的 RowId, 不属于的跳过
+    std::vector<RowId> GetRowIds(const std::vector<RowIdMapEntry *> &entries);
+
 protected:
     RowIdMapEntry *GetSegment(int segId);
 
@@ -215,6 +222,9 @@ private:
 
 RowIdMap *GetRowIdMap(uint32 segHead, uint32 row_len);
 
+/* 表被删除或清空后丢弃 segHead 对应的 RowIdMap, 各线程的本地缓存在下次 GetRowIdMap 时失效 */
+void DropRowIdMap(uint32 segHead);
+
 void InitGlobalRowIdMapCache();
 
 void InitLocalRowIdMapCache();
@@ -4,11 +4,16 @@
 #include "table_space/nvm_table_space.h"
 #include "heap/nvm_tuple.h"
 #include "common/numa.h"
+#include "common/nvm_persist.h"
+#include <algorithm>
 
 namespace NVMDB {
 
 static const ExtentSizeType HEAP_EXTENT_SIZE = EXT_SIZE_2M;
 
+// 新建表时每个 slot 最多填充的字节数, 用来减少 tuple 跨 256B XPLine 的次数; 0 表示按原始行长存储
+DECLARE_int32(heap_slot_max_padding);
+
 class BestTupleLenCalculator {
 public:
     BestTupleLenCalculator() {
@@ -22,9 +27,13 @@ public:
 
     // 根据数据大小获取最佳对齐大小
     size_t getBestAlignment(size_t tupleLen, size_t maxWaste=63) {
+        if (tupleLen >= MAX_CALCULATED_LEN) {
+            return tupleLen;
+        }
         double minCrossBlockTimes = crossBlockTimes[tupleLen];
         size_t alignTupleLen = tupleLen;
-        for (size_t i=tupleLen+1; i<=tupleLen+maxWaste; i++) {
+        const size_t maxLen = std::min(tupleLen + maxWaste, MAX_CALCULATED_LEN - 1);
+        for (size_t i=tupleLen+1; i<=maxLen; i++) {
             if (minCrossBlockTimes > crossBlockTimes[i]) {
                 minCrossBlockTimes = crossBlockTimes[i];
                 alignTupleLen = i;
@@ -63,8 +72,9 @@ protected:
     }
 
 private:
+    static constexpr size_t MAX_CALCULATED_LEN = 2048;
     // 每个tuple跨的次数
-    double crossBlockTimes[2048] = {};
+    double crossBlockTimes[MAX_CALCULATED_LEN] = {};
 };
 
 class RowIDMgr {
@@ -75,9 +85,10 @@ public:
         : m_tableSpace(tableSpace),
           m_segHead(segHead),
           // heap中每行元组的大小 = NVM的header + 元组真实的数据
-          m_tupleLen(NVMTupleHeadSize + tupleLen) {
-        // 一个table segment的总逻辑空间 - header 除以每个tuple长度
-        m_tuplesPerExtent = GetExtentSize(HEAP_EXTENT_SIZE) / m_tupleLen;
+          m_tupleLen(NVMTupleHeadSize + tupleLen),
+          m_slotLen(loadSlotLen()) {
+        // 一个table segment的总逻辑空间 - header 除以每个slot长度
+        m_tuplesPerExtent = GetExtentSize(HEAP_EXTENT_SIZE) / m_slotLen;
     }
 
     // 根据 rowid 读取NVM中Table对应的记录
@@ -86,6 +97,10 @@ public:
         const uint32 leafExtentId = rowId / m_tuplesPerExtent;
         const uint32 leafPageOffset = rowId % m_tuplesPerExtent;
 
+        if (leafExtentId >= MaxLeafExtents()) {
+            CHECK(!append) << "Heap segment " << m_segHead << " is full, max " << MaxLeafExtents() << " extents";
+            return nullptr;
+        }
         uint32 *extentIds = GetLeafPageExtentIds();
         /* 1. check leaf page existing. If not, try to allocate a new page */
         if (!NVMPageIdIsValid(extentIds[leafExtentId])) {    // pageId
@@ -101,7 +116,7 @@ public:
         DCHECK(NVMPageIdIsValid(pageId));
         char *leafPage = m_tableSpace->getNvmAddrByPageId(pageId);
         char *leafData = (char *)GetExtentAddr(leafPage);
-        char *tuple = leafData + leafPageOffset * m_tupleLen;
+        char *tuple = leafData + leafPageOffset * m_slotLen;
 
         return tuple;
     }
@@ -112,9 +127,41 @@ public:
     // 每个heap page extent能存储的tuple数量
     [[nodiscard]] inline uint32 getTuplesPerExtent() const { return m_tuplesPerExtent; };
 
+    // leaf extent 所在的目录 (NUMA 组), 由它的物理页号推导; extent 还没有分配时返回 -1
+    [[nodiscard]] int getLeafExtentSpaceId(uint32 leafExtentId) const {
+        if (leafExtentId >= MaxLeafExtents()) {
+            return -1;
+        }
+        uint32 pageId = GetLeafPageExtentIds()[leafExtentId];
+        if (!NVMPageIdIsValid(pageId)) {
+            return -1;
+        }
+        return static_cast<int>(m_tableSpace->spaceIdFromGlobalPageId(pageId));
+    }
+
+    // 每行在 NVM 上占用的长度, 不小于 NVM header + 行长
+    [[nodiscard]] inline uint32 getSlotLen() const { return m_slotLen; }
+
+    // 清空所有 leaf extent 的页号 (保留 slot 长度), truncate 时在回收 extent 之前调用
+    void resetLeafExtents() {
+        char *head = GetExtentAddr(m_tableSpace->getNvmAddrByPageId(m_segHead));
+        const size_t len = GetExtentSize(HEAP_EXTENT_SIZE) - sizeof(uint32);
+        int ret = memset_s(head, len, 0, len);
+        SecureRetCheck(ret);
+        PersistTagScope tag(PersistTag::META);
+        NVMPersist(head, len);
+    }
+
 protected:
-    // Table Segment Header 存储 MaxPageNum 和 PageMap
-    uint32 *GetLeafPageExtentIds() {
+    /*
+     * Table Segment Header 按 uint32 划分: 第一个为 MaxPageNum, 之后 MaxLeafExtents() 个为 PageMap,
+     * 最后一个为 slot 长度. PageMap 不能越过 slot 长度, 一张表最多 MaxLeafExtents() 个 leaf extent
+     */
+    static inline uint32 MaxLeafExtents() {
+        return static_cast<uint32>(GetExtentSize(HEAP_EXTENT_SIZE) / sizeof(uint32)) - 2;
+    }
+
+    uint32 *GetLeafPageExtentIds() const {
         char *rootPage = m_tableSpace->getNvmAddrByPageId(m_segHead);
         /* NVMPageHeader + MaxPageNum + Page Maps */
         return (uint32 *)GetExtentAddr(rootPage) + 1;
@@ -138,6 +185,31 @@ protected:
         return *(uint32 *)GetExtentAddr(rootPage);
     }
 
+    uint32 *GetSlotLenRef() const {
+        return GetLeafPageExtentIds() + MaxLeafExtents();
+    }
+
+    /*
+     * 新建的 segment 按 --heap_slot_max_padding 选择跨 XPLine 最少的 slot 长度并持久化, 之后 mount 时沿用.
+     * 旧格式的 segment 没有记录 slot 长度 (为 0), 已经有数据时按原始行长访问.
+     */
+    uint32 loadSlotLen() const {
+        auto *slotLen = GetSlotLenRef();
+        if (*slotLen != 0) {
+            CHECK(*slotLen >= m_tupleLen) << "Heap slot length " << *slotLen << " < tuple length " << m_tupleLen;
+            return *slotLen;
+        }
+        if (GetMaxPageId() != 0 || NVMPageIdIsValid(GetLeafPageExtentIds()[0])) {
+            return m_tupleLen;
+        }
+        auto maxPadding = static_cast<size_t>(std::max(FLAGS_heap_slot_max_padding, 0));
+        auto bestLen = static_cast<uint32>(BestTupleLenCalculator::g_btc.getBestAlignment(m_tupleLen, maxPadding));
+        *slotLen = bestLen;
+        PersistTagScope tag(PersistTag::META);
+        NVMPersist(slotLen, sizeof(uint32));
+        return bestLen;
+    }
+
     // 基于 m_segHead 分配新的 extent, 并存储在 m_segHead 中
     void tryAllocNewPage(uint32 leafExtentId) {
         auto *extentIds = GetLeafPageExtentIds();
@@ -145,22 +217,27 @@ protected:
             return; // optimistic retry
         }
         auto pageId = m_tableSpace->fastAllocNewExtent(HEAP_EXTENT_SIZE, m_segHead, NumaBinding::getThreadLocalGroupId());
-        std::lock_guard<std::mutex> lock_guard(m_tableSpaceMutex);
-        while (NVMPageIdIsValid(extentIds[leafExtentId])) {
-            auto spaceCount = m_tableSpace->getDirConfig()->getDirPaths().size();
-            leafExtentId += spaceCount;
-        }
         // use leafExtentId as a hint for space idx
         // leaf page idx is logic page number. allocate physical page from space idx.
         // CHECK(leafExtentId % 4 == NumaBinding::getThreadLocalGroupId());
-        extentIds[leafExtentId] = pageId;
+        // 被其他线程抢先时, 放到同一目录的下一个空位上, 分配出来的 extent 不会被浪费
+        const auto spaceCount = m_tableSpace->getDirConfig()->getDirPaths().size();
+        while (true) {
+            auto *extentId = reinterpret_cast<std::atomic<uint32> *>(&extentIds[leafExtentId]);
+            uint32 expected = NVMInvalidPageId;
+            if (extentId->compare_exchange_strong(expected, pageId)) {
+                break;
+            }
+            leafExtentId += spaceCount;
+            CHECK(leafExtentId < MaxLeafExtents()) << "Heap segment " << m_segHead << " is full";
+        }
     }
 
 private:
-    std::mutex m_tableSpaceMutex;
     TableSpace *m_tableSpace;   // Table space, 保存真正的文件
     const uint32 m_segHead;   // 当前 Table 的 page id 入口
-    const uint32 m_tupleLen;  // 实际上每行占用的NVM的长度, 每行定长
+    const uint32 m_tupleLen;  // 每行数据的长度 (包括 NVM header), 每行定长
+    const uint32 m_slotLen;   // 实际上每行占用的NVM的长度, 对齐 XPLine 时大于 m_tupleLen
     uint32 m_tuplesPerExtent;  // 每个Table segment能保存的数组数量
 };
 
@@ -2,6 +2,7 @@
 #define NVMDB_TUPLE_H
 
 #include "common/nvm_cfg.h"
+#include "common/nvm_persist.h"
 #include "undo/nvm_undo_ptr.h"
 #include "glog/logging.h"
 #include <bitset>
@@ -85,65 +86,6 @@ inline size_t RealTupleSize(size_t rowLen) {
     return rowLen + NVMTupleHeadSize;
 }
 
-constexpr int GROUP = 1 << 12;
-constexpr int SET = 32;
-constexpr uint64_t FMASK = (uint64_t(1)<<50) - 1; // 32位key掩码，按你的实际定义
-constexpr int COUNT_START = 50;   // 计数器起始位，按你的实际定义
-
-using Address = uint64_t;
-
-struct FlushCache {
-    std::array<std::array<Address, SET>, GROUP> tuple_id{};
-    size_t counter;
-
-    FlushCache() : counter(0) {
-        for (auto& group : tuple_id) {
-            group.fill(0);
-        }
-    }
-
-    static thread_local FlushCache g_rowIdCache;
-
-
-    bool access(Address access) {
-        size_t k = ((access / 100) % 1'000'000'007) & (GROUP - 1);
-        auto& caches = tuple_id[k];
-
-        // 查找命中
-        for (auto& cache : caches) {
-            if (access == (cache & FMASK)) {
-                uint64_t count = cache >> COUNT_START;
-                if (count < 10000) {
-                    cache += (FMASK + 1);
-                }
-                return true; // 命中
-            }
-        }
-
-        // 插入/替换
-        for (int i = 0; i < 2; ++i) {
-            if (counter == SET) counter = 0;
-            auto& cache = caches[counter];
-            uint64_t count = cache >> COUNT_START;
-            if (count == 0) {
-                cache = access;
-                ++counter;
-                return false; // 未命中并插入
-            }
-            cache -= (FMASK + 1);
-            ++counter;
-        }
-        return false; // 未命中
-    }
-
-    inline static void flush(const void *src, size_t n) {
-        const auto *s = (const uint8_t *)src;
-        for (size_t i = 0; i < n; i += 64) {
-            _mm_clflushopt((void *)(s + i));
-        }
-    }
-};
-
 class RAMTuple {
 private:
     // 该tuple的定义
@@ -222,9 +164,8 @@ public:
         for (uint32 i = 0; i < m_updateCnt; i++) {
             memcpy_s(nvmAddr + m_updatedCols[i].m_colOffset, m_updatedCols[i].m_colLen,
                      this->m_rowDataPtr + m_updatedCols[i].m_colOffset, m_updatedCols[i].m_colLen);
-        }
-        if (!FlushCache::g_rowIdCache.access(rowId)) {
-            FlushCache::flush(nvmAddr, getRowLen());
+            // 只刷写修改的列, 提交时统一 fence
+            NVMFlush(nvmAddr + m_updatedCols[i].m_colOffset, m_updatedCols[i].m_colLen);
         }
     }
 
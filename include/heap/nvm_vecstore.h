@@ -32,6 +32,8 @@ public:
 private:
     // Table 入口地址, 为 page id
     uint32 m_segHead = 0;
+    // 线程本地缓存的 key. 表被删除后 segHead 可能被复用, 不能用 segHead 区分
+    uint32 m_cacheId = 0;
     // 每次扩展出的table segment可以存储的page数量
     uint32 m_tuplesPerExtent = 0;
     // 每个目录对应一个GlobalBitMap
@@ -0,0 +1,155 @@
+#ifndef NVMDB_HASH_INDEX_H
+#define NVMDB_HASH_INDEX_H
+
+#include "common/pactree/pactree_snapshot.h"
+#include "common/pdl_art/nvm_ptr.h"
+#include "common/pdl_art/pmem.h"
+#include "common/pdl_art/string_key.h"
+#include "common/nvm_persist.h"
+#include "common/nvm_spinlock.h"
+#include <mutex>
+#include <vector>
+
+namespace NVMDB {
+
+// 哈希索引的个数上限, id 是注册表的下标
+constexpr int HASH_INDEX_MAX = 1024;
+
+// 索引 key 以 CODE_ROWID 和 RowId 结尾 (见 NVMIndex::Encode), 哈希只取前面的索引列部分
+constexpr uint32 HASH_KEY_ROWID_LEN = 1 + sizeof(uint32);
+
+constexpr uint32 HASH_BUCKET_SLOTS = 16;
+
+struct HashSlot {
+    Val_t m_val;
+    Key_t m_key;
+};
+
+/*
+ * 桶覆盖哈希值最高 m_localDepth 位等于 m_pattern 的 key. 同一个索引列值的所有 RowId 哈希值相同,
+ * 放不下又无法分裂时挂到 m_next 的溢出桶上, 溢出桶只使用 m_bitmap, m_hash 和 m_slots.
+ * m_bitmap 标记有效的槽, 先写槽再置位, 删除时清位, 都是 8 字节原子写
+ */
+struct HashBucket {
+    uint32 m_localDepth;
+    uint32 m_pattern;
+    uint64 m_bitmap;
+    uint64 m_next;
+    uint64 m_hash[HASH_BUCKET_SLOTS];
+    HashSlot m_slots[HASH_BUCKET_SLOTS];
+};
+
+/* 目录有 2^m_depth 项, 下标是哈希值的最高 m_depth 位. 扩容时旧目录挂在 m_prev 上, 下次挂载时释放 */
+struct HashDirectory {
+    uint32 m_depth;
+    uint64 m_prev;
+    std::atomic<uint64> m_buckets[0];
+};
+
+/*
+ * 持久化的根. 分裂时新桶建好之后先记在 m_splitNew/m_splitOld 中再修改目录,
+ * 中途崩溃在挂载时重做; 新桶和新目录登记之前崩溃只会泄漏空间
+ */
+struct HashRoot {
+    uint64 m_dir;
+    uint64 m_splitOld;
+    uint64 m_splitNew;
+};
+
+/*
+ * 持久化的可扩展哈希, 建在 PACTree 的内存池上, key 和 value 的含义与 PACTreeImpl 相同:
+ * value 是删除这个 key 的事务, INVALID_CSN 表示没有被删除. 只支持同一个索引列值内的扫描 (等值查找).
+ * 读写都持有桶所在的锁分段; 分裂和扩容互斥, 目录和头桶在运行期间不释放, 读者拿到旧的目录项时
+ * 按桶的 pattern 发现后重试. 溢出桶只能持有头桶的锁访问, 分裂或删除后变空时持锁摘下并释放. 这个对象只在 DRAM 中, 每次挂载时重新建立
+ */
+class ExtendibleHash {
+public:
+    ExtendibleHash(uint16 id, HashRoot *root);
+
+    // 新建一个空的哈希, 根对象由调用者登记
+    static void Create(HashRoot *root);
+
+    // 插入 key, 已经存在时更新 value
+    void Insert(Key_t &key, Val_t val);
+
+    /*
+     * 同 PACTreeImpl::Scan, 结果按 key 排序. startKey 和 endKey 的索引列部分必须相同;
+     * 顺带删除对所有快照都不可见的 key
+     */
+    void Scan(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot, bool reverse,
+              std::vector<std::pair<Key_t, Val_t>> &result);
+
+    // 把所有 key 的 value 改为 val, 调用者保证没有并发访问
+    void SetAll(Val_t val);
+
+    // 释放所有的桶和目录, 根对象由调用者释放
+    void Destroy();
+
+    uint16 Id() const {
+        return m_id;
+    }
+
+    // 只取索引列部分, 同一个索引列值的所有 key 哈希值相同
+    static uint64 HashKey(const Key_t &key);
+
+private:
+    // 每个锁独占一个 CPU cache line
+    struct BucketLock {
+        PassiveSpinner42 m_lock;
+        char m_padding[64 - sizeof(PassiveSpinner42)];
+    };
+
+    static constexpr uint32 LOCK_STRIPES = 256;
+
+    static bool InBucket(const HashBucket *bucket, uint64 hash);
+
+    static HashBucket *GetBucket(uint64 raw);
+
+    PassiveSpinner42 &LockOf(uint64 raw) {
+        return m_locks[(raw * 0x9E3779B97F4A7C15ULL) >> 56].m_lock;
+    }
+
+    // 找到 hash 所在的桶并加锁
+    uint64 LockBucket(uint64 hash);
+
+    bool TryInsert(HashBucket *bucket, uint64 hash, Key_t &key, Val_t val);
+
+    void Grow(uint64 hash, Key_t &key);
+
+    void Split(uint64 raw, HashBucket *bucket);
+
+    void DoubleDirectory();
+
+    void FinishSplit(uint64 oldRaw, uint64 newRaw);
+
+    void Recover();
+
+    uint16 m_id;
+
+    HashRoot *m_root;
+
+    std::atomic<HashDirectory *> m_dir;
+
+    // 分裂和扩容互斥
+    std::mutex m_growLock;
+
+    BucketLock m_locks[LOCK_STRIPES];
+};
+
+/* 挂载哈希索引的注册表, 打开并恢复其中所有的哈希索引 */
+void HashIndexBootstrap();
+
+void HashIndexExitProcess();
+
+/* 索引 idxId 的哈希, 不存在时新建并登记到注册表中 */
+ExtendibleHash *OpenHashIndex(uint32 idxId);
+
+/* 删除索引 idxId 的哈希并回收所有空间, 调用者保证没有并发访问这个索引 */
+void DropHashIndex(uint32 idxId);
+
+/* 按 id 找已经打开的哈希索引, 已经删除时返回 nullptr */
+ExtendibleHash *GetHashIndexById(uint16 id);
+
+}  // namespace NVMDB
+
+#endif  // NVMDB_HASH_INDEX_H
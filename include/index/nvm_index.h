@@ -6,9 +6,9 @@
 
 namespace NVMDB {
 
-/* idx id + tag + row id */
+/* tag + row id, 每个索引有自己的树, key 中不再有 idx id */
 // only use for FDW
-static constexpr uint32 KEY_EXTRA_LENGTH = sizeof(uint32)  + 1  + sizeof(uint32) ;
+static constexpr uint32 KEY_EXTRA_LENGTH = 1 + sizeof(uint32);
 static constexpr uint32 KEY_DATA_LENGTH = KEYLENGTH - KEY_EXTRA_LENGTH;
 
 // allocate pactree
@@ -33,27 +33,82 @@ inline void IndexDescDelete(IndexColumnDesc *desc) {
 // 类型为oid, 唯一确定一个index
 using IndexId = uint32;
 
+/*
+ * PACTREE 支持范围扫描; HASH 是持久化的可扩展哈希 (见 ExtendibleHash), 只支持索引列的等值查找,
+ * 点查不需要走 search layer 和数据层的链表, 不能是覆盖索引.
+ * VOLATILE 只在 DRAM 中 (见 VolatileIndex), 限制与 HASH 相同, 写索引不刷写 NVM, 重启后由
+ * RebuildVolatileIndexes 扫描 heap 重建 (通过 catalog 打开表时自动重建)
+ */
+enum class IndexType : uint8 {
+    PACTREE = 0,
+    HASH = 1,
+    VOLATILE = 2,
+};
+
+// 哈希索引和易失索引在 undo 中记录的 tree id 带上对应的位, 低位是它们各自的 id
+constexpr uint16 HASH_INDEX_UNDO_FLAG = 0x8000;
+constexpr uint16 VOLATILE_INDEX_UNDO_FLAG = 0x4000;
+
+class Transaction;
+
+/*
+ * 在索引的树 tree 中找 [kb, ke) 中第一个删除对 tx 不可见的 key, 删除标记按 Transaction::VersionIsVisible 的规则判断:
+ * 快照之前提交的删除和自己的删除不可见, 进行中, 快照之后提交或者已经回滚的删除可见.
+ * 不构造迭代器, 结果缓冲区是线程私有的, 稳定状态下不分配内存.
+ * Source 为 PACTreeImpl, ExtendibleHash (kb 和 ke 的索引列必须相同) 或者 VolatileIndex, 在 nvm_index.cpp 中实例化
+ */
+template <typename Source>
+bool IndexLookupVisible(Source *tree, Transaction *tx, Key_t &kb, Key_t &ke, Key_t *key);
+
+/* 同上, 覆盖索引还要求 key 中记录的插入事务 (在最后 suffixLen 字节的开头) 对 tx 可见 */
+bool IndexLookupCovering(PACTreeImpl *tree, Transaction *tx, Key_t &kb, Key_t &ke, uint32 suffixLen, Key_t *key);
+
+/* 找 [kb, ke) 中没有删除标记的 key */
+bool IndexFindLiveKey(PACTreeImpl *tree, Key_t &kb, Key_t &ke, Key_t *key);
+
+/*
+ * 覆盖索引: 包含列 (非 key 列) 和插入事务 (TxSlot, 非事务插入时为 INVALID_CSN) 跟在 RowId 后面存到 key 中,
+ * 点查时按插入事务和删除标记判断可见性, 可见时直接从 key 中取包含列, 不需要回表 (见 IndexUniqueRead).
+ * 包含列按定长原样存放, 整个 key 不能超过 KEYLENGTH. 只更新包含列时 HeapUpdate/HeapUpdate2 通过
+ * Transaction::IndexUpdate 同步表上的覆盖索引; key 列也被更新时由调用者删除旧的 key 并插入新的 key.
+ *
+ * 每个索引有自己的一棵 PACTree, 按 idxId 登记在 PACTree 的持久化注册表中, 同一个 idxId 总是打开同一棵树,
+ * 重启后由 IndexBootstrap 打开并各自恢复; Drop 删除整棵树并回收空间. 哈希索引和易失索引同样按 idxId 登记,
+ * 这时 m_tree 为空, 所有读写都转到 m_hash 或者 m_volatile; 易失索引重建完成之前读写都会等待
+ */
 class NVMIndex {
     IndexId m_idxId;
+    IndexType m_type;
+    PACTreeImpl *m_tree = nullptr;
+    ExtendibleHash *m_hash = nullptr;
+    VolatileIndex *m_volatile = nullptr;
     uint32 m_colCnt = 0;
     uint64 m_rowLen = 0;
     IndexColumnDesc *m_indexDes = nullptr;
     uint8 *m_colBitmap = nullptr;
+    IndexColumnDesc *m_includeDes = nullptr;
+    uint32 m_includeColCnt = 0;
+    uint64 m_includeLen = 0;
 
 public:
-    explicit NVMIndex(IndexId id)
-        : m_idxId(id) { }
+    explicit NVMIndex(IndexId id, IndexType type = IndexType::PACTREE) : m_idxId(id), m_type(type) {
+        if (type == IndexType::HASH) {
+            m_hash = OpenHashIndex(id);
+        } else if (type == IndexType::VOLATILE) {
+            m_volatile = OpenVolatileIndex(id);
+        } else {
+            m_tree = GetGlobalPACTree()->openIndexTree(id);
+        }
+    }
 
     ~NVMIndex() {
         delete[] m_colBitmap;
         IndexDescDelete(m_indexDes);
+        IndexDescDelete(m_includeDes);
     }
 
     void Encode(DRAMIndexTuple *tuple, Key_t *key, RowId rowId) const {
         BinaryWriter writer(key->getData());
-        // For tpcc testing
-        // writer.write_uint8(m_idxId);
-        writer.write_uint32(m_idxId);
         tuple->Encode(writer);
         writer.write_uint8(CODE_ROWID);
         writer.write_uint32(rowId);
@@ -61,7 +116,51 @@ public:
         CHECK(key->keyLength <= KEYLENGTH) << (int)key->keyLength;
     }
 
-    /* find begin <= key <= end */
+    /* 覆盖索引的 key: Encode 之后是插入事务和包含列 */
+    void EncodeCovering(DRAMIndexTuple *tuple, Key_t *key, RowId rowId, uint64 inserter, const RAMTuple *row) const {
+        DCHECK(IsCovering());
+        BinaryWriter writer(key->getData());
+        tuple->Encode(writer);
+        writer.write_uint8(CODE_ROWID);
+        writer.write_uint32(rowId);
+        writer.write_uint64(inserter);
+        for (uint32 i = 0; i < m_includeColCnt; i++) {
+            writer.write_bytes(row->GetCol(m_includeDes[i].m_colId), m_includeDes[i].m_colLen);
+        }
+        key->keyLength = writer.get_size();
+        CHECK(key->keyLength <= KEYLENGTH) << (int)key->keyLength;
+    }
+
+    /*
+     * 这一行当前 (没有被删除) 的 key. 覆盖索引的 key 中有插入事务和包含列, 需要在 PACTree 中找;
+     * 行被锁住, 同一个 RowId 最多只有一个没有删除标记的 key
+     */
+    void EncodeLive(DRAMIndexTuple *tuple, Key_t *key, RowId rowId) const {
+        if (!IsCovering()) {
+            Encode(tuple, key, rowId);
+            return;
+        }
+        Key_t kb;
+        Key_t ke;
+        Encode(tuple, &kb, rowId);
+        Encode(tuple, &ke, rowId + 1);
+        CHECK(IndexFindLiveKey(m_tree, kb, ke, key)) << "no live index key for row " << rowId;
+    }
+
+    /* 覆盖索引的 key 中的包含列是否与 row 相同 */
+    bool IncludeEqual(Key_t &key, const RAMTuple *row) const {
+        DCHECK(IsCovering());
+        const char *data = key.getData() + key.keyLength - m_includeLen;
+        for (uint32 i = 0; i < m_includeColCnt; i++) {
+            if (memcmp(data, row->GetCol(m_includeDes[i].m_colId), m_includeDes[i].m_colLen) != 0) {
+                return false;
+            }
+            data += m_includeDes[i].m_colLen;
+        }
+        return true;
+    }
+
+    /* find begin <= key <= end, reverse 为 true 时从大到小返回 */
     NVMIndexIter *GenerateIter(DRAMIndexTuple *begin,
                                DRAMIndexTuple *end,
                                LookupSnapshot snapshot,
@@ -72,22 +171,144 @@ public:
         Encode(begin, &kb, 0);
         Encode(end, &ke, 0xffffffff);
 
-        auto iter = new NVMIndexIter(kb, ke, snapshot, max_range, reverse);
+        if (IsHash()) {
+            return new NVMIndexIter(m_hash, kb, ke, snapshot, max_range, reverse);
+        }
+        if (IsVolatile()) {
+            m_volatile->WaitReady();
+            return new NVMIndexIter(m_volatile, kb, ke, snapshot, max_range, reverse);
+        }
+        auto iter = new NVMIndexIter(m_tree, kb, ke, snapshot, max_range, reverse, KeySuffixLen());
         return iter;
     }
 
+    /* 同上, 复用调用者的 iter (例如每个线程一个), 不分配内存 */
+    void GenerateIter(DRAMIndexTuple *begin,
+                      DRAMIndexTuple *end,
+                      LookupSnapshot snapshot,
+                      int max_range,
+                      bool reverse,
+                      NVMIndexIter *iter) const {
+        Key_t kb;
+        Key_t ke;
+        Encode(begin, &kb, 0);
+        Encode(end, &ke, 0xffffffff);
+        if (IsHash()) {
+            iter->Seek(m_hash, kb, ke, snapshot, max_range, reverse);
+            return;
+        }
+        if (IsVolatile()) {
+            m_volatile->WaitReady();
+            iter->Seek(m_volatile, kb, ke, snapshot, max_range, reverse);
+            return;
+        }
+        iter->Seek(m_tree, kb, ke, snapshot, max_range, reverse, KeySuffixLen());
+    }
+
+    /*
+     * 唯一索引的点查, 返回 RowId >= from 中第一个没有被 tx 看到删除的, 没有时返回 InvalidRowId.
+     * 索引中没有记录插入的事务, 插入是否可见仍然由 heap 判断, 不可见时从下一个 RowId 继续, 见 UniqueSearch
+     */
+    RowId Lookup(Transaction *tx, DRAMIndexTuple *tuple, RowId from = 0) const {
+        Key_t kb;
+        Key_t ke;
+        Key_t key;
+        Encode(tuple, &kb, from);
+        Encode(tuple, &ke, InvalidRowId);
+        bool found;
+        if (IsHash()) {
+            found = IndexLookupVisible(m_hash, tx, kb, ke, &key);
+        } else if (IsVolatile()) {
+            m_volatile->WaitReady();
+            found = IndexLookupVisible(m_volatile, tx, kb, ke, &key);
+        } else {
+            found = IndexLookupVisible(m_tree, tx, kb, ke, &key);
+        }
+        if (!found) {
+            return InvalidRowId;
+        }
+        return DecodeIndexRowId(key, KeySuffixLen());
+    }
+
+    /*
+     * 覆盖索引的点查, 插入事务和删除标记都对 tx 可见时把包含列填到 row 中并返回 RowId,
+     * 只有包含列有效; 没有可见的 key 时返回 InvalidRowId
+     */
+    RowId LookupCovering(Transaction *tx, DRAMIndexTuple *tuple, RAMTuple *row) const {
+        DCHECK(IsCovering());
+        Key_t kb;
+        Key_t ke;
+        Key_t key;
+        Encode(tuple, &kb, 0);
+        Encode(tuple, &ke, InvalidRowId);
+        if (!IndexLookupCovering(m_tree, tx, kb, ke, KeySuffixLen(), &key)) {
+            return InvalidRowId;
+        }
+        const char *data = key.getData() + key.keyLength - m_includeLen;
+        for (uint32 i = 0; i < m_includeColCnt; i++) {
+            row->SetCol(m_includeDes[i].m_colId, const_cast<char *>(data), m_includeDes[i].m_colLen);
+            data += m_includeDes[i].m_colLen;
+        }
+        return DecodeIndexRowId(key, KeySuffixLen());
+    }
+
     void Insert(DRAMIndexTuple *tuple, RowId rowId) const {
-        PACTree *pt = GetGlobalPACTree();
+        CHECK(!IsCovering()) << "covering index needs the row, use InsertCovering";
         Key_t key;
         Encode(tuple, &key, rowId);
-        pt->Insert(key, INVALID_CSN);
+        Put(key, INVALID_CSN);
+    }
+
+    /* 插入覆盖索引, 不在事务中插入 (如导入数据) 时 inserter 为 INVALID_CSN, 对所有事务可见 */
+    void InsertCovering(DRAMIndexTuple *tuple, RowId rowId, uint64 inserter, const RAMTuple *row) const {
+        Key_t key;
+        EncodeCovering(tuple, &key, rowId, inserter, row);
+        Put(key, INVALID_CSN);
     }
 
     void Delete(DRAMIndexTuple *tuple, RowId rowId, TxSlotPtr tx) const {
-        PACTree *pt = GetGlobalPACTree();
         Key_t key;
-        Encode(tuple, &key, rowId);
-        pt->Insert(key, tx);
+        EncodeLive(tuple, &key, rowId);
+        DeleteKey(key, tx);
+    }
+
+    void DeleteKey(Key_t &key, TxSlotPtr tx) const {
+        Put(key, tx);
+    }
+
+    /*
+     * 删除这个索引的所有 key, 表被清空时调用.
+     * key 标记为在 MIN_TX_CSN 时已经删除, 对所有快照都不可见, 之后由 Prune 回收
+     */
+    void DeleteAll() const {
+        if (IsHash()) {
+            m_hash->SetAll(MIN_TX_CSN);
+            return;
+        }
+        if (IsVolatile()) {
+            m_volatile->WaitReady();
+            m_volatile->Clear();
+            return;
+        }
+        static constexpr int DELETE_BATCH = 1024;
+        Key_t kb;
+        Key_t ke;
+        EncodePrefix(&kb, 0x00);
+        EncodePrefix(&ke, 0xff);
+        LookupSnapshot snapshot {UINT64_MAX, MIN_TX_CSN};
+        std::vector<std::pair<Key_t, Val_t>> result;
+        while (true) {
+            result.clear();
+            m_tree->Scan(kb, ke, DELETE_BATCH, snapshot, false, result);
+            for (auto &it : result) {
+                m_tree->Insert(it.first, MIN_TX_CSN);
+            }
+            if (result.size() < DELETE_BATCH) {
+                break;
+            }
+            kb = result.back().first;
+            kb.next();
+        }
     }
 
     // 表总共有几列
@@ -131,9 +352,124 @@ public:
         return m_indexDes;
     }
 
+    // 设置包含列, 必须在插入数据之前调用; desc 由 InitIndexDesc 初始化, 之后由索引释放
+    void SetIncludeDesc(IndexColumnDesc *desc, uint32 colCount, uint64 includeLen) noexcept {
+        CHECK(m_type == IndexType::PACTREE) << "only PACTree index can be covering";
+        m_includeDes = desc;
+        m_includeColCnt = colCount;
+        m_includeLen = includeLen;
+    }
+
+    bool IsCovering() const noexcept {
+        return m_includeColCnt != 0;
+    }
+
+    // key 中 RowId 之后的字节数
+    uint32 KeySuffixLen() const noexcept {
+        return IsCovering() ? sizeof(uint64) + m_includeLen : 0;
+    }
+
+    /* 更新的列 (行内偏移和长度, 见 RAMTuple::GetUpdatedCols) 中是否有索引的 key 列, rowDes 为表的列定义 */
+    bool KeyUpdated(const ColumnDesc *rowDes, const UndoColumnDesc *updatedCols, uint32 updateCnt) const {
+        return ColumnsUpdated(m_indexDes, m_colCnt, rowDes, updatedCols, updateCnt);
+    }
+
+    /* 同上, 是否有覆盖索引的包含列 */
+    bool IncludeUpdated(const ColumnDesc *rowDes, const UndoColumnDesc *updatedCols, uint32 updateCnt) const {
+        return ColumnsUpdated(m_includeDes, m_includeColCnt, rowDes, updatedCols, updateCnt);
+    }
+
     IndexId Id() const {
         return m_idxId;
     }
+
+    IndexType Type() const {
+        return m_type;
+    }
+
+    bool IsHash() const {
+        return m_type == IndexType::HASH;
+    }
+
+    bool IsVolatile() const {
+        return m_type == IndexType::VOLATILE;
+    }
+
+    // 易失索引的 DRAM 对象, 用于重建
+    VolatileIndex *GetVolatileIndex() const {
+        return m_volatile;
+    }
+
+    // undo 中记录的索引位置, 回滚时按它找到树或者哈希索引
+    uint16 TreeId() const {
+        if (IsHash()) {
+            return HASH_INDEX_UNDO_FLAG | m_hash->Id();
+        }
+        if (IsVolatile()) {
+            return VOLATILE_INDEX_UNDO_FLAG | m_volatile->Id();
+        }
+        return m_tree->TreeId();
+    }
+
+    /*
+     * 删除整棵树并回收它的所有空间, 表被删除时调用. 调用者保证没有并发访问这个索引,
+     * 之后这个对象不能再使用; 用同一个 idxId 新建的 NVMIndex 是一棵空树
+     */
+    void Drop() {
+        if (IsHash()) {
+            DropHashIndex(m_idxId);
+            m_hash = nullptr;
+            return;
+        }
+        if (IsVolatile()) {
+            DropVolatileIndex(m_idxId);
+            m_volatile = nullptr;
+            return;
+        }
+        GetGlobalPACTree()->dropIndexTree(m_idxId);
+        m_tree = nullptr;
+    }
+
+private:
+    static bool ColumnsUpdated(const IndexColumnDesc *cols, uint32 colCnt, const ColumnDesc *rowDes,
+                               const UndoColumnDesc *updatedCols, uint32 updateCnt) {
+        for (uint32 i = 0; i < colCnt; i++) {
+            const ColumnDesc &col = rowDes[cols[i].m_colId];
+            for (uint32 j = 0; j < updateCnt; j++) {
+                if (updatedCols[j].m_colOffset < col.m_colOffset + col.m_colLen &&
+                    col.m_colOffset < updatedCols[j].m_colOffset + updatedCols[j].m_colLen) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void Put(Key_t &key, Val_t val) const {
+        if (IsHash()) {
+            m_hash->Insert(key, val);
+        } else if (IsVolatile()) {
+            m_volatile->WaitReady();
+            m_volatile->Insert(key, val);
+        } else {
+            m_tree->Insert(key, val);
+        }
+    }
+
+    /*
+     * 界定整棵树中所有索引 key 的边界, 其余部分填 fill. 空 key 是链表头的哨兵,
+     * 所以下界至少有一个字节; 全是 0xff 的上界是链表尾的哨兵, 不会被扫描到
+     */
+    void EncodePrefix(Key_t *key, uint8 fill) const {
+        BinaryWriter writer(key->getData());
+        writer.write_uint8(fill);
+        if (fill != 0) {
+            while (writer.get_size() < KEYLENGTH) {
+                writer.write_uint8(fill);
+            }
+        }
+        key->keyLength = writer.get_size();
+    }
 };
 
 }  // namespace NVMDB
@@ -2,22 +2,65 @@
 #define NVMDB_INDEX_ITER_H
 
 #include "common/pactree/pactree.h"
+#include "index/nvm_volatile_index.h"
 #include "common/serializer.h"
 
 namespace NVMDB {
 
 PACTree *GetGlobalPACTree();
 
+/* 索引 key 以 CODE_ROWID 和 RowId 结尾, 覆盖索引在后面还有 suffixLen 字节, 见 NVMIndex::Encode */
+inline RowId DecodeIndexRowId(Key_t &key, uint32 suffixLen = 0) {
+    BinaryReader reader(key.getData());
+    reader.set_position(key.keyLength - suffixLen - 1 - sizeof(uint32));
+    CHECK(reader.read_uint8() == CODE_ROWID);
+    return (RowId)reader.read_uint32();
+}
+
+/*
+ * 遍历索引的树中 [begin, end) 内对 snapshot 可见的 key, reverse 为 true 时从大到小遍历.
+ * 结果分批从 PACTree 中取出, 一批用完后用游标从上一批停下的数据节点继续, 不再从 search layer 查找.
+ * 不限制数量时第一批取 m_minBatch 个, 之后每批翻倍直到 m_maxBatch, 短扫描不会多取, 长扫描减少批数.
+ * 同一个迭代器可以通过 Seek 反复使用, 结果缓冲区的容量保留下来, 稳定状态下不再分配内存.
+ * 哈希索引和易失索引的迭代器每批都重新扫描 key 所在的桶 (分段), begin 和 end 的索引列必须相同
+ */
 class NVMIndexIter {
 public:
-    NVMIndexIter(Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse)
-        : cursor(0), m_keyEnd(end), m_snapshot(snapshot), m_maxSize(maxSize), m_reverse(reverse) {
-        if (maxSize == 0) {
-            // no size limit, use m_defaultRange
-            search(begin, end, m_defaultRange, snapshot, reverse);
-            return;
-        }
-        search(begin, end, maxSize, snapshot, reverse);
+    NVMIndexIter() = default;
+
+    NVMIndexIter(PACTreeImpl *tree, Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse,
+                 uint32 suffixLen = 0) {
+        Seek(tree, begin, end, snapshot, maxSize, reverse, suffixLen);
+    }
+
+    NVMIndexIter(ExtendibleHash *hash, Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse) {
+        Seek(hash, begin, end, snapshot, maxSize, reverse);
+    }
+
+    NVMIndexIter(VolatileIndex *index, Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse) {
+        Seek(index, begin, end, snapshot, maxSize, reverse);
+    }
+
+    void Seek(ExtendibleHash *hash, Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse) {
+        m_tree = nullptr;
+        m_hash = hash;
+        m_volatile = nullptr;
+        Start(begin, end, snapshot, maxSize, reverse, 0);
+    }
+
+    void Seek(VolatileIndex *index, Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse) {
+        m_tree = nullptr;
+        m_hash = nullptr;
+        m_volatile = index;
+        Start(begin, end, snapshot, maxSize, reverse, 0);
+    }
+
+    void Seek(PACTreeImpl *tree, Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse,
+              uint32 suffixLen = 0) {
+        m_tree = tree;
+        m_hash = nullptr;
+        m_volatile = nullptr;
+        Start(begin, end, snapshot, maxSize, reverse, suffixLen);
     }
 
     void Next() {
@@ -30,9 +73,22 @@ public:
             m_valid = false;
             return;
         }
+        // 上一批不足一批时已经扫描到了边界
+        if (m_result.size() < static_cast<size_t>(m_batchSize)) {
+            m_valid = false;
+            return;
+        }
+        m_batchSize = m_batchSize * 2 < m_maxBatch ? m_batchSize * 2 : m_maxBatch;
+        if (m_reverse) {
+            // 逆序时上界是开区间, 直接从上一批最小的 key 继续
+            Key_t new_ke = LastKey();
+            search(m_keyBegin, new_ke, m_batchSize, m_snapshot, m_reverse);
+            cursor = 0;
+            return;
+        }
         Key_t new_kb = LastKey();
         new_kb.next();
-        search(new_kb, m_keyEnd, m_defaultRange, m_snapshot, m_reverse);
+        search(new_kb, m_keyEnd, m_batchSize, m_snapshot, m_reverse);
         cursor = 0;
     }
 
@@ -40,40 +96,79 @@ public:
 
     RowId Curr() {
         DCHECK(m_valid);
-        auto& key = m_result[cursor].first;
-        BinaryReader reader(key.getData());
-        reader.set_position(key.keyLength - 1 - sizeof(uint32));
-        CHECK(reader.read_uint8() == CODE_ROWID);
-        return (RowId)reader.read_uint32();
+        return DecodeIndexRowId(m_result[cursor].first, m_suffixLen);
     }
 
     [[nodiscard]] Key_t &LastKey() { return m_result.back().first; }
 
 protected:
+    void Start(Key_t &begin, Key_t &end, LookupSnapshot snapshot, int maxSize, bool reverse, uint32 suffixLen) {
+        cursor = 0;
+        m_suffixLen = suffixLen;
+        m_scanCursor.Reset();
+        m_keyBegin = begin;
+        m_keyEnd = end;
+        m_snapshot = snapshot;
+        m_maxSize = maxSize;
+        m_reverse = reverse;
+        if (maxSize == 0) {
+            // no size limit, start from m_minBatch
+            m_batchSize = m_minBatch;
+            search(begin, end, m_batchSize, snapshot, reverse);
+            return;
+        }
+        search(begin, end, maxSize, snapshot, reverse);
+    }
+
     void search(Key_t &kb, Key_t &ke, int max_range, LookupSnapshot snapshot, bool reverse) {
-        auto* pt = GetGlobalPACTree();
-        pt->scan(kb, ke, max_range, snapshot, reverse, m_result);
+        if (m_hash != nullptr) {
+            m_hash->Scan(kb, ke, max_range, snapshot, reverse, m_result);
+        } else if (m_volatile != nullptr) {
+            m_volatile->Scan(kb, ke, max_range, snapshot, reverse, m_result);
+        } else {
+            m_tree->Scan(kb, ke, max_range, snapshot, reverse, m_result, &m_scanCursor);
+        }
         m_valid = !m_result.empty();
     }
 
 private:
+    // 所在索引的树
+    PACTreeImpl *m_tree = nullptr;
+
+    // 哈希索引和易失索引时其中一个不为空, 不使用 m_tree
+    ExtendibleHash *m_hash = nullptr;
+
+    VolatileIndex *m_volatile = nullptr;
+
     std::vector<std::pair<Key_t, Val_t>> m_result;
 
+    ScanCursor m_scanCursor;
+
     // 搜索结果是否存在
     bool m_valid = false;
 
-    int cursor;
+    int cursor = 0;
 
     // maxSize = 0, means no limit
-    int m_maxSize;
+    int m_maxSize = 0;
 
-    bool m_reverse;
+    bool m_reverse = false;
+
+    // 覆盖索引的 key 在 RowId 之后的字节数
+    uint32 m_suffixLen = 0;
+
+    Key_t m_keyBegin;
 
     Key_t m_keyEnd;
 
-    LookupSnapshot m_snapshot;
+    LookupSnapshot m_snapshot {};
+
+    // 不限制数量时当前一批的大小
+    int m_batchSize = m_minBatch;
+
+    static constexpr int m_minBatch = 6;
 
-    static constexpr auto m_defaultRange = 6;
+    static constexpr int m_maxBatch = 384;
 };
 
 }  // namespace NVMDB
@@ -32,7 +32,7 @@ inline bool IsIndexTypeSupported(ColumnType indexType) {
     return false;
 }
 
-/* 内存中的 IndexTuple */
+/* 内存中的 IndexTuple, 编码后不超过一个 key, 数据直接放在对象内, 在栈上构造时不需要分配内存 */
 class DRAMIndexTuple {
 public:
     const ColumnDesc *const m_rowDes;
@@ -42,16 +42,16 @@ public:
     uint64 m_indexLen;
 
     DRAMIndexTuple(const ColumnDesc *const rowDes, const IndexColumnDesc *const indexDes, uint32 colCnt, uint64 indexLen)
-        : m_rowDes(rowDes), m_indexDes(indexDes), m_colCnt(colCnt), m_indexLen(indexLen) {
-        DCHECK(indexLen <= KEYLENGTH);
-        m_indexData = new char[indexLen];
+        : m_rowDes(rowDes), m_indexDes(indexDes), m_colCnt(colCnt), m_indexData(m_indexBuffer),
+          m_indexLen(indexLen) {
+        CHECK(indexLen <= KEYLENGTH);
         int ret = memset_s(m_indexData, indexLen, 0, indexLen);
         SecureRetCheck(ret);
     }
 
-    ~DRAMIndexTuple() {
-        delete[] m_indexData;
-    }
+    // m_indexData 指向自己的 buffer, 不能按位拷贝
+    DRAMIndexTuple(const DRAMIndexTuple &) = delete;
+    DRAMIndexTuple &operator=(const DRAMIndexTuple &) = delete;
 
     void ExtractFromTuple(RAMTuple *tuple) const {
         DCHECK(m_rowDes == tuple->m_rowDes);    // 检测定义相同
@@ -157,6 +157,9 @@ public:
                            tuple->m_indexData + m_indexDes[colIndex].m_colOffset, m_indexDes[colIndex].m_colLen);
         SecureRetCheck(ret);
     }
+
+private:
+    char m_indexBuffer[KEYLENGTH];
 };
 
 }  // namespace NVMDB
@@ -0,0 +1,79 @@
+#ifndef NVMDB_VOLATILE_INDEX_H
+#define NVMDB_VOLATILE_INDEX_H
+
+#include "index/nvm_hash_index.h"
+#include <map>
+
+namespace NVMDB {
+
+// 易失索引的个数上限, id 是注册表的下标
+constexpr int VOLATILE_INDEX_MAX = 1024;
+
+/*
+ * 只在 DRAM 中的索引, key 和 value 的含义与 ExtendibleHash 相同, 也只支持索引列的等值查找:
+ * 按索引列的哈希值分到 VOLATILE_SHARDS 个分段, 每个分段一个有序的 map 和一把锁.
+ * 写索引不刷写 NVM, 重启后内容丢失, 由 RebuildVolatileIndexes 扫描 heap 重建;
+ * 重建完成 (SetReady) 之前 NVMIndex 的读写都会等待, undo 也找不到这个索引
+ */
+class VolatileIndex {
+public:
+    explicit VolatileIndex(uint16 id) : m_id(id) { }
+
+    // 插入 key, 已经存在时更新 value
+    void Insert(Key_t &key, Val_t val);
+
+    /* 同 ExtendibleHash::Scan */
+    void Scan(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot, bool reverse,
+              std::vector<std::pair<Key_t, Val_t>> &result);
+
+    // 删除所有的 key, 调用者保证没有并发访问
+    void Clear();
+
+    // 重建完成, 之后可以读写
+    void SetReady() {
+        m_ready.store(true, std::memory_order_release);
+    }
+
+    bool Ready() const {
+        return m_ready.load(std::memory_order_acquire);
+    }
+
+    void WaitReady() const;
+
+    uint16 Id() const {
+        return m_id;
+    }
+
+private:
+    static constexpr uint32 VOLATILE_SHARDS = 1024;
+
+    struct Shard {
+        PassiveSpinner42 m_lock;
+        std::map<Key_t, Val_t> m_keys;
+    };
+
+    Shard &ShardOf(const Key_t &key) {
+        return m_shards[ExtendibleHash::HashKey(key) % VOLATILE_SHARDS];
+    }
+
+    uint16 m_id;
+
+    std::atomic<bool> m_ready{false};
+
+    Shard m_shards[VOLATILE_SHARDS];
+};
+
+void VolatileIndexExitProcess();
+
+/* 索引 idxId 的易失索引, 不存在时新建一个空的, 需要重建之后才能使用 */
+VolatileIndex *OpenVolatileIndex(uint32 idxId);
+
+/* 删除索引 idxId 的易失索引, 调用者保证没有并发访问这个索引 */
+void DropVolatileIndex(uint32 idxId);
+
+/* 按 id 找已经重建好的易失索引, 已经删除或者还没有重建好时返回 nullptr */
+VolatileIndex *GetVolatileIndexById(uint16 id);
+
+}  // namespace NVMDB
+
+#endif  // NVMDB_VOLATILE_INDEX_H
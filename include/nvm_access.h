@@ -30,6 +30,13 @@ HamStatus HeapUpdate2(Transaction *tx, Table *table, RowId rowid, RAMTuple *new_
 
 HamStatus HeapDelete(Transaction *tx, Table *table, RowId rowid);
 
+/*
+ * 通过唯一索引读一行, 返回可见的 RowId, 没有时返回 InvalidRowId.
+ * 覆盖索引直接从索引中取包含列, tuple 中只有包含列有效; 其他索引回表读整行
+ */
+RowId IndexUniqueRead(Transaction *tx, const NVMIndex *index, const Table *table, DRAMIndexTuple *key,
+                      RAMTuple *tuple);
+
 }  // namespace NVMDB
 
 #endif  // NVMDB_HEAP_ACCESS_H
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef NVMDB_CATALOG_H
+#define NVMDB_CATALOG_H
+
+#include "nvm_table.h"
+#include "undo/nvm_undo_record.h"
+
+namespace NVMDB {
+
+class Transaction;
+
+/*
+ * 系统表 (catalog): 持久化表名, 列定义, 行长度和索引定义.
+ * catalog 本身是一张普通的 heap 表, 读写都走 HeapInsert/HeapRead/HeapDelete,
+ * 所以 DDL 和普通事务一样由 undo 保证原子性和崩溃一致性. 建表分配的 segment 和建索引分配的空间
+ * 也记在 undo 中 (TableCreateUndo, IndexCreateUndo), 回滚或崩溃恢复时回收.
+ * 系统表的行对并发事务不可见, 所以建表和建索引还要在 DRAM 中锁住表名和 index id, 同名的表或同 id 的索引
+ * 正在被其他事务创建, 或者在 tx 的快照之后才提交时, 创建失败.
+ * 删表时在同一个事务中写入 DROPPED 行记下表的 segment 和索引, 提交之后回收, 回收完成后删除这一行.
+ * 它的 segment head 登记在 TableSpace 的表目录中 (oid 为 CATALOG_TABLE_OID).
+ * 按名字查找走 DRAM 中的哈希索引, 在 BootStrap 时扫描系统表重建, 读不加锁.
+ * 表的易失索引在第一次打开表时扫描 heap 重建 (见 RebuildVolatileIndexes), 完成后才返回表.
+ */
+static constexpr uint32 CATALOG_TABLE_OID = 0xFFFFFFFF;
+
+static constexpr uint32 NVM_MAX_TABLE_NAME_LEN = NVM_MAX_COLUMN_NAME_LEN;
+
+/* InitDB 时创建空的系统表 */
+void CatalogCreate();
+
+/*
+ * BootStrap 时挂载系统表, 表和索引对象在第一次 CatalogOpenTable 时重建.
+ * 同时完成崩溃前没有做完的表截断 (Table::TruncateSegment), 并回收已经提交删除的表
+ */
+void CatalogBootStrap();
+
+/* 释放 catalog 缓存的 Table 和 NVMIndex 对象 */
+void CatalogExitProcess();
+
+/*
+ * 在 tx 中创建表, 分配 heap segment 并写入表和列的定义, desc 的 col_desc 需要已经设置好偏移量.
+ * 返回的 Table 由 catalog 持有, tx 回滚后被释放. 同名表对 tx 可见, 或者正在被其他事务创建时返回 nullptr.
+ */
+Table *CatalogCreateTable(Transaction *tx, const char *name, TableId tid, const TableDesc &desc);
+
+/*
+ * 在 tx 中为表创建索引, 只使用 indexDesc 和 includeDesc 的 m_colId. includeCnt 不为 0 时创建覆盖索引,
+ * includeDesc 是包含列. type 为 HASH 或者 VOLATILE 时不能有包含列, 易失索引用表中已经提交的行建立.
+ * 返回的 NVMIndex 已经加入 table, tx 回滚时从 table 中移除并释放. idxId 已经被使用 (包括被删除但还没有回收的表使用),
+ * 或者表已经有 31 个索引时返回 nullptr
+ */
+NVMIndex *CatalogCreateIndex(Transaction *tx, Table *table, IndexId idxId, const IndexColumnDesc *indexDesc,
+                             uint32 colCnt, const IndexColumnDesc *includeDesc = nullptr, uint32 includeCnt = 0,
+                             IndexType type = IndexType::PACTREE);
+
+/*
+ * 在 tx 中删除表和索引的定义. heap segment 和索引项不随 tx 回收, tx 提交之后由 CatalogPurgeDroppedTables
+ * 回收, 没有回收的在下次 BootStrap 时回收. 表不存在时返回 false
+ */
+bool CatalogDropTable(Transaction *tx, const char *name);
+
+/*
+ * 回收已经提交删除的表的 segment 和索引, 释放缓存的 Table, 返回回收的表的个数.
+ * 使用当前线程的事务上下文, 调用时不能有进行中的事务. 调用者需保证没有事务还在访问这些表.
+ * 回收过程崩溃后在下次 BootStrap 时继续, 不会重复回收
+ */
+uint32 CatalogPurgeDroppedTables();
+
+/* 按名字打开对 tx 可见的表, 同时重建它的索引. 表不存在时返回 nullptr */
+Table *CatalogOpenTable(Transaction *tx, const char *name);
+
+/* 回滚建表: 释放缓存的 Table 并回收 undo 中记录的 segment */
+void UndoTableCreate(const UndoRecord *undo, UndoRecPtr undoPtr);
+
+/* 回滚建索引: 从缓存的 Table 中移除索引并回收索引的空间 */
+void UndoIndexCreate(const UndoRecord *undo, UndoRecPtr undoPtr);
+
+}  // namespace NVMDB
+
+#endif  // NVMDB_CATALOG_H
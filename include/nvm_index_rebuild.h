@@ -0,0 +1,31 @@
+#ifndef NVMDB_INDEX_REBUILD_H
+#define NVMDB_INDEX_REBUILD_H
+
+#include "nvm_table.h"
+#include <gflags/gflags.h>
+
+namespace NVMDB {
+
+// 每个 NUMA 组重建易失索引的线程数
+DECLARE_int32(index_rebuild_threads_per_group);
+
+struct IndexRebuildStats {
+    uint32 m_indexes = 0;      // 重建的索引个数
+    uint64 m_rows = 0;         // 插入索引的可见行数
+    uint64 m_heapBytes = 0;    // 扫描的 heap 大小, 按 slot 长度计
+    double m_seconds = 0;      // 包括等待 undo 恢复的时间
+};
+
+/*
+ * 重建表中所有还没有重建的易失索引 (IndexType::VOLATILE), 完成后这些索引才能读写.
+ * 先等待 undo 恢复完成, 再按 RowIDMgr 的 extent 并行扫描 heap: 每个 extent 按物理页号归到所在的目录 (NUMA 组),
+ * 每个组 index_rebuild_threads_per_group 个线程, 绑定到这个组并只扫描这个组的 extent,
+ * 每个 extent 一个事务, 对它可见 (已提交且没有删除) 的行插入所有待重建的索引.
+ * tx 不为空时是调用者进行中的事务 (在其中建索引), 它写过的行按它看到的版本插入.
+ * 调用者保证重建期间没有其他事务写这张表; 通过 catalog 打开表或者建索引时自动调用
+ */
+IndexRebuildStats RebuildVolatileIndexes(Table *table, Transaction *tx = nullptr);
+
+}  // namespace NVMDB
+
+#endif  // NVMDB_INDEX_REBUILD_H
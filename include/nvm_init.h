@@ -5,9 +5,14 @@
 
 namespace NVMDB {
 
-/* 创建数据库初始环境 */
+struct UndoSpaceConfig;
+
+/* 创建数据库初始环境, 持久域模式 (ADR/eADR/DRAM) 由 --persist_mode 指定 */
 void InitDB(const std::string& dir);
 
+/* 创建数据库初始环境, 使用指定的 undo 空间配置 */
+void InitDB(const std::string& dir, const UndoSpaceConfig& undoConfig);
+
 /* 数据库启动，进行必要的初始化。 */
 void BootStrap(const std::string& dir);
 
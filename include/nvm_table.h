@@ -51,6 +51,22 @@ public:
     /* 已经建好的表，重启之后需要 mount segment，传参的是 segment 页号 */
     void Mount(uint32 segHead);
 
+    /*
+     * 删除表的所有行并使索引项失效, 回收除 segment head 以外的 extent. 调用者需保证没有并发访问这张表.
+     * 先在 TableSpace 中登记再清空索引和 segment head 中的页号, 最后回收 extent;
+     * 崩溃后重新打开表时由 ResumeTruncate 重做, 不会有行指向已经回收的 extent, 也不会有失效的索引项
+     */
+    void TruncateSegment();
+
+    /* 表的 segment 有崩溃前没有完成的截断时重新截断, 在加入索引之后, 访问表之前调用 */
+    bool ResumeTruncate();
+
+    /*
+     * 删除表的索引树并回收表的整个 segment, 之后表不能再访问. 调用者需先删除表目录或系统表中对 segment 的引用,
+     * 并保证没有并发访问这张表. 回收过程崩溃后在下次 mount 时继续, tag 见 TableSpace::freeSegment
+     */
+    void DropSegment(uint32 tag = 0);
+
     uint32 SegmentHead() const {
         return m_segHead;
     }
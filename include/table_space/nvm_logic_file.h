@@ -1,10 +1,10 @@
 #pragma once
 
 #include "common/nvm_cfg.h"
+#include "common/nvm_persist.h"
 #include "glog/logging.h"
+#include <atomic>
 #include <memory>
-#include <vector>
-#include <x86intrin.h>
 
 namespace NVMDB {
 /*
@@ -26,7 +26,7 @@ public:
     // undo segment 128 in debug
     [[nodiscard]] inline auto getPagesPerSegment() const { return m_pagesPerSegment; }
 
-    /*  segment_addr 数组初始化的时候就设够足够大，否则当数组扩展的时候，会影响并发的读 */
+    /*  segment_addr 数组初始化的时候就设够足够大, 之后不再扩展, 并发读不需要加锁 */
     LogicFile(std::shared_ptr<DirectoryConfig> dirConfig,
               std::string spaceName,
               size_t segmentSize,
@@ -34,16 +34,20 @@ public:
         : m_dirConfig(std::move(dirConfig)),
           m_spaceName(std::move(spaceName)),
           m_segmentSize(segmentSize), // 每个segment的大小, 10M in debug
-          m_pagesPerSegment(segmentSize / NVM_PAGE_SIZE) {
-        m_segmentAddr.reserve(maxSegmentCount);
+          m_pagesPerSegment(segmentSize / NVM_PAGE_SIZE),
+          m_segmentCapacity(maxSegmentCount),
+          m_segmentAddr(new std::atomic<void *>[maxSegmentCount]) {
+        for (size_t i = 0; i < m_segmentCapacity; i++) {
+            m_segmentAddr[i].store(nullptr, std::memory_order_relaxed);
+        }
         CHECK(mMapFile(0, true)) << "Mount failed!";  // create file if not exist
     }
 
-    // 当前已经分配的segment数量
-    inline size_t segmentCount() const { return m_segmentAddr.size(); }
+    // 已经映射过的最大 segment id + 1, 中间可能有未映射的 segment
+    inline size_t segmentCount() const { return m_segmentCount.load(std::memory_order_acquire); }
 
     // 最大支持的segment数量 16 * 1024, store in memory
-    inline size_t segmentCapacity() const { return m_segmentAddr.capacity(); }
+    inline size_t segmentCapacity() const { return m_segmentCapacity; }
 
     // input global page number (for table space)
     void extend(uint32 pageId) {
@@ -52,17 +56,20 @@ public:
 
     void punch(uint32 startSegmentId, uint32 endSegmentId) {
         CHECK(startSegmentId < endSegmentId);
-        for (auto i = startSegmentId; i < endSegmentId; i++) {
-            reMMapFile(i);
-        }
+        punchHole(static_cast<uint64>(startSegmentId) * m_segmentSize,
+                  static_cast<uint64>(endSegmentId - startSegmentId) * m_segmentSize);
     }
 
+    // 释放 [offset, offset + len) 占用的物理空间, 映射保持不变, 之后读到的内容为 0
+    // 不会 remap, 前台线程可以同时访问其他地址; 返回实际释放的字节数
+    size_t punchHole(uint64 offset, uint64 len);
+
     void truncate() { }
 
 protected:
     template <typename T=void*>
     [[nodiscard]] inline T nvmAddrFromSegmentId(uint32 segmentId) const {
-        return reinterpret_cast<T>(m_segmentAddr[segmentId]);
+        return reinterpret_cast<T>(m_segmentAddr[segmentId].load(std::memory_order_acquire));
     }
 
 public:
@@ -76,66 +83,62 @@ public:
     }
 
     void unmount() {
-        for (auto i = 0; i < segmentCount(); i++) {
+        for (size_t i = 0; i < segmentCount(); i++) {
             unMMapFile(i);
         }
-        m_segmentAddr.clear();
+        m_segmentCount.store(0, std::memory_order_release);
     }
 
     // 输入global page号, 返回Logic file中对应的地址
     // return nvm pointer of the segment (the offset of the page with pageId)
+    // segment 还没有映射时 (懒挂载), 在这里映射已经存在的文件
     [[nodiscard]] void* getNvmAddrByPageId(uint32 globalPageId) const {
         auto pagesPerSegment = getPagesPerSegment();
         auto segmentId = globalPageId / pagesPerSegment;
-        CHECK(segmentId < segmentCount()) << "PageId overflow!";
+        CHECK(segmentId < m_segmentCapacity) << "PageId overflow!";
         auto* nvmAddr = nvmAddrFromSegmentId<char*>(segmentId);
+        if (__glibc_unlikely(nvmAddr == nullptr)) {
+            nvmAddr = static_cast<char*>(mapSegment(segmentId, false));
+        }
         CHECK(nvmAddr != nullptr) << "Cannot find nvmAddr by pageId";
         return nvmAddr + static_cast<uint64>(globalPageId % pagesPerSegment) * NVM_PAGE_SIZE;
     }
 
 protected:
-    static inline void flush(const void *src, size_t n) {
-        const auto *s = (const uint8_t *)src;
-        for (size_t i = 0; i < n; i += 64) {
-            _mm_clflushopt((void *)(s + i));
-        }
-    }
-
     static void WriteToNVM(void *dest, const void *src, size_t n) {
         DCHECK(((uintptr_t)src & 0x3F) == 0);    // 64字节对齐
 
         auto *d = (uint8_t *)dest;
         const auto *s = (const uint8_t *)src;
 
-        // 对于大块数据，使用AVX-512指令集
         if (n >= 64) {
             size_t blocks = n / 64;
-            for (size_t i = 0; i < blocks; i++) {
-                // 使用非时序存储加载和写入到NVM，因为之后不会访问这些数据
-                __m512i data = _mm512_stream_load_si512((__m512i *)(s + i * 64));
-                _mm512_storeu_si512((__m512i *)(d + i * 64), data);
-            }
-
-            // 确保所有非时序写入已完成，不清除DRAM缓存行，因为一会要写
-            _mm_sfence();
-            for (size_t i = 0; i < blocks; i++) {
-                // 清除NVM缓存行
-                _mm_clflushopt((void *)(d + i * 64));
+            if (((uintptr_t)d & 0x3F) == 0) {
+                // 使用非时序写入NVM，因为之后不会访问这些数据
+                NVMStreamCopy(d, s, blocks * 64);
+            } else {
+                // 目的地址不对齐时普通写入后清除NVM缓存行
+                memcpy(d, s, blocks * 64);
+                NVMFlush(d, blocks * 64);
             }
+            // 确保所有写入已完成，不清除DRAM缓存行，因为一会要写
+            NVMFence();
 
             // 更新指针位置
             s += blocks * 64;
             d += blocks * 64;
             n -= blocks * 64;
 
-            // 处理剩余字节, 不需要flush，因为之后会追加
+            // 处理剩余字节, 之后追加时会写同一个缓存行, 用 clwb 时刷写不会逐出
             if (n > 0) {
                 memcpy(d, s, n);
+                NVMPersist(d, n);
             }
             return;
         }
-        // 对于小数据，直接复制，并按情况逐出缓存
+        // 对于小数据，直接复制并刷写
         memcpy(d, s, n);
+        NVMPersist(d, n);
     }
 
 public:
@@ -162,6 +165,7 @@ public:
         // copy the rest to pageId + 1
         auto ret = memcpy_no_flush_nt(secondPageAddr, len - segmentSpaceRemain, src + segmentSpaceRemain, len - segmentSpaceRemain);
         SecureRetCheck(ret);
+        NVMWritten(secondPageAddr, len - segmentSpaceRemain);
     }
 
     // 根据虚拟地址读指定长度的片段
@@ -172,6 +176,7 @@ public:
         uint32 offset = vptr % NVM_PAGE_SIZE;
         this->extend(pageId);
         auto* nvmAddr = static_cast<char*>(getNvmAddrByPageId(pageId));
+        NVMReadDelay(nvmAddr + offset, len);
         if (segmentSpaceRemain >= len) {
             errno_t ret = memcpy_no_flush_nt(dst, len, nvmAddr + offset, len);
             SecureRetCheck(ret);
@@ -192,23 +197,37 @@ protected:
     // for undo: undo0
     std::string m_spaceName;
 
-    // for undo seg: 16, store nvmAddr of each segment
-    // segment_addr 数组初始化的时候就设够足够大，否则当数组扩展的时候，会影响并发的读
-    std::vector<void *> m_segmentAddr;
-
     std::shared_ptr<DirectoryConfig> m_dirConfig;
 
     const size_t m_segmentSize;
 
     const size_t m_pagesPerSegment;
 
+    const size_t m_segmentCapacity;
+
+    // for undo seg: 16, store nvmAddr of each segment
+    // 未映射的 segment 为 nullptr, 映射后不会改变, 直到 unmount
+    std::unique_ptr<std::atomic<void *>[]> m_segmentAddr;
+
+    mutable std::atomic<size_t> m_segmentCount {0};
+
 public:
-    // if init is true, the file will be deleted and recreate
-    bool mMapFile(uint32 segmentId, bool init);
+    // create the file if init is true and it does not exist
+    bool mMapFile(uint32 segmentId, bool init) { return mapSegment(segmentId, init) != nullptr; }
 
     void unMMapFile(uint32 segmentId, bool destroy = false);
 
-    void reMMapFile(uint32 segmentId);
+    // 映射 segment (如果文件存在) 并预先建立页表, 避免前台线程第一次访问时缺页
+    void prefault(uint32 segmentId) const;
+
+private:
+    // 返回映射后的地址, 文件不存在且 init 为 false 时返回 nullptr
+    void *mapSegment(uint32 segmentId, bool init) const;
+
+    // 映射 segment 文件, 失败时处理同 mapSegment
+    void *mapSegmentFile(const std::string& fileName, bool init, bool requirePMem) const;
+
+    void unmapAddr(void *nvmAddr) const;
 
 private:
     // for heap: data/heap.0
@@ -3,6 +3,10 @@
 
 #include "table_space/nvm_logic_file.h"
 #include "common/thread_pool_light.h"
+#include "common/nvm_lockfree_hash.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <mutex>
 
 namespace NVMDB {
@@ -51,13 +55,23 @@ struct TableSegMetaData {
     uint32 m_seg;
 };
 
-// 第一个page为tablespace元数据页面，第二个页面为应用根页面
-// 每张表一组文件作为heap, 相互独立
+/*
+ * 第一个page为tablespace元数据页面 (包括表目录)，第二个页面为应用根页面
+ * 每张表一组文件作为heap, 相互独立
+ *
+ * 一个 segment 由 root extent 和之后以它为 rootPageId 分配的 extent 组成, 通过 page header 中的
+ * m_pageList 串成以 root 为头的环形双向链表 (与空闲链表共用这两个字段), 回收时沿链表把 extent 放回空闲链表.
+ * 链表以 prev 方向为准, 每一步的提交点都是一次 4 字节的写.
+ */
 class TableSpace {
 public:
     // 1 GB for release， 10 MB for debug
     static const size_t HEAP_SPACE_SEGMENT_LEN = CompileValue(8 * 1024ULL * 1024 * 1024, 10 * 1024ULL * 1024);
     static const size_t HEAP_SPACE_MAX_SEGMENT_NUM = 2 * 1024; /* 实际中最多16TB */
+    // fastAllocNewExtent 每次为线程预留的 extent 数量
+    static constexpr uint32 EXTENT_RESERVATION_BATCH = 8;
+    // 按目录分区的 DRAM 结构 (锁, 预留槽位的 bitmap 和线程缓存) 的大小, 最多支持16个目录分区
+    static constexpr size_t MAX_DIRECTORY_NUM = 16;
 
     explicit TableSpace(const std::shared_ptr<DirectoryConfig>& dirConfig, bool isInit=false)
         : m_logicFile(dirConfig,
@@ -65,29 +79,42 @@ public:
                       HEAP_SPACE_SEGMENT_LEN,
                       HEAP_SPACE_MAX_SEGMENT_NUM)
           , m_dirConfig(dirConfig) {
-        auto threadPoolLight = std::make_unique<util::thread_pool_light>(m_dirConfig->size() * 7);
-        moodycamel::LightweightSemaphore semaphore(0, 0);
-        auto threadFunc = [&](int idxStart, int idxEnd) {
-            for (int i = idxStart; i < idxEnd; i++) {
-                m_logicFile.mMapFile(i, isInit);
-            }
-            semaphore.signal();
-        };
-        threadPoolLight->push_loop(0, 32, threadFunc);
-        for (auto i=threadPoolLight->get_thread_count(); i>0; i-=(int)semaphore.waitMany((ssize_t)i));
-        threadPoolLight.reset(nullptr);
+        // 只映射第一个 segment (元数据), 其他 segment 在分配或第一次访问时才映射
         // 第一个page存储SpaceMetaData相关信息
         m_spaceMetadata = static_cast<SpaceMetaData *>(m_logicFile.getNvmAddrByPageId(0));
         // 防止SpaceMetaData溢出
-        CHECK(m_dirConfig->size() * sizeof(SpaceMetaData) <= NVM_PAGE_SIZE);
-        // TableMetaData从第二个page开始
-        m_tableMetadata = static_cast<TableMetaData *>(m_logicFile.getNvmAddrByPageId(1));
+        CHECK(m_dirConfig->size() * sizeof(SpaceMetaData) <= SEGMENT_FREE_LOG_OFFSET);
+        CHECK(m_dirConfig->size() <= MAX_DIRECTORY_NUM) << "too many directories for table space";
+        m_segmentFreeLog = reinterpret_cast<SegmentFreeLog *>(reinterpret_cast<char *>(m_spaceMetadata) +
+                                                              SEGMENT_FREE_LOG_OFFSET);
+        // 线程预留的 extent 范围保存在第一个 page 的后半部分
+        m_reservations = reinterpret_cast<ExtentReservation *>(reinterpret_cast<char *>(m_spaceMetadata) +
+                                                               EXTENT_RESERVATION_OFFSET);
+        const auto maxSlots = static_cast<uint32>(EXTENT_RESERVATION_MAX_SLOTS);
+        m_reservationSlots = std::min<uint32>(maxSlots,
+            (TABLE_DIRECTORY_OFFSET - EXTENT_RESERVATION_OFFSET) / (m_dirConfig->size() * sizeof(ExtentReservation)));
+        // 表目录保存在第一个 page 的最后 4K
+        m_tableDirectory = reinterpret_cast<TableDirectory *>(reinterpret_cast<char *>(m_spaceMetadata) +
+                                                              TABLE_DIRECTORY_OFFSET);
+        for (auto &dirBitmap : m_reservationBitmap) {
+            for (auto &bitmap : dirBitmap) {
+                bitmap.store(0, std::memory_order_relaxed);
+            }
+        }
+        m_instanceId = NextInstanceId();
+        // 第二个page留给应用
+        m_rootPage = m_logicFile.getNvmAddrByPageId(1);
     }
 
     [[nodiscard]] inline const auto& getDirConfig() const { return m_dirConfig; }
 
     [[nodiscard]] inline const auto& getLogicFile() const { return m_logicFile; }
 
+    // space num of global physical page num.
+    inline uint32 spaceIdFromGlobalPageId(const uint32& pageId) const {
+        return (pageId / m_logicFile.getPagesPerSegment()) % m_dirConfig->size();
+    }
+
     // 重新初始化tableSpace
     void create() {
         // first two page of space 0 kept as space meta and table meta respectively.
@@ -98,20 +125,62 @@ public:
             getFPLRootPageIdRef(i, EXT_SIZE_2M) = NVMInvalidPageId;
         }
         m_spaceMetadata[0].m_usedPageCount = 2; // HIGH_WATER_MARK
+        PersistMeta(m_spaceMetadata, m_dirConfig->size() * sizeof(SpaceMetaData));
+        m_segmentFreeLog->m_root = NVMInvalidPageId;
+        m_segmentFreeLog->m_transit = NVMInvalidPageId;
+        m_segmentFreeLog->m_keepRoot = 0;
+        m_segmentFreeLog->m_tag = 0;
+        m_segmentFreeLog->m_doneTag = 0;
+        m_segmentFreeLog->m_truncateRoot = NVMInvalidPageId;
+        PersistMeta(m_segmentFreeLog, sizeof(SegmentFreeLog));
+        initTableDirectory();
+        auto reservationSize = m_dirConfig->size() * m_reservationSlots * sizeof(ExtentReservation);
+        errno_t ret = memset_s(m_reservations, reservationSize, 0, reservationSize);
+        SecureRetCheck(ret);
+        PersistMeta(m_reservations, reservationSize);
     }
 
-    // 挂载所有heap相关的文件
+    // 懒挂载: 启动时只需要元数据所在的 segment (构造时已经映射),
+    // 其余 segment 在 getNvmAddrByPageId 第一次访问时映射, 或者由 prefault 在后台提前映射
     void mount() {
-        m_logicFile.mount();
-        // 遍历挂载目录
+        // 先完成崩溃前没有做完的 segment 回收, 这时空闲链表的尾部还是它最后归还的 extent
+        resumeFreeSegment();
+        // 崩溃前线程预留但没有用完的 extent 放回空闲链表
+        for (uint32 spaceId = 0; spaceId < m_dirConfig->size(); spaceId++) {
+            for (uint32 slot = 0; slot < m_reservationSlots; slot++) {
+                auto *reservation = getReservation(spaceId, slot);
+                auto next = reservation->m_next;
+                auto end = reservation->m_end;
+                if (next < end) {
+                    LOG(INFO) << "Repair leaked extent reservation of space " << spaceId << ": [" << next << ", "
+                              << end << ")";
+                    storeReservation(reservation, 0, 0);
+                    returnLocalPages(spaceId, next, end);
+                }
+            }
+        }
+        loadTableDirectory();
+    }
+
+    // 在后台映射并预先建立 hwm 以下所有 segment 的页表, 各目录交替进行; stop 为 true 时提前退出
+    void prefault(const std::atomic<bool>& stop) const {
+        const auto pagesPerSegment = m_logicFile.getPagesPerSegment();
+        uint32 maxLocalSegments = 0;
         for (uint32 i = 0; i < m_dirConfig->size(); i++) {
-            // 获取目录对应的 hwm
-            auto hwm = m_spaceMetadata[i].m_usedPageCount;
-            // mount segments that are smaller than hwm (所以 m_spaceMetadata[0].m_usedPageCount 初始值为2)
-            auto pagesPerSegment = m_logicFile.getPagesPerSegment();
-            for (uint32 j = 0; j * pagesPerSegment <= hwm; j++) {
-                auto pageId = getGlobalPageId(j * pagesPerSegment, i);
-                m_logicFile.extend(pageId); // e.g., space id =0, mount heap.0, space id=1, mount heap.1
+            maxLocalSegments = std::max<uint32>(maxLocalSegments,
+                                                m_spaceMetadata[i].m_usedPageCount / pagesPerSegment + 1);
+        }
+        for (uint32 j = 0; j < maxLocalSegments; j++) {
+            for (uint32 i = 0; i < m_dirConfig->size(); i++) {
+                if (stop.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                // mount segments that are smaller than hwm (所以 m_spaceMetadata[0].m_usedPageCount 初始值为2)
+                if (j * pagesPerSegment > m_spaceMetadata[i].m_usedPageCount) {
+                    continue;
+                }
+                // e.g., space id =0, mount heap.0, space id=1, mount heap.1
+                m_logicFile.prefault(getGlobalPageId(j * pagesPerSegment, i) / pagesPerSegment);
             }
         }
     }
@@ -136,14 +205,71 @@ private:
     // nvm ptr in heap.0 (当有两个目录时候, 其大小为2)
     SpaceMetaData *m_spaceMetadata = nullptr;
 
-    struct TableMetaData {
-        uint32 m_tableNum;
-        TableSegMetaData m_segHeads[0];
+    // 应用根页面, 即第二个 page
+    void *m_rootPage = nullptr;
+
+    // 表目录: oid -> segment head 的槽位存放在 2M extent 中, 表目录记录这些 extent 和空闲槽位链表.
+    // 空闲槽位的 m_seg 为 NVMInvalidPageId, m_oid 为下一个空闲槽位号 + 1
+    struct TableDirectory {
+        uint64 m_magic;
+        uint32 m_slotNum;    // 已经使用过的槽位数 (高水位)
+        uint32 m_freeSlot;   // 空闲槽位链表头, 槽位号 + 1, 0 表示链表为空
+        uint32 m_extentNum;
+        uint32 m_extents[0];
     };
-    // nvm ptr + blksize in heap.0
-    TableMetaData *m_tableMetadata = nullptr;
+    static constexpr size_t TABLE_DIRECTORY_OFFSET = 4096;
+    static constexpr uint64 TABLE_DIRECTORY_MAGIC = 0x4e564d4454424c53;
+    TableDirectory *m_tableDirectory = nullptr;
     std::mutex m_tableMetadataMutex;
-    std::mutex m_usedPageMutex[16]; // 最多支持16个目录分区
+    // oid -> 槽位号, 挂载时根据表目录重建, 读不加锁
+    LockFreeHashMap m_oidMap;
+    std::mutex m_usedPageMutex[MAX_DIRECTORY_NUM];
+    // 串行化同一个 segment 链表的修改, 按 root 的页号分片
+    static constexpr uint32 SEGMENT_LOCK_BITS = 6;
+    std::mutex m_segmentMutex[1U << SEGMENT_LOCK_BITS];
+
+    // 正在回收的 segment, 持久化在第一个 page 中, 重启时据此继续回收.
+    // m_transit 为正在从 segment 链表移到空闲链表的 extent; m_tag 为调用者给这次回收的标记,
+    // 完成时记入 m_doneTag. m_truncateRoot 为正在截断的 segment, 见 truncateSegment
+    struct SegmentFreeLog {
+        uint32 m_root;
+        uint32 m_transit;
+        uint32 m_keepRoot;
+        uint32 m_tag;
+        uint32 m_doneTag;
+        uint32 m_truncateRoot;
+    };
+    static constexpr size_t SEGMENT_FREE_LOG_OFFSET = 1000;
+    SegmentFreeLog *m_segmentFreeLog = nullptr;
+    std::mutex m_freeSegmentMutex;
+    std::mutex m_truncateMutex;
+
+    // 线程预留但还没有用完的 extent 范围 [m_next, m_end), 为目录内的 local page id.
+    // 每个目录 m_reservationSlots 个, 持久化在第一个 page 中, 重启时据此回收泄漏的预留
+    struct ExtentReservation {
+        uint32 m_next;
+        uint32 m_end;
+    };
+    static constexpr size_t EXTENT_RESERVATION_OFFSET = 1024;
+    static_assert(SEGMENT_FREE_LOG_OFFSET + sizeof(SegmentFreeLog) <= EXTENT_RESERVATION_OFFSET, "");
+    static constexpr uint32 EXTENT_RESERVATION_MAX_SLOTS = 128;
+    static constexpr uint32 BITMAP_BITS = 64;
+    ExtentReservation *m_reservations = nullptr;
+    uint32 m_reservationSlots = 0;
+    // DRAM 中记录哪些槽位已经分配给了线程
+    std::atomic<uint64> m_reservationBitmap[MAX_DIRECTORY_NUM][EXTENT_RESERVATION_MAX_SLOTS / BITMAP_BITS];
+
+    // 线程持有的每个目录的槽位, m_instanceId 不同说明是之前挂载的 TableSpace 留下的
+    struct ThreadReservationCache {
+        uint64 m_instanceId = 0;
+        int32 m_slot[MAX_DIRECTORY_NUM] = {};
+    };
+    uint64 m_instanceId = 0;
+
+    static uint64 NextInstanceId() {
+        static std::atomic<uint64> g_instanceId {0};
+        return g_instanceId.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
 
     std::shared_ptr<DirectoryConfig> m_dirConfig;
 
@@ -174,6 +300,7 @@ protected:
             DCHECK(headNode.next == headPageId);
             auto ret = headPageId;
             headPageId = NVMInvalidPageId;
+            PersistMeta(&headPageId, sizeof(uint32));
             return ret;
         }
 
@@ -182,18 +309,21 @@ protected:
         auto& tailPrev = getFPLNode(tailNode.prev)->m_pageList;
         auto ret = headNode.prev;
         headNode.prev = tailNode.prev;
+        PersistMeta(&headNode.prev, sizeof(uint32));
         tailPrev.next = headPageId;
+        PersistMeta(&tailPrev.next, sizeof(uint32));
         return ret;
     }
 
     void pushFPLNode(uint32 extentPageId, uint32& headPageId) {
         if (isFPLEmpty(headPageId)) {
-            // freePageList 链表为空
+            // freePageList 链表为空, 初始化双向链表, rootPageId 作为 head
+            auto& headNode = getFPLNode(extentPageId)->m_pageList;
+            headNode.next = extentPageId;
+            headNode.prev = extentPageId;
+            PersistMeta(&headNode, sizeof(headNode));
             headPageId = extentPageId;
-            // 初始化双向链表, rootPageId 作为 head
-            auto& headNode = getFPLNode(headPageId)->m_pageList;
-            headNode.next = headPageId;
-            headNode.prev = headPageId;
+            PersistMeta(&headPageId, sizeof(uint32));
             return;
         }
         // 将 rootPageId push 到 rootPageId 后, 形成双向链表
@@ -202,8 +332,11 @@ protected:
         auto& newNode = getFPLNode(extentPageId)->m_pageList;
         newNode.prev = headNode.prev;
         newNode.next = headPageId;
+        PersistMeta(&newNode, sizeof(newNode));
         tailNode.next = extentPageId;
+        PersistMeta(&tailNode.next, sizeof(uint32));
         headNode.prev = extentPageId;
+        PersistMeta(&headNode.prev, sizeof(uint32));
     }
 
     // 根据目录本地的pageId和挂载目录的Id推导出全局PageId
@@ -216,9 +349,323 @@ protected:
         return globalPageId;
     }
 
-    // space num of global physical page num.
-    inline uint32 spaceIdFromGlobalPageId(const uint32& pageId) {
-        return (pageId / m_logicFile.getPagesPerSegment()) % m_dirConfig->size();
+    static inline void PersistMeta(const void *addr, size_t len) {
+        PersistTagScope tag(PersistTag::META);
+        NVMPersist(addr, len);
+    }
+
+    static inline uint32 TableSlotsPerExtent() {
+        return GetExtentSize(EXT_SIZE_2M) / sizeof(TableSegMetaData);
+    }
+
+    static inline uint32 MaxTableExtents() {
+        return (NVM_PAGE_SIZE - TABLE_DIRECTORY_OFFSET - sizeof(TableDirectory)) / sizeof(uint32);
+    }
+
+    // 槽位按 8 字节原子读写, 读者不会看到只写了一半的 oid 和 segment head
+    inline std::atomic<uint64> *getTableSlot(uint32 slot) const {
+        const auto slotsPerExtent = TableSlotsPerExtent();
+        DCHECK(slot / slotsPerExtent < m_tableDirectory->m_extentNum);
+        auto *extent = GetExtentAddr(getNvmAddrByPageId(m_tableDirectory->m_extents[slot / slotsPerExtent]));
+        static_assert(sizeof(TableSegMetaData) == sizeof(uint64), "");
+        return reinterpret_cast<std::atomic<uint64> *>(extent) + slot % slotsPerExtent;
+    }
+
+    inline TableSegMetaData loadTableSlot(uint32 slot) const {
+        auto value = getTableSlot(slot)->load(std::memory_order_acquire);
+        return TableSegMetaData{static_cast<uint32>(value), static_cast<uint32>(value >> 32)};
+    }
+
+    inline void storeTableSlot(uint32 slot, uint32 oid, uint32 seg) const {
+        auto *addr = getTableSlot(slot);
+        addr->store(static_cast<uint64>(seg) << 32 | oid, std::memory_order_release);
+        PersistMeta(addr, sizeof(uint64));
+    }
+
+    void initTableDirectory() {
+        m_tableDirectory->m_slotNum = 0;
+        m_tableDirectory->m_freeSlot = 0;
+        m_tableDirectory->m_extentNum = 0;
+        m_tableDirectory->m_magic = TABLE_DIRECTORY_MAGIC;
+        PersistMeta(m_tableDirectory, sizeof(TableDirectory));
+        m_oidMap.clear();
+    }
+
+    // 挂载时扫描所有槽位重建 m_oidMap, 同时重建空闲槽位链表 (崩溃可能导致空闲槽位不在链表中)
+    void loadTableDirectory() {
+        if (m_tableDirectory->m_magic != TABLE_DIRECTORY_MAGIC) {
+            initTableDirectory();
+            return;
+        }
+        m_oidMap.clear();
+        uint32 freeSlot = 0;
+        // 倒序遍历, 让编号小的空闲槽位先被复用
+        for (uint32 slot = m_tableDirectory->m_slotNum; slot-- > 0;) {
+            auto meta = loadTableSlot(slot);
+            if (NVMPageIdIsValid(meta.m_seg)) {
+                m_oidMap.insert(meta.m_oid, slot);
+                continue;
+            }
+            if (meta.m_oid != freeSlot) {
+                storeTableSlot(slot, freeSlot, NVMInvalidPageId);
+            }
+            freeSlot = slot + 1;
+        }
+        m_tableDirectory->m_freeSlot = freeSlot;
+        PersistMeta(&m_tableDirectory->m_freeSlot, sizeof(uint32));
+    }
+
+    // 需持有 m_tableMetadataMutex. 优先复用空闲槽位, 否则推进高水位, 必要时为表目录申请新的 extent
+    uint32 allocTableSlot() {
+        auto *dir = m_tableDirectory;
+        if (dir->m_freeSlot != 0) {
+            uint32 slot = dir->m_freeSlot - 1;
+            dir->m_freeSlot = loadTableSlot(slot).m_oid;
+            PersistMeta(&dir->m_freeSlot, sizeof(uint32));
+            return slot;
+        }
+        uint32 slot = dir->m_slotNum;
+        if (slot / TableSlotsPerExtent() >= dir->m_extentNum) {
+            CHECK(dir->m_extentNum < MaxTableExtents()) << "Too many tables!";
+            dir->m_extents[dir->m_extentNum] = allocNewExtent(EXT_SIZE_2M);
+            PersistMeta(&dir->m_extents[dir->m_extentNum], sizeof(uint32));
+            dir->m_extentNum++;
+            PersistMeta(&dir->m_extentNum, sizeof(uint32));
+        }
+        dir->m_slotNum++;
+        PersistMeta(&dir->m_slotNum, sizeof(uint32));
+        return slot;
+    }
+
+    inline ExtentReservation *getReservation(uint32 spaceId, uint32 slot) const {
+        return m_reservations + spaceId * m_reservationSlots + slot;
+    }
+
+    // m_next 和 m_end 一起原子地写入 NVM
+    static inline void storeReservation(ExtentReservation *reservation, uint32 next, uint32 end) {
+        static_assert(sizeof(ExtentReservation) == sizeof(uint64), "");
+        reinterpret_cast<std::atomic<uint64> *>(reservation)->store(static_cast<uint64>(end) << 32 | next,
+                                                                    std::memory_order_release);
+        PersistMeta(reservation, sizeof(uint64));
+    }
+
+    /*
+     * 用 CAS 推进目录的水位线, 在同一个 segment 内预留 minPages 的整数倍 (最多 maxPages) 个 page,
+     * 返回起始的 local page id 和预留的 page 数. 当前 segment 剩余不足 minPages 时跳过剩余部分,
+     * 跳过的 page 数通过 skipped 返回.
+     */
+    std::pair<uint32, uint32> reserveLocalPages(uint32 spaceId, uint32 minPages, uint32 maxPages,
+                                                uint32 *skipped = nullptr) {
+        const auto pagesPerSegment = m_logicFile.getPagesPerSegment();
+        auto *hwm = reinterpret_cast<std::atomic<uint32> *>(&m_spaceMetadata[spaceId].m_usedPageCount);
+        uint32 used = hwm->load(std::memory_order_relaxed);
+        uint32 start;
+        uint32 count;
+        uint32 skip;
+        do {
+            skip = 0;
+            uint32 restPages = pagesPerSegment - used % pagesPerSegment;
+            if (restPages < minPages) {
+                // 这样做会存在部分page未完全利用的情况
+                skip = restPages;
+                restPages = pagesPerSegment;
+            }
+            start = used + skip;
+            count = std::min(maxPages, restPages) / minPages * minPages;
+        } while (!hwm->compare_exchange_weak(used, start + count, std::memory_order_acq_rel));
+        // 水位线先落盘, 再由调用者记录预留范围或使用 extent, 崩溃后不会把已经交出去的 page 再分配一次
+        PersistMeta(hwm, sizeof(uint32));
+        if (skipped != nullptr) {
+            *skipped = skip;
+        }
+        // 挂载预留范围所在的 segment, 以及之后的 segment
+        m_logicFile.mMapFile(getGlobalPageId(start, spaceId) / pagesPerSegment, true);
+        m_logicFile.mMapFile(getGlobalPageId(start + count, spaceId) / pagesPerSegment, true);
+        return {start, count};
+    }
+
+    // 归还 [begin, end) 范围的 local pages: 仍在水位线末尾时直接回退水位线, 否则放入空闲链表
+    void returnLocalPages(uint32 spaceId, uint32 begin, uint32 end) {
+        auto *hwm = reinterpret_cast<std::atomic<uint32> *>(&m_spaceMetadata[spaceId].m_usedPageCount);
+        uint32 expected = end;
+        if (hwm->compare_exchange_strong(expected, begin, std::memory_order_acq_rel)) {
+            PersistMeta(hwm, sizeof(uint32));
+            return;
+        }
+        std::lock_guard<std::mutex> lockGuard(m_usedPageMutex[spaceId]);
+        // 预留范围在同一个 segment 内, 可以按 EXT_SIZE_2M 切分, 剩余部分按 EXT_SIZE_8K 归还
+        for (uint32 i = begin; i < end;) {
+            auto sizeType = end - i >= GetPageCountPerExtent(EXT_SIZE_2M) ? EXT_SIZE_2M : EXT_SIZE_8K;
+            auto pageId = getGlobalPageId(i, spaceId);
+            auto *pageNode = getFPLNode(pageId);
+            pageNode->m_pageId = pageId;
+            pageNode->m_pageSize = sizeType;
+            PersistMeta(pageNode, sizeof(NVMPageHeader));
+            pushFPLNode(pageId, getFPLRootPageIdRef(spaceId, sizeType));
+            i += GetPageCountPerExtent(sizeType);
+        }
+    }
+
+    ThreadReservationCache &getThreadReservationCache() const {
+        static thread_local ThreadReservationCache t_cache;
+        if (t_cache.m_instanceId != m_instanceId) {
+            t_cache.m_instanceId = m_instanceId;
+            std::fill(std::begin(t_cache.m_slot), std::end(t_cache.m_slot), -1);
+        }
+        return t_cache;
+    }
+
+    // 返回当前线程在 spaceId 下的预留槽位, 槽位用完时返回 nullptr
+    ExtentReservation *acquireThreadReservation(uint32 spaceId) {
+        auto &cache = getThreadReservationCache();
+        if (cache.m_slot[spaceId] >= 0) {
+            return getReservation(spaceId, cache.m_slot[spaceId]);
+        }
+        for (uint32 slot = 0; slot < m_reservationSlots; slot++) {
+            auto &bitmap = m_reservationBitmap[spaceId][slot / BITMAP_BITS];
+            auto mask = 1ULL << (slot % BITMAP_BITS);
+            if ((bitmap.fetch_or(mask, std::memory_order_acq_rel) & mask) == 0) {
+                cache.m_slot[spaceId] = static_cast<int32>(slot);
+                return getReservation(spaceId, slot);
+            }
+        }
+        return nullptr;
+    }
+
+    // 初始化新分配的 extent 的 page header, 从空闲链表复用的 extent 需要清零
+    void initExtent(uint32 pageId, ExtentSizeType sizeType, bool zero) {
+        auto* pageNode = getFPLNode(pageId);
+        pageNode->m_pageId = pageId;
+        pageNode->m_pageSize = sizeType;
+        if (zero) {
+            // 例如一起分配了 256 个 pages, 仅第一个 page 有 header, 其他 pages 均为0
+            char *content = GetExtentAddr(pageNode);
+            int ret = memset_s(content, GetExtentSize(sizeType), 0, GetExtentSize(sizeType));
+            SecureRetCheck(ret);
+            NVMPersist(content, GetExtentSize(sizeType));
+        }
+        PersistMeta(pageNode, sizeof(NVMPageHeader));
+    }
+
+    // 先不加锁检查一次, 空闲链表为空时不用加锁
+    uint32 popFreeExtent(uint32 spaceId, ExtentSizeType sizeType) {
+        auto& headPageId = getFPLRootPageIdRef(spaceId, sizeType);
+        if (isFPLEmpty(reinterpret_cast<std::atomic<uint32> &>(headPageId).load(std::memory_order_relaxed))) {
+            return NVMInvalidPageId;
+        }
+        std::lock_guard<std::mutex> lockGuard(m_usedPageMutex[spaceId]);
+        return popFPLNode(headPageId);
+    }
+
+    // 将 extent 放回所在目录的空闲链表. mayBePushed 为 true 时, 如果它已经在链表尾部 (崩溃前已经放回) 则跳过
+    void pushFreeExtent(uint32 pageId, bool mayBePushed = false) {
+        auto spaceId = spaceIdFromGlobalPageId(pageId);
+        auto sizeType = static_cast<ExtentSizeType>(getFPLNode(pageId)->m_pageSize);
+        std::lock_guard<std::mutex> lockGuard(m_usedPageMutex[spaceId]);
+        auto& headPageId = getFPLRootPageIdRef(spaceId, sizeType);
+        if (mayBePushed && !isFPLEmpty(headPageId) && getFPLNode(headPageId)->m_pageList.prev == pageId) {
+            return;
+        }
+        pushFPLNode(pageId, headPageId);
+    }
+
+    // root 为 rootPageId 的 segment 链表的锁. root 按 extent 对齐, 乘法哈希取高位打散
+    std::mutex &segmentMutex(uint32 rootPageId) {
+        return m_segmentMutex[(rootPageId * 2654435761U) >> (32 - SEGMENT_LOCK_BITS)];
+    }
+
+    // 把新分配的 extent 加入 rootPageId 所在 segment 的链表, rootPageId 无效时 extent 自己成为 root
+    void linkSegmentExtent(uint32 rootPageId, uint32 extentPageId) {
+        if (!NVMPageIdIsValid(rootPageId)) {
+            auto& node = getFPLNode(extentPageId)->m_pageList;
+            node.prev = extentPageId;
+            node.next = extentPageId;
+            PersistMeta(&node, sizeof(node));
+            return;
+        }
+        std::lock_guard<std::mutex> lockGuard(segmentMutex(rootPageId));
+        auto& rootNode = getFPLNode(rootPageId)->m_pageList;
+        if (!NVMPageIdIsValid(rootNode.prev)) {
+            // 旧版本分配的 root 没有初始化链表
+            rootNode.prev = rootPageId;
+            rootNode.next = rootPageId;
+            PersistMeta(&rootNode, sizeof(rootNode));
+        }
+        uint32 headPageId = rootPageId;
+        pushFPLNode(extentPageId, headPageId);
+    }
+
+    // 把 extent 从 root 为 rootPageId 的 segment 链表中摘下
+    void unlinkSegmentExtent(uint32 rootPageId, uint32 extentPageId) {
+        std::lock_guard<std::mutex> lockGuard(segmentMutex(rootPageId));
+        auto& node = getFPLNode(extentPageId)->m_pageList;
+        if (!NVMPageIdIsValid(node.prev) || node.prev == extentPageId) {
+            return;
+        }
+        auto& nextNode = getFPLNode(node.next)->m_pageList;
+        nextNode.prev = node.prev;
+        PersistMeta(&nextNode.prev, sizeof(uint32));
+        auto& prevNode = getFPLNode(node.prev)->m_pageList;
+        prevNode.next = node.next;
+        PersistMeta(&prevNode.next, sizeof(uint32));
+    }
+
+    // 开始回收 rootPageId 对应的 segment, 需持有 m_freeSegmentMutex
+    void freeSegmentExtents(uint32 rootPageId, bool keepRoot, uint32 tag = 0) {
+        DCHECK(NVMPageIdIsValid(rootPageId));
+        auto *log = m_segmentFreeLog;
+        DCHECK(!NVMPageIdIsValid(log->m_root));
+        log->m_transit = NVMInvalidPageId;
+        log->m_keepRoot = keepRoot ? 1 : 0;
+        log->m_tag = tag;
+        PersistMeta(log, sizeof(SegmentFreeLog));
+        log->m_root = rootPageId;
+        PersistMeta(&log->m_root, sizeof(uint32));
+        resumeFreeSegment();
+    }
+
+    /*
+     * 从 segment 链表的尾部逐个摘下 extent 放回空闲链表, 最后放回 root (或者只保留 root).
+     * 每个 extent 先记在 m_transit 中, 崩溃后重做时已经摘下但不确定是否放回的 extent 不会重复放回.
+     * 在 mount 时调用或者需持有 m_freeSegmentMutex.
+     */
+    void resumeFreeSegment() {
+        auto *log = m_segmentFreeLog;
+        const uint32 rootPageId = log->m_root;
+        if (!NVMPageIdIsValid(rootPageId)) {
+            return;
+        }
+        auto& rootNode = getFPLNode(rootPageId)->m_pageList;
+        if (log->m_transit != rootPageId) {
+            if (NVMPageIdIsValid(log->m_transit) && rootNode.prev != log->m_transit) {
+                pushFreeExtent(log->m_transit, true);
+            }
+            // 旧版本分配的 root 没有链表, 只能回收 root 本身
+            while (NVMPageIdIsValid(rootNode.prev) && rootNode.prev != rootPageId) {
+                const uint32 extentPageId = rootNode.prev;
+                log->m_transit = extentPageId;
+                PersistMeta(&log->m_transit, sizeof(uint32));
+                unlinkSegmentExtent(rootPageId, extentPageId);
+                pushFreeExtent(extentPageId);
+            }
+        }
+        if (log->m_keepRoot != 0) {
+            rootNode.prev = rootPageId;
+            rootNode.next = rootPageId;
+            PersistMeta(&rootNode, sizeof(rootNode));
+        } else {
+            log->m_transit = rootPageId;
+            PersistMeta(&log->m_transit, sizeof(uint32));
+            pushFreeExtent(rootPageId, true);
+        }
+        if (log->m_tag != 0) {
+            log->m_doneTag = log->m_tag;
+            PersistMeta(&log->m_doneTag, sizeof(uint32));
+        }
+        log->m_root = NVMInvalidPageId;
+        PersistMeta(&log->m_root, sizeof(uint32));
+        log->m_transit = NVMInvalidPageId;
+        PersistMeta(&log->m_transit, sizeof(uint32));
     }
 
 public:
@@ -226,7 +673,7 @@ public:
     [[nodiscard]] inline auto getUsedPageCount(uint32 spaceId=0) const { return m_spaceMetadata[spaceId].m_usedPageCount; }
 
     // 返回 root page address in NVM
-    [[nodiscard]] inline void *getTableMetadataPage() const { return reinterpret_cast<void *>(m_tableMetadata); }
+    [[nodiscard]] inline void *getTableMetadataPage() const { return m_rootPage; }
 
     [[nodiscard]] inline char* getNvmAddrByPageId(uint32 globalPageId) const {
         return static_cast<char *>(m_logicFile.getNvmAddrByPageId(globalPageId));
@@ -243,144 +690,197 @@ public:
         auto newPageId = popFPLNode(extPageId);
         if (isFPLEmpty(newPageId)) {
             // 当前 FreePageLists 为空, 分配一组新的 extent
-            const auto pagePerSegment = m_logicFile.getPagesPerSegment();
-            // 当前 segment 中已用多少 page, 同时也是下一个 page 的 local page id
-            auto& totalUsedPages = m_spaceMetadata[spaceId].m_usedPageCount;
-            // 1. 计算当前segment中剩余page的数量
-            const auto restPages = pagePerSegment - totalUsedPages % pagePerSegment;
             // EXT_SIZE_2M需要256个page, 而EXT_SIZE_8k只需要1个page
-            // 当前 segment 中的 page 数量不足以提供给 FreePageLists 链表
             const auto pagePerSeg = GetPageCountPerExtent(sizeType);
-            if (restPages < pagePerSeg) {
-                // The new extent of EXT_SIZE_2M should be in one segment.
-                // 如果是EXT_SIZE_2M, 将这些未分配的 pages 插入对应分区的 EXT_SIZE_8K 链表中
-                for (int i = 0; i < restPages; i++) {   // EXT_SIZE_8K 不会进入这个循环
-                    auto tmpPageId = getGlobalPageId(totalUsedPages + i, spaceId);
-                    // 获取 EXT_SIZE_8K 的 freePageList 链表
-                    auto& ext8kHeadPageId = getFPLRootPageIdRef(spaceId, EXT_SIZE_8K);
-                    pushFPLNode(tmpPageId, ext8kHeadPageId);
-                }
-                // 标记这些 page 已经被分配
-                totalUsedPages += restPages;
-                CHECK(totalUsedPages % pagePerSegment == 0) << "Start from a new segment failed!";
+            uint32 skipped = 0;
+            // 水位线通过 CAS 推进, 与 fastAllocNewExtent 并发时不需要额外的锁
+            auto localPageId = reserveLocalPages(spaceId, pagePerSeg, pagePerSeg, &skipped).first;
+            // The new extent of EXT_SIZE_2M should be in one segment.
+            // 如果是EXT_SIZE_2M, 将跳过的 pages 插入对应分区的 EXT_SIZE_8K 链表中
+            auto& ext8kHeadPageId = getFPLRootPageIdRef(spaceId, EXT_SIZE_8K);
+            for (uint32 i = localPageId - skipped; i < localPageId; i++) {   // EXT_SIZE_8K 不会进入这个循环
+                pushFPLNode(getGlobalPageId(i, spaceId), ext8kHeadPageId);
             }
             // 根据分区的 page 水位线得到分配前的 全局Page ID (因为之前pageId == NVMInvalidPageId)
-            newPageId = getGlobalPageId(totalUsedPages, spaceId);
+            newPageId = getGlobalPageId(localPageId, spaceId);
             DCHECK(!isFPLEmpty(newPageId));
-            // 计算并挂载对应分配后的 segment id
-            uint32 nextSegmentId = getGlobalPageId(totalUsedPages + pagePerSeg, spaceId) / pagePerSegment;
-            m_logicFile.mMapFile(nextSegmentId, true);
-            // 最后更新分配这些 pages 后的水位线
-            totalUsedPages += GetPageCountPerExtent(sizeType);
         }
         m_usedPageMutex[spaceId].unlock();
-        // 初始化这个 page id 对应的 page
-        auto* pageNode = getFPLNode(newPageId);
-        pageNode->m_pageId = newPageId;
-        pageNode->m_pageSize = sizeType;
-        // 将剩余部分初始化为 0 (注意, 例如一起分配了 256 个 pages, 仅第一个 page 有 header, 其他 pages 均为0)
-        char *content = GetExtentAddr(pageNode);
-        int ret = memset_s(content, GetExtentSize(sizeType), 0, GetExtentSize(sizeType));
-        SecureRetCheck(ret);
+        // 初始化这个 page id 对应的 page, 将剩余部分初始化为 0
+        initExtent(newPageId, sizeType, true);
+        linkSegmentExtent(rootPageId, newPageId);
         return newPageId;
     }
 
+    /*
+     * 优先复用空闲链表中回收的 extent (清零后返回), 空闲链表为空时从当前线程预留的 extent 中分配;
+     * 预留用完时用 CAS 推进水位线再预留一批, 这个过程不加锁. 水位线以上的 extent 本来就是 0, 不需要清零
+     */
     uint32 fastAllocNewExtent(ExtentSizeType sizeType, uint32 rootPageId, uint32 spaceIdHint) {
         const auto spaceId = spaceIdHint % m_dirConfig->size();
-        // 当前 FreePageLists 为空, 分配一组新的 extent
-        const auto pagePerSegment = m_logicFile.getPagesPerSegment();
+        auto reusedPageId = popFreeExtent(spaceId, sizeType);
+        if (!isFPLEmpty(reusedPageId)) {
+            initExtent(reusedPageId, sizeType, true);
+            linkSegmentExtent(rootPageId, reusedPageId);
+            return reusedPageId;
+        }
         const auto pagePerSeg = GetPageCountPerExtent(sizeType);
-        m_usedPageMutex[spaceId].lock();
-        auto totalUsedPages = m_spaceMetadata[spaceId].m_usedPageCount;
-        const auto restPages = pagePerSegment - totalUsedPages % pagePerSegment;
-        if (restPages < pagePerSeg) {
-            // 这样做会存在部分page未完全利用的情况
-            totalUsedPages += restPages;
-        }
-        auto newPageId = getGlobalPageId(totalUsedPages, spaceId);
-        uint32 nextSegmentId = getGlobalPageId(totalUsedPages + pagePerSeg, spaceId) / pagePerSegment;
-        m_logicFile.mMapFile(nextSegmentId, true);
-        totalUsedPages += pagePerSeg;
-        m_spaceMetadata[spaceId].m_usedPageCount = totalUsedPages; // 写回到NVM
-        m_usedPageMutex[spaceId].unlock();
+        uint32 localPageId;
+        // 预留跨过 segment 末尾时跳过的 page 放回空闲链表, 否则这部分空间永远不会再被使用
+        uint32 skipped = 0;
+        auto *reservation = acquireThreadReservation(spaceId);
+        if (reservation == nullptr) {
+            // 槽位用完了, 直接从水位线分配一个 extent
+            localPageId = reserveLocalPages(spaceId, pagePerSeg, pagePerSeg, &skipped).first;
+            if (skipped != 0) {
+                returnLocalPages(spaceId, localPageId - skipped, localPageId);
+            }
+        } else {
+            auto next = reservation->m_next;
+            auto end = reservation->m_end;
+            if (end - next < pagePerSeg) {
+                // 先清空槽位再归还, 崩溃时最多泄漏, 不会重复回收
+                storeReservation(reservation, 0, 0);
+                if (next < end) {
+                    returnLocalPages(spaceId, next, end);
+                }
+                auto range = reserveLocalPages(spaceId, pagePerSeg, EXTENT_RESERVATION_BATCH * pagePerSeg, &skipped);
+                next = range.first;
+                end = range.first + range.second;
+                if (skipped != 0) {
+                    returnLocalPages(spaceId, next - skipped, next);
+                }
+            }
+            localPageId = next;
+            // 先持久化预留的进度, 再把 extent 交给调用者
+            storeReservation(reservation, next + pagePerSeg, end);
+        }
+        auto newPageId = getGlobalPageId(localPageId, spaceId);
 
         // 初始化这个 page id 对应的 page
-        auto* pageNode = getFPLNode(newPageId);
-        pageNode->m_pageId = newPageId;
-        pageNode->m_pageSize = sizeType;
+        initExtent(newPageId, sizeType, false);
+        linkSegmentExtent(rootPageId, newPageId);
         return newPageId;
     }
 
-    // 会把 *pageId 对应的page回收，并且*pageId 置为 NULL。一般不会掉这个函数，直接调用freeSegment
-    void freeExtent(uint32* pageId) {
-        std::lock_guard<std::mutex> guard(m_tableMetadataMutex);
-        auto* pageNode = getFPLNode(*pageId);
-        DCHECK(*pageId == pageNode->m_pageId);
-        // 找到 page 对应的 free list 链表
-        auto spaceId = spaceIdFromGlobalPageId(*pageId);
-        std::lock_guard<std::mutex> lg (m_usedPageMutex[spaceId]);
-        auto sizeType = static_cast<ExtentSizeType>(pageNode->m_pageSize);
-        auto& extHeadPageId = getFPLRootPageIdRef(spaceId, sizeType);
-        // 将 page extent 插入链表
-        pushFPLNode(*pageId, extHeadPageId);
+    // 线程退出时调用, 归还当前线程预留但没有用完的 extent
+    void releaseThreadReservations() {
+        auto &cache = getThreadReservationCache();
+        for (uint32 spaceId = 0; spaceId < m_dirConfig->size(); spaceId++) {
+            if (cache.m_slot[spaceId] < 0) {
+                continue;
+            }
+            auto slot = static_cast<uint32>(cache.m_slot[spaceId]);
+            auto *reservation = getReservation(spaceId, slot);
+            auto next = reservation->m_next;
+            auto end = reservation->m_end;
+            storeReservation(reservation, 0, 0);
+            if (next < end) {
+                returnLocalPages(spaceId, next, end);
+            }
+            m_reservationBitmap[spaceId][slot / BITMAP_BITS].fetch_and(~(1ULL << (slot % BITMAP_BITS)),
+                                                                      std::memory_order_acq_rel);
+            cache.m_slot[spaceId] = -1;
+        }
+    }
+
+    // 会把 *pageId 对应的page回收，并且*pageId 置为 NULL。一般不会掉这个函数，直接调用freeSegment.
+    // rootPageId 为它所在 segment 的 root, 不能用来回收还有其他 extent 的 segment root
+    void freeExtent(uint32* pageId, uint32 rootPageId) {
+        DCHECK(*pageId == getFPLNode(*pageId)->m_pageId);
+        // 先从 segment 链表中摘下, 再放回所在目录的空闲链表
+        unlinkSegmentExtent(rootPageId, *pageId);
+        pushFreeExtent(*pageId);
         *pageId = NVMInvalidPageId;
     }
 
-    // rootPageId 对应一个segment 的 root，回收整个 segment，并且置 *rootPageId 为null
-    void freeSegment(uint32* rootPageId) {
-        CHECK(false);
+    // rootPageId 对应一个segment 的 root，回收整个 segment，并且置 *rootPageId 为null.
+    // 调用者需保证 segment 不再被访问; 崩溃后 mount 时继续回收.
+    // tag 不为 0 时, 回收完成后 lastFreedSegmentTag 返回它, 调用者据此判断崩溃前是否已经回收
+    void freeSegment(uint32* rootPageId, uint32 tag = 0) {
+        std::lock_guard<std::mutex> lockGuard(m_freeSegmentMutex);
+        freeSegmentExtents(*rootPageId, false, tag);
+        // 没有完成的截断随 segment 一起结束
+        if (m_segmentFreeLog->m_truncateRoot == *rootPageId) {
+            m_segmentFreeLog->m_truncateRoot = NVMInvalidPageId;
+            PersistMeta(&m_segmentFreeLog->m_truncateRoot, sizeof(uint32));
+        }
+        *rootPageId = NVMInvalidPageId;
     }
 
+    // 最近一次完成的带标记的 segment 回收的 tag
+    [[nodiscard]] uint32 lastFreedSegmentTag() const { return m_segmentFreeLog->m_doneTag; }
+
+    /*
+     * 回收 segment 中除了 root 以外的所有 extent, root 的内容由调用者在 resetRoot 中清空.
+     * 调用 resetRoot 之前把 rootPageId 记在 SegmentFreeLog 中, extent 回收完才清除; 崩溃后
+     * pendingTruncateSegment 返回它, 由 segment 的所有者重新截断. 同一时间只登记一个 segment, 并发的截断依次进行
+     */
+    void truncateSegment(uint32 rootPageId, const std::function<void()> &resetRoot = nullptr) {
+        std::lock_guard<std::mutex> truncateGuard(m_truncateMutex);
+        auto *log = m_segmentFreeLog;
+        log->m_truncateRoot = rootPageId;
+        PersistMeta(&log->m_truncateRoot, sizeof(uint32));
+        if (resetRoot) {
+            resetRoot();
+        }
+        {
+            std::lock_guard<std::mutex> lockGuard(m_freeSegmentMutex);
+            freeSegmentExtents(rootPageId, true);
+        }
+        log->m_truncateRoot = NVMInvalidPageId;
+        PersistMeta(&log->m_truncateRoot, sizeof(uint32));
+    }
+
+    // 崩溃前没有完成的截断的 segment root, 没有时返回 NVMInvalidPageId
+    [[nodiscard]] uint32 pendingTruncateSegment() const { return m_segmentFreeLog->m_truncateRoot; }
+
 public:
-    /* 将存储oid->表地址的映射写入表空间的1号page */
+    /* 将 oid->表地址的映射写入表目录, oid 已经存在时覆盖 */
     void CreateTable(uint32 pgTableOID, uint32 tableSegHead) {
+        DCHECK(NVMPageIdIsValid(tableSegHead));
         std::lock_guard<std::mutex> lockGuard(m_tableMetadataMutex);
-        TableSegMetaData segAddr {
-            .m_oid = pgTableOID,
-            .m_seg = tableSegHead,
-        };
-        // 根据第i个table偏移保存对应metadata, 持久化table
-        errno_t ret = memcpy_s(m_tableMetadata->m_segHeads + m_tableMetadata->m_tableNum, sizeof(segAddr),
-                               &segAddr, sizeof(segAddr));
-        SecureRetCheck(ret);
-        m_tableMetadata->m_tableNum++;
+        uint32 slot = m_oidMap.find(pgTableOID);
+        if (slot == LockFreeHashMap::INVALID_VALUE) {
+            slot = allocTableSlot();
+        }
+        storeTableSlot(slot, pgTableOID, tableSegHead);
+        m_oidMap.insert(pgTableOID, slot);
     }
 
-    // 根据oid在表空间中寻找表地址, 返回 Table的 segment head
+    // 根据oid在表空间中寻找表地址, 返回 Table的 segment head, 不存在返回 NVMInvalidPageId
     uint32 SearchTable(uint32 oid) {
-        std::lock_guard<std::mutex> lockGuard(m_tableMetadataMutex);
-        for (int i = 0; i < m_tableMetadata->m_tableNum; ++i) {
-            TableSegMetaData *segAddr = m_tableMetadata->m_segHeads + i;
-            if (segAddr->m_oid == oid) {
-                return segAddr->m_seg;
-            }
+        uint32 slot = m_oidMap.find(oid);
+        if (slot == LockFreeHashMap::INVALID_VALUE) {
+            return NVMInvalidPageId;
+        }
+        auto meta = loadTableSlot(slot);
+        if (meta.m_oid == oid && NVMPageIdIsValid(meta.m_seg)) {
+            return meta.m_seg;
         }
-        return 0;
+        // 槽位被并发的 DropTable 释放或者已经被复用, 加锁重新查找
+        std::lock_guard<std::mutex> lockGuard(m_tableMetadataMutex);
+        slot = m_oidMap.find(oid);
+        return slot == LockFreeHashMap::INVALID_VALUE ? NVMInvalidPageId : loadTableSlot(slot).m_seg;
     }
 
-    /* 根据表地址将drop的表数据从表空间中删除 */
+    /* 从表目录中删除 oid, 槽位放入空闲链表 */
     void DropTable(uint32 oid) {
         std::lock_guard<std::mutex> lockGuard(m_tableMetadataMutex);
-        int i = 0;
-        TableSegMetaData *segAddr = nullptr;
-        for (; i < m_tableMetadata->m_tableNum; ++i) {
-            segAddr = m_tableMetadata->m_segHeads + i;
-            if (segAddr->m_oid == oid) {
-                break;
-            }
-        }
-
-        if (segAddr == nullptr) {
+        uint32 slot = m_oidMap.find(oid);
+        if (slot == LockFreeHashMap::INVALID_VALUE) {
             return;
         }
+        m_oidMap.erase(oid);
+        storeTableSlot(slot, m_tableDirectory->m_freeSlot, NVMInvalidPageId);
+        m_tableDirectory->m_freeSlot = slot + 1;
+        PersistMeta(&m_tableDirectory->m_freeSlot, sizeof(uint32));
+    }
 
-        size_t count = m_tableMetadata->m_tableNum - i - 1;
-        if (count != 0) {
-            size_t memLen = count * sizeof(TableSegMetaData);
-            errno_t ret = memmove_s(m_tableMetadata->m_segHeads + i, memLen, m_tableMetadata->m_segHeads + i + 1, memLen);
-            SecureRetCheck(ret);
-        }
-        m_tableMetadata->m_tableNum -= 1;
+    // 表目录中的表数量
+    size_t GetTableNum() {
+        std::lock_guard<std::mutex> lockGuard(m_tableMetadataMutex);
+        return m_oidMap.size();
     }
 };
 
@@ -98,30 +98,64 @@ public:
         Key_t key;
         this->PrepareUndo();
         index->Encode(indexTuple, &key, rowId);
-        PrepareIndexInsertUndo(key);
+        PrepareIndexInsertUndo(key, index->TreeId());
         index->Insert(indexTuple, rowId);
     }
 
+    // 覆盖索引需要整行来取包含列, key 中记录自己的 TxSlot 作为插入事务
+    void IndexInsert(NVMIndex *index, DRAMIndexTuple *indexTuple, RowId rowId, const RAMTuple *row) {
+        if (!index->IsCovering()) {
+            IndexInsert(index, indexTuple, rowId);
+            return;
+        }
+        Key_t key;
+        this->PrepareUndo();
+        index->EncodeCovering(indexTuple, &key, rowId, m_txSlotPtr, row);
+        PrepareIndexInsertUndo(key, index->TreeId());
+        index->InsertCovering(indexTuple, rowId, m_txSlotPtr, row);
+    }
+
     void IndexDelete(NVMIndex *index, DRAMIndexTuple *indexTuple, RowId rowId) {
         Key_t key;
         this->PrepareUndo();
-        index->Encode(indexTuple, &key, rowId);
-        PrepareIndexDeleteUndo(key);
-        index->Delete(indexTuple, rowId, this->GetTxSlotLocation());
+        index->EncodeLive(indexTuple, &key, rowId);
+        PrepareIndexDeleteUndo(key, index->TreeId());
+        index->DeleteKey(key, this->GetTxSlotLocation());
+    }
+
+    // 更新了覆盖索引的包含列之后调用: 删除旧的 key, 插入带新包含列的 key; 包含列没有变化时什么都不做.
+    // HeapUpdate/HeapUpdate2 对表上只更新了包含列的覆盖索引自动调用
+    void IndexUpdate(NVMIndex *index, DRAMIndexTuple *indexTuple, RowId rowId, const RAMTuple *newRow) {
+        if (!index->IsCovering()) {
+            return;
+        }
+        Key_t key;
+        this->PrepareUndo();
+        index->EncodeLive(indexTuple, &key, rowId);
+        if (index->IncludeEqual(key, newRow)) {
+            return;
+        }
+        PrepareIndexDeleteUndo(key, index->TreeId());
+        index->DeleteKey(key, this->GetTxSlotLocation());
+        IndexInsert(index, indexTuple, rowId, newRow);
     }
 
     inline void PushWriteSet(RowIdMapEntry *row) {
         m_writeSet.push_back(row);
     }
 
+    // 这个事务写过的行, 同一行可能出现多次
+    inline const std::vector<RowIdMapEntry *> &GetWriteSet() const { return m_writeSet; }
+
     // For testing only
     inline uint64 GetSnapshot() const { return m_snapshotCSN; }
 
 public:
-    void PrepareIndexInsertUndo(const Key_t &key);
+    // treeId 是 key 所在索引的树, 回滚时据此找到要回填的树
+    void PrepareIndexInsertUndo(const Key_t &key, uint16 treeId = PACTREE_DEFAULT_TREE);
 
     // 删除的时候可以保证，自己可以看见，且没有并发的修改，即在删除之前肯定是可见的。所以回滚直接设置value 为InvalidCSN即可。
-    void PrepareIndexDeleteUndo(Key_t &key);
+    void PrepareIndexDeleteUndo(Key_t &key, uint16 treeId = PACTREE_DEFAULT_TREE);
 
 private:
     // NVM对应的undo segment
@@ -6,8 +6,8 @@
 namespace NVMDB {
 
 // initdb 时调用, Undo 单独占一个tablespace。(is this true? 第一个数据页面里存所有segment的位置)。
-inline void UndoCreate() {
-    UndoSegmentCreate();
+inline void UndoCreate(const UndoSpaceConfig& config = UndoSpaceConfig()) {
+    UndoSegmentCreate(config);
 }
 
 /* 数据库启动时调用，初始化基本信息，启动清理线程。 */
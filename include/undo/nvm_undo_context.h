@@ -12,28 +12,37 @@ public:
     UndoTxContext(UndoSegment *undoSegment, uint32 slotId)
         : m_slotId(slotId), m_undoSegment(undoSegment) {
         DCHECK(m_slotId == m_undoSegment->getNextFreeSlot());
+        PersistTagScope tag(PersistTag::UNDO);
         m_slot = m_undoSegment->getTxSlot(m_slotId, true);
         m_slot->status = TxSlotStatus::IN_PROGRESS;
+        NVMPersist(m_slot, sizeof(TxSlot));
     }
 
     void UpdateTxSlotCSN(uint64 csn) {
+        PersistTagScope tag(PersistTag::UNDO);
         m_slot->csn = csn;
+        NVMFlush(m_slot, sizeof(TxSlot));
         std::atomic_thread_fence(std::memory_order_release);
     }
 
+    // 事务的修改都已经刷写, fence 之后再持久化状态
     void UpdateTxSlotStatus(TxSlotStatus status) {
+        PersistTagScope tag(PersistTag::UNDO);
+        NVMFence();
         m_slot->status = status;
+        NVMPersist(m_slot, sizeof(TxSlot));
     }
 
     // 根据segment id和segment 中的slot id生成全局slot id
     inline TxSlotPtr GetTxSlotLocation() const {
         auto segmentId = m_undoSegment->getSegmentId();
-        DCHECK(segmentId < NVMDB_UNDO_SEGMENT_NUM);
+        DCHECK(segmentId < NVMDB_UNDO_MAX_SEGMENT_NUM);
         return ((uint64)segmentId << TSP_SLOT_ID_BIT) | m_slotId;
     }
 
     // 将 cachedUndoRecPtr 插入到 nvm 中, 并做链表链接
     UndoRecPtr insertUndoRecord(UndoRecord *cachedUndoRecPtr) {
+        PersistTagScope tag(PersistTag::UNDO);
         cachedUndoRecPtr->m_pre = m_slot->end;
         UndoRecPtr nvmUndoRecPtr = m_undoSegment->insertUndoRecord(cachedUndoRecPtr);
         if (UndoRecPtrIsInValid(m_slot->start)) {
@@ -42,6 +51,8 @@ public:
         DCHECK(m_slot->end < nvmUndoRecPtr);
         m_slot->end = nvmUndoRecPtr;
         DCHECK(m_slot->end >= m_slot->start);
+        // undo 必须先于 heap 上的修改持久化
+        NVMPersist(m_slot, sizeof(TxSlot));
         return nvmUndoRecPtr;
     }
 
@@ -31,6 +31,9 @@ enum UndoRecordType {
     IndexInsertUndo,
     IndexDeleteUndo,
 
+    TableCreateUndo,
+    IndexCreateUndo,
+
     MaxUndoRecordType,
 };
 
@@ -8,17 +8,25 @@
 
 namespace NVMDB {
 
+DECLARE_int32(undo_recovery_threads);
+DECLARE_bool(undo_punch_hole);
+DECLARE_int32(undo_punch_mb_per_sec);
+
 /*
  * 前16位， segment id,  后48位，segment 内 tx slot id
- * 但是实际不会有 1<<48 这么多个 tx slot，实际在文件头部存有 UNDO_TX_SLOTS 个 slot， slot id通过求模映射到对应的位置。
+ * 但是实际不会有 1<<48 这么多个 tx slot，实际在文件头部存有 m_txSlotsPerSegment 个 slot， slot id通过求模映射到对应的位置。
  * segment head 中的 m_minSlotId 表示最小的 tx slot id，更小的都被回收掉了。
  * */
 using TxSlotPtr = uint64 ;  // 2048 undo segment, with 8k slots in debug mode
 
+// 以下为默认的 undo 空间配置, 实际使用的配置保存在 undo space header 中
 static constexpr int UNDO_TX_SLOTS = CompileValue(256 * 1024, 8 * 1024);
 static constexpr size_t UNDO_SEGMENT_SIZE = CompileValue(256 * 1024 * 1024, 1024 * 1024);
 static constexpr size_t UNDO_MAX_SEGMENT_NUM = 64;
 
+// 回收 undo 空间时打洞的粒度, 与 DAX 的 2MB 大页对齐
+static constexpr uint64 UNDO_PUNCH_UNIT = 2 * 1024 * 1024;
+
 static constexpr uint32 TSP_SLOT_ID_BIT = 48;
 static constexpr uint32 TSP_SEGMENT_ID_BIT = 16;
 static constexpr uint64 TSP_SLOT_ID_MASK = (1llu << TSP_SLOT_ID_BIT) - 1;
@@ -28,31 +36,53 @@ struct UndoSegmentHead {
     uint64 m_freeBegin;  /* next free space for undo record */
     uint64 m_recycledBegin; /* next undo record to be recycled */
     // recovery the Tx slot between recovery_start and recovery_end
-    // recovery_start and recovery_end may be bigger than UNDO_TX_SLOTS
+    // recovery_start and recovery_end may be bigger than m_txSlotsPerSegment
     uint64 m_recoveryStart;
     uint64 m_recoveryEnd;
     std::atomic<uint64> m_nextFreeSlot;  /* 下一个可用的 tx slot id; 分配的时候从这里开始 */
     std::atomic<uint64> m_nextRecycleSlot;   /* 下一个需要回收的 slot id;  分配的时候不得超过这个限制，回收的时候会往前推这个下标 */
     std::atomic<uint64> m_minSlotId; /* min transaction slot id; any smaller transactions slot id is recycled */
-    TxSlot m_txSlots[UNDO_TX_SLOTS]; /* transaction slots, 2KB, 8192 count */
+    TxSlot m_txSlots[0]; /* transaction slots, 数量为 m_txSlotsPerSegment */
 };
 
-/* ensure the undo segment head can be located in the first segment */
-static_assert(UNDO_SEGMENT_SIZE >= sizeof(UndoSegmentHead), "");
+inline size_t UndoSegmentHeadSize(uint64 txSlotsPerSegment) {
+    return sizeof(UndoSegmentHead) + txSlotsPerSegment * sizeof(TxSlot);
+}
 
-static_assert(NVMDB_UNDO_SEGMENT_NUM <= (1 << TSP_SEGMENT_ID_BIT), "");
+/* ensure the undo segment head can be located in the first segment */
+static_assert(UNDO_SEGMENT_SIZE >= sizeof(UndoSegmentHead) + UNDO_TX_SLOTS * sizeof(TxSlot), "");
+
+static_assert(NVMDB_UNDO_MAX_SEGMENT_NUM <= (1 << TSP_SEGMENT_ID_BIT), "");
+
+/* undo 空间的配置, InitDB 时写入 undo space header, BootStrap 时从中读取并校验 */
+struct UndoSpaceConfig {
+    uint32 segmentNum = NVMDB_UNDO_SEGMENT_NUM;     // undo segment 数量, 运行时可以在线扩展
+    uint32 txSlotsPerSegment = UNDO_TX_SLOTS;       // 每个 segment 的 tx slot 数量
+    uint64 segmentFileSize = UNDO_SEGMENT_SIZE;     // 每个 segment 中单个文件的大小
+    uint32 maxFilesPerSegment = UNDO_MAX_SEGMENT_NUM;   // 每个 segment 最多的文件数量
+
+    // 配置不合法时返回 false
+    [[nodiscard]] bool isValid() const {
+        return segmentNum > 0 && segmentNum <= NVMDB_UNDO_MAX_SEGMENT_NUM &&
+               txSlotsPerSegment > 0 &&
+               segmentFileSize % NVM_PAGE_SIZE == 0 &&
+               segmentFileSize >= UndoSegmentHeadSize(txSlotsPerSegment) &&
+               maxFilesPerSegment > 1;
+    }
+};
 
 void UndoRecycle(); // start a thread with this function
 
 class UndoSegment {
 public:
-    // UNDO_SEGMENT_SIZE 1M for debug 64M for release, UNDO_MAX_SEGMENT_NUM 16
+    // 文件大小和文件数量由 config 决定, 默认 UNDO_SEGMENT_SIZE, UNDO_MAX_SEGMENT_NUM
     // 为了NUMA优化, 一条Undo segment只能存在一个path中, 同时应在启动时完成初始化
     // segment 和 segment 同义
-    UndoSegment(const std::string& directory, uint32 undoSegmentId)
+    UndoSegment(const std::string& directory, uint32 undoSegmentId, const UndoSpaceConfig& config)
         : segId(undoSegmentId), // undo segment id
+          m_txSlotNum(config.txSlotsPerSegment),
           filename("undo" + std::to_string(undoSegmentId)), // undo0, undo1
-          m_logicFile(std::make_shared<DirectoryConfig>(directory), filename, UNDO_SEGMENT_SIZE, UNDO_MAX_SEGMENT_NUM) {
+          m_logicFile(std::make_shared<DirectoryConfig>(directory), filename, config.segmentFileSize, config.maxFilesPerSegment) {
         m_logicFile.mMapFile(0, true);
         segHead = (UndoSegmentHead *)m_logicFile.getNvmAddrByPageId(0);
         CHECK(segHead != nullptr) << "mount segment head failed";
@@ -69,19 +99,22 @@ public:
 
     // create a new undo segment
     inline void create() {
+        PersistTagScope tag(PersistTag::UNDO);
         m_logicFile.mMapFile(1, true);
         m_logicFile.mMapFile(2, true);
         // init the segment head
         // first, clear the data of the UndoSegmentHead
-        errno_t ret = memset_s(segHead, sizeof(UndoSegmentHead), 0, sizeof(UndoSegmentHead));
+        auto headSize = UndoSegmentHeadSize(m_txSlotNum);
+        errno_t ret = memset_s(segHead, headSize, 0, headSize);
         SecureRetCheck(ret);
         // set free_begin to the offset of segment head
-        segHead->m_freeBegin = sizeof(UndoSegmentHead);
+        segHead->m_freeBegin = headSize;
         // set recycled_begin to the offset of segment head
-        segHead->m_recycledBegin = sizeof(UndoSegmentHead);
+        segHead->m_recycledBegin = headSize;
         segHead->m_nextFreeSlot = 0;
         segHead->m_nextRecycleSlot = 0;
         segHead->m_minSlotId = 0;
+        NVMPersist(segHead, headSize);
     }
 
     inline void mount() { m_logicFile.mount(); }
@@ -92,7 +125,7 @@ public:
     [[nodiscard]] inline bool isFull() const {
         // transaction slot is full
         return segHead->m_nextFreeSlot.load(std::memory_order_relaxed) ==
-               segHead->m_nextRecycleSlot.load(std::memory_order_relaxed) + UNDO_TX_SLOTS;
+               segHead->m_nextRecycleSlot.load(std::memory_order_relaxed) + m_txSlotNum;
     }
 
     [[nodiscard]] inline bool isEmpty() const {
@@ -103,7 +136,7 @@ public:
     uint64 getNextTxSlot() {
         DCHECK(!isFull());
         auto nextSlotId = segHead->m_nextFreeSlot.load(std::memory_order_relaxed);
-        DCHECK(nextSlotId <= segHead->m_nextRecycleSlot.load(std::memory_order_relaxed) + UNDO_TX_SLOTS);
+        DCHECK(nextSlotId <= segHead->m_nextRecycleSlot.load(std::memory_order_relaxed) + m_txSlotNum);
         return nextSlotId;
     }
 
@@ -140,6 +173,17 @@ public:
         return true;
     }
 
+    // 崩溃前仍在执行的事务 (已经或即将被后台恢复回滚), 调用者已读到 slot 状态为 IN_PROGRESS
+    [[nodiscard]] bool isCrashedTxSlot(uint64 slotId) const {
+        auto recoveryStart = segHead->m_recoveryStart;
+        if (recoveryStart != 0 && slotId >= recoveryStart && slotId <= segHead->m_recoveryEnd) {
+            return true;
+        }
+        // 后台恢复可能刚刚完成, 重新读取状态
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return getTxSlot(slotId)->status == TxSlotStatus::ROLL_BACKED;
+    }
+
 protected:
     bool isTxSlotRecyclable(uint64 slotId, uint64 minSnapshot) const {
         TransactionInfo info = {};
@@ -161,12 +205,14 @@ public:
     // called when constructing UndoTxContext
     TxSlot *getTxSlot(uint64 slotId, bool prefetch=false) const {
         if (prefetch) {
-            __builtin_prefetch(&segHead->m_txSlots[(slotId+1) % UNDO_TX_SLOTS], 1, 3);
+            __builtin_prefetch(&segHead->m_txSlots[(slotId+1) % m_txSlotNum], 1, 3);
             __builtin_prefetch(segHead, 1, 3);
         }
-        return &segHead->m_txSlots[slotId % UNDO_TX_SLOTS];
+        return &segHead->m_txSlots[slotId % m_txSlotNum];
     }
 
+    [[nodiscard]] inline uint64 getTxSlotNum() const { return m_txSlotNum; }
+
     [[nodiscard]] uint64 getNextFreeSlot() const {
         return segHead->m_nextFreeSlot.load(std::memory_order_relaxed);
     }
@@ -178,11 +224,13 @@ public:
     UndoRecPtr insertUndoRecord(const UndoRecord *undoRecordCache) {
         auto undoSize = undoRecordCache->m_payload + sizeof(UndoRecord);
         DCHECK(undoSize <= MAX_UNDO_RECORD_CACHE_SIZE);
+        PersistTagScope tag(PersistTag::UNDO);
         // The pointer of the undo record in undo segment
         UndoRecPtr ptr = AssembleUndoRecPtr(segId, segHead->m_freeBegin);
         // write and increase undo segment
         m_logicFile.seekAndWrite(segHead->m_freeBegin, (const char *)undoRecordCache, undoSize);
         segHead->m_freeBegin += undoSize;
+        NVMFlush(&segHead->m_freeBegin, sizeof(segHead->m_freeBegin));
         return ptr;
     }
 
@@ -197,19 +245,50 @@ public:
         m_logicFile.seekAndRead(vptr, (char *)undoRecordCache, undo_head.m_payload + sizeof(UndoRecord));
     }
 
+    // 把 undo record 标记为无效, 之后的回滚 (包括崩溃后重做的回滚) 会跳过它
+    void invalidateUndoRecord(UndoRecPtr undoRecPtr) {
+        DCHECK(UndoRecPtrGetSegment(undoRecPtr) == segId);
+        auto vptr = UndoRecPtrGetOffset(undoRecPtr);
+        auto pageId = static_cast<uint32>(vptr / NVM_PAGE_SIZE);
+        m_logicFile.extend(pageId);
+        auto *undo = reinterpret_cast<UndoRecord *>(static_cast<char *>(m_logicFile.getNvmAddrByPageId(pageId)) +
+                                                    vptr % NVM_PAGE_SIZE);
+        PersistTagScope tag(PersistTag::UNDO);
+        undo->m_undoType = InvalidUndoRecordType;
+        NVMPersist(&undo->m_undoType, sizeof(undo->m_undoType));
+    }
+
 private:
     uint32 segId;
+    const uint64 m_txSlotNum;
     UndoSegmentHead *segHead{}; /* pointer to segment head, note that it's non-volatile */
     std::string filename;
     LogicFile m_logicFile;
 };
 
-void UndoSegmentCreate();
+void UndoSegmentCreate(const UndoSpaceConfig& config);
 
 void UndoSegmentMount();
 
+// 当前 undo segment 的数量
+uint32 GetUndoSegmentNum();
+
+// 当前 undo 空间的配置
+const UndoSpaceConfig& GetUndoSpaceConfig();
+
 void UndoSegmentUnmount();
 
+// 使用 threadNum 个线程恢复所有 undo segment 中未提交的事务
+void UndoSegmentRecovery(int threadNum);
+
+// 回收线程通过打洞释放的 undo 空间字节数, 进程内累计
+uint64 GetUndoBytesPunched();
+
+// BootStrap 后台恢复是否已经完成
+bool UndoRecoveryFinished();
+
+void WaitUndoRecovery();
+
 // return thread local undo segment
 UndoSegment *GetThreadLocalUndoSegment();
 
@@ -222,7 +301,7 @@ UndoSegment *GetUndoSegment(int segId);
 inline bool GetTransactionInfo(TxSlotPtr txSlotPtr, TransactionInfo *txInfo) {
     // 1. 通过segId和slotId定位对应的槽
     auto segId = static_cast<int>(txSlotPtr >> TSP_SLOT_ID_BIT);
-    DCHECK(segId < NVMDB_UNDO_SEGMENT_NUM);
+    DCHECK(segId < NVMDB_UNDO_MAX_SEGMENT_NUM);
     // find the undo segment
     UndoSegment *undo_segment = GetUndoSegment(segId);
     auto slotId = static_cast<uint32>(txSlotPtr & TSP_SLOT_ID_MASK);
@@ -230,6 +309,13 @@ inline bool GetTransactionInfo(TxSlotPtr txSlotPtr, TransactionInfo *txInfo) {
     return undo_segment->getTransactionInfo(slotId, txInfo);
 }
 
+// txSlotPtr 对应的事务是否在崩溃时未提交, 这样的事务视为已回滚
+inline bool IsCrashedTxSlot(TxSlotPtr txSlotPtr) {
+    auto segId = static_cast<int>(txSlotPtr >> TSP_SLOT_ID_BIT);
+    DCHECK(segId < NVMDB_UNDO_MAX_SEGMENT_NUM);
+    return GetUndoSegment(segId)->isCrashedTxSlot(txSlotPtr & TSP_SLOT_ID_MASK);
+}
+
 // 根据 undo ptr 获得具体的 undo record
 inline void GetUndoRecord(UndoRecPtr undoRecPtr, UndoRecord* undoRecordCache) {
     int segId = (int)UndoRecPtrGetSegment(undoRecPtr);
@@ -239,6 +325,11 @@ inline void GetUndoRecord(UndoRecPtr undoRecPtr, UndoRecord* undoRecordCache) {
     segment->getUndoRecord(undoRecPtr, undoRecordCache);
 }
 
+// 回滚操作不能重复执行时, 在执行之前调用, 这样崩溃后重做回滚不会再执行它
+inline void InvalidateUndoRecord(UndoRecPtr undoRecPtr) {
+    GetUndoSegment(static_cast<int>(UndoRecPtrGetSegment(undoRecPtr)))->invalidateUndoRecord(undoRecPtr);
+}
+
 void InitLocalUndoSegment();
 
 void DestroyLocalUndoSegment();
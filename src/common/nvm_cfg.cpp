@@ -3,6 +3,13 @@
 //
 
 #include "common/nvm_cfg.h"
+#include "common/nvm_persist.h"
+#include "common/nvm_storage_backend.h"
+#include "common/numa.h"
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <fstream>
+#include <algorithm>
 #include <sstream>
 #include <experimental/filesystem>
 #include <immintrin.h>
@@ -60,43 +67,17 @@ __attribute__((noinline)) errno_t memcpy_no_flush_nt(void* dest, size_t ndest, c
         }
     }
 
-    // 主循环：使用 AVX-512 非时态存储
+    // 主循环：使用非时态存储, 内核在运行时根据 CPU 选择
+    // 目的地址可能是 DRAM (如读 undo), 不经过 NVMStreamCopy 的统计和时延注入, 写 NVM 的调用方用 NVMWritten 记录
     if (i + 64 <= n) {
-        size_t avx512_blocks = (n - i) / 64;
-
-        // 对于大块数据，使用预取来提高性能
-        if (avx512_blocks > 4) {
-            for (size_t j = 0; j < avx512_blocks; j++, i += 64) {
-                // 预取下一个缓存行
-                if (j + 4 < avx512_blocks) {
-                    _mm_prefetch((const char*)(s + i + 256), _MM_HINT_NTA);
-                }
-
-                // 加载 64 字节
-                __m512i data = _mm512_loadu_si512((__m512i*)(s + i));
-
-                // 使用非时态存储指令写入，绕过缓存
-                _mm512_stream_si512((__m512i*)(d + i), data);
-            }
-        } else {
-            // 对于较小的块，不使用预取
-            for (size_t j = 0; j < avx512_blocks; j++, i += 64) {
-                __m512i data = _mm512_loadu_si512((__m512i*)(s + i));
-                _mm512_stream_si512((__m512i*)(d + i), data);
-            }
-        }
+        size_t blocks = (n - i) / 64;
+        g_persistKernels.m_streamCopy(d + i, s + i, blocks * 64);
+        i += blocks * 64;
     }
 
-    // 处理剩余的 32 字节块（使用 AVX/AVX2）
-    if (i + 32 <= n) {
-        __m256i data = _mm256_loadu_si256((__m256i*)(s + i));
-        _mm256_storeu_si256((__m256i*)(d + i), data);
-        i += 32;
-    }
-
-    // 处理剩余的 16 字节块（使用 SSE）
-    if (i + 16 <= n) {
-        __m128i data = _mm_loadu_si128((__m128i*)(s + i));
+    // 处理剩余的 16 字节块
+    while (i + 16 <= n) {
+        __m128i data = _mm_loadu_si128((const __m128i*)(s + i));
         _mm_storeu_si128((__m128i*)(d + i), data);
         i += 16;
     }
@@ -120,7 +101,9 @@ __attribute__((noinline)) errno_t memcpy_no_flush_nt(void* dest, size_t ndest, c
     }
 
     // 确保非时态存储完成
-    _mm_sfence();
+    if (g_persistKernels.m_fence) {
+        _mm_sfence();
+    }
     return 0;
 }
 
@@ -147,6 +130,26 @@ DirectoryConfig::DirectoryConfig(const std::string &dirPathsString, bool init) {
         std::stringstream ss(dirPathsString);
         for (std::string dirPath; std::getline(ss, dirPath, ';'); m_dirPaths.push_back(dirPath));
     }
+    std::vector<int> configuredNodes(m_dirPaths.size(), -1);
+    for (size_t i = 0; i < m_dirPaths.size(); i++) {
+        auto &it = m_dirPaths[i];
+        auto at = it.rfind('@');
+        if (at != std::string::npos && at + 1 < it.size() &&
+            it.find_first_not_of("0123456789", at + 1) == std::string::npos) {
+            configuredNodes[i] = std::stoi(it.substr(at + 1));
+            it.resize(at);
+        }
+    }
+    // 没有 NVM 时所有目录都放到 --nvm_emulate_dir 下, 已经在其中的路径 (如由 g_dir_config 派生的) 不变
+    const auto backend = GetStorageBackend();
+    if (backend != StorageBackend::DAX) {
+        const std::string root = FLAGS_nvm_emulate_dir + "/";
+        for (auto &it : m_dirPaths) {
+            if (it.compare(0, root.size(), root) != 0) {
+                it = FLAGS_nvm_emulate_dir + (it[0] == '/' ? "" : "/") + it;
+            }
+        }
+    }
     // for (const auto& it: m_dirPaths) {
     //     LOG(INFO) << "NVM dir paths: " << it;
     // }
@@ -155,6 +158,9 @@ DirectoryConfig::DirectoryConfig(const std::string &dirPathsString, bool init) {
     if (init) {
         for (const auto &it : m_dirPaths) {
             std::experimental::filesystem::remove_all(it);
+            if (backend == StorageBackend::ANON) {
+                FreeAnonSegments(it);
+            }
         }
     }
     // 创建文件夹
@@ -164,6 +170,29 @@ DirectoryConfig::DirectoryConfig(const std::string &dirPathsString, bool init) {
             LOG(WARNING) << "Create " << it << " failed, directory may already exists!";
         }
     }
+    for (size_t i = 0; i < m_dirPaths.size(); i++) {
+        m_numaNodes.push_back(resolveNumaNode(m_dirPaths[i], configuredNodes[i], i));
+    }
+}
+
+int DirectoryConfig::resolveNumaNode(const std::string &dirPath, int configured, size_t dirId) const {
+    if (configured >= 0) {
+        return configured;
+    }
+    // pmem 等块设备在 sysfs 中记录所在的节点, 分区的节点记录在上一级设备中
+    struct stat st {};
+    if (stat(dirPath.c_str(), &st) == 0) {
+        const std::string dev = "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" +
+                                std::to_string(minor(st.st_dev));
+        for (const auto &file : {dev + "/device/numa_node", dev + "/../device/numa_node"}) {
+            std::ifstream in(file);
+            int node = -1;
+            if (in >> node && node >= 0) {
+                return node;
+            }
+        }
+    }
+    return static_cast<int>(dirId % static_cast<size_t>(std::max(NumaBinding::getNumaNodeCount(), 1)));
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include "common/nvm_persist.h"
+#include "glog/logging.h"
+#include <chrono>
+#include <cpuid.h>
+#include <cstring>
+#include <immintrin.h>
+
+namespace NVMDB {
+
+DEFINE_string(persist_mode, "adr", "persistence domain of NVM: adr (flush and fence), eadr (fence only) or dram");
+DEFINE_int32(nvm_read_latency_ns, 0, "injected latency per cache line read from emulated NVM, 0 to disable");
+DEFINE_int32(nvm_write_latency_ns, 0, "injected latency per cache line flushed or streamed to emulated NVM, 0 to disable");
+DEFINE_int32(nvm_write_bandwidth_mbps, 0, "per-thread write bandwidth of emulated NVM in MB/s, 0 for unlimited");
+
+namespace {
+
+constexpr uintptr_t CACHE_LINE_MASK = 63;
+
+/* CPUID.(EAX=7,ECX=0):EBX */
+constexpr uint32 CPUID_AVX2 = 1U << 5;
+constexpr uint32 CPUID_AVX512F = 1U << 16;
+constexpr uint32 CPUID_CLFLUSHOPT = 1U << 23;
+constexpr uint32 CPUID_CLWB = 1U << 24;
+/* XCR0: SSE, AVX 和 AVX-512 的寄存器状态由操作系统保存 */
+constexpr uint64 XCR0_AVX = 0x6;
+constexpr uint64 XCR0_AVX512 = 0xe6;
+
+struct CpuFeatures {
+    bool m_avx2 = false;
+    bool m_avx512 = false;
+    bool m_clflushopt = false;
+    bool m_clwb = false;
+};
+
+CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features;
+    uint32 eax = 0;
+    uint32 ebx = 0;
+    uint32 ecx = 0;
+    uint32 edx = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+        return features;
+    }
+    uint64 xcr0 = 0;
+    if ((ecx & bit_OSXSAVE) != 0) {
+        uint32 lo = 0;
+        uint32 hi = 0;
+        __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = (static_cast<uint64>(hi) << 32) | lo;
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0) {
+        return features;
+    }
+    features.m_avx2 = (ebx & CPUID_AVX2) != 0 && (xcr0 & XCR0_AVX) == XCR0_AVX;
+    features.m_avx512 = (ebx & CPUID_AVX512F) != 0 && (xcr0 & XCR0_AVX512) == XCR0_AVX512;
+    features.m_clflushopt = (ebx & CPUID_CLFLUSHOPT) != 0;
+    features.m_clwb = (ebx & CPUID_CLWB) != 0;
+    return features;
+}
+
+const CpuFeatures &GetCpuFeatures() {
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
+
+/* 拷贝内核: 源地址可以不对齐, 目的地址 64 字节对齐, 对大块数据预取源地址 */
+__attribute__((target("avx512f"))) void StreamCopyAVX512(void *dest, const void *src, size_t n) {
+    auto *d = static_cast<char *>(dest);
+    const auto *s = static_cast<const char *>(src);
+    for (size_t i = 0; i < n; i += 64) {
+        _mm_prefetch(s + i + 256, _MM_HINT_NTA);
+        __m512i data = _mm512_loadu_si512(reinterpret_cast<const void *>(s + i));
+        _mm512_stream_si512(reinterpret_cast<__m512i *>(d + i), data);
+    }
+}
+
+__attribute__((target("avx2"))) void StreamCopyAVX2(void *dest, const void *src, size_t n) {
+    auto *d = static_cast<char *>(dest);
+    const auto *s = static_cast<const char *>(src);
+    for (size_t i = 0; i < n; i += 64) {
+        _mm_prefetch(s + i + 256, _MM_HINT_NTA);
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + 32));
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(d + i), lo);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(d + i + 32), hi);
+    }
+}
+
+void CopyMemcpy(void *dest, const void *src, size_t n) {
+    memcpy(dest, src, n);
+}
+
+void StreamCopySSE2(void *dest, const void *src, size_t n) {
+    auto *d = static_cast<char *>(dest);
+    const auto *s = static_cast<const char *>(src);
+    for (size_t i = 0; i < n; i += 64) {
+        _mm_prefetch(s + i + 256, _MM_HINT_NTA);
+        for (size_t j = 0; j < 64; j += 16) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + j));
+            _mm_stream_si128(reinterpret_cast<__m128i *>(d + i + j), data);
+        }
+    }
+}
+
+/* 刷写内核: 起始地址向下对齐到 cache line */
+__attribute__((target("clwb"))) void FlushCLWB(const void *addr, size_t n) {
+    auto end = reinterpret_cast<uintptr_t>(addr) + n;
+    for (auto p = reinterpret_cast<uintptr_t>(addr) & ~CACHE_LINE_MASK; p < end; p += 64) {
+        _mm_clwb(reinterpret_cast<void *>(p));
+    }
+}
+
+__attribute__((target("clflushopt"))) void FlushCLFLUSHOPT(const void *addr, size_t n) {
+    auto end = reinterpret_cast<uintptr_t>(addr) + n;
+    for (auto p = reinterpret_cast<uintptr_t>(addr) & ~CACHE_LINE_MASK; p < end; p += 64) {
+        _mm_clflushopt(reinterpret_cast<void *>(p));
+    }
+}
+
+void FlushCLFLUSH(const void *addr, size_t n) {
+    auto end = reinterpret_cast<uintptr_t>(addr) + n;
+    for (auto p = reinterpret_cast<uintptr_t>(addr) & ~CACHE_LINE_MASK; p < end; p += 64) {
+        _mm_clflush(reinterpret_cast<void *>(p));
+    }
+}
+
+void FlushNone(const void *addr, size_t n) {}
+
+inline uint64 CacheLinesOf(const void *addr, size_t n) {
+    auto begin = reinterpret_cast<uintptr_t>(addr) & ~CACHE_LINE_MASK;
+    auto end = (reinterpret_cast<uintptr_t>(addr) + n + CACHE_LINE_MASK) & ~CACHE_LINE_MASK;
+    return (end - begin) / 64;
+}
+
+void SpinFor(uint64 ns) {
+    if (ns == 0) {
+        return;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+    while (std::chrono::steady_clock::now() < deadline) {
+        _mm_pause();
+    }
+}
+
+}  // namespace
+
+NVMDelay g_nvmDelay = {false, 0, 0, 0};
+
+void SetNVMDelay(uint32 readLatencyNs, uint32 writeLatencyNs, uint32 writeBandwidthMBps) {
+    g_nvmDelay.m_readLatencyNs = readLatencyNs;
+    g_nvmDelay.m_writeLatencyNs = writeLatencyNs;
+    g_nvmDelay.m_writeBandwidthMBps = writeBandwidthMBps;
+    g_nvmDelay.m_enabled = readLatencyNs != 0 || writeLatencyNs != 0 || writeBandwidthMBps != 0;
+    g_persistHooks = g_nvmDelay.m_enabled || PersistStatsEnabled();
+}
+
+void InjectReadDelay(const void *addr, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    SpinFor(CacheLinesOf(addr, n) * g_nvmDelay.m_readLatencyNs);
+}
+
+void InjectWriteDelay(const void *addr, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    uint64 ns = CacheLinesOf(addr, n) * g_nvmDelay.m_writeLatencyNs;
+    if (g_nvmDelay.m_writeBandwidthMBps != 0) {
+        // 1 MB/s 即每微秒 1 字节
+        ns += static_cast<uint64>(n) * 1000 / g_nvmDelay.m_writeBandwidthMBps;
+    }
+    SpinFor(ns);
+}
+
+/* 进程启动前使用所有 x86-64 都支持的 SSE2 和 clflush, 静态初始化时切换到最快的实现 */
+PersistKernels g_persistKernels = {CopyKernel::SSE2, FlushKernel::CLFLUSH, StreamCopySSE2, FlushCLFLUSH, true};
+
+bool CopyKernelSupported(CopyKernel kind) {
+    switch (kind) {
+        case CopyKernel::MEMCPY:
+        case CopyKernel::SSE2:
+            return true;
+        case CopyKernel::AVX2:
+            return GetCpuFeatures().m_avx2;
+        case CopyKernel::AVX512:
+            return GetCpuFeatures().m_avx512;
+    }
+    return false;
+}
+
+bool FlushKernelSupported(FlushKernel kind) {
+    switch (kind) {
+        case FlushKernel::NONE:
+        case FlushKernel::CLFLUSH:
+            return true;
+        case FlushKernel::CLFLUSHOPT:
+            return GetCpuFeatures().m_clflushopt;
+        case FlushKernel::CLWB:
+            return GetCpuFeatures().m_clwb;
+    }
+    return false;
+}
+
+CopyKernel BestCopyKernel() {
+    if (CopyKernelSupported(CopyKernel::AVX512)) {
+        return CopyKernel::AVX512;
+    }
+    return CopyKernelSupported(CopyKernel::AVX2) ? CopyKernel::AVX2 : CopyKernel::SSE2;
+}
+
+FlushKernel BestFlushKernel() {
+    if (FlushKernelSupported(FlushKernel::CLWB)) {
+        return FlushKernel::CLWB;
+    }
+    return FlushKernelSupported(FlushKernel::CLFLUSHOPT) ? FlushKernel::CLFLUSHOPT : FlushKernel::CLFLUSH;
+}
+
+bool SetPersistKernels(CopyKernel copyKind, FlushKernel flushKind) {
+    if (!CopyKernelSupported(copyKind) || !FlushKernelSupported(flushKind)) {
+        return false;
+    }
+    PersistKernels kernels{copyKind, flushKind, StreamCopySSE2, FlushCLFLUSH, true};
+    switch (copyKind) {
+        case CopyKernel::AVX512:
+            kernels.m_streamCopy = StreamCopyAVX512;
+            break;
+        case CopyKernel::AVX2:
+            kernels.m_streamCopy = StreamCopyAVX2;
+            break;
+        case CopyKernel::MEMCPY:
+            kernels.m_streamCopy = CopyMemcpy;
+            break;
+        case CopyKernel::SSE2:
+            break;
+    }
+    switch (flushKind) {
+        case FlushKernel::CLWB:
+            kernels.m_flush = FlushCLWB;
+            break;
+        case FlushKernel::CLFLUSHOPT:
+            kernels.m_flush = FlushCLFLUSHOPT;
+            break;
+        case FlushKernel::NONE:
+            kernels.m_flush = FlushNone;
+            break;
+        case FlushKernel::CLFLUSH:
+            break;
+    }
+    kernels.m_fence = copyKind != CopyKernel::MEMCPY || flushKind != FlushKernel::NONE;
+    g_persistKernels = kernels;
+    return true;
+}
+
+void SetPersistMode(PersistMode mode) {
+    bool ret = false;
+    switch (mode) {
+        case PersistMode::ADR:
+            ret = SetPersistKernels(BestCopyKernel(), BestFlushKernel());
+            break;
+        case PersistMode::EADR:
+            ret = SetPersistKernels(BestCopyKernel(), FlushKernel::NONE);
+            break;
+        case PersistMode::DRAM:
+            ret = SetPersistKernels(CopyKernel::MEMCPY, FlushKernel::NONE);
+            break;
+    }
+    CHECK(ret);
+}
+
+PersistMode GetPersistMode() {
+    if (g_persistKernels.m_flushKind != FlushKernel::NONE) {
+        return PersistMode::ADR;
+    }
+    return g_persistKernels.m_fence ? PersistMode::EADR : PersistMode::DRAM;
+}
+
+void InitPersistMode() {
+    CHECK(FLAGS_nvm_read_latency_ns >= 0 && FLAGS_nvm_write_latency_ns >= 0 && FLAGS_nvm_write_bandwidth_mbps >= 0);
+    SetNVMDelay(FLAGS_nvm_read_latency_ns, FLAGS_nvm_write_latency_ns, FLAGS_nvm_write_bandwidth_mbps);
+    SetPersistStatsEnabled(FLAGS_nvm_persist_stats);
+    const PersistMode modes[] = {PersistMode::ADR, PersistMode::EADR, PersistMode::DRAM};
+    for (auto mode : modes) {
+        if (FLAGS_persist_mode == PersistModeName(mode)) {
+            SetPersistMode(mode);
+            return;
+        }
+    }
+    CHECK(false) << "Unknown persist mode: " << FLAGS_persist_mode;
+}
+
+const char *PersistModeName(PersistMode mode) {
+    switch (mode) {
+        case PersistMode::ADR:
+            return "adr";
+        case PersistMode::EADR:
+            return "eadr";
+        case PersistMode::DRAM:
+            return "dram";
+    }
+    return "unknown";
+}
+
+const char *CopyKernelName(CopyKernel kind) {
+    switch (kind) {
+        case CopyKernel::MEMCPY:
+            return "memcpy";
+        case CopyKernel::SSE2:
+            return "sse2";
+        case CopyKernel::AVX2:
+            return "avx2";
+        case CopyKernel::AVX512:
+            return "avx512";
+    }
+    return "unknown";
+}
+
+const char *FlushKernelName(FlushKernel kind) {
+    switch (kind) {
+        case FlushKernel::NONE:
+            return "none";
+        case FlushKernel::CLFLUSH:
+            return "clflush";
+        case FlushKernel::CLFLUSHOPT:
+            return "clflushopt";
+        case FlushKernel::CLWB:
+            return "clwb";
+    }
+    return "unknown";
+}
+
+namespace {
+struct PersistKernelsInitializer {
+    PersistKernelsInitializer() {
+        bool ret = SetPersistKernels(BestCopyKernel(), BestFlushKernel());
+        CHECK(ret);
+    }
+} g_persistKernelsInitializer;
+}  // namespace
+
+}  // namespace NVMDB
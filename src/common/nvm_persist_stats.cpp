@@ -0,0 +1,253 @@
+#include "common/nvm_persist.h"
+#include "common/nvm_cfg.h"
+#include "glog/logging.h"
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <unordered_set>
+
+namespace NVMDB {
+
+DEFINE_bool(nvm_persist_stats, gflags::BoolFromEnv("NVMDB_PERSIST_STATS", false),
+            "count bytes, flushes, fences and 256B XPLines written to NVM per subsystem");
+
+thread_local PersistTag t_persistTag = PersistTag::OTHER;
+
+bool g_persistHooks = false;
+
+namespace {
+
+enum StatField : uint8 {
+    FLUSH_CALLS = 0,
+    FLUSH_BYTES,
+    STREAM_BYTES,
+    STORE_BYTES,
+    FENCES,
+    XPLINES,
+    STAT_FIELDS,
+};
+
+constexpr size_t TAG_COUNT = static_cast<size_t>(PersistTag::COUNT);
+// 一个 fence 窗口内最多跟踪的 XPLine 数, 超过后开始新的窗口 (会高估)
+constexpr uint32 XPLINE_WINDOW = 64;
+constexpr uint32 XPLINE_SHIFT = 8;
+static_assert((1U << XPLINE_SHIFT) == NVM_CACHE_LINE_SIZE && NVM_CACHE_LINE_SIZE == PersistStats::NVM_XPLINE_SIZE, "");
+
+bool g_persistStatsEnabled = false;
+
+/* 只由所属线程写, 汇总时其他线程用 relaxed 读 */
+struct ThreadPersistStats {
+    ThreadPersistStats();
+
+    ~ThreadPersistStats();
+
+    inline void add(PersistTag tag, StatField field, uint64 value) {
+        auto &counter = m_counters[static_cast<size_t>(tag)][field];
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void touch(PersistTag tag, const void *addr, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        auto first = reinterpret_cast<uintptr_t>(addr) >> XPLINE_SHIFT;
+        auto last = (reinterpret_cast<uintptr_t>(addr) + n - 1) >> XPLINE_SHIFT;
+        for (auto line = first; line <= last; line++) {
+            bool found = false;
+            for (uint32 i = 0; i < m_windowSize; i++) {
+                if (m_window[i] == line) {
+                    found = true;
+                    break;
+                }
+            }
+            if (found) {
+                continue;
+            }
+            if (m_windowSize == XPLINE_WINDOW) {
+                m_windowSize = 0;
+            }
+            m_window[m_windowSize++] = line;
+            add(tag, XPLINES, 1);
+        }
+    }
+
+    std::atomic<uint64> m_counters[TAG_COUNT][STAT_FIELDS];
+    uintptr_t m_window[XPLINE_WINDOW];
+    uint32 m_windowSize = 0;
+};
+
+std::mutex g_statsMutex;
+std::unordered_set<ThreadPersistStats *> g_liveStats;
+// 已经退出的线程的统计
+uint64 g_retiredStats[TAG_COUNT][STAT_FIELDS];
+
+ThreadPersistStats::ThreadPersistStats() {
+    for (auto &tagCounters : m_counters) {
+        for (auto &counter : tagCounters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+    std::lock_guard<std::mutex> guard(g_statsMutex);
+    g_liveStats.insert(this);
+}
+
+ThreadPersistStats::~ThreadPersistStats() {
+    std::lock_guard<std::mutex> guard(g_statsMutex);
+    for (size_t tag = 0; tag < TAG_COUNT; tag++) {
+        for (size_t field = 0; field < STAT_FIELDS; field++) {
+            g_retiredStats[tag][field] += m_counters[tag][field].load(std::memory_order_relaxed);
+        }
+    }
+    g_liveStats.erase(this);
+}
+
+thread_local ThreadPersistStats t_persistStats;
+
+void RecordPersistEvent(PersistEvent event, const void *addr, size_t n) {
+    auto &stats = t_persistStats;
+    const PersistTag tag = t_persistTag;
+    switch (event) {
+        case PersistEvent::FLUSH:
+            stats.add(tag, FLUSH_CALLS, 1);
+            stats.add(tag, FLUSH_BYTES, n);
+            stats.touch(tag, addr, n);
+            break;
+        case PersistEvent::STREAM:
+            stats.add(tag, STREAM_BYTES, n);
+            stats.touch(tag, addr, n);
+            break;
+        case PersistEvent::STORE:
+            stats.add(tag, STORE_BYTES, n);
+            stats.touch(tag, addr, n);
+            break;
+        case PersistEvent::FENCE:
+            stats.add(tag, FENCES, 1);
+            stats.m_windowSize = 0;
+            break;
+        case PersistEvent::READ:
+            break;
+    }
+}
+
+PersistStats ToPersistStats(const uint64 *fields) {
+    PersistStats stats{};
+    stats.m_flushCalls = fields[FLUSH_CALLS];
+    stats.m_flushBytes = fields[FLUSH_BYTES];
+    stats.m_streamBytes = fields[STREAM_BYTES];
+    stats.m_storeBytes = fields[STORE_BYTES];
+    stats.m_fences = fields[FENCES];
+    stats.m_xplines = fields[XPLINES];
+    return stats;
+}
+
+}  // namespace
+
+void OnPersistEvent(PersistEvent event, const void *addr, size_t n) {
+    if (g_nvmDelay.m_enabled) {
+        if (event == PersistEvent::READ) {
+            InjectReadDelay(addr, n);
+        } else if (event != PersistEvent::FENCE) {
+            InjectWriteDelay(addr, n);
+        }
+    }
+    if (g_persistStatsEnabled) {
+        RecordPersistEvent(event, addr, n);
+    }
+}
+
+void SetPersistStatsEnabled(bool enabled) {
+    g_persistStatsEnabled = enabled;
+    g_persistHooks = g_persistStatsEnabled || g_nvmDelay.m_enabled;
+}
+
+bool PersistStatsEnabled() {
+    return g_persistStatsEnabled;
+}
+
+std::vector<PersistStats> CollectPersistStats() {
+    uint64 sum[TAG_COUNT][STAT_FIELDS];
+    std::lock_guard<std::mutex> guard(g_statsMutex);
+    for (size_t tag = 0; tag < TAG_COUNT; tag++) {
+        for (size_t field = 0; field < STAT_FIELDS; field++) {
+            sum[tag][field] = g_retiredStats[tag][field];
+            for (auto *stats : g_liveStats) {
+                sum[tag][field] += stats->m_counters[tag][field].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    std::vector<PersistStats> result;
+    for (auto &fields : sum) {
+        result.push_back(ToPersistStats(fields));
+    }
+    return result;
+}
+
+void ResetPersistStats() {
+    std::lock_guard<std::mutex> guard(g_statsMutex);
+    for (size_t tag = 0; tag < TAG_COUNT; tag++) {
+        for (size_t field = 0; field < STAT_FIELDS; field++) {
+            g_retiredStats[tag][field] = 0;
+            for (auto *stats : g_liveStats) {
+                stats->m_counters[tag][field].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+std::string PersistStatsReport(uint64 txnCount) {
+    auto stats = CollectPersistStats();
+    PersistStats total{};
+    std::string report;
+    char line[256];
+    snprintf(line, sizeof(line), "%-12s %12s %12s %14s %14s %8s %12s %12s\n", "subsystem", "flushes", "fences",
+             "written(B)", "xpline(B)", "amplif", "B/txn", "xpline/txn");
+    report += line;
+    const auto appendRow = [&](const char *name, const PersistStats &s) {
+        auto logical = s.LogicalBytes();
+        double amplification = logical == 0 ? 0 : static_cast<double>(s.MediaBytes()) / logical;
+        double perTxn = txnCount == 0 ? 0 : static_cast<double>(logical) / txnCount;
+        double xplinePerTxn = txnCount == 0 ? 0 : static_cast<double>(s.m_xplines) / txnCount;
+        snprintf(line, sizeof(line), "%-12s %12lu %12lu %14lu %14lu %8.2f %12.1f %12.2f\n", name, s.m_flushCalls,
+                 s.m_fences, logical, s.MediaBytes(), amplification, perTxn, xplinePerTxn);
+        report += line;
+    };
+    for (size_t tag = 0; tag < TAG_COUNT; tag++) {
+        const auto &s = stats[tag];
+        if (s.LogicalBytes() == 0 && s.m_fences == 0) {
+            continue;
+        }
+        appendRow(PersistTagName(static_cast<PersistTag>(tag)), s);
+        total.m_flushCalls += s.m_flushCalls;
+        total.m_flushBytes += s.m_flushBytes;
+        total.m_streamBytes += s.m_streamBytes;
+        total.m_storeBytes += s.m_storeBytes;
+        total.m_fences += s.m_fences;
+        total.m_xplines += s.m_xplines;
+    }
+    appendRow("total", total);
+    return report;
+}
+
+const char *PersistTagName(PersistTag tag) {
+    switch (tag) {
+        case PersistTag::OTHER:
+            return "other";
+        case PersistTag::HEAP:
+            return "heap";
+        case PersistTag::UNDO:
+            return "undo";
+        case PersistTag::INDEX:
+            return "index";
+        case PersistTag::OPLOG:
+            return "oplog";
+        case PersistTag::SEARCH_LAYER:
+            return "search_layer";
+        case PersistTag::META:
+            return "meta";
+        case PersistTag::COUNT:
+            break;
+    }
+    return "unknown";
+}
+
+}  // namespace NVMDB
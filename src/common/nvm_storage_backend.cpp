@@ -0,0 +1,135 @@
+#include "common/nvm_storage_backend.h"
+#include "glog/logging.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <sys/mman.h>
+
+namespace NVMDB {
+
+DEFINE_string(nvm_backend, gflags::StringFromEnv("NVMDB_BACKEND", "dax"),
+              "storage of LogicFile: dax (NVM files), file (plain files, e.g. on tmpfs) or anon (anonymous DRAM)");
+DEFINE_string(nvm_emulate_dir, "/dev/shm/revivedb", "root of the pg_nvm directories when nvm_backend is not dax");
+DEFINE_bool(nvm_hugepage, false, "back anon segments with 2MB huge pages when available");
+
+namespace {
+
+constexpr size_t OS_PAGE_SIZE = 4096;
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+struct AnonSegment {
+    void *m_addr;
+    size_t m_size;
+    size_t m_pageSize;
+};
+
+std::mutex g_anonMutex;
+std::unordered_map<std::string, AnonSegment> g_anonSegments;
+
+AnonSegment AllocAnonSegment(size_t size) {
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (FLAGS_nvm_hugepage && size % HUGE_PAGE_SIZE == 0) {
+        // 不能带 MAP_NORESERVE, 否则大页不够时在访问时才 SIGBUS
+        void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            return {addr, size, HUGE_PAGE_SIZE};
+        }
+        // 没有预留大页时退回透明大页
+        LOG(WARNING) << "Cannot map " << size << " bytes of hugetlb pages, errno: " << errno;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0);
+    CHECK(addr != MAP_FAILED) << "Cannot map anonymous segment, errno: " << errno;
+    if (FLAGS_nvm_hugepage) {
+        (void)madvise(addr, size, MADV_HUGEPAGE);
+    }
+    return {addr, size, OS_PAGE_SIZE};
+}
+
+}  // namespace
+
+StorageBackend GetStorageBackend() {
+    const StorageBackend backends[] = {StorageBackend::DAX, StorageBackend::FILE, StorageBackend::ANON};
+    for (auto backend : backends) {
+        if (FLAGS_nvm_backend == StorageBackendName(backend)) {
+            return backend;
+        }
+    }
+    CHECK(false) << "Unknown storage backend: " << FLAGS_nvm_backend;
+    return StorageBackend::DAX;
+}
+
+const char *StorageBackendName(StorageBackend backend) {
+    switch (backend) {
+        case StorageBackend::DAX:
+            return "dax";
+        case StorageBackend::FILE:
+            return "file";
+        case StorageBackend::ANON:
+            return "anon";
+    }
+    return "unknown";
+}
+
+void *MapAnonSegment(const std::string &name, size_t size, bool create) {
+    std::lock_guard<std::mutex> guard(g_anonMutex);
+    auto it = g_anonSegments.find(name);
+    if (it != g_anonSegments.end()) {
+        CHECK(it->second.m_size == size) << "Segment size mismatch: " << name;
+        return it->second.m_addr;
+    }
+    if (!create) {
+        return nullptr;
+    }
+    auto segment = AllocAnonSegment(size);
+    g_anonSegments.emplace(name, segment);
+    return segment.m_addr;
+}
+
+bool AnonSegmentExists(const std::string &name) {
+    std::lock_guard<std::mutex> guard(g_anonMutex);
+    return g_anonSegments.count(name) != 0;
+}
+
+void FreeAnonSegment(const std::string &name) {
+    std::lock_guard<std::mutex> guard(g_anonMutex);
+    auto it = g_anonSegments.find(name);
+    if (it == g_anonSegments.end()) {
+        return;
+    }
+    munmap(it->second.m_addr, it->second.m_size);
+    g_anonSegments.erase(it);
+}
+
+void FreeAnonSegments(const std::string &dir) {
+    const std::string prefix = dir + "/";
+    std::lock_guard<std::mutex> guard(g_anonMutex);
+    for (auto it = g_anonSegments.begin(); it != g_anonSegments.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            munmap(it->second.m_addr, it->second.m_size);
+            it = g_anonSegments.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t PunchAnonSegment(const std::string &name, uint64 offset, uint64 len) {
+    std::lock_guard<std::mutex> guard(g_anonMutex);
+    auto it = g_anonSegments.find(name);
+    if (it == g_anonSegments.end()) {
+        return 0;
+    }
+    const uint64 pageSize = it->second.m_pageSize;
+    uint64 begin = (offset + pageSize - 1) / pageSize * pageSize;
+    uint64 end = std::min<uint64>(offset + len, it->second.m_size) / pageSize * pageSize;
+    if (begin >= end) {
+        return 0;
+    }
+    if (madvise(static_cast<char *>(it->second.m_addr) + begin, end - begin, MADV_DONTNEED) != 0) {
+        LOG(WARNING) << "Punch anonymous segment " << name << " failed, errno: " << errno;
+        return 0;
+    }
+    return end - begin;
+}
+
+}  // namespace NVMDB
@@ -3,22 +3,22 @@
 
 namespace NVMDB {
 
-ListNode *LinkedList::Initialize() {
+ListNode *LinkedList::Initialize(uint16_t treeId) {
+    PersistTagScope persistTag(PersistTag::INDEX);
     genId = 0;
-    auto *oplog = (OpStruct *)PMem::getOpLog(0);
-
-    PMem::alloc(LIST_NODE_SIZE, (void **)&headPtr, &(oplog->newNodeOid));
+    this->treeId = treeId;
+    // 运行期间也会建新树, 不能借用 oplog 记录分配
+    PMEMoid headOid;
+    PMem::alloc(LIST_NODE_SIZE, (void **)&headPtr, &headOid);
     auto *head = (ListNode *)new (headPtr.getVaddr()) ListNode();
     flushToNVM((char *)&headPtr, sizeof(NVMPtr<ListNode>));
     smp_wmb();
 
-    auto *oplog2 = (OpStruct *)PMem::getOpLog(1);
-
-    PMem::alloc(LIST_NODE_SIZE, (void **)&tailPtr, &(oplog->newNodeOid));
+    PMEMoid tailOid;
+    PMem::alloc(LIST_NODE_SIZE, (void **)&tailPtr, &tailOid);
     auto *tail = (ListNode *)new (tailPtr.getVaddr()) ListNode();
-
-    oplog->op = OpStruct::done;
-    oplog2->op = OpStruct::done;
+    head->SetTreeId(treeId);
+    tail->SetTreeId(treeId);
 
     NVMPtr<ListNode> nullPtr(0, 0);
 
@@ -26,7 +26,8 @@ ListNode *LinkedList::Initialize() {
     head->SetPrev(nullPtr);
     head->SetCur(headPtr);
     static const std::string minString = "\0";
-    static const std::string maxString = "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
+    // 索引 key 不再以 idxId 开头, 第一个字节可以是任何值, 所以上界取最大的 key
+    static const std::string maxString(KEYLENGTH, '\xff');
     Key_t max;
     max.setFromString(maxString);
     Key_t min;
@@ -66,12 +67,16 @@ static NVMPtr<ListNode> getNextActiveNode(ListNode *next) {
     return res;
 }
 
-static ListNode *searchAndLockNode(ListNode *cur, uint64_t genId, Key_t &key) {
+/*
+ * 找到并锁住 min <= key < max 的节点.
+ * upperBound 为 true 时 key 是开区间的上界, 找的是 min < key <= max 的节点, 即包含小于 key 的最大 key 的节点
+ */
+static ListNode *searchAndLockNode(ListNode *cur, uint64_t genId, Key_t &key, bool upperBound = false) {
     while (true) {
         auto& mutex = cur->getVersionedLock();
         mutex.lock(genId);
         // key小于当前节点最小的key, 向左面查找
-        if (key < cur->GetMin()) {
+        if (upperBound ? key <= cur->GetMin() : key < cur->GetMin()) {
             auto* prev = cur->GetPrev();
             if (cur->GetDeleted() && prev->GetDeleted()) {
                 auto prevPtr = getPrevActiveNode(prev);
@@ -83,7 +88,7 @@ static ListNode *searchAndLockNode(ListNode *cur, uint64_t genId, Key_t &key) {
             continue;
         }
         // key大于当前节点最小的key, 向右面查找
-        if (key >= cur->GetMax()) {
+        if (upperBound ? key > cur->GetMax() : key >= cur->GetMax()) {
             ListNode *next = cur->GetNext();
             if (cur->GetDeleted() && next->GetDeleted()) {
                 auto nextPtr = getNextActiveNode(next);
@@ -167,8 +172,19 @@ ListNode *LinkedList::GetHead() {
     return head;
 }
 
+ListNode *LinkedList::ResumeNode(const ScanCursor *cursor) const {
+    if (cursor == nullptr || cursor->m_node == nullptr || cursor->m_genId != genId) {
+        return nullptr;
+    }
+    // 没有加锁, 只是预判; 之后被合并的话 searchAndLockNode 会跳过已删除的节点
+    if (cursor->m_node->GetDeleted()) {
+        return nullptr;
+    }
+    return cursor->m_node;
+}
+
 bool LinkedList::ScanInOrder(Key_t &startKey, Key_t &endKey, ListNode *head, int maxRange, LookupSnapshot snapshot,
-                             std::vector<std::pair<Key_t, Val_t>> &result) const {
+                             std::vector<std::pair<Key_t, Val_t>> &result, ScanCursor *cursor) const {
     ListNode *cur = head;
     cur = searchAndLockNode(cur, genId, startKey);
 
@@ -184,6 +200,11 @@ bool LinkedList::ScanInOrder(Key_t &startKey, Key_t &endKey, ListNode *head, int
             cur->Prune(snapshot, genId);
         }
         end |= endKey < cur->GetMax();
+        if (end && cursor != nullptr) {
+            // 下一批从最后一个 key 之后开始, 它在这个节点或者之后的节点中
+            cursor->m_node = cur;
+            cursor->m_genId = genId;
+        }
         cur->getVersionedLock().unlock();
         if (end) {
             break;
@@ -197,13 +218,47 @@ bool LinkedList::ScanInOrder(Key_t &startKey, Key_t &endKey, ListNode *head, int
     return true;
 }
 
+/*
+ * 从 endKey (不包含) 向 startKey (包含) 逆序扫描. 每个节点扫描完之后以它的 min 作为新的上界,
+ * 解锁后重新定位前一个节点: 前一个节点在此期间分裂时向右找到新节点, 被合并删除时继续向左找
+ */
+bool LinkedList::ScanReverse(Key_t &startKey, Key_t &endKey, ListNode *head, int maxRange, LookupSnapshot snapshot,
+                             std::vector<std::pair<Key_t, Val_t>> &result, ScanCursor *cursor) const {
+    Key_t upperKey = endKey;
+    ListNode *cur = searchAndLockNode(head, genId, upperKey, true);
+    DCHECK(!cur->GetDeleted() && cur->GetMin() < upperKey && upperKey <= cur->GetMax());
+    result.clear();
+    while (true) {
+        bool needPrune;
+        bool end = cur->ScanReverse(startKey, upperKey, maxRange, snapshot, result, &needPrune);
+        // Prune 可能把空节点合并到前一个节点, 先记下这个节点的下界
+        upperKey = cur->GetMin();
+        ListNode *prev = cur->GetPrev();
+        if (needPrune) {
+            cur->Prune(snapshot, genId);
+        }
+        end |= startKey >= upperKey;
+        if (end && cursor != nullptr) {
+            // 下一批以最小的 key 为上界, 它在这个节点或者之前的节点中
+            cursor->m_node = cur;
+            cursor->m_genId = genId;
+        }
+        cur->getVersionedLock().unlock();
+        if (end || prev == nullptr) {
+            break;
+        }
+        cur = searchAndLockNode(prev, genId, upperKey, true);
+    }
+    return true;
+}
+
 void LinkedList::Recover(void *sl) {
     genId++;
     auto art = (SearchLayer *)sl;
 
     for (int i = 0; i < NVMDB_NUM_LOGS_PER_THREAD * NVMDB_MAX_THREAD_NUM; i++) {
         auto oplog = (OpStruct *)PMem::getOpLog(i);
-        if (oplog->op == OpStruct::done || oplog->op == OpStruct::dummy) {
+        if (oplog->op == OpStruct::done || oplog->op == OpStruct::dummy || oplog->treeId != treeId) {
             continue;
         }
         if (!(oplog->searchLayers.load() & art->grpMask)) {
@@ -246,4 +301,16 @@ void LinkedList::Recover(void *sl) {
     }
 }
 
+void LinkedList::Destroy() {
+    // 合并时摘下的节点不在链表上, 和运行期间一样不回收
+    NVMPtr<ListNode> cur = headPtr;
+    while (cur.getVaddr() != nullptr) {
+        NVMPtr<ListNode> next = cur.getVaddr()->GetNextPtr();
+        PMem::free((void *)cur.getRawPtr());
+        cur = next;
+    }
+    headPtr = NVMPtr<ListNode>();
+    tailPtr = NVMPtr<ListNode>();
+}
+
 }  // namespace NVMDB
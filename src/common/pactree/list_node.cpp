@@ -1,4 +1,5 @@
 #include "common/pactree/list_node.h"
+#include <immintrin.h>
 
 namespace NVMDB {
 
@@ -13,15 +14,9 @@ void SetPACTreeWhiteBoxBP(PACTreeWhiteBoxType type) {
     g_whiteBoxType = type;
 }
 
-static void destroy_remain_key(VarLenString *remain_key) {
-    auto key = (Key_t *)remain_key;
-    delete key;
-}
-
-VarLenString *ListNode::GetRemainKey(Key_t *origin_key) const {
-    auto *remain_key = new Key_t();
-    remain_key->set(origin_key->getData() + prefix.keyLength, origin_key->keyLength - prefix.keyLength);
-    return (VarLenString *)remain_key;
+VarLenString *ListNode::GetRemainKey(Key_t *origin_key, Key_t *buf) const {
+    buf->set(origin_key->getData() + prefix.keyLength, origin_key->keyLength - prefix.keyLength);
+    return (VarLenString *)buf;
 }
 
 void ListNode::GetOriginKey(VarLenString *remain_key, Key_t *origin_key) {
@@ -57,14 +52,117 @@ uint8_t ListNode::GetKeyFingerPrint(VarLenString *key) {
     return static_cast<uint8_t>(hash & 0xFF);
 }
 
+namespace {
+
+constexpr int PROBE_MASK_WORDS = 2;
+constexpr int PROBE_WORD_BITS = 64;
+constexpr int AVX2_LANES = 32;
+
+using FingerprintProbeFunc = void (*)(const uint8_t *fingerPrints, uint8_t keyHash, uint32_t count, uint64_t *mask);
+
+void ProbeScalar(const uint8_t *fingerPrints, uint8_t keyHash, uint32_t count, uint64_t *mask) {
+    mask[0] = 0;
+    mask[1] = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (fingerPrints[i] == keyHash) {
+            mask[i / PROBE_WORD_BITS] |= 1ULL << (i % PROBE_WORD_BITS);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) void ProbeAVX2(const uint8_t *fingerPrints, uint8_t keyHash, uint32_t count,
+                                              uint64_t *mask) {
+    const __m256i target = _mm256_set1_epi8(static_cast<char>(keyHash));
+    uint32_t bits[FINGERPRINT_PROBE_SLOTS / AVX2_LANES];
+    for (int i = 0; i < FINGERPRINT_PROBE_SLOTS / AVX2_LANES; i++) {
+        __m256i fps = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fingerPrints + i * AVX2_LANES));
+        bits[i] = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(fps, target)));
+    }
+    mask[0] = bits[0] | (static_cast<uint64_t>(bits[1]) << AVX2_LANES);
+    mask[1] = bits[2];
+}
+
+__attribute__((target("avx512f,avx512bw,avx2"))) void ProbeAVX512(const uint8_t *fingerPrints, uint8_t keyHash,
+                                                                  uint32_t count, uint64_t *mask) {
+    const __m512i fps = _mm512_loadu_si512(fingerPrints);
+    mask[0] = _mm512_cmpeq_epi8_mask(fps, _mm512_set1_epi8(static_cast<char>(keyHash)));
+    __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fingerPrints + PROBE_WORD_BITS));
+    auto tailBits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(tail, _mm256_set1_epi8(static_cast<char>(keyHash))));
+    mask[1] = static_cast<uint32_t>(tailBits);
+}
+
+FingerprintProbeFunc GetProbeFunc(FingerprintProbe kind) {
+    switch (kind) {
+        case FingerprintProbe::AVX512:
+            return ProbeAVX512;
+        case FingerprintProbe::AVX2:
+            return ProbeAVX2;
+        case FingerprintProbe::SCALAR:
+            break;
+    }
+    return ProbeScalar;
+}
+
+FingerprintProbe g_probeKind = BestFingerprintProbe();
+FingerprintProbeFunc g_probeFunc = GetProbeFunc(g_probeKind);
+
+}  // namespace
+
+bool FingerprintProbeSupported(FingerprintProbe kind) {
+    // 可能在静态初始化时调用, 这时 libgcc 还没有初始化 CPU 信息
+    __builtin_cpu_init();
+    switch (kind) {
+        case FingerprintProbe::SCALAR:
+            return true;
+        case FingerprintProbe::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case FingerprintProbe::AVX512:
+            return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx2");
+    }
+    return false;
+}
+
+FingerprintProbe BestFingerprintProbe() {
+    if (FingerprintProbeSupported(FingerprintProbe::AVX512)) {
+        return FingerprintProbe::AVX512;
+    }
+    return FingerprintProbeSupported(FingerprintProbe::AVX2) ? FingerprintProbe::AVX2 : FingerprintProbe::SCALAR;
+}
+
+FingerprintProbe CurrentFingerprintProbe() {
+    return g_probeKind;
+}
+
+bool SetFingerprintProbe(FingerprintProbe kind) {
+    if (!FingerprintProbeSupported(kind)) {
+        return false;
+    }
+    g_probeKind = kind;
+    g_probeFunc = GetProbeFunc(kind);
+    return true;
+}
+
 int ListNode::GetKeyIndex(VarLenString *key, uint8_t keyHash) {
     const LinePointArray *lpa = GetCurrPerm();
-    for (int i = 0; i < lpa->count; i++) {
-        if (lpa->GetFingerPrint(i) == keyHash) {
+    const uint32_t count = lpa->count;
+    uint64_t mask[PROBE_MASK_WORDS];
+    g_probeFunc(lpa->fingerPrints, keyHash, count, mask);
+    // 屏蔽 count 之后的 slot
+    if (count < PROBE_WORD_BITS) {
+        mask[0] &= (1ULL << count) - 1;
+        mask[1] = 0;
+    } else {
+        mask[1] &= (1ULL << (count - PROBE_WORD_BITS)) - 1;
+    }
+    for (int w = 0; w < PROBE_MASK_WORDS; w++) {
+        uint64_t bits = mask[w];
+        while (bits != 0) {
+            int i = w * PROBE_WORD_BITS + __builtin_ctzll(bits);
             auto kv = GetKVItem(lpa->GetOffset(i));
             if (kv->key == *key) {
                 return i;
             }
+            bits &= bits - 1;
         }
     }
     return -1;
@@ -76,7 +174,7 @@ uint8_t ListNode::PermuteLowerBound(VarLenString *key) {
     uint8_t upper = lpa->count;
     do {
         int mid = ((upper - lower) / 2) + lower;
-        auto offset = lpa->linePoint[mid].offset;
+        auto offset = lpa->GetOffset(mid);
         auto kvItem = GetKVItem(offset);
         if (*key > kvItem->key) {
             lower = mid + 1;
@@ -89,8 +187,10 @@ uint8_t ListNode::PermuteLowerBound(VarLenString *key) {
 
 void ListNode::UpdateAtIndex(Val_t value, int index) {
     LinePointArray *lpa = GetCurrPerm();
-    KVItem *kvItem = GetKVItem(lpa->linePoint[index].offset);
+    KVItem *kvItem = GetKVItem(lpa->GetOffset(index));
     kvItem->value = value;
+    NVMWritten(&kvItem->value, sizeof(kvItem->value));
+    NVMPersist(&kvItem->value, sizeof(kvItem->value));
 }
 
 static std::atomic<int> g_linepointFull;
@@ -132,6 +232,9 @@ int ListNode::InsertKVItem(VarLenString *key, Val_t value, bool duringSplit) {
     kvItem->value = value;
     std::atomic_thread_fence(std::memory_order_release);
     kvItem->key.set(key->getData(), key->keyLength);
+    NVMWritten(kvItem, size);
+    // 只刷出, UpdatePermutation 在切换 currPerm 之前的 fence 保证它先于新的 permutation 持久化
+    NVMFlush(kvItem, size);
     int nextOffset = offset + (size + KV_ALIGN_BYTES - 1) / KV_ALIGN_BYTES;
     if (nextOffset >= MAX_OFFSET) {
         nextKv = MAX_OFFSET;
@@ -150,59 +253,31 @@ void ListNode::UpdatePermutation(KVItem *kvItem, uint8_t offset, uint8_t keyHash
 
     CHECK(nextLpa->count < MAX_ENTRIES);
     for (uint8_t i = nextLpa->count; i > startIndex; i--) {
-        nextLpa->linePoint[i] = nextLpa->linePoint[i - 1];
+        nextLpa->MoveLinePoint(i, i - 1);
     }
     if (g_whiteBoxType == PACTreeWhiteBoxType::UPDATE_PERMUTATION) {
         throw std::invalid_argument("update permutation white box exception");
     }
-    nextLpa->linePoint[startIndex] = {.offset = offset, .fingerPrint = keyHash};
+    nextLpa->SetLinePoint(startIndex, offset, keyHash);
     nextLpa->count++;
+    NVMWritten(nextLpa, sizeof(LinePointArray));
+    // KV item 和不在使用中的 permutation 都持久化之后才能切换, 崩溃后 currPerm 指向的数组总是完整的
+    NVMFlush(nextLpa, sizeof(LinePointArray));
+    NVMFence();
     SwitchPerm();
+    NVMWritten(&currPerm, sizeof(currPerm));
+    NVMPersist(&currPerm, sizeof(currPerm));
 }
 
-ListNode::MVCCVisibility ListNode::CheckMVCCVisibility(KVItem *kv, LookupSnapshot snapshot) {
-    if (TxInfoIsTxSlot(kv->value)) {
-        /* value 存的是 TxSlotPtr */
-        TransactionInfo txInfo{};
-        bool recycled = !GetTransactionInfo(kv->value, &txInfo);
-        if (recycled) {
-            /* 事务已提交，且slot被回收了 */
-            return MVCCVisibility::REMOVABLE;
-        }
-        DCHECK(txInfo.status != TxSlotStatus::EMPTY);
-        if (txInfo.status == TxSlotStatus::COMMITTED) {
-            /* 事务已提交 */
-            if (txInfo.csn < snapshot.min_csn) {
-                return MVCCVisibility::REMOVABLE;
-            } else {
-                kv->value = txInfo.csn;
-            }
-        }
-        /* 其它情况，说明删除事务正在执行，或者已经被回滚，那么 对自己是可见的，可以往下走 */
-    }
-
-    if (TxInfoIsCSN(kv->value)) {
-        /* 删除的事务的CSN已经回填 */
-        if (kv->value < snapshot.min_csn) {
-            return MVCCVisibility::REMOVABLE;
-        }
-        if (kv->value < snapshot.snapshot) {
-            /* 删除的事务对自己是可见的，所以该 IndexTuple 是不可见的 */
-            return MVCCVisibility::INVISIBLE;
-        }
-    }
-    return MVCCVisibility::VISIBLE;
-}
-
-void ListNode::RemoveFromPermutation(std::vector<std::pair<uint8_t, int>> &items) {
+void ListNode::RemoveFromPermutation(const std::pair<uint8_t, int> *items, int itemCount) {
     auto currLpa = GetCurrPerm();
     auto nextLpa = GetNextPerm();
 
     int j = 0;
     int k = 0;
     for (int i = 0; i < currLpa->count; i++) {
-        if (k >= items.size() || i != items[k].first) {
-            nextLpa->linePoint[j] = currLpa->linePoint[i];
+        if (k >= itemCount || i != items[k].first) {
+            nextLpa->SetLinePoint(j, currLpa->GetOffset(i), currLpa->GetFingerPrint(i));
             j++;
         } else {
             nextLpa->recyclable += CM_ALIGN_ANY(items[k].second, KV_ALIGN_BYTES) / KV_ALIGN_BYTES;
@@ -210,7 +285,12 @@ void ListNode::RemoveFromPermutation(std::vector<std::pair<uint8_t, int>> &items
         }
     }
     nextLpa->count = j;
+    NVMWritten(nextLpa, sizeof(LinePointArray));
+    NVMFlush(nextLpa, sizeof(LinePointArray));
+    NVMFence();
     SwitchPerm();
+    NVMWritten(&currPerm, sizeof(currPerm));
+    NVMPersist(&currPerm, sizeof(currPerm));
 }
 
 void ListNode::Shrink() {
@@ -226,12 +306,12 @@ void ListNode::Shrink() {
     uint8_t newOffset = 0;
 
     for (int i = 0; i < lpa->count; i++) {
-        auto kv = GetKVItem(lpa->linePoint[i].offset);
+        auto kv = GetKVItem(lpa->GetOffset(i));
         auto newKv = reinterpret_cast<KVItem *>(buf + KV_ALIGN_BYTES * newOffset);
         newKv->value = kv->value;
         newKv->key.set(kv->key.getData() + prefixDelta, kv->key.keyLength - prefixDelta);
 
-        newLpa.linePoint[i] = {.offset = newOffset, .fingerPrint = GetKeyFingerPrint(&newKv->key)};
+        newLpa.SetLinePoint(i, newOffset, GetKeyFingerPrint(&newKv->key));
         newOffset += ALIGN_ANY(GetKVItemSize(newKv), KV_ALIGN_BYTES) / KV_ALIGN_BYTES;
     }
     newLpa.recyclable = 0;
@@ -259,15 +339,27 @@ NVMPtr<ListNode> ListNode::Split(Key_t &key, Val_t value) {
     OpStruct *oplog = Oplog::allocOpLog();
     errno_t ret = memcpy_s((void *)oplog->oldNodeData, LIST_NODE_SIZE, (void *)this, LIST_NODE_SIZE);
     SecureRetCheck(ret);
+    {
+        PersistTagScope oplogTag(PersistTag::OPLOG);
+        NVMWritten(oplog->oldNodeData, LIST_NODE_SIZE);
+        // 由 WriteOpLog 中的 fence 和 oplog 的其他部分一起持久化
+        NVMFlush(oplog->oldNodeData, LIST_NODE_SIZE);
+    }
 
     // 1) Add Oplog and set the information for current(overflown) node.
-    Oplog::WriteOpLog(oplog, OpStruct::insert, new_min, (void *)curPtr.getRawPtr(), 0, key, value);
+    Oplog::WriteOpLog(oplog, treeId, OpStruct::insert, new_min, (void *)curPtr.getRawPtr(), 0, key, value);
+    // 旧节点的副本持久化之后才能修改节点, 崩溃后从 during_split 的 oplog 恢复
     oplog->step = OpStruct::during_split;
+    {
+        PersistTagScope oplogTag(PersistTag::OPLOG);
+        NVMPersist(&oplog->step, sizeof(oplog->step));
+    }
 
     if (lpa->recyclable > MAX_RECYCLE) {
         // if the node is recyclable, shrink directly.
         Shrink();
         Insert(key, value, 1);
+        NVMPersist(this, LIST_NODE_SIZE);
         oplog->op = OpStruct::done;  // no need to update search layer
         return curPtr;
     }
@@ -279,6 +371,7 @@ NVMPtr<ListNode> ListNode::Split(Key_t &key, Val_t value) {
 
     memset_s((void *)newNodePtr.getVaddr(), sizeof(ListNode), 0, sizeof(ListNode));
     auto newNode = (ListNode *)new (newNodePtr.getVaddr()) ListNode();
+    newNode->SetTreeId(treeId);
 
     // 3) Perform Split Operation
     //    3-1) Update New node
@@ -302,10 +395,7 @@ NVMPtr<ListNode> ListNode::Split(Key_t &key, Val_t value) {
         new_kv->value = kv->value;
         new_kv->key.set(kv->key.getData() + prefixDelta, kv->key.keyLength - prefixDelta);
 
-        newNode_lpa->linePoint[newNode_lpa->count] = {
-            .offset = (uint8_t)offset,
-            .fingerPrint = GetKeyFingerPrint(&new_kv->key)
-        };
+        newNode_lpa->SetLinePoint(newNode_lpa->count, (uint8_t)offset, GetKeyFingerPrint(&new_kv->key));
         newNode_lpa->count++;
 
         // not worry about overflow, as total node size must be smaller than the old node.
@@ -334,8 +424,17 @@ NVMPtr<ListNode> ListNode::Split(Key_t &key, Val_t value) {
      * Thus, we change the list link only after all modification has finished.
      */
     ListNode *nextNode = GetNext();
+    // 新节点和分裂后的旧节点先持久化, 再链入链表并推进 oplog
+    NVMFlush(newNode, LIST_NODE_SIZE);
+    NVMFlush(this, LIST_NODE_SIZE);
+    NVMFence();
     SetNext(newNodePtr);
+    NVMPersist(&nextPtr, sizeof(nextPtr));
     oplog->step = OpStruct::finish_split;
+    {
+        PersistTagScope oplogTag(PersistTag::OPLOG);
+        NVMPersist(oplog, sizeof(OpStruct) - sizeof(oplog->oldNodeData));
+    }
 
     if (nextNode != nullptr) {
         nextNode->SetPrev(newNodePtr);
@@ -347,19 +446,18 @@ NVMPtr<ListNode> ListNode::Split(Key_t &key, Val_t value) {
 }
 
 bool ListNode::Insert(Key_t &key, Val_t value, int duringSplit) {
-    auto remain_key = GetRemainKey(&key);
+    Key_t remainBuf;
+    auto remain_key = GetRemainKey(&key, &remainBuf);
     uint8_t keyHash = GetKeyFingerPrint(remain_key);
     int index = GetKeyIndex(remain_key, keyHash);
     if (index >= 0) {
         // key exists
         UpdateAtIndex(value, index);
-        destroy_remain_key(remain_key);
         return true;
     }
 
     // key not exists, insert into current node if free space is enough
     int offset = InsertKVItem(remain_key, value, duringSplit);
-    destroy_remain_key(remain_key);
     if (offset < 0) {  // need split
         CHECK(!duringSplit);
         Split(key, value);
@@ -374,14 +472,14 @@ bool ListNode::Insert(Key_t &key, Val_t value, int duringSplit) {
 }
 
 bool ListNode::Lookup(Key_t &key, Val_t &value) {
-    auto remain_key = GetRemainKey(&key);
+    Key_t remainBuf;
+    auto remain_key = GetRemainKey(&key, &remainBuf);
     uint8_t keyHash = GetKeyFingerPrint(remain_key);
     int index = GetKeyIndex(remain_key, keyHash);
-    destroy_remain_key(remain_key);
 
     if (index >= 0) {
         auto lpa = GetCurrPerm();
-        auto kv = GetKVItem(lpa->linePoint[index].offset);
+        auto kv = GetKVItem(lpa->GetOffset(index));
         value = kv->value;
         return true;
     }
@@ -390,18 +488,18 @@ bool ListNode::Lookup(Key_t &key, Val_t &value) {
 
 bool ListNode::ScanInOrder(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot,
                            std::vector<std::pair<Key_t, Val_t>> &result, bool continueScan, bool *needPrune) {
+    Key_t edBuf;
     VarLenString *ed_remain;
     if (endKey >= max) {
-        ed_remain = GetRemainKey(&max);
+        ed_remain = GetRemainKey(&max, &edBuf);
     } else {
-        ed_remain = GetRemainKey(&endKey);
+        ed_remain = GetRemainKey(&endKey, &edBuf);
     }
     uint8_t startIndex = 0;
     if (!continueScan) {
         DCHECK(startKey >= GetMin() && startKey < GetMax());
-        auto st_remain = GetRemainKey(&startKey);
-        startIndex = PermuteLowerBound(st_remain);
-        destroy_remain_key(st_remain);
+        Key_t stBuf;
+        startIndex = PermuteLowerBound(GetRemainKey(&startKey, &stBuf));
     }
 
     int todo = maxRange - (int)result.size();
@@ -411,7 +509,7 @@ bool ListNode::ScanInOrder(Key_t &startKey, Key_t &endKey, int maxRange, LookupS
     auto lpa = GetCurrPerm();
     for (uint8_t i = startIndex; i < lpa->count && todo > 0; i++) {
         scanItems++;
-        auto kv = GetKVItem(lpa->linePoint[i].offset);
+        auto kv = GetKVItem(lpa->GetOffset(i));
         auto status = CheckMVCCVisibility(kv, snapshot);
         if (kv->key >= *ed_remain) {
             end = true;
@@ -431,7 +529,52 @@ bool ListNode::ScanInOrder(Key_t &startKey, Key_t &endKey, int maxRange, LookupS
 
     *needPrune = (scanItems > 0 && removeItems >= scanItems / SCAN_ITEM_DIV);
 
-    destroy_remain_key(ed_remain);
+    if (end) {
+        return true;
+    }
+    return result.size() == maxRange;
+}
+
+bool ListNode::ScanReverse(Key_t &startKey, Key_t &upperKey, int maxRange, LookupSnapshot snapshot,
+                           std::vector<std::pair<Key_t, Val_t>> &result, bool *needPrune) {
+    DCHECK(upperKey > GetMin() && upperKey <= GetMax());
+    auto lpa = GetCurrPerm();
+    uint8_t upperIndex = lpa->count;
+    if (upperKey < max && lpa->count != 0) {
+        Key_t upBuf;
+        upperIndex = PermuteLowerBound(GetRemainKey(&upperKey, &upBuf));
+    }
+    Key_t stBuf;
+    VarLenString *st_remain = nullptr;
+    if (startKey > min) {
+        st_remain = GetRemainKey(&startKey, &stBuf);
+    }
+
+    int todo = maxRange - (int)result.size();
+    bool end = false;
+    int removeItems = 0;
+    int scanItems = 0;
+    for (int i = upperIndex - 1; i >= 0 && todo > 0; i--) {
+        scanItems++;
+        auto kv = GetKVItem(lpa->GetOffset(i));
+        if (st_remain != nullptr && kv->key < *st_remain) {
+            end = true;
+            break;
+        }
+        auto status = CheckMVCCVisibility(kv, snapshot);
+        if (status == MVCCVisibility::VISIBLE) {
+            Key_t match;
+            CHECK(kv->key.keyLength != 0);
+            GetOriginKey(&kv->key, &match);
+            result.emplace_back(match, kv->value);
+            todo--;
+        } else if (status == MVCCVisibility::REMOVABLE) {
+            removeItems++;
+        }
+    }
+
+    *needPrune = (scanItems > 0 && removeItems >= scanItems / SCAN_ITEM_DIV);
+
     if (end) {
         return true;
     }
@@ -445,16 +588,17 @@ void ListNode::RecoverSplit(OpStruct *oplog) {
 
 void ListNode::Prune(LookupSnapshot snapshot, uint64_t genId) {
     auto lpa = GetCurrPerm();
-    std::vector<std::pair<uint8, int>> remove_items;
+    std::pair<uint8, int> remove_items[MAX_ENTRIES];
+    int removeCount = 0;
     for (int i = 0; i < lpa->count; i++) {
-        auto kv = GetKVItem(lpa->linePoint[i].offset);
+        auto kv = GetKVItem(lpa->GetOffset(i));
         auto status = CheckMVCCVisibility(kv, snapshot);
         if (status == MVCCVisibility::REMOVABLE) {
-            remove_items.emplace_back(i, GetKVItemSize(kv));
+            remove_items[removeCount++] = {i, GetKVItemSize(kv)};
         }
     }
-    if (!remove_items.empty()) {
-        RemoveFromPermutation(remove_items);
+    if (removeCount != 0) {
+        RemoveFromPermutation(remove_items, removeCount);
         lpa = GetCurrPerm();
         if (lpa->count == 0) {
             MergeEmptyNodeWithPrev(genId);
@@ -492,7 +636,7 @@ void ListNode::MergeEmptyNodeWithPrev(uint64_t genId) {
 
     prevNode->getVersionedLock().unlock();
 
-    Oplog::WriteOpLog(oplog, OpStruct::remove, GetMin(), (void *)curPtr.getRawPtr(), curPtr.getPoolId(), Key_t(-1), -1);
+    Oplog::WriteOpLog(oplog, treeId, OpStruct::remove, GetMin(), (void *)curPtr.getRawPtr(), curPtr.getPoolId(), Key_t(-1), -1);
     Oplog::EnqPerThreadLog(oplog);
 }
 
@@ -33,9 +33,10 @@ constexpr int SLEEP_TIME = 200;
 #define HYDRALIST_RESET_TIMERS()
 #endif
 
-std::vector<WorkerThread *> g_WorkerThreadInst(NVMDB_MAX_GROUP *NVMDB_OPLOG_WORKER_THREAD_PER_GROUP);
+DEFINE_int32(pactree_combiner_threads, 1, "the number of PACTree combiner threads, each merges the oplogs of a key shard");
+DEFINE_int32(pactree_workers_per_group, 1, "the number of PACTree worker threads updating the search layer of a NUMA group");
 
-std::vector<SearchLayer *> g_perGrpSlPtr(NVMDB_MAX_GROUP);
+std::vector<WorkerThread *> g_WorkerThreadInst(NVMDB_MAX_GROUP *NVMDB_OPLOG_MAX_WORKER_THREAD_PER_GROUP);
 
 std::set<ThreadData *> g_threadDataSet;
 
@@ -43,13 +44,20 @@ std::atomic<bool> g_globalStop;
 
 std::atomic<bool> g_combinerStop;
 
+// 还没有退出的 combiner 个数, 最后一个退出的 combiner 通知 worker 退出
+static std::atomic<int> g_combinerRunning;
+
 thread_local ThreadData *g_curThreadData = nullptr;
 
+std::vector<std::thread *> *PACTreeImpl::wtArray = nullptr;
+
+std::vector<std::thread *> *PACTreeImpl::combinerArray = nullptr;
+
 volatile int PACTreeImpl::totalGroupActive = 0;
 
-volatile bool threadInitialized[NVMDB_MAX_GROUP];
+std::atomic<uint32_t> PACTreeImpl::numThreads{0};
 
-volatile bool slReady[NVMDB_MAX_GROUP];
+volatile bool g_workerReady[NVMDB_MAX_GROUP * NVMDB_OPLOG_MAX_WORKER_THREAD_PER_GROUP];
 
 std::mutex g_threadDataLock;
 
@@ -57,21 +65,40 @@ uint64_t g_removeCount;
 
 volatile std::atomic<bool> g_removeDetected;
 
-void workerThreadExec(int threadId, int activeGrp, root_obj *root) {
+/*
+ * 持久化的树注册表, 挂在内存池的根对象上 (root->ptr[1]), 下标是 tree id.
+ * 0 号默认树不在注册表中, 它挂在 root->ptr[0] 上
+ */
+struct PACTreeRegistry {
+    struct Entry {
+        uint32_t m_inUse;
+        uint32_t m_idxId;
+        PMEMoid m_root;
+    };
+    Entry m_entries[PACTREE_MAX_TREES];
+};
+
+static PACTreeRegistry *g_treeRegistry = nullptr;
+
+// 已经打开的树, worker 按 oplog 中的 tree id 在这里找 search layer
+static std::atomic<PACTreeImpl *> g_trees[PACTREE_MAX_TREES];
+
+static std::mutex g_treeRegistryLock;
+
+PACTreeImpl *GetTreeById(uint16_t treeId) {
+    DCHECK(treeId < PACTREE_MAX_TREES);
+    return g_trees[treeId].load(std::memory_order_acquire);
+}
+
+void workerThreadExec(int threadId, int activeGrp) {
     CHECK(activeGrp > 0);
-    auto groupId = threadId / NVMDB_OPLOG_WORKER_THREAD_PER_GROUP;
+    auto groupId = threadId % activeGrp;
     auto thread_name = std::string("PACTreeW_") + std::to_string(threadId);
     pthread_setname_np(pthread_self(), thread_name.c_str());
     NumaBinding::bindThreadToNode(groupId);
     WorkerThread wt(threadId, activeGrp);
     g_WorkerThreadInst[threadId] = &wt;
-    if (threadId < activeGrp) {
-        while (threadInitialized[threadId] == 0) { }
-        slReady[threadId] = false;
-        g_perGrpSlPtr[threadId] = PACTreeImpl::CreateSearchLayer(root, threadId);
-        g_perGrpSlPtr[threadId]->SetGroupId(threadId);
-        slReady[threadId] = true;
-    }
+    g_workerReady[threadId] = true;
     int count = 0;
     uint64_t lastRemoveCount = 0;
     while (!g_combinerStop) {
@@ -135,19 +162,21 @@ void BroadcastDoneCount(uint64_t removeCount) {
     g_removeCount = removeCount;
 }
 
-void CombinerThreadExec(int activeGrp) {
-    pthread_setname_np(pthread_self(), "PACTreeCombiner");
-    CombinerThread ct;
+void CombinerThreadExec(int shard, int workerNum) {
+    auto thread_name = std::string("PACTreeC_") + std::to_string(shard);
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+    CombinerThread ct(shard);
     int count = 0;
     while (!g_globalStop) {
         std::vector<OpStruct *> *mergedLog = ct.combineLogs();
         if (mergedLog != nullptr) {
             count++;
-            ct.broadcastMergedLog(mergedLog, activeGrp);
+            ct.broadcastMergedLog(mergedLog, workerNum);
         }
-        uint64_t doneCountWt = ct.FreeMergedLogs(activeGrp, false);
+        uint64_t doneCountWt = ct.FreeMergedLogs(workerNum, false);
         std::vector<ThreadData *> threadsToWait;
-        if (g_removeDetected && doneCountWt != 0) {
+        // 宽限期只由第一个 combiner 处理
+        if (shard == 0 && g_removeDetected && doneCountWt != 0) {
             uint64_t gpStartTime = gracePeriodInit(threadsToWait);
             waitForThreads(threadsToWait, gpStartTime);
             BroadcastDoneCount(doneCountWt);
@@ -162,27 +191,106 @@ void CombinerThreadExec(int activeGrp) {
         std::vector<OpStruct *> *mergedLog = ct.combineLogs();
         if (mergedLog != nullptr) {
             count++;
-            ct.broadcastMergedLog(mergedLog, activeGrp);
+            ct.broadcastMergedLog(mergedLog, workerNum);
         }
     }
     while (!ct.MergedLogsToBeFreed()) {
-        ct.FreeMergedLogs(activeGrp, true);
+        ct.FreeMergedLogs(workerNum, true);
+    }
+    if (g_combinerRunning.fetch_sub(1) == 1) {
+        g_combinerStop = true;
     }
-    g_combinerStop = true;
 }
 
-void PACTreeImpl::CreateWorkerThread(int numGrp, root_obj *root) {
-    for (int i = 0; i < numGrp * NVMDB_OPLOG_WORKER_THREAD_PER_GROUP; i++) {
-        threadInitialized[i % numGrp] = false;
-        auto *wt = new std::thread(workerThreadExec, i, numGrp, root);
-        usleep(1);
-        wtArray->push_back(wt);
-        threadInitialized[i % numGrp] = true;
+void PACTreeImpl::CreateWorkerThread(int numGrp) {
+    int workerNum = numGrp * g_oplogWorkersPerGroup;
+    for (int i = 0; i < workerNum; i++) {
+        g_workerReady[i] = false;
+        wtArray->push_back(new std::thread(workerThreadExec, i, numGrp));
+    }
+    for (int i = 0; i < workerNum; i++) {
+        while (!g_workerReady[i]) { }
     }
 }
 
 void PACTreeImpl::CreateCombinerThread() {
-    combinerThead = new std::thread(CombinerThreadExec, totalGroupActive);
+    g_combinerRunning = g_oplogCombinerNum;
+    for (int i = 0; i < g_oplogCombinerNum; i++) {
+        combinerArray->push_back(new std::thread(CombinerThreadExec, i, totalGroupActive * g_oplogWorkersPerGroup));
+    }
+}
+
+void PACTreeImpl::StartBackgroundThreads(int numGrp) {
+    InitGlobalLogMgr();
+    totalGroupActive = numGrp;
+    wtArray = new std::vector<std::thread *>;
+    combinerArray = new std::vector<std::thread *>;
+    g_oplogCombinerNum = std::min(std::max(FLAGS_pactree_combiner_threads, 1), NVMDB_OPLOG_MAX_COMBINER_THREAD);
+    g_oplogWorkersPerGroup =
+        std::min(std::max(FLAGS_pactree_workers_per_group, 1), NVMDB_OPLOG_MAX_WORKER_THREAD_PER_GROUP);
+    LOG(INFO) << "PACTree oplog: " << g_oplogCombinerNum << " combiner threads, " << g_oplogWorkersPerGroup
+              << " worker threads per group.";
+    g_WorkerThreadInst.assign(NVMDB_MAX_GROUP * NVMDB_OPLOG_MAX_WORKER_THREAD_PER_GROUP, nullptr);
+    g_threadDataSet.clear();
+    g_globalStop = false;
+    g_combinerStop = false;
+    CreateWorkerThread(numGrp);
+    CreateCombinerThread();
+}
+
+void PACTreeImpl::StopBackgroundThreads() {
+    g_globalStop = true;
+    for (auto &t : *wtArray) {
+        t->join();
+        delete t;
+    }
+    for (auto &t : *combinerArray) {
+        t->join();
+        delete t;
+    }
+    delete combinerArray;
+    combinerArray = nullptr;
+    delete wtArray;
+    wtArray = nullptr;
+}
+
+static bool OplogPending(const volatile OpStruct *oplog) {
+    return oplog->op != OpStruct::done && oplog->op != OpStruct::dummy;
+}
+
+/* 等待 treeId 的 oplog 都被 worker 应用到 search layer */
+static void WaitTreeOplogs(uint16_t treeId) {
+    for (int i = 0; i < NVMDB_NUM_LOGS_PER_THREAD * NVMDB_MAX_THREAD_NUM; i++) {
+        auto oplog = (volatile OpStruct *)PMem::getOpLog(i);
+        while (OplogPending(oplog) && oplog->treeId == treeId) {
+            usleep(1);
+        }
+    }
+}
+
+/* 等待当前所有读者离开读临界区 (见 ThreadData::ReadLock), 之后它们不会再访问已经注销的树 */
+static void WaitReaders() {
+    std::lock_guard<std::mutex> guard(g_threadDataLock);
+    uint64_t gpStartTime = ordo_get_clock();
+    std::vector<ThreadData *> threadsToWait;
+    for (auto td : g_threadDataSet) {
+        if (!td->GetFinish() && td->GetRunCnt() % RUN_CNT_MOD != 0) {
+            threadsToWait.push_back(td);
+        }
+    }
+    waitForThreads(threadsToWait, gpStartTime);
+}
+
+/* 所有的树都打开之后, 剩下没有完成的 oplog 属于已经删除的树, 直接丢弃 */
+static void DiscardOrphanOplogs() {
+    for (int i = 0; i < NVMDB_NUM_LOGS_PER_THREAD * NVMDB_MAX_THREAD_NUM; i++) {
+        auto oplog = (OpStruct *)PMem::getOpLog(i);
+        if (OplogPending(oplog) && GetTreeById(oplog->treeId) == nullptr) {
+            oplog->op = OpStruct::done;
+            flushToNVM((char *)oplog, sizeof(oplog->op));
+        }
+    }
+    smp_wmb();
 }
 
 PACTreeImpl *InitPT() {
@@ -192,72 +300,115 @@ PACTreeImpl *InitPT() {
     int isCreate;
     PMem::CreatePMemPool(&isCreate, &root, &sl_root);
     int poolNum = PMem::GetPoolNum();
+    PACTreeImpl::StartBackgroundThreads(poolNum);
+    auto *pop = (PMEMobjpool *)PMem::getBaseOf(1);
+    // 先建注册表再建默认树; 崩溃时两者都可能还没有建立, 没有的在这里补建
+    if (OID_IS_NULL(root->ptr[1])) {
+        CHECK(pmemobj_zalloc(pop, &(root->ptr[1]), sizeof(PACTreeRegistry), 0) == 0);
+        flushToNVM((char *)root, sizeof(root_obj));
+        smp_wmb();
+    }
+    g_treeRegistry = (PACTreeRegistry *)pmemobj_direct(root->ptr[1]);
+    CHECK(g_treeRegistry != nullptr);
+    PACTreeImpl *pt;
+    if (OID_IS_NULL(root->ptr[0])) {
+        CHECK(pmemobj_alloc(pop, &(root->ptr[0]), sizeof(PACTreeImpl), 0, nullptr, nullptr) == 0);
+        pt = new (pmemobj_direct(root->ptr[0])) PACTreeImpl(PACTREE_DEFAULT_TREE, poolNum);
+        flushToNVM((char *)root, sizeof(root_obj));
+        smp_wmb();
+    } else {
+        pt = (PACTreeImpl *)pmemobj_direct(root->ptr[0]);
+    }
+    g_trees[PACTREE_DEFAULT_TREE].store(pt, std::memory_order_release);
+    for (int i = PACTREE_DEFAULT_TREE + 1; i < PACTREE_MAX_TREES; i++) {
+        auto &entry = g_treeRegistry->m_entries[i];
+        if (entry.m_inUse != 0) {
+            g_trees[i].store((PACTreeImpl *)pmemobj_direct(entry.m_root), std::memory_order_release);
+        }
+    }
     if (isCreate == 0) {
-        auto *pt = (PACTreeImpl *)pmemobj_direct(root->ptr[0]);
-        pt->Init(poolNum, sl_root);
-        return pt;
+        // 每棵树分别重做自己的 oplog
+        PACTreeImpl::RegisterThread();
+        for (auto &tree : g_trees) {
+            PACTreeImpl *opened = tree.load(std::memory_order_relaxed);
+            if (opened != nullptr) {
+                opened->Open(poolNum);
+            }
+        }
+        PACTreeImpl::UnregisterThread();
+        DiscardOrphanOplogs();
     }
-
-    auto *pop = (PMEMobjpool *)PMem::getBaseOf(1);
-    pmemobj_alloc(pop, &(root->ptr[0]), sizeof(PACTreeImpl), 0, nullptr, nullptr);
-    void *rootVirtAddr = pmemobj_direct(root->ptr[0]);
-    auto *pt = (PACTreeImpl *)new (rootVirtAddr) PACTreeImpl(poolNum, sl_root);
-    flushToNVM((char *)root, sizeof(root_obj));
-    smp_wmb();
     return pt;
 }
 
-void PACTreeImpl::Init(int numGrp, root_obj *root) {
-    InitGlobalLogMgr();
-    totalGroupActive = numGrp;
-    wtArray = new std::vector<std::thread *>;
-    g_WorkerThreadInst.clear();
-    g_perGrpSlPtr.clear();
-    g_threadDataSet.clear();
+uint64_t PendingOplogCount() {
+    uint64_t applied = g_oplogApplied.load(std::memory_order_relaxed);
+    uint64_t enqueued = g_oplogEnqueued.load(std::memory_order_relaxed);
+    return enqueued > applied ? enqueued - applied : 0;
+}
 
-    g_perGrpSlPtr.resize(totalGroupActive);
-    g_globalStop = false;
-    g_combinerStop = false;
-    CreateWorkerThread(numGrp, root);
-    CreateCombinerThread();
-    for (int i = 0; i < totalGroupActive; i++) {
-        while (!slReady[i]) { }
+void ExitPT() {
+    PACTreeImpl::StopBackgroundThreads();
+    for (auto &tree : g_trees) {
+        tree.store(nullptr, std::memory_order_relaxed);
     }
-    RegisterThread();
-    Recover();
-    UnregisterThread();
-    HYDRALIST_RESET_TIMERS();
+    g_treeRegistry = nullptr;
 }
 
-PACTreeImpl::PACTreeImpl(int numGrp, root_obj *root) {
-    totalGroupActive = numGrp;
-    InitGlobalLogMgr();
-    wtArray = new std::vector<std::thread *>;
-    g_perGrpSlPtr.resize(totalGroupActive);
-    dl.Initialize();
-    // need to read from PM
-
-    g_globalStop = false;
-    g_combinerStop = false;
-
-    CreateWorkerThread(numGrp, root);
-    CreateCombinerThread();
-    for (int i = 0; i < totalGroupActive; i++) {
-        while (!slReady[i]) { }
+PACTreeImpl *OpenIndexTree(uint32_t idxId) {
+    std::lock_guard<std::mutex> lockGuard(g_treeRegistryLock);
+    DCHECK(g_treeRegistry != nullptr);
+    int freeSlot = -1;
+    for (int i = PACTREE_DEFAULT_TREE + 1; i < PACTREE_MAX_TREES; i++) {
+        auto &entry = g_treeRegistry->m_entries[i];
+        if (entry.m_inUse == 0) {
+            freeSlot = freeSlot < 0 ? i : freeSlot;
+        } else if (entry.m_idxId == idxId) {
+            return GetTreeById(i);
+        }
     }
-    HYDRALIST_RESET_TIMERS();
+    CHECK(freeSlot > 0) << "too many index trees";
+    // 先建好树再登记, 中途崩溃只会泄漏空间
+    auto &entry = g_treeRegistry->m_entries[freeSlot];
+    auto *pop = (PMEMobjpool *)PMem::getBaseOf(1);
+    CHECK(pmemobj_alloc(pop, &entry.m_root, sizeof(PACTreeImpl), 0, nullptr, nullptr) == 0);
+    auto *pt = new (pmemobj_direct(entry.m_root)) PACTreeImpl(static_cast<uint16_t>(freeSlot), PMem::GetPoolNum());
+    entry.m_idxId = idxId;
+    flushToNVM((char *)&entry, sizeof(entry));
+    smp_wmb();
+    entry.m_inUse = 1;
+    flushToNVM((char *)&entry.m_inUse, sizeof(entry.m_inUse));
+    smp_wmb();
+    g_trees[freeSlot].store(pt, std::memory_order_release);
+    return pt;
 }
 
-PACTreeImpl::~PACTreeImpl() {
-    g_globalStop = true;
-    for (auto &t : *wtArray)
-        t->join();
-    combinerThead->join();
+void DropIndexTree(uint32_t idxId) {
+    std::lock_guard<std::mutex> lockGuard(g_treeRegistryLock);
+    DCHECK(g_treeRegistry != nullptr);
+    for (int i = PACTREE_DEFAULT_TREE + 1; i < PACTREE_MAX_TREES; i++) {
+        auto &entry = g_treeRegistry->m_entries[i];
+        if (entry.m_inUse == 0 || entry.m_idxId != idxId) {
+            continue;
+        }
+        PACTreeImpl *pt = GetTreeById(i);
+        WaitTreeOplogs(static_cast<uint16_t>(i));
+        g_trees[i].store(nullptr, std::memory_order_release);
+        // 先注销再释放, 中途崩溃只会泄漏空间
+        entry.m_inUse = 0;
+        flushToNVM((char *)&entry.m_inUse, sizeof(entry.m_inUse));
+        smp_wmb();
+        // 注销之前进入的读者可能还在遍历这棵树, 过了宽限期再释放节点
+        WaitReaders();
+        pt->Destroy();
+        pmemobj_free(&entry.m_root);
+        return;
+    }
 }
 
 ListNode *PACTreeImpl::getJumpNode(Key_t &key) {
     int grpId = NVMDB::NumaBinding::getThreadLocalGroupId();
-    SearchLayer &sl = *g_perGrpSlPtr[grpId];
+    SearchLayer &sl = *slPtr[grpId];
     if (sl.IsEmpty()) {
         return dl.GetHead();
     }
@@ -268,6 +419,7 @@ ListNode *PACTreeImpl::getJumpNode(Key_t &key) {
 }
 
 bool PACTreeImpl::Insert(Key_t &key, Val_t val) {
+    PersistTagScope persistTag(PersistTag::INDEX);
     uint64_t clock = ordo_get_clock();
     g_curThreadData->ReadLock(clock);
 
@@ -298,31 +450,29 @@ Val_t PACTreeImpl::Lookup(Key_t &key, bool *found) {
     return val;
 }
 
-SearchLayer *PACTreeImpl::CreateSearchLayer(root_obj *root, int threadId) {
-    // Read from Root Object or Allocate new one.
-    if (pmemobj_direct(root->ptr[threadId]) == nullptr) {
-        NVMPtr<SearchLayer> sPtr;
-        PMem::alloc(sizeof(SearchLayer), (void **)&sPtr, &(root->ptr[threadId]));
-        auto *s = new (sPtr.getVaddr()) SearchLayer();
-        return s;
-    }
-    auto *s = (SearchLayer *)pmemobj_direct(root->ptr[threadId]);
-    s->Init();
-    return s;
-}
-
 void PACTreeImpl::Scan(Key_t &startKey,
                        Key_t &endKey,
                        int maxRange,
                        LookupSnapshot snapshot,
                        bool reverse,
-                       std::vector<std::pair<Key_t, Val_t>> &result) {
+                       std::vector<std::pair<Key_t, Val_t>> &result,
+                       ScanCursor *cursor) {
     while (true) {
+        // 从游标继续时不经过 search layer
+        ListNode *jumpNode = dl.ResumeNode(cursor);
         if (reverse) {
-            CHECK(false);
+            if (jumpNode == nullptr) {
+                jumpNode = getJumpNode(endKey);
+            }
+            if (dl.ScanReverse(startKey, endKey, jumpNode, maxRange, snapshot, result, cursor)) {
+                return;
+            }
+            continue;
+        }
+        if (jumpNode == nullptr) {
+            jumpNode = getJumpNode(startKey);
         }
-        ListNode *jumpNode = getJumpNode(startKey);
-        if (dl.ScanInOrder(startKey, endKey, jumpNode, maxRange, snapshot, result)) {
+        if (dl.ScanInOrder(startKey, endKey, jumpNode, maxRange, snapshot, result, cursor)) {
             return;
         }
     }
@@ -346,10 +496,45 @@ void PACTreeImpl::UnregisterThread() {
     g_curThreadData->SetFinish();
 }
 
+PACTreeImpl::PACTreeImpl(uint16_t treeId, int numGrp) : treeId(treeId), numGrp(numGrp) {
+    CHECK(numGrp <= NVMDB_MAX_GROUP);
+    dl.Initialize(treeId);
+    // 每个组的 search layer 放在这个组的内存池中
+    for (int i = 0; i < numGrp; i++) {
+        PMEMoid oid;
+        PMem::allocOnGroup(i, sizeof(SearchLayer), (void **)&slRoot[i], &oid);
+        slPtr[i] = new (slRoot[i].getVaddr()) SearchLayer(i);
+    }
+    flushToNVM((char *)this, sizeof(PACTreeImpl));
+    smp_wmb();
+    HYDRALIST_RESET_TIMERS();
+}
+
+void PACTreeImpl::Open(int numGrp) {
+    CHECK(this->numGrp == numGrp) << "NUMA group count changed";
+    for (int i = 0; i < numGrp; i++) {
+        slPtr[i] = slRoot[i].getVaddr();
+        slPtr[i]->Init();
+        slPtr[i]->SetGroupId(i);
+    }
+    Recover();
+    HYDRALIST_RESET_TIMERS();
+}
+
 void PACTreeImpl::Recover() {
-    for (int i = 0; i < totalGroupActive; i++) {
-        dl.Recover(g_perGrpSlPtr[i]);
+    for (int i = 0; i < numGrp; i++) {
+        dl.Recover(slPtr[i]);
+    }
+}
+
+void PACTreeImpl::Destroy() {
+    for (int i = 0; i < numGrp; i++) {
+        slPtr[i]->Destroy();
+        PMem::free((void *)slRoot[i].getRawPtr());
+        slRoot[i] = NVMPtr<SearchLayer>();
+        slPtr[i] = nullptr;
     }
+    dl.Destroy();
 }
 
-}  // namespace NVMDB
\ No newline at end of file
+}  // namespace NVMDB
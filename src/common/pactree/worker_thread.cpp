@@ -1,15 +1,14 @@
 #include "common/pactree/worker_thread.h"
-#include "common/pactree/search_layer.h"
+#include "common/pactree/pactree_impl.h"
 
 namespace NVMDB {
 
-extern std::vector<SearchLayer *> g_perGrpSlPtr;
-
 WorkerThread::WorkerThread(int id, int activeGrp) {
     this->workerThreadId = id;
     this->activeGrp = activeGrp;
-    this->workQueue = &g_workQueue[workerThreadId];
-    this->logDoneCount = 0;
+    for (auto &count : logDoneCount) {
+        count.store(0, std::memory_order_relaxed);
+    }
     this->opcount = 0;
     if (id == 0) {
         freeQueue = new std::queue<std::pair<uint64_t, void *>>();
@@ -17,40 +16,57 @@ WorkerThread::WorkerThread(int id, int activeGrp) {
 }
 
 bool WorkerThread::ApplyOperation() {
-    std::vector<OpStruct *> *oplog = workQueue->front();
+    bool applied = false;
+    for (int i = 0; i < g_oplogCombinerNum; i++) {
+        OplogWorkQueue &workQueue = g_workQueue[i][workerThreadId];
+        if (!workQueue.read_available()) {
+            continue;
+        }
+        ApplyMergedLog(*workQueue.front());
+        workQueue.pop();
+        logDoneCount[i].fetch_add(1, std::memory_order_release);
+        applied = true;
+    }
+    return applied;
+}
+
+void WorkerThread::ApplyMergedLog(const std::vector<OpStruct *> &oplog) {
     int grpId = workerThreadId % activeGrp;
-    SearchLayer *sl = g_perGrpSlPtr[grpId];
-    auto hash = static_cast<uint8_t>(workerThreadId / activeGrp);
-    for (auto opsPtr : *oplog) {
+    int hash = workerThreadId / activeGrp;
+    PersistTagScope persistTag(PersistTag::SEARCH_LAYER);
+    for (auto opsPtr : oplog) {
         OpStruct &ops = *opsPtr;
-        if (ops.hash != hash) {
+        if (OplogWorkerOf(ops.hash) != hash) {
             continue;
         }
         opcount++;
+        if (ops.op == OpStruct::done) {
+            LOG(WARNING) << "Operation is done, " << opsPtr;
+            continue;
+        }
+        // 树被删除之前会等待它的 oplog 都完成
+        PACTreeImpl *tree = GetTreeById(ops.treeId);
+        CHECK(tree != nullptr) << "oplog of dropped tree " << ops.treeId;
+        SearchLayer *sl = tree->GetSearchLayer(grpId);
         if (ops.op == OpStruct::insert) {
             void *newNodePtr = reinterpret_cast<void *>((static_cast<unsigned long>(ops.poolId) << 48) | ops.newNodeOid.off);
             sl->Insert(ops.key, newNodePtr);
-            uint8_t remain_task = opsPtr->searchLayers.fetch_sub(sl->grpMask);
-            if (remain_task == sl->grpMask) {
-                opsPtr->op = OpStruct::done;
-            }
         } else if (ops.op == OpStruct::remove) {
             sl->remove(ops.key, ops.oldNodePtr);
-            uint8_t remain_task = opsPtr->searchLayers.fetch_sub(sl->grpMask);
-            if (remain_task == sl->grpMask) {
-                opsPtr->op = OpStruct::done;
-            }
-        } else if (ops.op == OpStruct::done) {
-            LOG(WARNING) << "Operation is done, " << opsPtr;
         } else {
             CHECK(false) << "unknown op";
         }
-        flushToNVM((char *)opsPtr, sizeof(OpStruct));
-        smp_wmb();
+        uint8_t remain_task = opsPtr->searchLayers.fetch_sub(sl->grpMask);
+        if (remain_task == sl->grpMask) {
+            opsPtr->op = OpStruct::done;
+            g_oplogApplied.fetch_add(1, std::memory_order_relaxed);
+        }
+        {
+            PersistTagScope oplogTag(PersistTag::OPLOG);
+            flushToNVM((char *)opsPtr, sizeof(OpStruct));
+            smp_wmb();
+        }
     }
-    workQueue->pop();
-    logDoneCount++;
-    return true;
 }
 
 void WorkerThread::FreeListNodes(uint64_t removeCount) {
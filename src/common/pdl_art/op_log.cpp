@@ -1,12 +1,18 @@
 #include "common/pdl_art/op_log.h"
 #include "common/pdl_art/pmem.h"
+#include "common/pdl_art/ordo_clock.h"
 #include <list>
 
 constexpr int QNUM_MOD = 2;
-boost::lockfree::spsc_queue<std::vector<OpStruct *> *, boost::lockfree::capacity<NVMDB::NVMDB_OPLOG_QUEUE_MAX_CAPACITY>>
-    g_workQueue[NVMDB::NVMDB_MAX_GROUP * NVMDB::NVMDB_OPLOG_WORKER_THREAD_PER_GROUP];
+static_assert(LOCK_CAPACITY == NVMDB::NVMDB_OPLOG_QUEUE_MAX_CAPACITY, "");
+OplogWorkQueue g_workQueue[NVMDB::NVMDB_OPLOG_MAX_COMBINER_THREAD]
+                          [NVMDB::NVMDB_MAX_GROUP * NVMDB::NVMDB_OPLOG_MAX_WORKER_THREAD_PER_GROUP];
 thread_local Oplog *Oplog::perThreadLog;
-int g_combinerSplits = 0;
+std::atomic<uint64_t> g_combinerSplits{0};
+std::atomic<uint64_t> g_oplogEnqueued{0};
+std::atomic<uint64_t> g_oplogApplied{0};
+int g_oplogCombinerNum = 1;
+int g_oplogWorkersPerGroup = 1;
 
 class GlobalLogMgr {
     ThreadLogMgr *tLogMgrs{nullptr};
@@ -80,27 +86,33 @@ void ReleaseThreadLogMgr() {
 Oplog::Oplog() = default;
 
 void Oplog::Enq(OpStruct *ops) {
+    Shard &shard = shards[OplogCombinerOf(ops->hash)];
 retry:
-    unsigned long qnum = curQ % QNUM_MOD;
-    while (!qLock[qnum].try_lock()) {
+    unsigned long qnum = shard.curQ % QNUM_MOD;
+    while (!shard.qLock[qnum].try_lock()) {
         std::atomic_thread_fence(std::memory_order_acq_rel);
-        qnum = curQ % QNUM_MOD;
+        qnum = shard.curQ % QNUM_MOD;
     }
-    if (curQ % QNUM_MOD != qnum) {
+    if (shard.curQ % QNUM_MOD != qnum) {
         /* 读curQ之后，上锁之前， combine线程已经把 curQ 向前推了一个，所以应该切换下一个队列 */
-        qLock[qnum].unlock();
+        shard.qLock[qnum].unlock();
         goto retry;
     }
-    op_[qnum].push_back(ops);
-    qLock[qnum].unlock();
+    shard.op_[qnum].push_back(ops);
+    shard.qLock[qnum].unlock();
+    g_oplogEnqueued.fetch_add(1, std::memory_order_relaxed);
 }
 
-void Oplog::ResetQ(int qNum) {
-    op_[qNum].clear();
-}
-
-std::vector<OpStruct *> *Oplog::getQ(int qNum) {
-    return &op_[qNum];
+void Oplog::Drain(int shardId, std::vector<OpStruct *> *out) {
+    Shard &shard = shards[shardId];
+    int qnum = shard.curQ % QNUM_MOD;
+    std::lock_guard<std::mutex> guard(shard.qLock[qnum]);
+    shard.curQ.fetch_add(1);
+    auto &queue = shard.op_[qnum];
+    if (!queue.empty()) {
+        out->insert(out->end(), queue.begin(), queue.end());
+        queue.clear();
+    }
 }
 
 std::set<Oplog *> *CopyGlobalThreadLogs() {
@@ -117,16 +129,24 @@ void Oplog::EnqPerThreadLog(OpStruct *ops) {
     perThrdLog->Enq(ops);
 }
 
-void Oplog::WriteOpLog(OpStruct *oplog, OpStruct::Operation op, const Key_t& key, void *oldNodeRawPtr, uint16_t poolId,
-                       const Key_t& newKey, Val_t newVal) {
+void Oplog::WriteOpLog(OpStruct *oplog, uint16_t treeId, OpStruct::Operation op, const Key_t& key,
+                       void *oldNodeRawPtr, uint16_t poolId, const Key_t& newKey, Val_t newVal) {
     oplog->op = op;
+    oplog->treeId = treeId;
     oplog->key = key;
     oplog->oldNodePtr = oldNodeRawPtr;  // should be persistent ptr
     oplog->poolId = poolId;
     oplog->newKey = newKey;
     oplog->newVal = newVal;
+    oplog->hash = OplogKeyHash(key);
     oplog->searchLayers = (1 << PMem::GetPoolNum()) - 1;
     oplog->step = OpStruct::initial;
+    // combiner 按写入时间合并各线程的 oplog
+    oplog->ts = ordo_get_clock();
+    NVMDB::PersistTagScope persistTag(NVMDB::PersistTag::OPLOG);
+    NVMDB::NVMWritten(oplog, sizeof(OpStruct) - sizeof(oplog->oldNodeData));
+    // 分裂在 oplog 持久化之后才修改节点, 这里的 fence 也覆盖调用者之前刷出的 oldNodeData
+    NVMDB::NVMPersist(oplog, sizeof(OpStruct) - sizeof(oplog->oldNodeData));
 }
 
 OpStruct *Oplog::allocOpLog() {
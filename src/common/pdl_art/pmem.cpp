@@ -34,7 +34,8 @@ struct PMemPoolManager {
     void UnbindAll();
 
     void *GetBaseOf(int poolId);
-    void Alloc(size_t size, void **p, PMEMoid *oid);
+    void Alloc(int grpId, size_t size, void **p, PMEMoid *oid);
+    size_t UsedBytes();
     void Free(void *pptr);
     static void FreeVaddr(void *vaddr);
 };
@@ -92,9 +93,8 @@ void PMemPoolManager::Init(int *isCreate, root_obj **root, root_obj **sl_root) {
     }
 }
 
-void PMemPoolManager::Alloc(size_t size, void **p, PMEMoid *oid) {
+void PMemPoolManager::Alloc(int grpId, size_t size, void **p, PMEMoid *oid) {
 restart:
-    int grpId = NVMDB::NumaBinding::getThreadLocalGroupId();
     int poolId = grpCurrentPoolId[grpId];
     auto pop = (PMEMobjpool *)baseAddresses[poolId];
     int ret = pmemobj_alloc(pop, oid, size, 0, nullptr, nullptr);
@@ -176,6 +176,21 @@ void PMemPoolManager::Bind(int poolId, const char *nvmPath, size_t size, void **
     DCHECK(baseAddresses[poolId] != nullptr);
 }
 
+size_t PMemPoolManager::UsedBytes() {
+    std::lock_guard<std::mutex> lockGuard(mtx);
+    size_t used = 0;
+    for (int i = 1; i < maxPoolId; i++) {
+        auto pop = reinterpret_cast<PMEMobjpool *>(const_cast<void *>(baseAddresses[i]));
+        if (pop == nullptr) {
+            continue;
+        }
+        for (PMEMoid oid = pmemobj_first(pop); !OID_IS_NULL(oid); oid = pmemobj_next(oid)) {
+            used += pmemobj_alloc_usable_size(oid);
+        }
+    }
+    return used;
+}
+
 bool PMemPoolManager::Unbind(int poolId) {
     auto pop = reinterpret_cast<PMEMobjpool *>(const_cast<void *>(baseAddresses[poolId]));
     pmemobj_close(pop);
@@ -210,7 +225,12 @@ int PMem::GetPoolNum() {
 
 void PMem::alloc(size_t size, void **p, PMEMoid *oid) {
     DCHECK(g_pmemMgr != nullptr);
-    g_pmemMgr->Alloc(size, p, oid);
+    g_pmemMgr->Alloc(NVMDB::NumaBinding::getThreadLocalGroupId(), size, p, oid);
+}
+
+void PMem::allocOnGroup(int grpId, size_t size, void **p, PMEMoid *oid) {
+    DCHECK(g_pmemMgr != nullptr && grpId < g_pmemMgr->grpNum);
+    g_pmemMgr->Alloc(grpId, size, p, oid);
 }
 
 void *PMem::getBaseOf(int poolId) {
@@ -232,4 +252,9 @@ void *PMem::getOpLog(int i) {
     DCHECK(g_pmemMgr != nullptr);
     auto vaddr = (unsigned long)g_pmemMgr->logVaddr;
     return (void *)(vaddr + (sizeof(OpStruct) * i));
+}
+
+size_t PMem::UsedBytes() {
+    DCHECK(g_pmemMgr != nullptr);
+    return g_pmemMgr->UsedBytes();
 }
\ No newline at end of file
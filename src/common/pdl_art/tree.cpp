@@ -33,6 +33,16 @@ Tree::Tree(LoadKeyFunction loadKey) : loadKey(loadKey) {
 
 Tree::~Tree() = default;
 
+void Tree::Destroy() {
+    N *rootNode = root.getVaddr();
+    if (rootNode == nullptr) {
+        return;
+    }
+    N::DeleteChildren(rootNode);
+    N::DeleteNode(rootNode);
+    root = NVMPtr<N>();
+}
+
 ThreadInfo Tree::GetThreadInfo() {
     return ThreadInfo(this->epoch);
 }
@@ -1,9 +1,15 @@
 #include "heap/nvm_heap.h"
+#include <thread>
 
 namespace NVMDB {
 
+DEFINE_bool(heap_prefault, true, "map and prefault heap segments in background after bootstrap");
+
 TableSpace *g_heapSpace = nullptr;
 
+static std::thread g_heapPrefaultThread;
+static std::atomic<bool> g_stopHeapPrefault {false};
+
 // pass in all dirs, HEAP_FILENAME:"heap"
 // TableSpace is also a logical file
 void HeapCreate(const std::shared_ptr<DirectoryConfig>& dirConfig) {
@@ -14,9 +20,21 @@ void HeapCreate(const std::shared_ptr<DirectoryConfig>& dirConfig) {
 void HeapBootStrap(const std::shared_ptr<DirectoryConfig>& dirConfig) {
     g_heapSpace = new TableSpace(dirConfig, false);
     g_heapSpace->mount();
+    if (FLAGS_heap_prefault) {
+        // 不阻塞启动, 前台线程访问到还未映射的 segment 时自行映射
+        g_stopHeapPrefault.store(false, std::memory_order_relaxed);
+        g_heapPrefaultThread = std::thread([] {
+            pthread_setname_np(pthread_self(), "NVM HeapPrefault");
+            g_heapSpace->prefault(g_stopHeapPrefault);
+        });
+    }
 }
 
 void HeapExitProcess() {
+    if (g_heapPrefaultThread.joinable()) {
+        g_stopHeapPrefault.store(true, std::memory_order_relaxed);
+        g_heapPrefaultThread.join();
+    }
     if (g_heapSpace != nullptr) {
         g_heapSpace->unmount();
         delete g_heapSpace;
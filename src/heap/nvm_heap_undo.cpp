@@ -2,6 +2,7 @@
 #include "heap/nvm_tuple.h"
 #include "heap/nvm_rowid_map.h"
 #include "transaction/nvm_transaction.h"
+#include <algorithm>
 
 namespace NVMDB {
 static constexpr size_t UNDO_DATA_MAX_SIZE = MAX_UNDO_RECORD_CACHE_SIZE - NVMTupleHeadSize;
@@ -93,7 +94,7 @@ UndoRecPtr PrepareDeleteUndo(Transaction *tx, uint32 segHead, RowId rowid, const
     return undoPtr;
 }
 
-void UndoInsert(const UndoRecord *undo) {
+void UndoInsert(const UndoRecord *undo, UndoRecPtr undoPtr) {
     RowIdMap *rowidMap = GetRowIdMap(undo->m_segHead, undo->m_rowLen);
     RowIdMapEntry *row = rowidMap->GetEntry(undo->m_rowId, false);
     row->Lock();
@@ -105,14 +106,20 @@ void UndoInsert(const UndoRecord *undo) {
     row->Unlock();
 }
 
-void UndoUpdate(const UndoRecord *undo) {
+void UndoUpdate(const UndoRecord *undo, UndoRecPtr undoPtr) {
+    PersistTagScope persistTag(PersistTag::HEAP);
     RowIdMap *rowidMap = GetRowIdMap(undo->m_segHead, undo->m_rowLen);
     RowIdMapEntry *row = rowidMap->GetEntry(undo->m_rowId, false);
     row->Lock();
+    if (row->loadDRAMCache<NVMTuple>(NVMTupleHeadSize)->m_prev != undoPtr) {
+        row->Unlock();
+        return;
+    }
     const auto nvmFunc = [&](char* addr) {
         auto ret = memcpy_no_flush_nt(addr, RealTupleSize(undo->m_rowLen), undo->data, NVMTupleHeadSize);
         SecureRetCheck(ret);
         UnpackDeltaUndo(addr + NVMTupleHeadSize, undo->data + NVMTupleHeadSize, undo->m_deltaLen);
+        NVMWritten(addr, RealTupleSize(undo->m_rowLen));
     };
     row->wrightThroughCache(nvmFunc, RealTupleSize(undo->m_rowLen));
     row->Unlock();
@@ -124,16 +131,53 @@ void UndoUpdate(const UndoRecord *undo, NVMTuple *tuple, char* rowData) {
     UnpackDeltaUndo(rowData, undo->data + NVMTupleHeadSize, undo->m_deltaLen);
 }
 
-void UndoDelete(const UndoRecord *undo) {
+void UndoDelete(const UndoRecord *undo, UndoRecPtr undoPtr) {
+    PersistTagScope persistTag(PersistTag::HEAP);
     RowIdMap *rowidMap = GetRowIdMap(undo->m_segHead, undo->m_rowLen);
     RowIdMapEntry *row = rowidMap->GetEntry(undo->m_rowId, false);
     row->Lock();
+    if (row->loadDRAMCache<NVMTuple>(NVMTupleHeadSize)->m_prev != undoPtr) {
+        row->Unlock();
+        return;
+    }
     const auto nvmFunc = [&](char* addr) {
         int ret = memcpy_no_flush_nt(addr, RealTupleSize(undo->m_rowLen), undo->data, undo->m_payload);
         SecureRetCheck(ret);
+        NVMWritten(addr, undo->m_payload);
     };
     row->wrightThroughCache(nvmFunc, undo->m_payload);
     row->Unlock();
 }
 
-}  // namespace NVMDB
\ No newline at end of file
+/*
+ * 只沿着这一行的版本链回滚: tuple 上每个由 owner 写入的版本都记录了指向旧版本的 undo,
+ * 逐个恢复直到 tuple 不再属于 owner. 回滚后 m_prev 不再指向这些 undo,
+ * 后台恢复在 UndoUpdate/UndoDelete 中据此跳过该行.
+ * 插入没有旧版本, 保持原样, 可见性判断会将其视为已回滚.
+ * 后台恢复之后不会再回滚这一行, 所以返回之前 (调用者释放行锁之前) 持久化回滚的结果, 否则再次崩溃会丢失回滚.
+ */
+void UndoTupleRollBack(NVMTuple *tuple, UndoRecord *undoRecordCache) {
+    PersistTagScope persistTag(PersistTag::HEAP);
+    const uint64 owner = tuple->m_txInfo;
+    size_t rolledBack = 0;
+    while (tuple->m_txInfo == owner && !UndoRecPtrIsInValid(tuple->m_prev)) {
+        GetUndoRecord(tuple->m_prev, undoRecordCache);
+        if (undoRecordCache->m_undoType == HeapUpdateUndo) {
+            UndoUpdate(undoRecordCache, tuple, tuple->m_data);
+            NVMWritten(tuple, RealTupleSize(undoRecordCache->m_rowLen));
+            rolledBack = std::max<size_t>(rolledBack, RealTupleSize(undoRecordCache->m_rowLen));
+        } else {
+            DCHECK(undoRecordCache->m_undoType == HeapDeleteUndo);
+            int ret = memcpy_no_flush_nt(tuple, RealTupleSize(undoRecordCache->m_rowLen),
+                                         undoRecordCache->data, undoRecordCache->m_payload);
+            SecureRetCheck(ret);
+            NVMWritten(tuple, undoRecordCache->m_payload);
+            rolledBack = std::max<size_t>(rolledBack, undoRecordCache->m_payload);
+        }
+    }
+    if (rolledBack != 0) {
+        NVMPersist(tuple, rolledBack);
+    }
+}
+
+}  // namespace NVMDB
@@ -1,11 +1,14 @@
 #include "heap/nvm_rowid_map.h"
 #include "heap/nvm_heap.h"
 #include <unordered_map>
+#include <vector>
 
 namespace NVMDB {
 
 DEFINE_int64(cache_size, 16384, "the max size of lru cache");
 DEFINE_int64(cache_elasticity, 64, "the elasticity of lru cache");
+DEFINE_int32(heap_slot_max_padding, 63,
+             "max padding bytes per heap slot of a new table to reduce rows straddling 256B XPLines, 0 stores rows at raw length");
 
 std::atomic<bool> g_forceWriteBackCSN {true};
 
@@ -34,6 +37,28 @@ RowIdMapEntry *RowIdMap::GetSegment(int segId) {
     return segmentPtr->begin();
 }
 
+std::vector<RowId> RowIdMap::GetRowIds(const std::vector<RowIdMapEntry *> &entries) {
+    std::vector<std::pair<RowIdMapEntry *, RowId>> segments;
+    {
+        std::lock_guard<std::mutex> lg(m_segmentsMutex);
+        for (int i = 0; i < SegmentEntryLen; i++) {
+            if (m_segments[i] != nullptr) {
+                segments.emplace_back(m_segments[i]->begin(), static_cast<RowId>(i) * RowIdMapSegmentLen);
+            }
+        }
+    }
+    std::vector<RowId> rowIds;
+    for (auto entry : entries) {
+        for (const auto &segment : segments) {
+            if (entry >= segment.first && entry < segment.first + RowIdMapSegmentLen) {
+                rowIds.push_back(segment.second + static_cast<RowId>(entry - segment.first));
+                break;
+            }
+        }
+    }
+    return rowIds;
+}
+
 RowIdMapEntry *RowIdMap::GetEntry(RowId rowId, bool isRead) {
     int segId = static_cast<int>(rowId / RowIdMapSegmentLen);
     RowIdMapEntry *segment = GetSegment(segId);
@@ -57,10 +82,20 @@ RowIdMapEntry *RowIdMap::GetEntry(RowId rowId, bool isRead) {
 }
 
 static std::unordered_map<uint32, RowIdMap *> g_globalRowidMaps;
+// 被丢弃的 RowIdMap 可能还被其他线程访问, 进程退出时再释放
+static std::vector<RowIdMap *> g_retiredRowidMaps;
 static std::mutex g_grimMtx;
+// 每次 DropRowIdMap 加 1, 线程发现变化时清空本地缓存, 避免 segHead 被复用后拿到旧的 RowIdMap
+static std::atomic<uint64> g_rowidMapEpoch {0};
 thread_local std::unordered_map<uint32, RowIdMap *> g_localRowidMaps;
+thread_local uint64 g_localRowidMapEpoch = 0;
 
 RowIdMap *GetRowIdMap(uint32 segHead, uint32 rowLen) {
+    auto epoch = g_rowidMapEpoch.load(std::memory_order_acquire);
+    if (unlikely(epoch != g_localRowidMapEpoch)) {
+        g_localRowidMaps.clear();
+        g_localRowidMapEpoch = epoch;
+    }
     if (g_localRowidMaps.find(segHead) == g_localRowidMaps.end()) {
         // 本地缓存不存在对应表的segHead (page ID), 从全局中找 RowIdMap
         std::lock_guard<std::mutex> lockGuard(g_grimMtx);
@@ -75,6 +110,17 @@ RowIdMap *GetRowIdMap(uint32 segHead, uint32 rowLen) {
     return result;
 }
 
+void DropRowIdMap(uint32 segHead) {
+    std::lock_guard<std::mutex> lockGuard(g_grimMtx);
+    auto iter = g_globalRowidMaps.find(segHead);
+    if (iter != g_globalRowidMaps.end()) {
+        g_retiredRowidMaps.push_back(iter->second);
+        g_globalRowidMaps.erase(iter);
+    }
+    g_localRowidMaps.erase(segHead);
+    g_rowidMapEpoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
 void InitGlobalRowIdMapCache() {
     g_globalRowidMaps.clear();
 }
@@ -88,6 +134,10 @@ void DestroyGlobalRowIdMapCache() {
         delete entry.second;
     }
     g_globalRowidMaps.clear();
+    for (auto *rowIdMap : g_retiredRowidMaps) {
+        delete rowIdMap;
+    }
+    g_retiredRowidMaps.clear();
 }
 
 void DestroyLocalRowIdMapCache() {
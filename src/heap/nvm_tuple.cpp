@@ -5,13 +5,8 @@
 
 namespace NVMDB {
 
-thread_local FlushCache FlushCache::g_rowIdCache;
-
 inline void flush(const void *src, size_t n) {
-    const auto *s = (const uint8_t *)src;
-    for (size_t i = 0; i < n; i += 64) {
-        _mm_clflushopt((void *)(s + i));
-    }
+    NVMFlush(src, n);
 }
 
 void dram_to_nvm_memcpy(void *dest, const void *src, size_t n) {
@@ -21,21 +16,15 @@ void dram_to_nvm_memcpy(void *dest, const void *src, size_t n) {
     auto *d = (uint8_t *)dest;
     const auto *s = (const uint8_t *)src;
 
-    // 对于大块数据，使用AVX-512指令集
+    // 对于大块数据，使用运行时选择的非时序写入
     if (n >= 64) {
         size_t blocks = n / 64;
-        for (size_t i = 0; i < blocks; i++) {
-            // 使用非时序存储加载和写入到NVM，因为之后不会访问这些数据
-            __m512i data = _mm512_stream_load_si512((__m512i *)(s + i * 64));
-            _mm512_stream_si512((__m512i *)(d + i * 64), data);
-        }
-
+        // 使用非时序写入到NVM，因为之后不会访问这些数据
+        NVMStreamCopy(d, s, blocks * 64);
         // 确保所有非时序写入已完成
-        _mm_sfence();
+        NVMFence();
         // 清除所有DRAM缓存行
-        for (size_t i = 0; i < blocks; i++) {
-            _mm_clflushopt((void *)(s + i * 64));
-        }
+        flush(s, blocks * 64);
 
         // 更新指针位置
         s += blocks * 64;
@@ -66,25 +55,13 @@ void dram_to_nvm_memcpy_no_align(void *dest, const void *src, size_t n) {
     auto *d = (uint8_t *)dest;
     const auto *s = (const uint8_t *)src;
 
-    // 对于大块数据，使用AVX-512指令集
     if (n >= 64) {
         size_t blocks = n / 64;
-        for (size_t i = 0; i < blocks; i++) {
-            // 使用非时序存储加载和写入到NVM，因为之后不会访问这些数据
-            __m512i data = _mm512_stream_load_si512((__m512i *)(s + i * 64));
-            _mm512_storeu_si512((__m512i *)(d + i * 64), data);
-        }
-
-        // 确保所有非时序写入已完成
-        _mm_sfence();
-        for (size_t i = 0; i < blocks; i++) {
-            // 清除所有DRAM缓存行
-            _mm_clflushopt((void *)(s + i * 64));
-            // 清除NVM缓存行
-            if (i != 0) {
-                _mm_clflushopt((void *)(d + i * 64));
-            }
-        }
+        memcpy(d, s, blocks * 64);
+        // 清除所有DRAM缓存行
+        flush(s, blocks * 64);
+        // 清除NVM缓存行
+        flush(d + 64, blocks * 64 - 64);
 
         // 更新指针位置
         s += blocks * 64;
@@ -122,79 +99,21 @@ void dram_to_nvm_memcpy_no_align(void *dest, const void *src, size_t n) {
 //    }
 //}
 
+// glibc 的 memcpy 已经在运行时按 CPU 选择实现
 void nvm_to_dram_memcpy_no_align(void *dest, const void *src, size_t n) {
     DCHECK(((uintptr_t)dest & 0x3F) == 0);   // 64字节对齐
-
-    auto *d = (uint8_t *)dest;
-    const auto *s = (const uint8_t *)src;
-
-    // 使用非时序加载指令从NVM加载数据
-    // 对于大块数据，使用AVX-512指令集
-    if (n >= 64) {
-        size_t blocks = n / 64;
-        for (size_t i = 0; i < blocks; i++) {
-            // 使用非时序加载从NVM读取数据
-            __m512i data = _mm512_loadu_si512((__m512i *)(s + i * 64));
-            // 使用时序存储写入DRAM
-            _mm512_store_si512((__m512i *)(d + i * 64), data);
-        }
-
-        // 确保所有非时序写入已完成
-        _mm_sfence();
-        for (size_t i = 0; i < blocks; i++) {
-            // 清除NVM缓存行
-            _mm_clflushopt((void *)(s + i * 64));
-        }
-
-        // 更新指针位置
-        s += blocks * 64;
-        d += blocks * 64;
-        n -= blocks * 64;
-        // 处理剩余字节
-        if (n > 0) {
-            memcpy(d, s, n);
-            flush(s, n);
-        }
-        return;
-    }
-    // 对于小数据，直接复制，并逐出NVM缓存
-    memcpy(d, s, n);
-    flush(s, n);
+    memcpy(dest, src, n);
+    // 逐出NVM缓存行
+    flush(src, n);
 }
 
 void nvm_to_dram_memcpy(void *dest, const void *src, size_t n) {
     DCHECK(((uintptr_t)src & 0x3F) == 0);    // 64字节对齐
     DCHECK(((uintptr_t)dest & 0x3F) == 0);   // 64字节对齐
-
-    auto *d = (uint8_t *)dest;
-    const auto *s = (const uint8_t *)src;
-
-    // 使用非时序加载指令从NVM加载数据
-    // 对于大块数据，使用AVX-512指令集
-    if (n >= 64) {
-        size_t blocks = n / 64;
-        for (size_t i = 0; i < blocks; i++) {
-            // 使用非时序加载从NVM读取数据
-            __m512i data = _mm512_stream_load_si512((__m512i *)(s + i * 64));
-            // 使用时序存储写入DRAM
-            _mm512_store_si512((__m512i *)(d + i * 64), data);
-        }
-        // 更新指针位置
-        s += blocks * 64;
-        d += blocks * 64;
-        n -= blocks * 64;
-        // 处理剩余字节
-        if (n > 0) {
-            memcpy(d, s, n);
-            flush(s, n);
-        }
-        // 确保所有非时序写入已完成
-        _mm_sfence();
-        return;
-    }
-    // 对于小数据，直接复制，并逐出NVM缓存
-    memcpy(d, s, n);
-    flush(s, n);
+    memcpy(dest, src, n);
+    // 整块部分之后还会读, 只逐出剩余字节所在的缓存行
+    size_t aligned = n / 64 * 64;
+    flush((const uint8_t *)src + aligned, n - aligned);
 }
 
 //void RAMTuple::Deserialize(const char *nvmAddr) {
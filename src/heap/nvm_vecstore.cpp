@@ -8,7 +8,9 @@
 namespace NVMDB {
 
 VecStore::VecStore(int spaceCount, uint32 segHead, uint32 tuplesPerExtent) {
+    static std::atomic<uint32> g_nextCacheId {0};
     m_segHead = segHead;    // 一张表的 segment head 对应的 page ID
+    m_cacheId = g_nextCacheId.fetch_add(1, std::memory_order_relaxed);
     m_tuplesPerExtent = tuplesPerExtent;   // 每个extent存的元组数量
 
     // spaceCount: 一共有多少个目录
@@ -24,7 +26,7 @@ VecStore::VecStore(int spaceCount, uint32 segHead, uint32 tuplesPerExtent) {
 
 RowId VecStore::tryNextRowid() const {
     // 在 table中锁定一个 extent (一组连续的pages), 用以写入数据
-    auto *localTableCache = TLTableCache::GetThreadLocalTableCache(m_segHead);
+    auto *localTableCache = TLTableCache::GetThreadLocalTableCache(m_cacheId);
 
     // 1. 从 RowID Cache 中找，是否有自己之前删过的。
     RowId rid = localTableCache->m_rowidCache.pop();
@@ -44,7 +46,7 @@ RowId VecStore::tryNextRowid() const {
 }
 
 void VecStore::tryNextSegment() const {
-    auto *localTableCache = TLTableCache::GetThreadLocalTableCache(m_segHead);
+    auto *localTableCache = TLTableCache::GetThreadLocalTableCache(m_cacheId);
     // 3. 从 GlobalBitMap中分配一个新的Range
     const auto spaceCount = m_gbm.size();
     uint32 dirSeq = NumaBinding::getThreadLocalGroupId();
@@ -0,0 +1,497 @@
+#include "index/nvm_hash_index.h"
+#include <algorithm>
+
+namespace NVMDB {
+
+static constexpr uint64 BUCKET_FULL = (1ULL << HASH_BUCKET_SLOTS) - 1;
+
+// 目录最多 2^MAX_DIR_DEPTH 项, 目录下标和 m_pattern 都是 32 位
+static constexpr uint32 MAX_DIR_DEPTH = 31;
+
+static inline uint32 DirIndex(uint64 hash, uint32 depth) {
+    return depth == 0 ? 0 : static_cast<uint32>(hash >> (64 - depth));
+}
+
+static size_t DirectorySize(uint32 depth) {
+    return sizeof(HashDirectory) + (sizeof(uint64) << depth);
+}
+
+static void *GetVaddr(uint64 raw) {
+    NVMPtr<char> ptr;
+    ptr.setRawPtr(reinterpret_cast<void *>(raw));
+    return ptr.getVaddr();
+}
+
+/* 在当前线程的 NUMA 组上分配并清零, 返回 NVMPtr 的 raw 值 */
+static uint64 AllocZeroed(size_t size) {
+    void *raw = nullptr;
+    PMEMoid oid;
+    PMem::alloc(size, &raw, &oid);
+    void *addr = pmemobj_direct(oid);
+    int ret = memset_s(addr, size, 0, size);
+    SecureRetCheck(ret);
+    NVMPersist(addr, size);
+    return reinterpret_cast<uint64>(raw);
+}
+
+/* 持有头桶的锁, 把链上空的溢出桶摘下来, 返回摘下的桶. 头桶在目录中, 不摘 */
+static std::vector<uint64> UnlinkEmptyOverflow(HashBucket *bucket) {
+    std::vector<uint64> unlinked;
+    HashBucket *prev = bucket;
+    while (prev->m_next != 0) {
+        uint64 raw = prev->m_next;
+        auto *b = static_cast<HashBucket *>(GetVaddr(raw));
+        if (b->m_bitmap != 0) {
+            prev = b;
+            continue;
+        }
+        prev->m_next = b->m_next;
+        NVMPersist(&prev->m_next, sizeof(uint64));
+        unlinked.push_back(raw);
+    }
+    return unlinked;
+}
+
+/* 摘下的桶只能从头桶的链上访问到, 已经不可达. 摘下后释放前崩溃只会泄漏空间 */
+static void FreeBuckets(const std::vector<uint64> &buckets) {
+    for (uint64 raw : buckets) {
+        PMem::free(reinterpret_cast<void *>(raw));
+    }
+}
+
+uint64 ExtendibleHash::HashKey(const Key_t &key) {
+    DCHECK(key.keyLength > HASH_KEY_ROWID_LEN);
+    // FNV-1a, 再用 murmur3 的 finalizer 打散高位, 目录按高位索引
+    uint64 h = 0xcbf29ce484222325ULL;
+    for (uint32 i = 0; i < key.keyLength - HASH_KEY_ROWID_LEN; i++) {
+        h = (h ^ key.data[i]) * 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool ExtendibleHash::InBucket(const HashBucket *bucket, uint64 hash) {
+    return DirIndex(hash, bucket->m_localDepth) == bucket->m_pattern;
+}
+
+HashBucket *ExtendibleHash::GetBucket(uint64 raw) {
+    return static_cast<HashBucket *>(GetVaddr(raw));
+}
+
+void ExtendibleHash::Create(HashRoot *root) {
+    PersistTagScope persistTag(PersistTag::INDEX);
+    uint64 bucket = AllocZeroed(sizeof(HashBucket));
+    uint64 dirRaw = AllocZeroed(DirectorySize(0));
+    auto *dir = static_cast<HashDirectory *>(GetVaddr(dirRaw));
+    dir->m_buckets[0].store(bucket, std::memory_order_relaxed);
+    NVMPersist(dir, DirectorySize(0));
+    root->m_splitOld = 0;
+    root->m_splitNew = 0;
+    root->m_dir = dirRaw;
+    NVMPersist(root, sizeof(HashRoot));
+}
+
+ExtendibleHash::ExtendibleHash(uint16 id, HashRoot *root) : m_id(id), m_root(root) {
+    m_dir.store(static_cast<HashDirectory *>(GetVaddr(root->m_dir)), std::memory_order_release);
+    Recover();
+}
+
+uint64 ExtendibleHash::LockBucket(uint64 hash) {
+    while (true) {
+        HashDirectory *dir = m_dir.load(std::memory_order_acquire);
+        uint64 raw = dir->m_buckets[DirIndex(hash, dir->m_depth)].load(std::memory_order_acquire);
+        auto &lock = LockOf(raw);
+        lock.lock();
+        // 拿到的是旧目录项时桶已经分裂, 重新读目录
+        if (InBucket(GetBucket(raw), hash)) {
+            return raw;
+        }
+        lock.unlock();
+    }
+}
+
+bool ExtendibleHash::TryInsert(HashBucket *bucket, uint64 hash, Key_t &key, Val_t val) {
+    HashBucket *freeBucket = nullptr;
+    for (HashBucket *b = bucket; b != nullptr; b = GetBucket(b->m_next)) {
+        for (uint64 bits = b->m_bitmap; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            if (b->m_hash[i] == hash && b->m_slots[i].m_key == key) {
+                b->m_slots[i].m_val = val;
+                NVMPersist(&b->m_slots[i].m_val, sizeof(Val_t));
+                return true;
+            }
+        }
+        if (freeBucket == nullptr && b->m_bitmap != BUCKET_FULL) {
+            freeBucket = b;
+        }
+    }
+    if (freeBucket == nullptr) {
+        return false;
+    }
+    int i = __builtin_ctzll(~freeBucket->m_bitmap);
+    HashSlot &slot = freeBucket->m_slots[i];
+    slot.m_val = val;
+    slot.m_key = key;
+    freeBucket->m_hash[i] = hash;
+    NVMFlush(&slot, sizeof(HashSlot));
+    NVMFlush(&freeBucket->m_hash[i], sizeof(uint64));
+    NVMFence();
+    freeBucket->m_bitmap |= 1ULL << i;
+    NVMPersist(&freeBucket->m_bitmap, sizeof(uint64));
+    return true;
+}
+
+void ExtendibleHash::Insert(Key_t &key, Val_t val) {
+    PersistTagScope persistTag(PersistTag::INDEX);
+    uint64 hash = HashKey(key);
+    while (true) {
+        uint64 raw = LockBucket(hash);
+        bool done = TryInsert(GetBucket(raw), hash, key, val);
+        LockOf(raw).unlock();
+        if (done) {
+            return;
+        }
+        Grow(hash, key);
+    }
+}
+
+/* 桶满了: 所有 key 的哈希值相同时挂溢出桶, 否则分裂, 目录不够深时先扩容. 之后由调用者重试插入 */
+void ExtendibleHash::Grow(uint64 hash, Key_t &key) {
+    std::lock_guard<std::mutex> growGuard(m_growLock);
+    uint64 raw = LockBucket(hash);
+    HashBucket *bucket = GetBucket(raw);
+    bool sameHash = true;
+    HashBucket *last = nullptr;
+    for (HashBucket *b = bucket; b != nullptr; b = GetBucket(b->m_next)) {
+        if (b->m_bitmap != BUCKET_FULL) {
+            // 等锁期间有 key 被删除了
+            LockOf(raw).unlock();
+            return;
+        }
+        for (uint32 i = 0; i < HASH_BUCKET_SLOTS; i++) {
+            sameHash &= b->m_hash[i] == hash;
+        }
+        last = b;
+    }
+    if (sameHash) {
+        uint64 overflow = AllocZeroed(sizeof(HashBucket));
+        last->m_next = overflow;
+        NVMPersist(&last->m_next, sizeof(uint64));
+    } else {
+        if (bucket->m_localDepth == m_dir.load(std::memory_order_relaxed)->m_depth) {
+            DoubleDirectory();
+        }
+        Split(raw, bucket);
+    }
+    LockOf(raw).unlock();
+}
+
+void ExtendibleHash::DoubleDirectory() {
+    HashDirectory *dir = m_dir.load(std::memory_order_relaxed);
+    uint32 depth = dir->m_depth + 1;
+    CHECK(depth <= MAX_DIR_DEPTH) << "hash index directory is too deep";
+    uint64 newRaw = AllocZeroed(DirectorySize(depth));
+    auto *newDir = static_cast<HashDirectory *>(GetVaddr(newRaw));
+    newDir->m_depth = depth;
+    newDir->m_prev = m_root->m_dir;
+    for (uint32 i = 0; i < (1U << depth); i++) {
+        newDir->m_buckets[i].store(dir->m_buckets[i >> 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    NVMPersist(newDir, DirectorySize(depth));
+    m_root->m_dir = newRaw;
+    NVMPersist(&m_root->m_dir, sizeof(uint64));
+    // 读者可能还在用旧目录, 旧目录的项仍然指向有效的桶
+    m_dir.store(newDir, std::memory_order_release);
+}
+
+/* 持有 bucket 的锁, 把哈希值下一位为 1 的 key 搬到新桶中 */
+void ExtendibleHash::Split(uint64 raw, HashBucket *bucket) {
+    uint32 depth = bucket->m_localDepth + 1;
+    DCHECK(depth <= m_dir.load(std::memory_order_relaxed)->m_depth);
+    uint64 newRaw = AllocZeroed(sizeof(HashBucket));
+    HashBucket *newBucket = GetBucket(newRaw);
+    newBucket->m_localDepth = depth;
+    newBucket->m_pattern = (bucket->m_pattern << 1) | 1;
+    HashBucket *target = newBucket;
+    for (HashBucket *b = bucket; b != nullptr; b = GetBucket(b->m_next)) {
+        for (uint64 bits = b->m_bitmap; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            if (!InBucket(newBucket, b->m_hash[i])) {
+                continue;
+            }
+            if (target->m_bitmap == BUCKET_FULL) {
+                target->m_next = AllocZeroed(sizeof(HashBucket));
+                NVMPersist(target, sizeof(HashBucket));
+                target = GetBucket(target->m_next);
+            }
+            int slot = __builtin_ctzll(~target->m_bitmap);
+            target->m_slots[slot] = b->m_slots[i];
+            target->m_hash[slot] = b->m_hash[i];
+            target->m_bitmap |= 1ULL << slot;
+        }
+    }
+    NVMPersist(target, sizeof(HashBucket));
+    m_root->m_splitOld = raw;
+    NVMPersist(&m_root->m_splitOld, sizeof(uint64));
+    m_root->m_splitNew = newRaw;
+    NVMPersist(&m_root->m_splitNew, sizeof(uint64));
+    FinishSplit(raw, newRaw);
+}
+
+/* 新桶已经建好并登记在根上: 修改目录, 从旧桶中删除搬走的 key. 可以重做 */
+void ExtendibleHash::FinishSplit(uint64 oldRaw, uint64 newRaw) {
+    HashBucket *bucket = GetBucket(oldRaw);
+    HashBucket *newBucket = GetBucket(newRaw);
+    HashDirectory *dir = m_dir.load(std::memory_order_relaxed);
+    uint32 shift = dir->m_depth - newBucket->m_localDepth;
+    uint32 begin = newBucket->m_pattern << shift;
+    for (uint32 i = begin; i < begin + (1U << shift); i++) {
+        dir->m_buckets[i].store(newRaw, std::memory_order_release);
+    }
+    NVMPersist(&dir->m_buckets[begin], sizeof(uint64) << shift);
+    for (HashBucket *b = bucket; b != nullptr; b = GetBucket(b->m_next)) {
+        uint64 moved = 0;
+        for (uint64 bits = b->m_bitmap; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            if (InBucket(newBucket, b->m_hash[i])) {
+                moved |= 1ULL << i;
+            }
+        }
+        if (moved != 0) {
+            b->m_bitmap &= ~moved;
+            NVMFlush(&b->m_bitmap, sizeof(uint64));
+        }
+    }
+    bucket->m_localDepth = newBucket->m_localDepth;
+    bucket->m_pattern = newBucket->m_pattern ^ 1;
+    NVMPersist(bucket, sizeof(uint64));
+    // 溢出桶里的 key 哈希值相同, 分裂时整条链常常一起被搬空
+    std::vector<uint64> emptied = UnlinkEmptyOverflow(bucket);
+    m_root->m_splitNew = 0;
+    NVMPersist(&m_root->m_splitNew, sizeof(uint64));
+    m_root->m_splitOld = 0;
+    NVMPersist(&m_root->m_splitOld, sizeof(uint64));
+    FreeBuckets(emptied);
+}
+
+void ExtendibleHash::Recover() {
+    PersistTagScope persistTag(PersistTag::INDEX);
+    if (m_root->m_splitNew != 0) {
+        FinishSplit(m_root->m_splitOld, m_root->m_splitNew);
+    }
+    HashDirectory *dir = m_dir.load(std::memory_order_relaxed);
+    // 没有读者了, 释放扩容前的目录
+    uint64 prev = dir->m_prev;
+    while (prev != 0) {
+        uint64 next = static_cast<HashDirectory *>(GetVaddr(prev))->m_prev;
+        PMem::free(reinterpret_cast<void *>(prev));
+        prev = next;
+    }
+    if (dir->m_prev != 0) {
+        dir->m_prev = 0;
+        NVMPersist(&dir->m_prev, sizeof(uint64));
+    }
+}
+
+void ExtendibleHash::Scan(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot, bool reverse,
+                          std::vector<std::pair<Key_t, Val_t>> &result) {
+    CHECK(startKey.keyLength == endKey.keyLength &&
+          memcmp(startKey.data, endKey.data, startKey.keyLength - HASH_KEY_ROWID_LEN) == 0)
+        << "hash index only supports equality lookups";
+    result.clear();
+    uint64 hash = HashKey(startKey);
+    uint64 raw = LockBucket(hash);
+    bool pruned = false;
+    for (HashBucket *b = GetBucket(raw); b != nullptr; b = GetBucket(b->m_next)) {
+        uint64 removable = 0;
+        for (uint64 bits = b->m_bitmap; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            HashSlot &slot = b->m_slots[i];
+            if (b->m_hash[i] != hash || slot.m_key < startKey || !(slot.m_key < endKey)) {
+                continue;
+            }
+            auto status = CheckMVCCVisibility(&slot.m_val, snapshot);
+            if (status == MVCCVisibility::VISIBLE) {
+                result.emplace_back(slot.m_key, slot.m_val);
+            } else if (status == MVCCVisibility::REMOVABLE) {
+                removable |= 1ULL << i;
+            }
+        }
+        if (removable != 0) {
+            PersistTagScope persistTag(PersistTag::INDEX);
+            b->m_bitmap &= ~removable;
+            NVMFlush(&b->m_bitmap, sizeof(uint64));
+            pruned = true;
+        }
+    }
+    std::vector<uint64> emptied;
+    if (pruned) {
+        NVMFence();
+        PersistTagScope persistTag(PersistTag::INDEX);
+        emptied = UnlinkEmptyOverflow(GetBucket(raw));
+    }
+    LockOf(raw).unlock();
+    FreeBuckets(emptied);
+
+    if (reverse) {
+        std::sort(result.begin(), result.end(), [](const std::pair<Key_t, Val_t> &a,
+                                                   const std::pair<Key_t, Val_t> &b) { return b.first < a.first; });
+    } else {
+        std::sort(result.begin(), result.end(), [](const std::pair<Key_t, Val_t> &a,
+                                                   const std::pair<Key_t, Val_t> &b) { return a.first < b.first; });
+    }
+    if (result.size() > static_cast<size_t>(maxRange)) {
+        result.resize(maxRange);
+    }
+}
+
+/* 目录中指向同一个桶的项是连续的, 按顺序去重就能访问每个桶一次 */
+template <typename Func>
+static void ForEachBucket(HashDirectory *dir, Func &&func) {
+    uint64 last = 0;
+    for (uint32 i = 0; i < (1U << dir->m_depth); i++) {
+        uint64 raw = dir->m_buckets[i].load(std::memory_order_relaxed);
+        if (raw != last) {
+            func(raw);
+            last = raw;
+        }
+    }
+}
+
+void ExtendibleHash::SetAll(Val_t val) {
+    PersistTagScope persistTag(PersistTag::INDEX);
+    ForEachBucket(m_dir.load(std::memory_order_relaxed), [val](uint64 raw) {
+        for (HashBucket *b = GetBucket(raw); b != nullptr; b = GetBucket(b->m_next)) {
+            for (uint64 bits = b->m_bitmap; bits != 0; bits &= bits - 1) {
+                int i = __builtin_ctzll(bits);
+                b->m_slots[i].m_val = val;
+                NVMFlush(&b->m_slots[i].m_val, sizeof(Val_t));
+            }
+        }
+    });
+    NVMFence();
+}
+
+void ExtendibleHash::Destroy() {
+    HashDirectory *dir = m_dir.load(std::memory_order_relaxed);
+    ForEachBucket(dir, [](uint64 raw) {
+        while (raw != 0) {
+            uint64 next = GetBucket(raw)->m_next;
+            PMem::free(reinterpret_cast<void *>(raw));
+            raw = next;
+        }
+    });
+    uint64 dirRaw = m_root->m_dir;
+    while (dirRaw != 0) {
+        uint64 prev = static_cast<HashDirectory *>(GetVaddr(dirRaw))->m_prev;
+        PMem::free(reinterpret_cast<void *>(dirRaw));
+        dirRaw = prev;
+    }
+    m_root->m_dir = 0;
+    m_dir.store(nullptr, std::memory_order_relaxed);
+}
+
+/*
+ * 持久化的哈希索引注册表, 挂在 search layer 内存池的根对象上 (ptr[0], search layer 不再使用它),
+ * 下标是哈希索引的 id. 根对象和注册表在同一个内存池中, 分配是原子的
+ */
+struct HashIndexRegistry {
+    struct Entry {
+        uint32 m_inUse;
+        uint32 m_idxId;
+        PMEMoid m_root;
+    };
+    Entry m_entries[HASH_INDEX_MAX];
+};
+
+static HashIndexRegistry *g_hashRegistry = nullptr;
+
+static std::atomic<ExtendibleHash *> g_hashIndexes[HASH_INDEX_MAX];
+
+static std::mutex g_hashRegistryLock;
+
+static PMEMobjpool *RegistryPool() {
+    return static_cast<PMEMobjpool *>(PMem::getBaseOf(1));
+}
+
+void HashIndexBootstrap() {
+    DCHECK(g_hashRegistry == nullptr);
+    PMEMobjpool *pop = RegistryPool();
+    auto *root = static_cast<root_obj *>(pmemobj_direct(pmemobj_root(pop, sizeof(root_obj))));
+    if (OID_IS_NULL(root->ptr[0])) {
+        CHECK(pmemobj_zalloc(pop, &root->ptr[0], sizeof(HashIndexRegistry), 0) == 0);
+    }
+    g_hashRegistry = static_cast<HashIndexRegistry *>(pmemobj_direct(root->ptr[0]));
+    for (int i = 0; i < HASH_INDEX_MAX; i++) {
+        auto &entry = g_hashRegistry->m_entries[i];
+        ExtendibleHash *hash = nullptr;
+        if (entry.m_inUse != 0) {
+            hash = new ExtendibleHash(static_cast<uint16>(i), static_cast<HashRoot *>(pmemobj_direct(entry.m_root)));
+        }
+        g_hashIndexes[i].store(hash, std::memory_order_release);
+    }
+}
+
+void HashIndexExitProcess() {
+    for (auto &hash : g_hashIndexes) {
+        delete hash.exchange(nullptr);
+    }
+    g_hashRegistry = nullptr;
+}
+
+ExtendibleHash *GetHashIndexById(uint16 id) {
+    DCHECK(id < HASH_INDEX_MAX);
+    return g_hashIndexes[id].load(std::memory_order_acquire);
+}
+
+ExtendibleHash *OpenHashIndex(uint32 idxId) {
+    std::lock_guard<std::mutex> lockGuard(g_hashRegistryLock);
+    DCHECK(g_hashRegistry != nullptr);
+    int freeSlot = -1;
+    for (int i = 0; i < HASH_INDEX_MAX; i++) {
+        auto &entry = g_hashRegistry->m_entries[i];
+        if (entry.m_inUse == 0) {
+            freeSlot = freeSlot < 0 ? i : freeSlot;
+        } else if (entry.m_idxId == idxId) {
+            return GetHashIndexById(static_cast<uint16>(i));
+        }
+    }
+    CHECK(freeSlot >= 0) << "too many hash indexes";
+    // 先建好再登记, 中途崩溃只会泄漏空间
+    auto &entry = g_hashRegistry->m_entries[freeSlot];
+    CHECK(pmemobj_zalloc(RegistryPool(), &entry.m_root, sizeof(HashRoot), 0) == 0);
+    auto *root = static_cast<HashRoot *>(pmemobj_direct(entry.m_root));
+    ExtendibleHash::Create(root);
+    entry.m_idxId = idxId;
+    NVMPersist(&entry, sizeof(entry));
+    entry.m_inUse = 1;
+    NVMPersist(&entry.m_inUse, sizeof(entry.m_inUse));
+    auto *hash = new ExtendibleHash(static_cast<uint16>(freeSlot), root);
+    g_hashIndexes[freeSlot].store(hash, std::memory_order_release);
+    return hash;
+}
+
+void DropHashIndex(uint32 idxId) {
+    std::lock_guard<std::mutex> lockGuard(g_hashRegistryLock);
+    DCHECK(g_hashRegistry != nullptr);
+    for (int i = 0; i < HASH_INDEX_MAX; i++) {
+        auto &entry = g_hashRegistry->m_entries[i];
+        if (entry.m_inUse == 0 || entry.m_idxId != idxId) {
+            continue;
+        }
+        ExtendibleHash *hash = g_hashIndexes[i].exchange(nullptr);
+        // 先注销再释放, 中途崩溃只会泄漏空间
+        entry.m_inUse = 0;
+        NVMPersist(&entry.m_inUse, sizeof(entry.m_inUse));
+        hash->Destroy();
+        pmemobj_free(&entry.m_root);
+        delete hash;
+        return;
+    }
+}
+
+}  // namespace NVMDB
@@ -1,4 +1,5 @@
 #include "index/nvm_index.h"
+#include "transaction/nvm_transaction.h"
 
 namespace NVMDB {
 
@@ -7,6 +8,7 @@ static PACTree *g_pt = nullptr;
 void IndexBootstrap() {
     DCHECK(g_pt == nullptr);
     g_pt = new PACTree();
+    HashIndexBootstrap();
 }
 
 PACTree *GetGlobalPACTree() {
@@ -15,6 +17,8 @@ PACTree *GetGlobalPACTree() {
 }
 
 void IndexExitProcess() {
+    VolatileIndexExitProcess();
+    HashIndexExitProcess();
     delete g_pt;
     g_pt = nullptr;
 }
@@ -29,4 +33,84 @@ void DestroyLocalIndex() {
     g_pt->unregisterThread();
 }
 
-}  // namespace NVMDB
\ No newline at end of file
+// 点查每次从 PACTree 取的 key 数, 通常第一个就可见
+static constexpr int LOOKUP_BATCH = 4;
+
+static thread_local std::vector<std::pair<Key_t, Val_t>> t_lookupResult;
+
+/* 写这个版本的事务 (TxSlot 或者 CSN) 对 tx 是否可见, 按 Transaction::VersionIsVisible 的规则 */
+static bool WriterIsVisible(Transaction *tx, uint64 writer) {
+    switch (tx->VersionIsVisible(writer)) {
+        case TMResult::OK:
+        case TMResult::SELF_UPDATED:
+            return true;
+        case TMResult::INVISIBLE:
+        case TMResult::BEING_MODIFIED:
+        case TMResult::ABORTED:
+            return false;
+        default:
+            CHECK(false);
+    }
+    return false;
+}
+
+/* value 是删除这个 key 的事务 (TxSlot 或者 CSN), INVALID_CSN 表示没有被删除 */
+static bool DeleteIsVisible(Transaction *tx, Val_t value) {
+    return value != INVALID_CSN && WriterIsVisible(tx, value);
+}
+
+/* 插入事务 (覆盖索引的 key 中记录的 TxSlot 或者 CSN) 对 tx 是否可见, INVALID_CSN 表示不在事务中插入 */
+static bool InsertIsVisible(Transaction *tx, uint64 inserter) {
+    return inserter == INVALID_CSN || WriterIsVisible(tx, inserter);
+}
+
+/* 按 key 的顺序找 [kb, ke) 中第一个满足 match 的 key, tree 是 PACTreeImpl, ExtendibleHash 或者 VolatileIndex */
+template <typename Source, typename Match>
+static bool LookupFirst(Source *tree, Key_t &kb, Key_t &ke, LookupSnapshot snapshot, Key_t *key, Match &&match) {
+    auto &result = t_lookupResult;
+    Key_t start = kb;
+    while (true) {
+        tree->Scan(start, ke, LOOKUP_BATCH, snapshot, false, result);
+        for (auto &it : result) {
+            if (match(it.first, it.second)) {
+                *key = it.first;
+                return true;
+            }
+        }
+        if (result.size() < LOOKUP_BATCH) {
+            return false;
+        }
+        start = result.back().first;
+        start.next();
+    }
+}
+
+template <typename Source>
+bool IndexLookupVisible(Source *tree, Transaction *tx, Key_t &kb, Key_t &ke, Key_t *key) {
+    // PACTree 的 scan 已经按快照过滤了回填了 CSN 的删除, 这里只需要判断还是 TxSlot 的
+    return LookupFirst(tree, kb, ke, tx->GetIndexLookupSnapshot(), key,
+                       [tx](Key_t &, Val_t value) { return !DeleteIsVisible(tx, value); });
+}
+
+template bool IndexLookupVisible(PACTreeImpl *tree, Transaction *tx, Key_t &kb, Key_t &ke, Key_t *key);
+template bool IndexLookupVisible(ExtendibleHash *tree, Transaction *tx, Key_t &kb, Key_t &ke, Key_t *key);
+template bool IndexLookupVisible(VolatileIndex *tree, Transaction *tx, Key_t &kb, Key_t &ke, Key_t *key);
+
+bool IndexLookupCovering(PACTreeImpl *tree, Transaction *tx, Key_t &kb, Key_t &ke, uint32 suffixLen, Key_t *key) {
+    return LookupFirst(tree, kb, ke, tx->GetIndexLookupSnapshot(), key, [tx, suffixLen](Key_t &k, Val_t value) {
+        if (DeleteIsVisible(tx, value)) {
+            return false;
+        }
+        BinaryReader reader(k.getData());
+        reader.set_position(k.keyLength - suffixLen);
+        return InsertIsVisible(tx, reader.read_uint64());
+    });
+}
+
+bool IndexFindLiveKey(PACTreeImpl *tree, Key_t &kb, Key_t &ke, Key_t *key) {
+    // 不回收也不过滤任何 key, 已提交的删除会回填为 CSN
+    LookupSnapshot snapshot {0, 0};
+    return LookupFirst(tree, kb, ke, snapshot, key, [](Key_t &, Val_t value) { return value == INVALID_CSN; });
+}
+
+}  // namespace NVMDB
@@ -1,24 +1,46 @@
 #include "index/nvm_index_undo.h"
 
 namespace NVMDB {
+/*
+ * 把 undo 中的 key 的 value 改回 val. undo 中记录了 key 所在的树, 带 HASH_INDEX_UNDO_FLAG 时是哈希索引,
+ * 带 VOLATILE_INDEX_UNDO_FLAG 时是易失索引; 索引已经被删除, 或者易失索引还没有重建时不需要回滚
+ */
+static void RestoreIndexUndo(const UndoRecord *undo, Val_t val) {
+    Key_t key;
+    uint16 treeId;
+    DCHECK(undo->m_payload == sizeof(Key_t) + sizeof(treeId));
+    int ret = memcpy_s(&key, sizeof(Key_t), undo->data, sizeof(Key_t));
+    SecureRetCheck(ret);
+    ret = memcpy_s(&treeId, sizeof(treeId), undo->data + sizeof(Key_t), sizeof(treeId));
+    SecureRetCheck(ret);
+    if (treeId & VOLATILE_INDEX_UNDO_FLAG) {
+        auto index = GetVolatileIndexById(treeId & ~VOLATILE_INDEX_UNDO_FLAG);
+        if (index != nullptr) {
+            index->Insert(key, val);
+        }
+        return;
+    }
+    if (treeId & HASH_INDEX_UNDO_FLAG) {
+        auto hash = GetHashIndexById(treeId & ~HASH_INDEX_UNDO_FLAG);
+        if (hash != nullptr) {
+            hash->Insert(key, val);
+        }
+        return;
+    }
+    auto tree = GetTreeById(treeId);
+    if (tree != nullptr) {
+        tree->Insert(key, val);
+    }
+}
+
 void UndoIndexInsert(const UndoRecord *undo) {
     uint64 csn = undo->m_segHead;
     csn = (csn << BIS_PER_U32) | undo->m_rowId;
-    Key_t key;
-    DCHECK(undo->m_payload == sizeof(Key_t));
-    int ret = memcpy_s(&key, sizeof(key), undo->data, undo->m_payload);
-    SecureRetCheck(ret);
-    auto pt = GetGlobalPACTree();
-    pt->Insert(key, csn);
+    RestoreIndexUndo(undo, csn);
 }
 
 void UndoIndexDelete(const UndoRecord *undo) {
-    Key_t key;
-    DCHECK(undo->m_payload == sizeof(Key_t));
-    int ret = memcpy_s(&key, sizeof(key), undo->data, undo->m_payload);
-    SecureRetCheck(ret);
-    auto pt = GetGlobalPACTree();
-    pt->Insert(key, INVALID_CSN);
+    RestoreIndexUndo(undo, INVALID_CSN);
 }
 
-}  // namespace NVMDB
\ No newline at end of file
+}  // namespace NVMDB
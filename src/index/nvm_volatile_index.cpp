@@ -0,0 +1,116 @@
+#include "index/nvm_volatile_index.h"
+#include <algorithm>
+#include <thread>
+
+namespace NVMDB {
+
+void VolatileIndex::Insert(Key_t &key, Val_t val) {
+    Shard &shard = ShardOf(key);
+    std::lock_guard<PassiveSpinner42> guard(shard.m_lock);
+    shard.m_keys[key] = val;
+}
+
+void VolatileIndex::Scan(Key_t &startKey, Key_t &endKey, int maxRange, LookupSnapshot snapshot, bool reverse,
+                         std::vector<std::pair<Key_t, Val_t>> &result) {
+    CHECK(startKey.keyLength == endKey.keyLength &&
+          memcmp(startKey.data, endKey.data, startKey.keyLength - HASH_KEY_ROWID_LEN) == 0)
+        << "volatile index only supports equality lookups";
+    result.clear();
+    Shard &shard = ShardOf(startKey);
+    std::lock_guard<PassiveSpinner42> guard(shard.m_lock);
+    auto end = shard.m_keys.lower_bound(endKey);
+    for (auto it = shard.m_keys.lower_bound(startKey); it != end;) {
+        auto status = CheckMVCCVisibility(&it->second, snapshot);
+        if (status == MVCCVisibility::REMOVABLE) {
+            it = shard.m_keys.erase(it);
+            continue;
+        }
+        if (status == MVCCVisibility::VISIBLE) {
+            result.emplace_back(it->first, it->second);
+            // 顺序扫描时前 maxRange 个就是结果
+            if (!reverse && result.size() == static_cast<size_t>(maxRange)) {
+                return;
+            }
+        }
+        ++it;
+    }
+    if (reverse) {
+        std::reverse(result.begin(), result.end());
+        if (result.size() > static_cast<size_t>(maxRange)) {
+            result.resize(maxRange);
+        }
+    }
+}
+
+void VolatileIndex::Clear() {
+    for (auto &shard : m_shards) {
+        std::lock_guard<PassiveSpinner42> guard(shard.m_lock);
+        shard.m_keys.clear();
+    }
+}
+
+void VolatileIndex::WaitReady() const {
+    while (!Ready()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/* 易失索引的注册表只在 DRAM 中, 下标是易失索引的 id, 记录在 undo 中 (见 NVMIndex::TreeId) */
+struct VolatileIndexEntry {
+    uint32 m_idxId;
+    std::atomic<VolatileIndex *> m_index;
+};
+
+static VolatileIndexEntry g_volatileIndexes[VOLATILE_INDEX_MAX];
+
+static std::mutex g_volatileRegistryLock;
+
+void VolatileIndexExitProcess() {
+    std::lock_guard<std::mutex> lockGuard(g_volatileRegistryLock);
+    for (auto &entry : g_volatileIndexes) {
+        delete entry.m_index.exchange(nullptr);
+    }
+}
+
+VolatileIndex *GetVolatileIndexById(uint16 id) {
+    DCHECK(id < VOLATILE_INDEX_MAX);
+    VolatileIndex *index = g_volatileIndexes[id].m_index.load(std::memory_order_acquire);
+    // 重建之前的 undo 属于重启前的索引, 重建会从 heap 中得到正确的内容
+    if (index == nullptr || !index->Ready()) {
+        return nullptr;
+    }
+    return index;
+}
+
+VolatileIndex *OpenVolatileIndex(uint32 idxId) {
+    std::lock_guard<std::mutex> lockGuard(g_volatileRegistryLock);
+    int freeSlot = -1;
+    for (int i = 0; i < VOLATILE_INDEX_MAX; i++) {
+        auto &entry = g_volatileIndexes[i];
+        VolatileIndex *index = entry.m_index.load(std::memory_order_relaxed);
+        if (index == nullptr) {
+            freeSlot = freeSlot < 0 ? i : freeSlot;
+        } else if (entry.m_idxId == idxId) {
+            return index;
+        }
+    }
+    CHECK(freeSlot >= 0) << "too many volatile indexes";
+    auto *index = new VolatileIndex(static_cast<uint16>(freeSlot));
+    g_volatileIndexes[freeSlot].m_idxId = idxId;
+    g_volatileIndexes[freeSlot].m_index.store(index, std::memory_order_release);
+    return index;
+}
+
+void DropVolatileIndex(uint32 idxId) {
+    std::lock_guard<std::mutex> lockGuard(g_volatileRegistryLock);
+    for (auto &entry : g_volatileIndexes) {
+        VolatileIndex *index = entry.m_index.load(std::memory_order_relaxed);
+        if (index != nullptr && entry.m_idxId == idxId) {
+            entry.m_index.store(nullptr, std::memory_order_release);
+            delete index;
+            return;
+        }
+    }
+}
+
+}  // namespace NVMDB
@@ -1,6 +1,7 @@
 #include "nvm_access.h"
 #include "heap/nvm_heap_undo.h"
 #include "heap/nvm_heap_cache.h"
+#include <memory>
 
 namespace NVMDB {
 
@@ -8,6 +9,21 @@ static inline bool CheckTxStatus(const Transaction *tx) {
     return tx->GetTxStatus() == TxStatus::WAIT_ABORT;
 }
 
+// 需持有行锁. 重启后第一次访问崩溃事务写过的行时, 就地回滚这一行, 不必等待后台恢复
+static inline void RollBackCrashedTuple(const Transaction *tx, NVMTuple *tuple) {
+    if (!tuple->m_isUsed || TxInfoIsCSN(tuple->m_txInfo)) {
+        return;
+    }
+    TransactionInfo txInfo{};
+    if (!GetTransactionInfo((TxSlotPtr)tuple->m_txInfo, &txInfo) || txInfo.status != TxSlotStatus::IN_PROGRESS) {
+        return;
+    }
+    if (!IsCrashedTxSlot((TxSlotPtr)tuple->m_txInfo)) {
+        return;
+    }
+    UndoTupleRollBack(tuple, reinterpret_cast<UndoRecord *>(tx->undoRecordCache));
+}
+
 RowId HeapUpperRowId(const Table *table) {
     DCHECK(table->Ready());
     RowIdMap *rowIdMap = table->m_rowIdMap;
@@ -15,6 +31,7 @@ RowId HeapUpperRowId(const Table *table) {
 }
 
 std::pair<std::unique_ptr<RAMTuple>, RowId> HeapInsertEmptyTuple(Transaction *tx, Table *table) {
+    PersistTagScope persistTag(PersistTag::HEAP);
     if (CheckTxStatus(tx)) {
         LOG(ERROR) << "Insert cannot fail by default!";
         return std::make_pair(nullptr, InvalidRowId);
@@ -35,6 +52,7 @@ std::pair<std::unique_ptr<RAMTuple>, RowId> HeapInsertEmptyTuple(Transaction *tx
 
     // Write tuple to NVM; note marking head as used
     tuple->InitHead(tx->GetTxSlotLocation(), InvalidUndoRecPtr, true, false);
+    NVMFlush(nvmAddr, NVMTupleHeadSize);
     if (ForceWriteBackCSN()) {
         RowIdMapEntry *rowEntry = rowIdMap->GetEntry(rowId, false);
         tx->PushWriteSet(rowEntry);
@@ -43,6 +61,7 @@ std::pair<std::unique_ptr<RAMTuple>, RowId> HeapInsertEmptyTuple(Transaction *tx
 }
 
 RowId HeapInsert(Transaction *tx, Table *table, RAMTuple *tuple) {
+    PersistTagScope persistTag(PersistTag::HEAP);
     DCHECK(table->GetRowLen() == tuple->getRowLen());
     if (CheckTxStatus(tx)) {
         LOG(ERROR) << "Insert cannot fail by default!";
@@ -63,8 +82,9 @@ RowId HeapInsert(Transaction *tx, Table *table, RAMTuple *tuple) {
 
     // Write tuple to NVM; note marking head as used
     tuple->InitHead(tx->GetTxSlotLocation(), InvalidUndoRecPtr, true, false);
-    // 直接写入nvm
+    // 直接写入nvm, 提交时统一 fence
     tuple->Serialize(nvmAddr, RealTupleSize(tuple->getRowLen()));
+    NVMFlush(nvmAddr, RealTupleSize(tuple->getRowLen()));
     if (ForceWriteBackCSN()) {
         RowIdMapEntry *rowEntry = rowIdMap->GetEntry(rowId, false);
         tx->PushWriteSet(rowEntry);
@@ -89,6 +109,7 @@ HamStatus HeapRead(const Transaction *tx, const Table *table, RowId rowId, RAMTu
     // 读记录, 加入到LRU
     // TLTupleCache::Touch(table->SegmentHead(), rowId, rowEntry);
     auto* dramCache = rowEntry->loadDRAMCache<char>(RealTupleSize(tuple->getRowLen()));
+    RollBackCrashedTuple(tx, reinterpret_cast<NVMTuple *>(dramCache));
     tuple->Deserialize(dramCache);
     rowEntry->addReadRef();
     rowEntry->Unlock();
@@ -115,8 +136,44 @@ HamStatus HeapRead(const Transaction *tx, const Table *table, RowId rowId, RAMTu
     }
 }
 
+namespace {
+
+// 更新的列包含覆盖索引的包含列但不包含 key 列时, 这个索引需要同步
+bool NeedCoveringUpdate(const Table *table, const NVMIndex *index, const UndoColumnDesc *updatedCols,
+                        uint32 updateCnt) {
+    return index->IsCovering() && index->IncludeUpdated(table->GetColDesc(), updatedCols, updateCnt) &&
+           !index->KeyUpdated(table->GetColDesc(), updatedCols, updateCnt);
+}
+
+bool NeedCoveringUpdate(const Table *table, const UndoColumnDesc *updatedCols, uint32 updateCnt) {
+    for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+        if (NeedCoveringUpdate(table, table->GetIndex(i), updatedCols, updateCnt)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 行更新之后同步表上的覆盖索引, newRow 为更新后的整行
+void UpdateCoveringIndexes(Transaction *tx, const Table *table, RowId rowId, RAMTuple *newRow,
+                           const UndoColumnDesc *updatedCols, uint32 updateCnt) {
+    for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+        NVMIndex *index = table->GetIndex(i);
+        if (!NeedCoveringUpdate(table, index, updatedCols, updateCnt)) {
+            continue;
+        }
+        DRAMIndexTuple indexTuple(table->GetColDesc(), index->GetIndexDesc(), index->GetColCount(),
+                                  index->GetRowLen());
+        indexTuple.ExtractFromTuple(newRow);
+        tx->IndexUpdate(index, &indexTuple, rowId, newRow);
+    }
+}
+
+}  // namespace
+
 // for read-modify-write
 HamStatus HeapUpdate(Transaction *tx, Table *table, RowId rowId, RAMTuple *tuple) {
+    PersistTagScope persistTag(PersistTag::HEAP);
     DCHECK(table->GetRowLen() == tuple->getRowLen());
     if (CheckTxStatus(tx)) {
         return HamStatus::WAIT_ABORT;
@@ -129,7 +186,8 @@ HamStatus HeapUpdate(Transaction *tx, Table *table, RowId rowId, RAMTuple *tuple
     rowEntry->Lock();
     // 更新时读记录, 加入到LRU
     // TLTupleCache::Touch(table->SegmentHead(), rowId, rowEntry);
-    const auto* dramCache = rowEntry->loadDRAMCache<NVMTuple>(RealTupleSize(tuple->getRowLen()));
+    auto* dramCache = rowEntry->loadDRAMCache<NVMTuple>(RealTupleSize(tuple->getRowLen()));
+    RollBackCrashedTuple(tx, dramCache);
     TMResult result = tx->SatisfiedUpdate(*dramCache);
     if (result == TMResult::INVISIBLE || result == TMResult::BEING_MODIFIED) {
         rowEntry->Unlock();
@@ -159,16 +217,19 @@ HamStatus HeapUpdate(Transaction *tx, Table *table, RowId rowId, RAMTuple *tuple
     // inplace update
     auto* dramCacheAddr = rowEntry->loadDRAMCache<char>(RealTupleSize(tuple->getRowLen()));
     tuple->Serialize(dramCacheAddr, RealTupleSize(table->GetRowLen()));
-    rowEntry->flushToNVM();
+    rowEntry->flushToNVM(RealTupleSize(table->GetRowLen()));
     rowEntry->addWriteRef();
     rowEntry->Unlock();
 
     tx->PushWriteSet(rowEntry);
+    // tuple 是更新后的整行
+    UpdateCoveringIndexes(tx, table, rowId, tuple, updatedCols, updateCnt);
     return HamStatus::OK;
 }
 
 // for direct update
 HamStatus HeapUpdate2(Transaction *tx, Table *table, RowId rowId, RAMTuple *tuple) {
+    PersistTagScope persistTag(PersistTag::HEAP);
     DCHECK(table->GetRowLen() == tuple->getRowLen());
     if (CheckTxStatus(tx)) {
         return HamStatus::WAIT_ABORT;
@@ -182,6 +243,7 @@ HamStatus HeapUpdate2(Transaction *tx, Table *table, RowId rowId, RAMTuple *tupl
     // 更新时读记录, 加入到LRU
     // TLTupleCache::Touch(table->SegmentHead(), rowId, rowEntry);
     auto* dramCache = rowEntry->loadDRAMCache<NVMTuple>(RealTupleSize(tuple->getRowLen()));
+    RollBackCrashedTuple(tx, dramCache);
     TMResult result = tx->SatisfiedUpdate(*dramCache);
     if (result == TMResult::INVISIBLE || result == TMResult::BEING_MODIFIED) {
         rowEntry->Unlock();
@@ -211,15 +273,25 @@ HamStatus HeapUpdate2(Transaction *tx, Table *table, RowId rowId, RAMTuple *tupl
     auto* tupleDataPtr = reinterpret_cast<char*>(dramCache) + NVMTupleHeadSize;
     // modification: only copy delta updates
     tuple->copyUpdatedColumnsToNVM(tupleDataPtr, rowId);
-    rowEntry->flushToNVM();
+    rowEntry->flushHeaderToNVM();
+    // tuple 中只有更新的列, 需要同步覆盖索引时在锁内复制出更新后的整行
+    std::unique_ptr<RAMTuple> newRow;
+    if (NeedCoveringUpdate(table, updatedCols, updateCnt)) {
+        newRow.reset(new RAMTuple(table->GetColDesc(), table->GetRowLen()));
+        newRow->Deserialize(reinterpret_cast<char *>(dramCache));
+    }
     rowEntry->addWriteRef();
     rowEntry->Unlock();
 
     tx->PushWriteSet(rowEntry);
+    if (newRow != nullptr) {
+        UpdateCoveringIndexes(tx, table, rowId, newRow.get(), updatedCols, updateCnt);
+    }
     return HamStatus::OK;
 }
 
 HamStatus HeapDelete(Transaction *tx, Table *table, RowId rowId) {
+    PersistTagScope persistTag(PersistTag::HEAP);
     if (CheckTxStatus(tx)) {
         return HamStatus::WAIT_ABORT;
     }
@@ -232,6 +304,7 @@ HamStatus HeapDelete(Transaction *tx, Table *table, RowId rowId) {
     // 删除时读记录, 加入到LRU
     // TLTupleCache::Touch(table->SegmentHead(), rowId, rowEntry);
     auto* dramCache = rowEntry->loadDRAMCache<NVMTuple>(RealTupleSize(table->GetRowLen()));
+    RollBackCrashedTuple(tx, dramCache);
     TMResult result = tx->SatisfiedUpdate(*dramCache);
     if (result == TMResult::INVISIBLE || result == TMResult::BEING_MODIFIED) {
         rowEntry->Unlock();
@@ -260,4 +333,19 @@ HamStatus HeapDelete(Transaction *tx, Table *table, RowId rowId) {
     return HamStatus::OK;
 }
 
+RowId IndexUniqueRead(Transaction *tx, const NVMIndex *index, const Table *table, DRAMIndexTuple *key,
+                      RAMTuple *tuple) {
+    if (index->IsCovering()) {
+        return index->LookupCovering(tx, key, tuple);
+    }
+    RowId rowId = index->Lookup(tx, key);
+    while (rowId != InvalidRowId) {
+        if (HeapRead(tx, table, rowId, tuple) == HamStatus::OK) {
+            return rowId;
+        }
+        rowId = index->Lookup(tx, key, rowId + 1);
+    }
+    return InvalidRowId;
+}
+
 }  // namespace NVMDB
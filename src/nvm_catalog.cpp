@@ -0,0 +1,846 @@
+#include "nvm_catalog.h"
+#include "nvm_access.h"
+#include "nvm_index_rebuild.h"
+#include "nvmdb_thread.h"
+#include "heap/nvm_heap.h"
+#include "undo/nvm_undo_segment.h"
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace NVMDB {
+
+namespace {
+
+enum CatalogKind : uint32 {
+    CATALOG_KIND_TABLE = 1,
+    CATALOG_KIND_COLUMN = 2,
+    CATALOG_KIND_INDEX = 3,
+    CATALOG_KIND_DROPPED = 4,
+};
+
+// 系统表的列
+enum CatalogColumn : uint32 {
+    CATALOG_COL_KIND = 0,
+    CATALOG_COL_OBJ_ID = 1,     // table id 或 index id
+    CATALOG_COL_OWNER = 2,      // 列和索引所属的表在系统表中的 row id
+    CATALOG_COL_NAME = 3,
+    CATALOG_COL_BODY = 4,
+    CATALOG_COL_COUNT,
+};
+
+struct CatalogTableBody {
+    uint32 m_segHead;
+    uint32 m_colCnt;
+    uint64 m_rowLen;
+};
+
+struct CatalogColumnBody {
+    uint32 m_colIdx;
+    uint32 m_colType;
+    uint32 m_colOid;
+    uint32 m_isNotNull;
+    uint64 m_colLen;
+    uint64 m_colOffset;
+};
+
+/*
+ * 覆盖索引的包含列跟在 key 列后面放在 m_colIds 中, 个数放在 m_colCnt 的高 16 位;
+ * 索引类型 (IndexType) 放在 m_colCnt 的 8~15 位. 这样普通的 PACTree 索引和原来的格式相同
+ */
+struct CatalogIndexBody {
+    uint32 m_colCnt;
+    uint32 m_colIds[NVMDB_TUPLE_MAX_COL_COUNT];
+
+    uint32 KeyColCount() const { return m_colCnt & 0xFF; }
+
+    IndexType Type() const { return static_cast<IndexType>((m_colCnt >> 8) & 0xFF); }
+
+    uint32 IncludeColCount() const { return m_colCnt >> 16; }
+};
+
+// 每张表最多的索引个数, 受限于 DROPPED 行能记下的索引
+constexpr uint32 CATALOG_MAX_TABLE_INDEXES = (sizeof(CatalogIndexBody) - 2 * sizeof(uint32)) / (2 * sizeof(uint32));
+
+/*
+ * 已经删除但还没有回收空间的表, 由删表的事务写入, owner 为表的 TABLE 行.
+ * CatalogPurgeDroppedTables 回收 segment 和索引之后删除这一行. m_indexes 中是索引的 id 和类型
+ */
+struct CatalogDroppedBody {
+    uint32 m_segHead;
+    uint32 m_indexCnt;
+    uint32 m_indexes[CATALOG_MAX_TABLE_INDEXES][2];
+};
+
+constexpr uint64 CATALOG_BODY_LEN = std::max(std::max(sizeof(CatalogIndexBody), sizeof(CatalogDroppedBody)),
+                                             std::max(sizeof(CatalogTableBody), sizeof(CatalogColumnBody)));
+
+// 从系统表中读出的一行
+struct CatalogRow {
+    RowId m_rowId;
+    uint32 m_kind;
+    uint32 m_objId;
+    RowId m_owner;
+    char m_name[NVM_MAX_TABLE_NAME_LEN];
+    char m_body[CATALOG_BODY_LEN];
+};
+
+Table *g_catalogTable = nullptr;
+
+/*
+ * 系统表的 DRAM 索引, 第一次访问 catalog 时扫描系统表建立, 之后由 DDL 维护. 读不加锁.
+ * 表名哈希到桶, 同一个桶的 TABLE 行通过 m_nextName 串起来; 列和索引行挂在所属 TABLE 行的 m_firstChild 链表上.
+ * 系统表的 row id 不会复用, 所以链表只增不减, 被删除或回滚的行在读取时通过可见性过滤掉.
+ */
+struct CatalogRowLink {
+    std::atomic<RowId> m_nextName;
+    std::atomic<RowId> m_firstChild;
+    std::atomic<RowId> m_nextChild;
+    std::atomic<Table *> m_table;   // 重建好的 Table, 只有 TABLE 行使用
+};
+
+constexpr uint32 CATALOG_NAME_BUCKETS = 1 << 16;
+constexpr uint32 CATALOG_LINK_SEGMENT_LEN = 1 << 16;
+constexpr uint32 CATALOG_LINK_MAX_SEGMENTS = 4096;
+
+std::atomic<RowId> g_nameBuckets[CATALOG_NAME_BUCKETS];
+std::atomic<CatalogRowLink *> g_rowLinks[CATALOG_LINK_MAX_SEGMENTS];
+std::atomic<bool> g_catalogLoaded{false};
+// 所有重建好的 Table 和它们在系统表中的 row id, 用于 CatalogCreateIndex, DDL 回滚和退出时释放
+std::unordered_map<const Table *, RowId> g_catalogTables;
+// 每个 index id 最新的 INDEX 行和 DROPPED 行, 用于检查 index id 是否已经被使用
+std::unordered_map<IndexId, RowId> g_indexRows;
+std::unordered_map<IndexId, RowId> g_droppedIndexes;
+// 等待回收的 DROPPED 行, 包括还没有提交和已经回滚的
+std::vector<RowId> g_droppedRows;
+// 最近一次创建表名和 index id 的事务, 见 LockCatalogKey
+std::unordered_map<std::string, TxSlotPtr> g_nameLocks;
+std::unordered_map<IndexId, TxSlotPtr> g_indexIdLocks;
+// 串行化 DDL 和 DRAM 索引的修改
+std::mutex g_catalogMutex;
+// 保护 g_catalogTables 和缓存的 Table 的索引列表. DDL 的回滚可能发生在后台恢复线程中,
+// 而持有 g_catalogMutex 时会等待后台恢复 (RebuildVolatileIndexes), 所以回滚只使用这把锁.
+// 加锁顺序为先 g_catalogMutex 后 g_catalogCacheMutex
+std::mutex g_catalogCacheMutex;
+
+TableDesc CatalogTableDesc() {
+    TableDesc desc;
+    CHECK(TableDescInit(&desc, CATALOG_COL_COUNT));
+    const uint64 colLen[CATALOG_COL_COUNT] = {sizeof(uint32), sizeof(uint32), sizeof(RowId), NVM_MAX_TABLE_NAME_LEN,
+                                              CATALOG_BODY_LEN};
+    const ColumnType colType[CATALOG_COL_COUNT] = {COL_TYPE_INT, COL_TYPE_INT, COL_TYPE_INT, COL_TYPE_VARCHAR,
+                                                   COL_TYPE_VARCHAR};
+    const char *colName[CATALOG_COL_COUNT] = {"kind", "obj_id", "owner", "name", "body"};
+    uint64 offset = 0;
+    for (uint32 i = 0; i < CATALOG_COL_COUNT; i++) {
+        ColumnDesc &col = desc.col_desc[i];
+        errno_t ret = memset_s(&col, sizeof(ColumnDesc), 0, sizeof(ColumnDesc));
+        SecureRetCheck(ret);
+        col.m_colType = colType[i];
+        col.m_colLen = colLen[i];
+        col.m_colOffset = offset;
+        col.m_isNotNull = true;
+        ret = strcpy_s(col.m_colName, NVM_MAX_COLUMN_NAME_LEN, colName[i]);
+        SecureRetCheck(ret);
+        offset += colLen[i];
+    }
+    // 8 字节对齐
+    desc.row_len = (offset + 7) & ~7ULL;
+    return desc;
+}
+
+bool CopyName(char *dst, const char *name) {
+    errno_t ret = memset_s(dst, NVM_MAX_TABLE_NAME_LEN, 0, NVM_MAX_TABLE_NAME_LEN);
+    SecureRetCheck(ret);
+    if (name == nullptr || strlen(name) >= NVM_MAX_TABLE_NAME_LEN) {
+        return false;
+    }
+    ret = strcpy_s(dst, NVM_MAX_TABLE_NAME_LEN, name);
+    SecureRetCheck(ret);
+    return true;
+}
+
+RowId InsertCatalogRow(Transaction *tx, uint32 kind, uint32 objId, RowId owner, const char *name, const void *body,
+                       size_t bodyLen) {
+    RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+    char nameBuf[NVM_MAX_TABLE_NAME_LEN];
+    CopyName(nameBuf, name);
+    char bodyBuf[CATALOG_BODY_LEN] = {0};
+    errno_t ret = memcpy_s(bodyBuf, CATALOG_BODY_LEN, body, bodyLen);
+    SecureRetCheck(ret);
+    tuple.SetCol(CATALOG_COL_KIND, (char *)&kind);
+    tuple.SetCol(CATALOG_COL_OBJ_ID, (char *)&objId);
+    tuple.SetCol(CATALOG_COL_OWNER, (char *)&owner);
+    tuple.SetCol(CATALOG_COL_NAME, nameBuf);
+    tuple.SetCol(CATALOG_COL_BODY, bodyBuf);
+    return HeapInsert(tx, g_catalogTable, &tuple);
+}
+
+bool ReadCatalogRow(Transaction *tx, RowId rowId, RAMTuple *tuple, CatalogRow *row) {
+    if (HeapRead(tx, g_catalogTable, rowId, tuple) != HamStatus::OK) {
+        return false;
+    }
+    row->m_rowId = rowId;
+    tuple->GetCol(CATALOG_COL_KIND, (char *)&row->m_kind);
+    tuple->GetCol(CATALOG_COL_OBJ_ID, (char *)&row->m_objId);
+    tuple->GetCol(CATALOG_COL_OWNER, (char *)&row->m_owner);
+    tuple->GetCol(CATALOG_COL_NAME, row->m_name);
+    tuple->GetCol(CATALOG_COL_BODY, row->m_body);
+    return true;
+}
+
+inline uint32 NameBucket(const char *name) {
+    // FNV-1a
+    uint32 hash = 2166136261U;
+    for (const char *c = name; *c != '\0'; c++) {
+        hash ^= static_cast<uint8>(*c);
+        hash *= 16777619U;
+    }
+    return hash & (CATALOG_NAME_BUCKETS - 1);
+}
+
+inline CatalogRowLink *GetRowLink(RowId rowId) {
+    auto *segment = g_rowLinks[rowId / CATALOG_LINK_SEGMENT_LEN].load(std::memory_order_acquire);
+    DCHECK(segment != nullptr);
+    return segment + rowId % CATALOG_LINK_SEGMENT_LEN;
+}
+
+// 需持有 g_catalogMutex
+CatalogRowLink *AllocRowLink(RowId rowId) {
+    CHECK(rowId / CATALOG_LINK_SEGMENT_LEN < CATALOG_LINK_MAX_SEGMENTS) << "Too many catalog rows!";
+    auto &segmentRef = g_rowLinks[rowId / CATALOG_LINK_SEGMENT_LEN];
+    auto *segment = segmentRef.load(std::memory_order_relaxed);
+    if (segment == nullptr) {
+        segment = new CatalogRowLink[CATALOG_LINK_SEGMENT_LEN];
+        for (uint32 i = 0; i < CATALOG_LINK_SEGMENT_LEN; i++) {
+            segment[i].m_nextName.store(InvalidRowId, std::memory_order_relaxed);
+            segment[i].m_firstChild.store(InvalidRowId, std::memory_order_relaxed);
+            segment[i].m_nextChild.store(InvalidRowId, std::memory_order_relaxed);
+            segment[i].m_table.store(nullptr, std::memory_order_relaxed);
+        }
+        segmentRef.store(segment, std::memory_order_release);
+    }
+    return segment + rowId % CATALOG_LINK_SEGMENT_LEN;
+}
+
+// 需持有 g_catalogMutex. 先设置新节点的 next 再发布到链表头, 读者看到的链表总是完整的
+void LinkTableRow(RowId rowId, const char *name) {
+    auto *link = AllocRowLink(rowId);
+    auto &bucket = g_nameBuckets[NameBucket(name)];
+    link->m_nextName.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    bucket.store(rowId, std::memory_order_release);
+}
+
+void LinkChildRow(RowId rowId, RowId owner) {
+    auto *link = AllocRowLink(rowId);
+    auto *ownerLink = AllocRowLink(owner);
+    link->m_nextChild.store(ownerLink->m_firstChild.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    ownerLink->m_firstChild.store(rowId, std::memory_order_release);
+}
+
+// 需持有 g_catalogMutex. DROPPED 行回收之前, 其中的 index id 不能再使用
+void AddDroppedRow(RowId rowId, const CatalogRow &row) {
+    CatalogDroppedBody body{};
+    errno_t ret = memcpy_s(&body, sizeof(body), row.m_body, sizeof(body));
+    SecureRetCheck(ret);
+    for (uint32 i = 0; i < body.m_indexCnt; i++) {
+        g_droppedIndexes[body.m_indexes[i][0]] = rowId;
+    }
+    g_droppedRows.push_back(rowId);
+}
+
+void ResetCatalogIndex() {
+    for (auto &bucket : g_nameBuckets) {
+        bucket.store(InvalidRowId, std::memory_order_relaxed);
+    }
+    g_indexRows.clear();
+    g_droppedIndexes.clear();
+    g_droppedRows.clear();
+    g_nameLocks.clear();
+    g_indexIdLocks.clear();
+    for (auto &segment : g_rowLinks) {
+        delete[] segment.exchange(nullptr, std::memory_order_relaxed);
+    }
+    g_catalogLoaded.store(false, std::memory_order_release);
+}
+
+// 需持有 g_catalogMutex. 重启后第一次访问 catalog 时扫描系统表, 建立 DRAM 索引.
+// 之后的 DDL 都会先走到这里, 所以扫描之后新写入的行由 DDL 自己加入索引
+void LoadCatalogLocked(Transaction *tx) {
+    if (g_catalogLoaded.load(std::memory_order_relaxed)) {
+        return;
+    }
+    RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+    CatalogRow row{};
+    RowId upper = HeapUpperRowId(g_catalogTable);
+    for (RowId rowId = 0; rowId < upper; rowId++) {
+        if (!ReadCatalogRow(tx, rowId, &tuple, &row)) {
+            continue;
+        }
+        if (row.m_kind == CATALOG_KIND_TABLE) {
+            LinkTableRow(rowId, row.m_name);
+        } else if (row.m_kind == CATALOG_KIND_DROPPED) {
+            AddDroppedRow(rowId, row);
+            continue;
+        } else {
+            LinkChildRow(rowId, row.m_owner);
+        }
+        if (row.m_kind == CATALOG_KIND_INDEX) {
+            g_indexRows[row.m_objId] = rowId;
+        }
+    }
+    g_catalogLoaded.store(true, std::memory_order_release);
+}
+
+void LoadCatalog(Transaction *tx) {
+    if (!g_catalogLoaded.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+        LoadCatalogLocked(tx);
+    }
+}
+
+/*
+ * 系统表的行在提交前对其他事务不可见, 只靠可见性检查时两个并发事务可以创建同名的表.
+ * 创建前在 locks 中记下创建者的事务槽: 上一个创建者还没有结束, 或者在 tx 的快照之后才提交时,
+ * tx 看不到它建的对象, 不能再创建. 上一个创建者结束后不需要释放, 下一个创建者检查状态后覆盖.
+ * 需持有 g_catalogMutex
+ */
+template <typename K>
+bool LockCatalogKey(std::unordered_map<K, TxSlotPtr> *locks, const K &key, Transaction *tx) {
+    tx->PrepareUndo();
+    TxSlotPtr self = tx->GetTxSlotLocation();
+    auto iter = locks->find(key);
+    if (iter != locks->end() && iter->second != self) {
+        TMResult result = tx->VersionIsVisible(iter->second);
+        if (result == TMResult::INVISIBLE || result == TMResult::BEING_MODIFIED) {
+            return false;
+        }
+    }
+    (*locks)[key] = self;
+    return true;
+}
+
+/*
+ * DDL 的 undo: m_segHead 为表的 segment head; 建索引时 m_rowId 为 index id, data 中是索引类型.
+ * 需要在分配空间之后, 写入系统表之前记录, 回滚时先撤销系统表中的定义再回收空间
+ */
+void PrepareCatalogUndo(Transaction *tx, UndoRecordType type, uint32 segHead, IndexId idxId = 0,
+                        IndexType idxType = IndexType::PACTREE) {
+    auto *undo = reinterpret_cast<UndoRecord *>(tx->undoRecordCache);
+    undo->m_undoType = type;
+    undo->m_rowLen = 0;
+    undo->m_deltaLen = 0;
+    undo->m_segHead = segHead;
+    undo->m_rowId = idxId;
+    undo->m_pre = 0;
+#ifndef NDEBUG
+    undo->m_txSlot = tx->GetTxSlotLocation();
+#endif
+    auto typeValue = static_cast<uint32>(idxType);
+    undo->m_payload = sizeof(typeValue);
+    errno_t ret = memcpy_s(undo->data, MAX_UNDO_RECORD_CACHE_SIZE, &typeValue, sizeof(typeValue));
+    SecureRetCheck(ret);
+    tx->insertUndoRecord(undo);
+}
+
+// 需持有 g_catalogCacheMutex
+std::unordered_map<const Table *, RowId>::iterator FindCachedTable(uint32 segHead) {
+    return std::find_if(g_catalogTables.begin(), g_catalogTables.end(),
+                        [segHead](const std::pair<const Table *const, RowId> &entry) {
+                            return entry.first->SegmentHead() == segHead;
+                        });
+}
+
+// 在表名对应的桶中查找对 tx 可见的 TABLE 行, 找不到返回 InvalidRowId
+RowId FindTableRow(Transaction *tx, const char *name, RAMTuple *tuple, CatalogRow *row) {
+    RowId rowId = g_nameBuckets[NameBucket(name)].load(std::memory_order_acquire);
+    for (; RowIdIsValid(rowId); rowId = GetRowLink(rowId)->m_nextName.load(std::memory_order_acquire)) {
+        if (ReadCatalogRow(tx, rowId, tuple, row) && row->m_kind == CATALOG_KIND_TABLE &&
+            strncmp(row->m_name, name, NVM_MAX_TABLE_NAME_LEN) == 0) {
+            return rowId;
+        }
+    }
+    return InvalidRowId;
+}
+
+// 读出表的列和索引中对 tx 可见的行
+std::vector<CatalogRow> ReadChildRows(Transaction *tx, RowId tableRowId, RAMTuple *tuple) {
+    std::vector<CatalogRow> rows;
+    CatalogRow row{};
+    RowId rowId = GetRowLink(tableRowId)->m_firstChild.load(std::memory_order_acquire);
+    for (; RowIdIsValid(rowId); rowId = GetRowLink(rowId)->m_nextChild.load(std::memory_order_acquire)) {
+        if (ReadCatalogRow(tx, rowId, tuple, &row)) {
+            rows.push_back(row);
+        }
+    }
+    return rows;
+}
+
+NVMIndex *BuildIndex(const Table *table, IndexId idxId, const CatalogIndexBody &body) {
+    auto *index = new NVMIndex(idxId, body.Type());
+    index->SetNumTableFields(table->GetColCount());
+    uint32 colCnt = body.KeyColCount();
+    IndexColumnDesc *indexDesc = IndexDescCreate(colCnt);
+    for (uint32 i = 0; i < colCnt; i++) {
+        DCHECK(body.m_colIds[i] < table->GetColCount());
+        indexDesc[i].m_colId = body.m_colIds[i];
+        index->FillBitmap(body.m_colIds[i]);
+    }
+    uint64 indexLen = 0;
+    InitIndexDesc(indexDesc, table->GetColDesc(), colCnt, indexLen);
+    index->SetIndexDesc(indexDesc, colCnt, indexLen);
+    uint32 includeCnt = body.IncludeColCount();
+    if (includeCnt != 0) {
+        IndexColumnDesc *includeDesc = IndexDescCreate(includeCnt);
+        for (uint32 i = 0; i < includeCnt; i++) {
+            DCHECK(body.m_colIds[colCnt + i] < table->GetColCount());
+            includeDesc[i].m_colId = body.m_colIds[colCnt + i];
+        }
+        uint64 includeLen = 0;
+        InitIndexDesc(includeDesc, table->GetColDesc(), includeCnt, includeLen);
+        index->SetIncludeDesc(includeDesc, includeCnt, includeLen);
+    }
+    return index;
+}
+
+// 根据系统表中的定义重建 Table 和它的索引
+Table *BuildTable(const std::vector<CatalogRow> &rows, const CatalogRow &tableRow) {
+    CatalogTableBody tableBody{};
+    errno_t ret = memcpy_s(&tableBody, sizeof(tableBody), tableRow.m_body, sizeof(tableBody));
+    SecureRetCheck(ret);
+    TableDesc desc;
+    CHECK(TableDescInit(&desc, tableBody.m_colCnt));
+    desc.row_len = tableBody.m_rowLen;
+    uint32 colFound = 0;
+    for (const auto &row : rows) {
+        if (row.m_kind != CATALOG_KIND_COLUMN || row.m_owner != tableRow.m_rowId) {
+            continue;
+        }
+        CatalogColumnBody colBody{};
+        ret = memcpy_s(&colBody, sizeof(colBody), row.m_body, sizeof(colBody));
+        SecureRetCheck(ret);
+        CHECK(colBody.m_colIdx < tableBody.m_colCnt);
+        ColumnDesc &col = desc.col_desc[colBody.m_colIdx];
+        col.m_colType = static_cast<ColumnType>(colBody.m_colType);
+        col.m_colOid = colBody.m_colOid;
+        col.m_colLen = colBody.m_colLen;
+        col.m_colOffset = colBody.m_colOffset;
+        col.m_isNotNull = colBody.m_isNotNull != 0;
+        ret = memcpy_s(col.m_colName, NVM_MAX_COLUMN_NAME_LEN, row.m_name, NVM_MAX_COLUMN_NAME_LEN);
+        SecureRetCheck(ret);
+        colFound++;
+    }
+    CHECK(colFound == tableBody.m_colCnt) << "Catalog of table " << tableRow.m_name << " is corrupted";
+
+    auto *table = new Table(tableRow.m_objId, desc);
+    table->Mount(tableBody.m_segHead);
+    for (const auto &row : rows) {
+        if (row.m_kind != CATALOG_KIND_INDEX || row.m_owner != tableRow.m_rowId) {
+            continue;
+        }
+        CatalogIndexBody indexBody{};
+        ret = memcpy_s(&indexBody, sizeof(indexBody), row.m_body, sizeof(indexBody));
+        SecureRetCheck(ret);
+        table->AddIndex(BuildIndex(table, row.m_objId, indexBody));
+    }
+    // 崩溃前没有完成的截断在访问表之前完成
+    table->ResumeTruncate();
+    // 易失索引在重启后是空的, 返回表之前从 heap 重建
+    RebuildVolatileIndexes(table);
+    return table;
+}
+
+// 返回 TABLE 行对应的表, 第一次打开时根据系统表重建
+Table *OpenTableRow(Transaction *tx, const CatalogRow &row, RAMTuple *tuple) {
+    auto *link = GetRowLink(row.m_rowId);
+    Table *table = link->m_table.load(std::memory_order_acquire);
+    if (table != nullptr) {
+        return table;
+    }
+    std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+    table = link->m_table.load(std::memory_order_relaxed);
+    if (table == nullptr) {
+        table = BuildTable(ReadChildRows(tx, row.m_rowId, tuple), row);
+        {
+            std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+            g_catalogTables[table] = row.m_rowId;
+        }
+        link->m_table.store(table, std::memory_order_release);
+    }
+    return table;
+}
+
+// 按 index id 回收索引的空间, 已经回收过时什么都不做
+void DropIndexById(IndexId idxId, IndexType type) {
+    switch (type) {
+        case IndexType::HASH:
+            DropHashIndex(idxId);
+            break;
+        case IndexType::VOLATILE:
+            DropVolatileIndex(idxId);
+            break;
+        default:
+            GetGlobalPACTree()->dropIndexTree(idxId);
+            break;
+    }
+}
+
+/*
+ * 回收 DROPPED 行记录的表. 回收 segment 不能重复执行, 以 DROPPED 行的 row id 为标记:
+ * 标记与 TableSpace 最近一次完成的回收相同时, 崩溃前已经回收, 只剩删除这一行. 需持有 g_catalogMutex
+ */
+void PurgeDroppedTable(const CatalogRow &row) {
+    CatalogDroppedBody body{};
+    errno_t ret = memcpy_s(&body, sizeof(body), row.m_body, sizeof(body));
+    SecureRetCheck(ret);
+    const uint32 tag = row.m_rowId + 1;
+    if (g_heapSpace->lastFreedSegmentTag() == tag) {
+        return;
+    }
+    Table *table = nullptr;
+    {
+        std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+        auto iter = FindCachedTable(body.m_segHead);
+        if (iter != g_catalogTables.end()) {
+            table = const_cast<Table *>(iter->first);
+            GetRowLink(iter->second)->m_table.store(nullptr, std::memory_order_release);
+            g_catalogTables.erase(iter);
+        }
+    }
+    if (table != nullptr) {
+        table->DropSegment(tag);
+        for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+            delete table->GetIndex(i);
+        }
+        delete table;
+        return;
+    }
+    for (uint32 i = 0; i < body.m_indexCnt; i++) {
+        DropIndexById(body.m_indexes[i][0], static_cast<IndexType>(body.m_indexes[i][1]));
+    }
+    uint32 segHead = body.m_segHead;
+    DropRowIdMap(segHead);
+    g_heapSpace->freeSegment(&segHead, tag);
+}
+
+// 需持有 g_catalogMutex, 调用线程不能有进行中的事务
+uint32 PurgeDroppedTablesLocked(Transaction *tx) {
+    RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+    CatalogRow row{};
+    uint32 purged = 0;
+    for (auto iter = g_droppedRows.begin(); iter != g_droppedRows.end();) {
+        tx->Begin();
+        // 删表的事务还没有提交或者已经回滚
+        if (!ReadCatalogRow(tx, *iter, &tuple, &row)) {
+            tx->Commit();
+            ++iter;
+            continue;
+        }
+        PurgeDroppedTable(row);
+        CHECK(HeapDelete(tx, g_catalogTable, row.m_rowId) == HamStatus::OK);
+        tx->Commit();
+        iter = g_droppedRows.erase(iter);
+        purged++;
+    }
+    return purged;
+}
+
+// BootStrap 时调用: 完成崩溃前没有做完的截断, 回收已经提交删除的表
+void RecoverCatalog() {
+    Transaction *tx = GetCurrentTxContext();
+    tx->Begin();
+    LoadCatalog(tx);
+    tx->Commit();
+    const uint32 truncateRoot = g_heapSpace->pendingTruncateSegment();
+    if (!NVMPageIdIsValid(truncateRoot) && g_droppedRows.empty()) {
+        return;
+    }
+    // 崩溃事务写过的行回滚之后再修改
+    WaitUndoRecovery();
+    if (NVMPageIdIsValid(truncateRoot)) {
+        // 截断在打开表时完成, 见 BuildTable. 表已经被删除时由回收 segment 结束截断
+        RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+        CatalogRow row{};
+        CatalogTableBody tableBody{};
+        tx->Begin();
+        RowId upper = HeapUpperRowId(g_catalogTable);
+        for (RowId rowId = 0; rowId < upper; rowId++) {
+            if (!ReadCatalogRow(tx, rowId, &tuple, &row) || row.m_kind != CATALOG_KIND_TABLE) {
+                continue;
+            }
+            errno_t ret = memcpy_s(&tableBody, sizeof(tableBody), row.m_body, sizeof(tableBody));
+            SecureRetCheck(ret);
+            if (tableBody.m_segHead == truncateRoot) {
+                OpenTableRow(tx, row, &tuple);
+                break;
+            }
+        }
+        tx->Commit();
+    }
+    std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+    PurgeDroppedTablesLocked(tx);
+}
+
+void MountCatalogTable(uint32 segHead) {
+    ResetCatalogIndex();
+    g_catalogTable = new Table(CATALOG_TABLE_OID, CatalogTableDesc());
+    if (NVMPageIdIsValid(segHead)) {
+        g_catalogTable->Mount(segHead);
+    } else {
+        segHead = g_catalogTable->CreateSegment();
+        g_heapSpace->CreateTable(CATALOG_TABLE_OID, segHead);
+    }
+}
+
+}  // namespace
+
+void CatalogCreate() {
+    MountCatalogTable(NVMInvalidPageId);
+}
+
+void CatalogBootStrap() {
+    // 旧的数据目录中没有系统表, 此时新建一个
+    MountCatalogTable(g_heapSpace->SearchTable(CATALOG_TABLE_OID));
+    // 需要事务上下文, 在单独的线程中进行
+    std::thread recoverThread([]() {
+        InitThreadLocalVariables();
+        RecoverCatalog();
+        DestroyThreadLocalVariables();
+    });
+    recoverThread.join();
+}
+
+void CatalogExitProcess() {
+    std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+    std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+    for (auto &entry : g_catalogTables) {
+        const Table *table = entry.first;
+        for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+            delete table->GetIndex(i);
+        }
+        delete table;
+    }
+    g_catalogTables.clear();
+    ResetCatalogIndex();
+    delete g_catalogTable;
+    g_catalogTable = nullptr;
+}
+
+Table *CatalogCreateTable(Transaction *tx, const char *name, TableId tid, const TableDesc &desc) {
+    DCHECK(g_catalogTable != nullptr);
+    char nameBuf[NVM_MAX_TABLE_NAME_LEN];
+    if (!CopyName(nameBuf, name) || desc.col_cnt == 0 || desc.col_cnt > NVMDB_TUPLE_MAX_COL_COUNT) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+    LoadCatalogLocked(tx);
+    RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+    CatalogRow row{};
+    if (RowIdIsValid(FindTableRow(tx, nameBuf, &tuple, &row)) ||
+        !LockCatalogKey(&g_nameLocks, std::string(nameBuf), tx)) {
+        return nullptr;
+    }
+    TableDesc tableDesc;
+    CHECK(TableDescInit(&tableDesc, desc.col_cnt));
+    tableDesc.row_len = desc.row_len;
+    errno_t ret = memcpy_s(tableDesc.col_desc, desc.col_cnt * sizeof(ColumnDesc), desc.col_desc,
+                           desc.col_cnt * sizeof(ColumnDesc));
+    SecureRetCheck(ret);
+    auto *table = new Table(tid, tableDesc);
+    uint32 segHead = table->CreateSegment();
+    PrepareCatalogUndo(tx, TableCreateUndo, segHead);
+
+    CatalogTableBody tableBody{segHead, desc.col_cnt, desc.row_len};
+    RowId tableRowId = InsertCatalogRow(tx, CATALOG_KIND_TABLE, tid, InvalidRowId, nameBuf, &tableBody,
+                                        sizeof(tableBody));
+    LinkTableRow(tableRowId, nameBuf);
+    for (uint32 i = 0; i < desc.col_cnt; i++) {
+        const ColumnDesc &col = desc.col_desc[i];
+        CatalogColumnBody colBody{i, col.m_colType, col.m_colOid, col.m_isNotNull, col.m_colLen, col.m_colOffset};
+        RowId colRowId = InsertCatalogRow(tx, CATALOG_KIND_COLUMN, tid, tableRowId, col.m_colName, &colBody,
+                                          sizeof(colBody));
+        LinkChildRow(colRowId, tableRowId);
+    }
+    // tx 回滚后系统表中的定义被撤销, 缓存的对象由 UndoTableCreate 释放
+    AllocRowLink(tableRowId)->m_table.store(table, std::memory_order_release);
+    std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+    g_catalogTables[table] = tableRowId;
+    return table;
+}
+
+NVMIndex *CatalogCreateIndex(Transaction *tx, Table *table, IndexId idxId, const IndexColumnDesc *indexDesc,
+                             uint32 colCnt, const IndexColumnDesc *includeDesc, uint32 includeCnt,
+                             IndexType type) {
+    DCHECK(g_catalogTable != nullptr);
+    if (colCnt == 0 || colCnt + includeCnt > NVMDB_TUPLE_MAX_COL_COUNT) {
+        return nullptr;
+    }
+    if (type != IndexType::PACTREE && includeCnt != 0) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+    LoadCatalogLocked(tx);
+    RowId tableRowId;
+    {
+        // 只能为通过 catalog 创建或打开的表建索引
+        std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+        auto iter = g_catalogTables.find(table);
+        if (iter == g_catalogTables.end()) {
+            return nullptr;
+        }
+        tableRowId = iter->second;
+        if (table->GetIndexCount() >= CATALOG_MAX_TABLE_INDEXES) {
+            return nullptr;
+        }
+    }
+    // 回滚时按 index id 回收索引的空间, 所以 index id 不能重复
+    RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+    CatalogRow row{};
+    auto rowIter = g_indexRows.find(idxId);
+    auto droppedIter = g_droppedIndexes.find(idxId);
+    if ((rowIter != g_indexRows.end() && ReadCatalogRow(tx, rowIter->second, &tuple, &row)) ||
+        (droppedIter != g_droppedIndexes.end() && ReadCatalogRow(tx, droppedIter->second, &tuple, &row)) ||
+        !LockCatalogKey(&g_indexIdLocks, idxId, tx)) {
+        return nullptr;
+    }
+    CatalogIndexBody indexBody{};
+    indexBody.m_colCnt = colCnt | (static_cast<uint32>(type) << 8) | (includeCnt << 16);
+    for (uint32 i = 0; i < colCnt; i++) {
+        indexBody.m_colIds[i] = indexDesc[i].m_colId;
+    }
+    for (uint32 i = 0; i < includeCnt; i++) {
+        indexBody.m_colIds[colCnt + i] = includeDesc[i].m_colId;
+    }
+    PrepareCatalogUndo(tx, IndexCreateUndo, table->SegmentHead(), idxId, type);
+    RowId indexRowId = InsertCatalogRow(tx, CATALOG_KIND_INDEX, idxId, tableRowId, "", &indexBody,
+                                        sizeof(indexBody));
+    LinkChildRow(indexRowId, tableRowId);
+    g_indexRows[idxId] = indexRowId;
+    NVMIndex *index = BuildIndex(table, idxId, indexBody);
+    {
+        std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+        table->AddIndex(index);
+    }
+    // 易失索引从表中已经提交的行和这个事务自己写的行建立
+    RebuildVolatileIndexes(table, tx);
+    return index;
+}
+
+bool CatalogDropTable(Transaction *tx, const char *name) {
+    DCHECK(g_catalogTable != nullptr);
+    char nameBuf[NVM_MAX_TABLE_NAME_LEN];
+    if (!CopyName(nameBuf, name)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+    LoadCatalogLocked(tx);
+    RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+    CatalogRow row{};
+    RowId tableRowId = FindTableRow(tx, nameBuf, &tuple, &row);
+    if (!RowIdIsValid(tableRowId)) {
+        return false;
+    }
+    if (HeapDelete(tx, g_catalogTable, tableRowId) != HamStatus::OK) {
+        return false;
+    }
+    CatalogTableBody tableBody{};
+    errno_t ret = memcpy_s(&tableBody, sizeof(tableBody), row.m_body, sizeof(tableBody));
+    SecureRetCheck(ret);
+    CatalogDroppedBody droppedBody{};
+    droppedBody.m_segHead = tableBody.m_segHead;
+    for (const auto &child : ReadChildRows(tx, tableRowId, &tuple)) {
+        if (HeapDelete(tx, g_catalogTable, child.m_rowId) != HamStatus::OK) {
+            return false;
+        }
+        if (child.m_kind == CATALOG_KIND_INDEX) {
+            CHECK(droppedBody.m_indexCnt < CATALOG_MAX_TABLE_INDEXES);
+            CatalogIndexBody indexBody{};
+            ret = memcpy_s(&indexBody, sizeof(indexBody), child.m_body, sizeof(indexBody));
+            SecureRetCheck(ret);
+            droppedBody.m_indexes[droppedBody.m_indexCnt][0] = child.m_objId;
+            droppedBody.m_indexes[droppedBody.m_indexCnt][1] = static_cast<uint32>(indexBody.Type());
+            droppedBody.m_indexCnt++;
+        }
+    }
+    // 与删除定义在同一个事务中记下待回收的空间, 提交之后由 CatalogPurgeDroppedTables 或下次 BootStrap 回收
+    CatalogRow droppedRow{};
+    droppedRow.m_rowId = InsertCatalogRow(tx, CATALOG_KIND_DROPPED, row.m_objId, tableRowId, nameBuf, &droppedBody,
+                                          sizeof(droppedBody));
+    ret = memcpy_s(droppedRow.m_body, CATALOG_BODY_LEN, &droppedBody, sizeof(droppedBody));
+    SecureRetCheck(ret);
+    AddDroppedRow(droppedRow.m_rowId, droppedRow);
+    return true;
+}
+
+uint32 CatalogPurgeDroppedTables() {
+    DCHECK(g_catalogTable != nullptr);
+    Transaction *tx = GetCurrentTxContext();
+    std::lock_guard<std::mutex> lockGuard(g_catalogMutex);
+    tx->Begin();
+    LoadCatalogLocked(tx);
+    tx->Commit();
+    return PurgeDroppedTablesLocked(tx);
+}
+
+Table *CatalogOpenTable(Transaction *tx, const char *name) {
+    DCHECK(g_catalogTable != nullptr);
+    char nameBuf[NVM_MAX_TABLE_NAME_LEN];
+    if (!CopyName(nameBuf, name)) {
+        return nullptr;
+    }
+    LoadCatalog(tx);
+    RAMTuple tuple(g_catalogTable->GetColDesc(), g_catalogTable->GetRowLen());
+    CatalogRow row{};
+    if (!RowIdIsValid(FindTableRow(tx, nameBuf, &tuple, &row))) {
+        return nullptr;
+    }
+    return OpenTableRow(tx, row, &tuple);
+}
+
+void UndoTableCreate(const UndoRecord *undo, UndoRecPtr undoPtr) {
+    uint32 segHead = undo->m_segHead;
+    {
+        std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+        auto iter = FindCachedTable(segHead);
+        if (iter != g_catalogTables.end()) {
+            // 在建表的进程中回滚. 表的索引都是同一个事务建的, 已经由 UndoIndexCreate 移除
+            auto *table = const_cast<Table *>(iter->first);
+            GetRowLink(iter->second)->m_table.store(nullptr, std::memory_order_release);
+            g_catalogTables.erase(iter);
+            DCHECK(table->GetIndexCount() == 0);
+            delete table;
+        }
+    }
+    DropRowIdMap(segHead);
+    // 回收 segment 不能重复执行, 先让这条 undo 失效: 回收完成前崩溃最多泄漏这个 segment
+    InvalidateUndoRecord(undoPtr);
+    g_heapSpace->freeSegment(&segHead);
+}
+
+void UndoIndexCreate(const UndoRecord *undo, UndoRecPtr undoPtr) {
+    auto idxId = static_cast<IndexId>(undo->m_rowId);
+    uint32 typeValue;
+    DCHECK(undo->m_payload == sizeof(typeValue));
+    errno_t ret = memcpy_s(&typeValue, sizeof(typeValue), undo->data, sizeof(typeValue));
+    SecureRetCheck(ret);
+    NVMIndex *index = nullptr;
+    {
+        std::lock_guard<std::mutex> cacheGuard(g_catalogCacheMutex);
+        auto iter = FindCachedTable(undo->m_segHead);
+        if (iter != g_catalogTables.end()) {
+            index = const_cast<Table *>(iter->first)->DelIndex(idxId);
+        }
+    }
+    if (index != nullptr) {
+        index->Drop();
+        delete index;
+        return;
+    }
+    // 崩溃恢复时没有缓存的对象, 按 index id 回收索引的空间
+    DropIndexById(idxId, static_cast<IndexType>(typeValue));
+}
+
+}  // namespace NVMDB
@@ -0,0 +1,135 @@
+#include "nvm_index_rebuild.h"
+#include "nvm_access.h"
+#include "nvmdb_thread.h"
+#include "undo/nvm_undo_segment.h"
+#include "common/numa.h"
+#include <chrono>
+#include <thread>
+#include <unordered_set>
+
+namespace NVMDB {
+
+DEFINE_int32(index_rebuild_threads_per_group, 1, "the number of threads per NUMA group to rebuild volatile indexes");
+
+IndexRebuildStats RebuildVolatileIndexes(Table *table, Transaction *tx) {
+    IndexRebuildStats stats;
+    std::vector<NVMIndex *> indexes;
+    for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+        NVMIndex *index = table->GetIndex(i);
+        // 同一个 idxId 在这个进程中已经重建过时, 内容是最新的
+        if (index->IsVolatile() && !index->GetVolatileIndex()->Ready()) {
+            indexes.push_back(index);
+        }
+    }
+    if (indexes.empty()) {
+        return stats;
+    }
+    auto start = std::chrono::steady_clock::now();
+    // 崩溃事务写过的行回滚之后再扫描; 在这之前回滚的 undo 找不到还没有重建好的索引
+    WaitUndoRecovery();
+
+    const auto dirNum = static_cast<int>(g_dir_config->size());
+    const uint32 tuplesPerExtent = table->m_rowIdMap->GetTuplesPerExtent();
+    const RowId upper = HeapUpperRowId(table);
+    const auto extentCount = static_cast<uint32>(upper / tuplesPerExtent);
+    // extent 分配在插入线程所在的 NUMA 组, 按物理页号归到所在的目录, 没有分配的 extent 中没有行
+    std::vector<std::vector<uint32>> dirExtents(dirNum);
+    for (uint32 extent = 0; extent < extentCount; extent++) {
+        int spaceId = table->m_rowIdMap->GetLeafExtentSpaceId(extent);
+        if (spaceId >= 0) {
+            dirExtents[spaceId].push_back(extent);
+        }
+    }
+    // 调用者事务自己写过的行对扫描事务不可见, 扫描时跳过, 最后按调用者看到的版本插入
+    std::unordered_set<RowId> ownRows;
+    if (tx != nullptr) {
+        auto rowIds = table->m_rowIdMap->GetRowIds(tx->GetWriteSet());
+        ownRows.insert(rowIds.begin(), rowIds.end());
+    }
+    // 每个目录一个游标, 指向该目录下一个待扫描的 extent
+    std::vector<std::atomic<size_t>> cursors(dirNum);
+    for (auto &cursor : cursors) {
+        cursor.store(0, std::memory_order_relaxed);
+    }
+    std::atomic<uint64> rows{0};
+    auto insertRow = [&](RowId rowId, RAMTuple *tuple, std::vector<std::unique_ptr<DRAMIndexTuple>> &indexTuples) {
+        Key_t key;
+        for (size_t i = 0; i < indexes.size(); i++) {
+            indexTuples[i]->ExtractFromTuple(tuple);
+            indexes[i]->Encode(indexTuples[i].get(), &key, rowId);
+            indexes[i]->GetVolatileIndex()->Insert(key, INVALID_CSN);
+        }
+    };
+    auto newIndexTuples = [&]() {
+        std::vector<std::unique_ptr<DRAMIndexTuple>> indexTuples;
+        for (auto index : indexes) {
+            indexTuples.emplace_back(new DRAMIndexTuple(table->GetColDesc(), index->GetIndexDesc(),
+                                                        index->GetColCount(), index->GetRowLen()));
+        }
+        return indexTuples;
+    };
+    auto threadFunc = [&](int dirId) {
+        InitThreadLocalVariables();
+        const int nodeId = g_dir_config->getNumaNodeByIndex(dirId);
+        if (!NumaBinding::bindThreadToNode(nodeId, dirId)) {
+            LOG(ERROR) << "failed to bind index rebuild thread of dir " << dirId << " to numa node " << nodeId;
+        }
+        Transaction *scanTx = GetCurrentTxContext();
+        RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+        auto indexTuples = newIndexTuples();
+        const auto &extents = dirExtents[dirId];
+        uint64 localRows = 0;
+        while (true) {
+            size_t next = cursors[dirId].fetch_add(1, std::memory_order_relaxed);
+            if (next >= extents.size()) {
+                break;
+            }
+            RowId first = static_cast<RowId>(extents[next]) * tuplesPerExtent;
+            scanTx->Begin();
+            for (RowId rowId = first; rowId < first + tuplesPerExtent; rowId++) {
+                if (ownRows.count(rowId) != 0 || HeapRead(scanTx, table, rowId, &tuple) != HamStatus::OK) {
+                    continue;
+                }
+                insertRow(rowId, &tuple, indexTuples);
+                localRows++;
+            }
+            scanTx->Commit();
+        }
+        rows.fetch_add(localRows, std::memory_order_relaxed);
+        DestroyThreadLocalVariables();
+    };
+    const int threadNum = dirNum * std::max(FLAGS_index_rebuild_threads_per_group, 1);
+    std::vector<std::thread> workers;
+    workers.reserve(threadNum);
+    for (int i = 0; i < threadNum; i++) {
+        workers.emplace_back(threadFunc, i % dirNum);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    if (!ownRows.empty()) {
+        RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+        auto indexTuples = newIndexTuples();
+        for (RowId rowId : ownRows) {
+            // 调用者删除的行读不到; 索引和调用者的写在同一个事务中, 回滚时一起丢弃
+            if (HeapRead(tx, table, rowId, &tuple) == HamStatus::OK) {
+                insertRow(rowId, &tuple, indexTuples);
+                rows.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    for (auto index : indexes) {
+        index->GetVolatileIndex()->SetReady();
+    }
+
+    stats.m_indexes = indexes.size();
+    stats.m_rows = rows.load(std::memory_order_relaxed);
+    stats.m_heapBytes = static_cast<uint64>(upper) * table->m_rowIdMap->GetSlotLen();
+    stats.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG(INFO) << "Rebuilt " << stats.m_indexes << " volatile indexes of table " << table->Id() << " with "
+              << threadNum << " threads: " << stats.m_rows << " rows, " << stats.m_heapBytes / (1024 * 1024)
+              << " MB heap, " << stats.m_seconds << " s";
+    return stats;
+}
+
+}  // namespace NVMDB
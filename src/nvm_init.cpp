@@ -1,4 +1,6 @@
 #include "nvm_init.h"
+#include "nvm_catalog.h"
+#include "common/nvm_persist.h"
 #include "undo/nvm_undo.h"
 #include "heap/nvm_heap.h"
 #include "index/nvm_index.h"
@@ -7,22 +9,31 @@
 namespace NVMDB {
 
 void InitDB(const std::string& dir) {
+    InitDB(dir, UndoSpaceConfig());
+}
+
+void InitDB(const std::string& dir, const UndoSpaceConfig& undoConfig) {
+    InitPersistMode();
     g_dir_config = std::make_shared<DirectoryConfig>(dir, true);
     InitGlobalVariables();
-    UndoCreate();
+    UndoCreate(undoConfig);
     HeapCreate(g_dir_config);    // heap is one table space
     IndexBootstrap();
+    CatalogCreate();
 }
 
 void BootStrap(const std::string& dir) {
+    InitPersistMode();
     g_dir_config = std::make_shared<DirectoryConfig>(dir, false);
     InitGlobalVariables();
     HeapBootStrap(g_dir_config);
     IndexBootstrap();
     UndoBootStrap(); // mount the heap so we can undo the logs
+    CatalogBootStrap();
 }
 
 void ExitDBProcess() {
+    CatalogExitProcess();
     IndexExitProcess();
     HeapExitProcess();
     UndoExitProcess();
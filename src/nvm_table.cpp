@@ -17,6 +17,38 @@ void Table::Mount(uint32 segHead) {
     m_rowIdMap = GetRowIdMap(segHead, m_rowLen);
 }
 
+void Table::TruncateSegment() {
+    DCHECK(Ready());
+    // 清空索引和 segment head 之前 TableSpace 已经登记了这次截断, 中途崩溃由 ResumeTruncate 重做
+    g_heapSpace->truncateSegment(m_segHead, [this]() {
+        for (auto *idx : index) {
+            idx->DeleteAll();
+        }
+        m_rowIdMap->ResetLeafExtents();
+    });
+    // DRAM 中缓存的行都已经失效, 重新建立 RowIdMap
+    DropRowIdMap(m_segHead);
+    m_rowIdMap = GetRowIdMap(m_segHead, m_rowLen);
+}
+
+bool Table::ResumeTruncate() {
+    if (g_heapSpace->pendingTruncateSegment() != m_segHead) {
+        return false;
+    }
+    TruncateSegment();
+    return true;
+}
+
+void Table::DropSegment(uint32 tag) {
+    DCHECK(Ready());
+    for (auto *idx : index) {
+        idx->Drop();
+    }
+    DropRowIdMap(m_segHead);
+    m_rowIdMap = nullptr;
+    g_heapSpace->freeSegment(&m_segHead, tag);
+}
+
 uint32 Table::GetColIdByName(const char *name) const {
     uint32 i;
     uint32 max = m_desc.col_cnt;
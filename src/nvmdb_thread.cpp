@@ -1,4 +1,5 @@
 #include "nvmdb_thread.h"
+#include "heap/nvm_heap.h"
 #include "heap/nvm_heap_cache.h"
 #include "index/nvm_index.h"
 #include "transaction/nvm_transaction.h"
@@ -90,6 +91,9 @@ void InitThreadLocalVariables() {
 }
 
 void DestroyThreadLocalVariables() {
+    if (g_heapSpace != nullptr) {
+        g_heapSpace->releaseThreadReservations();   // 归还预留但没有用完的 extent
+    }
     DestroyThreadLocalStorage();
     TLTupleCache::Clear();
     TLTableCache::Clear();
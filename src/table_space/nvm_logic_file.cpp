@@ -1,48 +1,30 @@
 #include "table_space/nvm_logic_file.h"
 #include "common/nvm_cfg.h"
+#include "common/nvm_storage_backend.h"
 #include <libpmem.h>
+#include <algorithm>
 #include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 // #define UNDO_LOG_IN_DRAM
 
 namespace NVMDB {
 
-bool LogicFile::mMapFile(uint32 segmentId, bool init) {
-    // if is mounted, return
-    if (m_segmentAddr.size() > segmentId && m_segmentAddr[segmentId] != nullptr) {
-        return true;
-    }
+// dax 后端要求映射到 PMem, 其他后端接受普通文件
+void *LogicFile::mapSegmentFile(const std::string& fileName, bool init, bool requirePMem) const {
     // create file if not exist
     int flags = init ? PMEM_FILE_CREATE : 0;
     size_t actualSegmentSize;
     int isPMem;
-    auto fileName = segmentFilename(segmentId);
-
-    bool fileExists = [](const std::string& filename) {
-        std::ifstream file(filename);
-        return file.good();
-    }(fileName);
-
 #ifdef UNDO_LOG_IN_DRAM
-    void *nvmAddr;
     if (m_spaceName[0] == 'u') {
-        nvmAddr = malloc(m_segmentSize);
-        CHECK(nvmAddr != nullptr);
-    } else {
-        nvmAddr = pmem_map_file(fileName.data(),
-                                m_segmentSize,
-                                flags,
-                                0666,
-                                &actualSegmentSize,
-                                &isPMem);
-        if (!isPMem || nvmAddr == nullptr || actualSegmentSize != m_segmentSize) {
-            if (!init) {
-                return false;
-            }
-            CHECK(false) << "Cannot map PMem file!";
-        }
+        void *dramAddr = malloc(m_segmentSize);
+        CHECK(dramAddr != nullptr);
+        return dramAddr;
     }
-#else
+#endif
     void *nvmAddr = pmem_map_file(fileName.data(),
                                   m_segmentSize,
                                   flags,
@@ -50,53 +32,155 @@ bool LogicFile::mMapFile(uint32 segmentId, bool init) {
                                   &actualSegmentSize,
                                   &isPMem);
     // NVM挂载失败
-    if (!isPMem || nvmAddr == nullptr || actualSegmentSize != m_segmentSize) {
+    if (nvmAddr == nullptr || (requirePMem && !isPMem) || actualSegmentSize != m_segmentSize) {
+        if (nvmAddr != nullptr) {
+            pmem_unmap(nvmAddr, actualSegmentSize);
+        }
         if (!init) {
-            return false;
+            return nullptr;
         }
         CHECK(false) << "Cannot map PMem file!";
     }
-#endif
+    return nvmAddr;
+}
+
+// 多个线程可能同时映射同一个 segment (例如首次访问时的缺页映射), 只有一个映射会被发布, 其余的被撤销
+void *LogicFile::mapSegment(uint32 segmentId, bool init) const {
+    CHECK(segmentId < m_segmentCapacity) << "Segment id overflow!";
+    // if is mounted, return
+    void *mappedAddr = m_segmentAddr[segmentId].load(std::memory_order_acquire);
+    if (mappedAddr != nullptr) {
+        return mappedAddr;
+    }
+    auto fileName = segmentFilename(segmentId);
+    const auto backend = GetStorageBackend();
+    bool fileExists;
+    void *nvmAddr;
+    if (backend == StorageBackend::ANON) {
+        fileExists = AnonSegmentExists(fileName);
+        nvmAddr = MapAnonSegment(fileName, m_segmentSize, init);
+    } else {
+        fileExists = [](const std::string& filename) {
+            std::ifstream file(filename);
+            return file.good();
+        }(fileName);
+        nvmAddr = mapSegmentFile(fileName, init, backend == StorageBackend::DAX);
+    }
+    if (nvmAddr == nullptr) {
+        return nullptr;
+    }
     if (!fileExists) {
         LOG(INFO) << "Init nvm file " << fileName;
         // pmem_memset(nvmAddr, 0, m_segmentSize, PMEM_F_MEM_NONTEMPORAL | PMEM_F_MEM_WC);
     }
     // 添加nvmAddr到m_segmentAddr
-    if (m_segmentAddr.size() <= segmentId) {
-        m_segmentAddr.resize(segmentId + 1);
+    if (!m_segmentAddr[segmentId].compare_exchange_strong(mappedAddr, nvmAddr, std::memory_order_acq_rel)) {
+        unmapAddr(nvmAddr);    // 其他线程已经完成映射
+        return mappedAddr;
+    }
+    auto count = m_segmentCount.load(std::memory_order_relaxed);
+    while (count <= segmentId && !m_segmentCount.compare_exchange_weak(count, segmentId + 1)) { }
+    return nvmAddr;
+}
+
+void LogicFile::unmapAddr(void *nvmAddr) const {
+    if (GetStorageBackend() == StorageBackend::ANON) {
+        return;    // 匿名 segment 在删除时才释放
+    }
+#ifdef UNDO_LOG_IN_DRAM
+    if (m_spaceName[0] == 'u') {
+        free(nvmAddr);
+        return;
     }
-    m_segmentAddr[segmentId] = nvmAddr;
-    return true;
+#endif
+    pmem_unmap(nvmAddr, m_segmentSize);
 }
 
 void LogicFile::unMMapFile(uint32 segmentId, bool destroy) {
-    if (m_segmentAddr.size() <= segmentId || m_segmentAddr[segmentId] == nullptr) {
+    if (segmentId >= m_segmentCapacity) {
         return;
     }
-    pmem_unmap(m_segmentAddr[segmentId], m_segmentSize);
-    m_segmentAddr[segmentId] = nullptr;
+    auto *nvmAddr = m_segmentAddr[segmentId].exchange(nullptr, std::memory_order_acq_rel);
+    if (nvmAddr == nullptr) {
+        return;
+    }
+    unmapAddr(nvmAddr);
     if (!destroy) {
         return;
     }
+    if (GetStorageBackend() == StorageBackend::ANON) {
+        FreeAnonSegment(segmentFilename(segmentId));
+        return;
+    }
     unlink(segmentFilename(segmentId).data());
 }
 
-void LogicFile::reMMapFile(uint32 segmentId) {
-    if (m_segmentAddr.size() <= segmentId || m_segmentAddr[segmentId] == nullptr) {
-        return;
+// 对 DAX 文件打洞, 文件大小和映射都不变
+static bool PunchFileHole(const std::string& fileName, uint64 offset, uint64 len) {
+    int fd = open(fileName.data(), O_RDWR);
+    if (fd < 0) {
+        LOG(WARNING) << "Cannot open " << fileName << " for punching, errno: " << errno;
+        return false;
+    }
+    int ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)len);
+    if (ret != 0) {
+        LOG(WARNING) << "Punch hole in " << fileName << " failed, errno: " << errno;
+    }
+    close(fd);
+    return ret == 0;
+}
+
+size_t LogicFile::punchHole(uint64 offset, uint64 len) {
+    size_t punched = 0;
+    while (len > 0) {
+        auto segmentId = static_cast<uint32>(offset / m_segmentSize);
+        uint64 segmentOffset = offset % m_segmentSize;
+        uint64 n = std::min<uint64>(len, m_segmentSize - segmentOffset);
+        auto *segmentAddr = segmentId < m_segmentCapacity ? nvmAddrFromSegmentId<char *>(segmentId) : nullptr;
+        if (segmentAddr != nullptr && GetStorageBackend() == StorageBackend::ANON) {
+            punched += PunchAnonSegment(segmentFilename(segmentId), segmentOffset, n);
+        } else if (segmentAddr != nullptr) {
+#ifdef UNDO_LOG_IN_DRAM
+            if (m_spaceName[0] == 'u') {
+                // 匿名内存, 只能按系统页对齐后 madvise
+                constexpr uint64 osPageSize = 4096;
+                auto begin = reinterpret_cast<uintptr_t>(segmentAddr) + segmentOffset;
+                auto alignedBegin = (begin + osPageSize - 1) / osPageSize * osPageSize;
+                auto alignedEnd = (begin + n) / osPageSize * osPageSize;
+                if (alignedBegin < alignedEnd &&
+                    madvise(reinterpret_cast<void *>(alignedBegin), alignedEnd - alignedBegin, MADV_DONTNEED) == 0) {
+                    punched += alignedEnd - alignedBegin;
+                }
+            } else if (PunchFileHole(segmentFilename(segmentId), segmentOffset, n)) {
+                punched += n;
+            }
+#else
+            if (PunchFileHole(segmentFilename(segmentId), segmentOffset, n)) {
+                punched += n;
+            }
+#endif
+        }
+        offset += n;
+        len -= n;
     }
-    // reuse stale data
-    CHECK(m_segmentAddr.size() < m_segmentAddr.capacity());
-    uint32 offset = m_segmentAddr.size();
-    m_segmentAddr.resize(offset + 1);
-    m_segmentAddr[offset] = m_segmentAddr[segmentId];
-    m_segmentAddr[segmentId] = nullptr;
+    return punched;
+}
 
-#ifndef UNDO_LOG_IN_DRAM
-    auto oldFileName = segmentFilename(segmentId);
-    auto newFileName = segmentFilename(offset);
-    CHECK(std::rename(oldFileName.data(), newFileName.data()) == 0);
-    LOG(INFO) << "reLink " << oldFileName << " to " << newFileName;
+void LogicFile::prefault(uint32 segmentId) const {
+    auto *nvmAddr = static_cast<volatile char *>(mapSegment(segmentId, false));
+    if (nvmAddr == nullptr) {
+        return;
+    }
+#ifdef MADV_POPULATE_WRITE
+    if (madvise((void *)nvmAddr, m_segmentSize, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
 #endif
+    // 内核不支持 MADV_POPULATE_WRITE 时, 逐个 2MB 大页读一次
+    constexpr size_t hugePageSize = 2 * 1024 * 1024;
+    for (size_t offset = 0; offset < m_segmentSize; offset += hugePageSize) {
+        (void)nvmAddr[offset];
+    }
 }
-}  // namespace NVMDB
\ No newline at end of file
+
+}  // namespace NVMDB
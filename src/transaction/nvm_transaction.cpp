@@ -57,6 +57,7 @@ void Transaction::Commit() {
     m_txStatus = TxStatus::COMMITTING;
     if (m_undoTxContext != nullptr) {
         m_commitCSN = m_processArray->advanceGlobalCSN();
+        PersistTagScope tag(PersistTag::HEAP);
          for (auto& it: m_writeSet) {
              if (!it->needCache()) {
                  continue;
@@ -65,6 +66,7 @@ void Transaction::Commit() {
              auto* dramCache = it->loadDRAMCache<NVMTuple>(NVMTupleHeadSize);
              if (dramCache->m_txInfo == GetTxSlotLocation()) {
                  dramCache->m_txInfo = m_commitCSN;
+                 NVMFlush(&dramCache->m_txInfo, sizeof(dramCache->m_txInfo));
              }
              std::atomic_thread_fence(std::memory_order_release);
              it->Unlock();
@@ -117,6 +119,10 @@ TMResult Transaction::VersionIsVisible(const uint64& csnOrTxPtr) const {
                 version_csn = txInfo.csn;
                 break;
             case TxSlotStatus::IN_PROGRESS:
+                // 崩溃前未提交的事务, 在后台恢复完成前也视为已回滚
+                if (IsCrashedTxSlot((TxSlotPtr)csnOrTxPtr)) {
+                    return TMResult::ABORTED;
+                }
                 committed = false;
                 break;
             case TxSlotStatus::EMPTY:
@@ -164,33 +170,38 @@ TMResult Transaction::SatisfiedUpdate(const NVMTuple& tuple) const {
  *              所以 tx2 的 snapshot 必然 大于 tx1 的CSN，所以直接用 tx2 的snapshot 回填即可。
  * undo 的格式
  * 因为UndoRecord 的head对索引undo来说没用，所以复用了下存储空间。segHead 和 rowid 两个 uint32 拼成了一个 uint64 的CSN
+ * data 中是 key, 后面跟着索引所在树的 tree id
  */
-void Transaction::PrepareIndexInsertUndo(const Key_t &key) {
+static void FillIndexUndoPayload(UndoRecord *undo, const Key_t &key, uint16 treeId) {
+    undo->m_payload = sizeof(key) + sizeof(treeId);
+    int ret = memcpy_s(undo->data, MAX_UNDO_RECORD_CACHE_SIZE, &key, sizeof(key));
+    SecureRetCheck(ret);
+    ret = memcpy_s(undo->data + sizeof(key), MAX_UNDO_RECORD_CACHE_SIZE - sizeof(key), &treeId, sizeof(treeId));
+    SecureRetCheck(ret);
+}
+
+void Transaction::PrepareIndexInsertUndo(const Key_t &key, uint16 treeId) {
     auto *undo = reinterpret_cast<UndoRecord *>(this->undoRecordCache);
     undo->m_undoType = IndexInsertUndo;
     undo->m_rowLen = 0;
     undo->m_segHead = m_commitCSN >> BIS_PER_U32;
     undo->m_rowId = m_commitCSN & 0xFFFFFFFF;
-    undo->m_payload = sizeof(key);
     undo->m_pre = 0;
 #ifndef NDEBUG
     undo->m_txSlot = this->GetTxSlotLocation();
 #endif
-    int ret = memcpy_s(undo->data, MAX_UNDO_RECORD_CACHE_SIZE, &key, sizeof(key));
-    SecureRetCheck(ret);
+    FillIndexUndoPayload(undo, key, treeId);
     this->insertUndoRecord(undo);
 }
 
-void Transaction::PrepareIndexDeleteUndo(Key_t &key) {
+void Transaction::PrepareIndexDeleteUndo(Key_t &key, uint16 treeId) {
     auto *undo = reinterpret_cast<UndoRecord *>(this->undoRecordCache);
     undo->m_undoType = IndexDeleteUndo;
     undo->m_rowLen = 0;
     undo->m_segHead = NVMInvalidPageId;
     undo->m_rowId = InvalidRowId;
-    undo->m_payload = sizeof(key);
     undo->m_pre = 0;
-    int ret = memcpy_s(undo->data, MAX_UNDO_RECORD_CACHE_SIZE, &key, sizeof(key));
-    SecureRetCheck(ret);
+    FillIndexUndoPayload(undo, key, treeId);
     this->insertUndoRecord(undo);
 }
 
@@ -1,25 +1,32 @@
 #include "undo/nvm_undo_rollback.h"
 #include "heap/nvm_heap_undo.h"
 #include "index/nvm_index_undo.h"
+#include "nvm_catalog.h"
 #include <string>
 
 namespace NVMDB {
 
 using NVMUndoFunc = void (*)(const UndoRecord*);
 
+// undoPtr 为该 undo record 在 undo segment 中的位置, 用于判断对应的行是否已经被回滚或者让这条 undo 失效
+using NVMUndoAtFunc = void (*)(const UndoRecord*, UndoRecPtr);
+
 struct NVMUndoProcedure {
    UndoRecordType type;
    std::string name;
    NVMUndoFunc undoFunc;
+   NVMUndoAtFunc undoAtFunc;
 };
 
 static NVMUndoProcedure g_nvmUndoFuncs[] = {
-   {InvalidUndoRecordType, "", nullptr},
-   {HeapInsertUndo, "HeapInsertUndo", UndoInsert},
-   {HeapUpdateUndo, "HeapUpdateUndo", UndoUpdate},
-   {HeapDeleteUndo, "HeapDeleteUndo", UndoDelete},
-   {IndexInsertUndo, "IndexInsertUndo", UndoIndexInsert},
-   {IndexDeleteUndo, "IndexDeleteUndo", UndoIndexDelete},
+   {InvalidUndoRecordType, "", nullptr, nullptr},
+   {HeapInsertUndo, "HeapInsertUndo", nullptr, UndoInsert},
+   {HeapUpdateUndo, "HeapUpdateUndo", nullptr, UndoUpdate},
+   {HeapDeleteUndo, "HeapDeleteUndo", nullptr, UndoDelete},
+   {IndexInsertUndo, "IndexInsertUndo", UndoIndexInsert, nullptr},
+   {IndexDeleteUndo, "IndexDeleteUndo", UndoIndexDelete, nullptr},
+   {TableCreateUndo, "TableCreateUndo", nullptr, UndoTableCreate},
+   {IndexCreateUndo, "IndexCreateUndo", nullptr, UndoIndexCreate},
 };
 
 void UndoRecordRollBack(UndoSegment* segment, TxSlot* txSlot, UndoRecord* undoRecordCache) {
@@ -40,7 +47,11 @@ void UndoRecordRollBack(UndoSegment* segment, TxSlot* txSlot, UndoRecord* undoRe
         if (UndoRecordTypeIsValid((UndoRecordType)undoRecordCache->m_undoType)) {
             NVMUndoProcedure *procedure = &g_nvmUndoFuncs[undoRecordCache->m_undoType];
             DCHECK(procedure->type == undoRecordCache->m_undoType);
-            procedure->undoFunc(undoRecordCache);
+            if (procedure->undoAtFunc != nullptr) {
+                procedure->undoAtFunc(undoRecordCache, undoRecPtr);
+            } else {
+                procedure->undoFunc(undoRecordCache);
+            }
         }
         undoRecPtr = undoRecordCache->m_pre;
     }
@@ -4,26 +4,118 @@
 #include "nvmdb_thread.h"
 #include "common/thread_pool_light.h"
 #include "common/numa.h"
+#include "common/mpmc_queue.h"
+#include <chrono>
+#include <mutex>
 
 namespace NVMDB {
 
-static UndoSegment *g_undo_segment_padding[NVMDB_UNDO_SEGMENT_NUM + 16];
+DEFINE_int32(undo_recovery_threads, 8, "the number of threads to recover undo segments in background");
+DEFINE_bool(undo_punch_hole, true, "punch holes in undo files to release the space of recycled undo records");
+DEFINE_int32(undo_punch_mb_per_sec, 1024, "max undo space punched per second in MB, 0 means no limit");
+
+static UndoSegment *g_undo_segment_padding[NVMDB_UNDO_MAX_SEGMENT_NUM + 16];
 static UndoSegment **g_undo_segments = &g_undo_segment_padding[16];
 
-// 如果 g_undoSegmentAllocated 中某位为1, 则代表有个线程正在持有它, 为0则不一定成立
-// 如果 g_undoSegmentAllocated 中某位为2, 代表还未完成初始化
-// 有些用, 但是用处不大, 还得结合segment是否满判断
-static uint16 g_undoSegmentAllocated[NVMDB_UNDO_SEGMENT_NUM];
+// 当前 undo segment 的数量, 下标小于它的 g_undo_segments 都已经初始化
+static std::atomic<uint32> g_undoSegmentNum {0};
+static std::mutex g_undoSegmentGrowLock;
+
+/* undo space header, 保存 undo 空间的配置, 位于第一个目录下 */
+struct UndoSpaceHeader {
+    uint64 m_magic;
+    uint32 m_segmentNum;            // 在线扩展后会增加
+    uint32 m_txSlotsPerSegment;
+    uint64 m_segmentFileSize;
+    uint32 m_maxFilesPerSegment;
+};
+static constexpr uint64 UNDO_SPACE_MAGIC = 0x4e564d4442554e44;  // "NVMDBUND"
+
+static std::unique_ptr<LogicFile> g_undoSpaceFile;
+static UndoSpaceHeader *g_undoSpaceHeader = nullptr;
+static UndoSpaceConfig g_undoSpaceConfig;
+
+// segment 的状态, 只有 UNDO_SEGMENT_FREE 的 segment 在空闲链表中
+enum UndoSegmentState : uint16 {
+    UNDO_SEGMENT_FREE = 0,          // 在所属 numa 节点的空闲链表中, 可被任意线程获取
+    UNDO_SEGMENT_HELD = 1,          // 有个线程正在持有它
+    UNDO_SEGMENT_NOT_RECOVERED = 2, // 还未完成初始化
+    UNDO_SEGMENT_FULL = 3,          // tx slot 已满, 等待回收线程回收后重新放回空闲链表
+};
+static std::atomic<uint16> g_undoSegmentAllocated[NVMDB_UNDO_MAX_SEGMENT_NUM];
+
+// 每个 numa 节点 (目录) 一个无锁的空闲链表, 存放 segment 下标
+static std::unique_ptr<rigtorp::MPMCQueue<uint32>> g_undoSegmentFreeList[NVMDB_MAX_GROUP];
 
 constexpr int SLOT_OFFSET = 2;
 
 thread_local UndoSegment *t_undo_segment = nullptr;
 thread_local uint64 t_undo_segment_index = 0;   // the global undo segment index allocated for local thread
-static uint64 clock_sweep = 0;
-std::mutex g_undoSegmentLock;   // when a thread acquire a new segment
 
 std::thread g_undoRecycle;
 static bool g_doRecycle = true;
+static std::atomic<bool> g_undoRecovered {true};
+
+static void InitUndoSegmentFreeList() {
+    for (size_t i = 0; i < g_dir_config->size(); i++) {
+        g_undoSegmentFreeList[i] = std::make_unique<rigtorp::MPMCQueue<uint32>>(NVMDB_UNDO_MAX_SEGMENT_NUM);
+    }
+}
+
+static void DestroyUndoSegmentFreeList() {
+    for (auto &freeList : g_undoSegmentFreeList) {
+        freeList = nullptr;
+    }
+}
+
+static void MountUndoSpaceHeader(bool init) {
+    auto dirConfig = std::make_shared<DirectoryConfig>(g_dir_config->getDirPathByIndex(0));
+    g_undoSpaceFile = std::make_unique<LogicFile>(dirConfig, "undo_space", NVM_PAGE_SIZE, 1);
+    g_undoSpaceHeader = static_cast<UndoSpaceHeader *>(g_undoSpaceFile->getNvmAddrByPageId(0));
+    if (init) {
+        CHECK(g_undoSpaceConfig.isValid()) << "Invalid undo space config!";
+        g_undoSpaceHeader->m_segmentNum = g_undoSpaceConfig.segmentNum;
+        g_undoSpaceHeader->m_txSlotsPerSegment = g_undoSpaceConfig.txSlotsPerSegment;
+        g_undoSpaceHeader->m_segmentFileSize = g_undoSpaceConfig.segmentFileSize;
+        g_undoSpaceHeader->m_maxFilesPerSegment = g_undoSpaceConfig.maxFilesPerSegment;
+        NVMPersist(g_undoSpaceHeader, sizeof(UndoSpaceHeader));
+        g_undoSpaceHeader->m_magic = UNDO_SPACE_MAGIC;
+        NVMPersist(&g_undoSpaceHeader->m_magic, sizeof(g_undoSpaceHeader->m_magic));
+        return;
+    }
+    CHECK(g_undoSpaceHeader->m_magic == UNDO_SPACE_MAGIC) << "Undo space header is corrupted!";
+    g_undoSpaceConfig.segmentNum = g_undoSpaceHeader->m_segmentNum;
+    g_undoSpaceConfig.txSlotsPerSegment = g_undoSpaceHeader->m_txSlotsPerSegment;
+    g_undoSpaceConfig.segmentFileSize = g_undoSpaceHeader->m_segmentFileSize;
+    g_undoSpaceConfig.maxFilesPerSegment = g_undoSpaceHeader->m_maxFilesPerSegment;
+    CHECK(g_undoSpaceConfig.isValid()) << "Invalid undo space config, segment num: " << g_undoSpaceConfig.segmentNum
+                                       << ", tx slots: " << g_undoSpaceConfig.txSlotsPerSegment
+                                       << ", file size: " << g_undoSpaceConfig.segmentFileSize;
+}
+
+static void UnmountUndoSpaceHeader() {
+    g_undoSpaceHeader = nullptr;
+    g_undoSpaceFile->unmount();
+    g_undoSpaceFile = nullptr;
+}
+
+uint32 GetUndoSegmentNum() {
+    return g_undoSegmentNum.load(std::memory_order_acquire);
+}
+
+const UndoSpaceConfig& GetUndoSpaceConfig() {
+    return g_undoSpaceConfig;
+}
+
+// 交还一个不再被持有的 segment: 未满则放回所属节点的空闲链表, 已满则等待回收
+static void ReleaseUndoSegment(uint32 index) {
+    if (g_undo_segments[index]->isFull()) {
+        g_undoSegmentAllocated[index].store(UNDO_SEGMENT_FULL, std::memory_order_release);
+        return;
+    }
+    g_undoSegmentAllocated[index].store(UNDO_SEGMENT_FREE, std::memory_order_release);
+    g_undoSegmentFreeList[g_dir_config->getDirPathIdByIndex(index)]->push(index);
+}
 
 uint64 UndoSegment::getMaxCSNForRollback() {
     if (isEmpty()) {
@@ -54,10 +146,47 @@ uint64 UndoSegment::getMaxCSNForRollback() {
     return maxUndoCSN;
 }
 
+/*
+ * 打洞的限速器, 令牌桶, 最多积攒一秒的额度.
+ * 回收线程和测试线程都可能调用, 用锁保护.
+ */
+class UndoPunchRateLimiter {
+public:
+    // 返回本次允许打洞的字节数
+    uint64 acquire(uint64 bytes) {
+        if (FLAGS_undo_punch_mb_per_sec <= 0) {
+            return bytes;
+        }
+        const double rate = FLAGS_undo_punch_mb_per_sec * 1024.0 * 1024.0;  // bytes per second
+        std::lock_guard<std::mutex> lockGuard(m_lock);
+        auto now = std::chrono::steady_clock::now();
+        m_tokens += std::chrono::duration<double>(now - m_lastRefill).count() * rate;
+        m_tokens = std::min(m_tokens, rate);
+        m_lastRefill = now;
+        auto granted = std::min<uint64>(bytes, static_cast<uint64>(m_tokens));
+        m_tokens -= static_cast<double>(granted);
+        return granted;
+    }
+
+private:
+    std::mutex m_lock;
+    double m_tokens = 0;
+    std::chrono::steady_clock::time_point m_lastRefill = std::chrono::steady_clock::now();
+};
+
+static UndoPunchRateLimiter g_undoPunchRateLimiter;
+static std::atomic<uint64> g_undoBytesPunched {0};
+
+uint64 GetUndoBytesPunched() {
+    return g_undoBytesPunched.load(std::memory_order_relaxed);
+}
+
+/*
+ * 对已回收的 undo record 所在区域打洞, 释放物理空间但不 remap,
+ * 前台线程追加写 undo 时不会被回收线程阻塞. 每次按 UNDO_PUNCH_UNIT 对齐, 受限速器约束,
+ * 没有额度时剩下的部分留到下一轮.
+ */
 void UndoSegment::recycleUndoPages(const uint64 &beginSlot, const uint64 &endSlot) {
-    auto segmentSize = m_logicFile.getSegmentSize();
-    uint32 startSegmentId = segHead->m_recycledBegin / segmentSize;
-    uint32 endSegmentId = 0;
     uint64 recycledEnd = 0;
 
     DCHECK(beginSlot <= endSlot);
@@ -69,16 +198,25 @@ void UndoSegment::recycleUndoPages(const uint64 &beginSlot, const uint64 &endSlo
         }
         DCHECK(txSlot->end != 0);
         recycledEnd = UndoRecPtrGetOffset(txSlot->end);
-        endSegmentId = recycledEnd / segmentSize;
+    }
+    if (!FLAGS_undo_punch_hole) {
+        return;
     }
     /* first segment kept as seg header. */
-    if (startSegmentId == 0) {
-        startSegmentId = 1;
+    uint64 punchBegin = std::max<uint64>(segHead->m_recycledBegin, m_logicFile.getSegmentSize());
+    punchBegin = (punchBegin + UNDO_PUNCH_UNIT - 1) / UNDO_PUNCH_UNIT * UNDO_PUNCH_UNIT;
+    /* the last recycled record starts at recycledEnd, keep the unit it lies in. */
+    uint64 punchEnd = recycledEnd / UNDO_PUNCH_UNIT * UNDO_PUNCH_UNIT;
+    if (punchBegin >= punchEnd) {
+        return;
     }
-    if (startSegmentId < endSegmentId) {
-        segHead->m_recycledBegin = recycledEnd;
-        m_logicFile.punch(startSegmentId, endSegmentId);
+    auto granted = g_undoPunchRateLimiter.acquire(punchEnd - punchBegin) / UNDO_PUNCH_UNIT * UNDO_PUNCH_UNIT;
+    if (granted == 0) {
+        return;
     }
+    auto punched = m_logicFile.punchHole(punchBegin, granted);
+    g_undoBytesPunched.fetch_add(punched, std::memory_order_relaxed);
+    segHead->m_recycledBegin = punchBegin + granted;
 }
 
 // Any transaction with csn smaller than min_csn (minSnapshot) can be recycled
@@ -113,15 +251,15 @@ void UndoSegment::recycleTxSlot(uint64 minSnapshot) {
         recycleUndoPages(begin_slot, next_slot - 1);
 
         DCHECK(next_slot != begin_slot);
-        uint64 begin_offset = begin_slot % UNDO_TX_SLOTS;
-        uint64 end_offset = next_slot % UNDO_TX_SLOTS;
+        uint64 begin_offset = begin_slot % m_txSlotNum;
+        uint64 end_offset = next_slot % m_txSlotNum;
         if (begin_offset < end_offset) {
             errno_t ret = memset_s(getTxSlot(begin_offset), (end_offset - begin_offset) * sizeof(TxSlot),
                                    0, (end_offset - begin_offset) * sizeof(TxSlot));
             SecureRetCheck(ret);
         } else {
-            errno_t ret = memset_s(getTxSlot(begin_offset), (UNDO_TX_SLOTS - begin_offset) * sizeof(TxSlot),
-                                   0, (UNDO_TX_SLOTS - begin_offset) * sizeof(TxSlot));
+            errno_t ret = memset_s(getTxSlot(begin_offset), (m_txSlotNum - begin_offset) * sizeof(TxSlot),
+                                   0, (m_txSlotNum - begin_offset) * sizeof(TxSlot));
             SecureRetCheck(ret);
             ret = memset_s(getTxSlot(0), end_offset * sizeof(TxSlot),
                            0, end_offset * sizeof(TxSlot));
@@ -156,41 +294,43 @@ void UndoRecycle() { // start a thread with this function
             continue;
         }
         previousCSN = nowCSN;
-        // 回收废弃的 undo segment
-        for (int i = 0; i < NVMDB_UNDO_SEGMENT_NUM; i++) {
+        // 回收废弃的 undo segment, 只有该线程会把 UNDO_SEGMENT_FULL 的 segment 放回空闲链表
+        for (uint32 i = 0; i < GetUndoSegmentNum(); i++) {
+            if (g_undoSegmentAllocated[i].load(std::memory_order_acquire) != UNDO_SEGMENT_FULL) {
+                continue;   // 正在被使用, 未完成初始化, 或者没有满
+            }
             UndoSegment *undoSegment = g_undo_segments[i];
-            /* necessary to recycle full undo segment. */
+            undoSegment->recycleTxSlot(nowCSN);
             if (!undoSegment->isFull()) {
-                continue;
-            }
-            if (g_undoSegmentAllocated[i] == 1) {
-                continue;   // 正在被使用
+                ReleaseUndoSegment(i);
             }
-            if (g_undoSegmentAllocated[i] == 2) {
-                continue;   // 未完成初始化
-            }
-            undoSegment->recycleTxSlot(nowCSN);
         }
     }
 }
 
-void UndoSegmentCreate() {
+void UndoSegmentCreate(const UndoSpaceConfig& config) {
+    g_undoSpaceConfig = config;
+    MountUndoSpaceHeader(true);
     auto threadPoolLight = std::make_unique<util::thread_pool_light>(15);
     moodycamel::LightweightSemaphore semaphore(0, 0);
-    LOG(INFO) << "Start creating undo segments, count: " << NVMDB_UNDO_SEGMENT_NUM;
+    LOG(INFO) << "Start creating undo segments, count: " << config.segmentNum
+              << ", tx slots per segment: " << config.txSlotsPerSegment;
+    InitUndoSegmentFreeList();
     auto threadFunc = [&](int idxStart, int idxEnd) {
         // LOG(INFO) << "Start: " << idxStart << ", End: " << idxEnd;
         for (int i = idxStart; i < idxEnd; i++) {  // from 0 to 2048, place undox in a round-robin manner
-            g_undo_segments[i] = new UndoSegment(g_dir_config->getDirPathByIndex(i), i);
+            g_undo_segments[i] = new UndoSegment(g_dir_config->getDirPathByIndex(i), i, g_undoSpaceConfig);
             g_undo_segments[i]->create();   // create the undo file, map it to memory(segHead)
-            g_undoSegmentAllocated[i] = 0;  // 未被使用
+            ReleaseUndoSegment(i);  // 未被使用
         }
         semaphore.signal();
     };
-    threadPoolLight->push_loop(0, NVMDB_UNDO_SEGMENT_NUM, threadFunc);
+    g_undoSegmentNum.store(config.segmentNum, std::memory_order_release);
+    threadPoolLight->push_loop(0, config.segmentNum, threadFunc);
     for (auto i=threadPoolLight->get_thread_count(); i>0; i-=(int)semaphore.waitMany((ssize_t)i));
     LOG(INFO) << "Finish creating undo segments.";
     threadPoolLight.reset(nullptr);
+    g_doRecycle = true;
     g_undoRecycle = std::thread(UndoRecycle);   // start nvm global UndoRecycle thread
 }
 
@@ -202,20 +342,20 @@ uint64 GetAndIncreaseWatermark() {
     auto* watermark = static_cast<uint64 *>(file.getNvmAddrByPageId(0));
     *watermark += 1;
     auto value = *watermark;
-    std::atomic_thread_fence(std::memory_order_release);
+    NVMPersist(watermark, sizeof(uint64));
     LOG(INFO) << "Finish obtain watermark, " << "newValue: " << value;
     return MIN_TX_CSN + (value << 32);
 }
 
 uint64 CheckRecoverUndoWatermark() {
     uint64 maxUndoCSN = MIN_TX_CSN;
-    for (int i = 0; i < NVMDB_UNDO_SEGMENT_NUM; i++) {
-        if (g_undoSegmentAllocated[i] != 2) {
+    for (uint32 i = 0; i < GetUndoSegmentNum(); i++) {
+        if (g_undoSegmentAllocated[i].load(std::memory_order_relaxed) != UNDO_SEGMENT_NOT_RECOVERED) {
             continue;
         }
         uint64 segmentMaxUndoCSN = g_undo_segments[i]->getMaxCSNForRollback();
         maxUndoCSN = std::max(maxUndoCSN, segmentMaxUndoCSN);
-        g_undoSegmentAllocated[i] = 0;  // 设置为未被使用
+        ReleaseUndoSegment(i);  // 设置为未被使用
         // maxUndoCSN is updated during Recovery
         // 1. set recovery_start and recovery_end for each undo segment
         // 2. update maxUndoCSN to recovery g_commitSequenceNumber
@@ -223,102 +363,193 @@ uint64 CheckRecoverUndoWatermark() {
     return maxUndoCSN;
 }
 
+// 并行恢复所有的Undo segment, 每个线程绑定到一个目录对应的numa节点, 先恢复该目录下的segment,
+// 再依次帮助恢复其他目录的segment, 线程数少于目录数时所有目录也都会被恢复
+// 同一个segment内按slot顺序串行回滚; 不同segment之间不会回滚同一行:
+// 一行同时只能被一个未提交的事务修改, 因此并行回滚不破坏单行上的版本顺序
+void UndoSegmentRecovery(int threadNum) {
+    const auto dirNum = static_cast<int>(g_dir_config->size());
+    const auto segmentNum = static_cast<int>(GetUndoSegmentNum());
+    threadNum = std::max(threadNum, 1);
+    // 每个目录一个游标, 指向该目录下下一个待恢复的segment (按目录内序号计)
+    std::vector<std::atomic<int>> cursors(dirNum);
+    for (auto& cursor : cursors) {
+        cursor.store(0, std::memory_order_relaxed);
+    }
+    auto threadFunc = [&](int dirId) {
+        char undoRecordCache[MAX_UNDO_RECORD_CACHE_SIZE]; // 4kb
+        // this thread acts as an ordinary worker thread to recover all uncommitted transactions
+        InitThreadLocalVariables();
+        const int nodeId = g_dir_config->getNumaNodeByIndex(dirId);
+        if (!NumaBinding::bindThreadToNode(nodeId, dirId)) {
+            LOG(ERROR) << "failed to bind recovery thread of dir " << dirId << " to numa node " << nodeId;
+        }
+        for (int k = 0; k < dirNum; k++) {
+            const int curDir = (dirId + k) % dirNum;
+            while (true) {
+                // segment i 位于目录 i % dirNum
+                int i = cursors[curDir].fetch_add(1, std::memory_order_relaxed) * dirNum + curDir;
+                if (i >= segmentNum) {
+                    break;
+                }
+                DCHECK(g_dir_config->getDirPathIdByIndex(i) == (size_t)curDir);
+                g_undo_segments[i]->backgroundRecovery(reinterpret_cast<UndoRecord *>(undoRecordCache));
+            }
+        }
+        DestroyThreadLocalVariables();
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threadNum);
+    for (int i = 0; i < threadNum; i++) {
+        workers.emplace_back(threadFunc, i % dirNum);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
 // 在挂载完成后异步后台恢复所有的Undo segment
 void UndoBGRecovery() {
     CheckRecoverUndoWatermark();
-    char undoRecordCache[MAX_UNDO_RECORD_CACHE_SIZE]; // 4kb
-    // this thread acts as an ordinary worker thread to recover all uncommitted transactions
-    InitThreadLocalVariables();
-    for (int i = 0; i < NVMDB_UNDO_SEGMENT_NUM; i++) {  // recover all undo segments
-        auto segment = g_undo_segments[i];
-        segment->backgroundRecovery(reinterpret_cast<UndoRecord *>(undoRecordCache));
-    }
+    UndoSegmentRecovery(FLAGS_undo_recovery_threads);
     LOG(INFO) << "NVMDB Finish recovered undo segments in background.";
-    DestroyThreadLocalVariables();
+    g_undoRecovered.store(true, std::memory_order_release);
     UndoRecycle();
 }
 
+bool UndoRecoveryFinished() {
+    return g_undoRecovered.load(std::memory_order_acquire);
+}
+
+void WaitUndoRecovery() {
+    while (!UndoRecoveryFinished()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
 /* must be invoked after undo tablespace is mounted */
 void UndoSegmentMount() {
     LOG(INFO) << "NVMDB Start mounting undo segments.";
-    for (int i = 0; i < NVMDB_UNDO_SEGMENT_NUM; i++) { // there are 2048 global undo segments (undo0-2048)
-        g_undo_segments[i] = new UndoSegment(g_dir_config->getDirPathByIndex(i), i);
+    MountUndoSpaceHeader(false);
+    InitUndoSegmentFreeList();
+    const auto segmentNum = g_undoSpaceConfig.segmentNum;
+    for (uint32 i = 0; i < segmentNum; i++) { // there are 600 global undo segments by default (undo0-599)
+        g_undo_segments[i] = new UndoSegment(g_dir_config->getDirPathByIndex(i), i, g_undoSpaceConfig);
         g_undo_segments[i]->mount(); // mount undox.0-undox.y
-        g_undoSegmentAllocated[i] = 2;  // 还未完成回收
+        g_undoSegmentAllocated[i] = UNDO_SEGMENT_NOT_RECOVERED;  // 还未完成回收
     }
+    g_undoSegmentNum.store(segmentNum, std::memory_order_release);
     LOG(INFO) << "NVMDB Start initialize undo segments.";
 //    ProcessArray::GetGlobalProcArray()->setRecoveredCSN(GetAndIncreaseWatermark());
      uint64 maxUndoCSN = CheckRecoverUndoWatermark();
      ProcessArray::GetGlobalProcArray()->setRecoveredCSN(maxUndoCSN);
     LOG(INFO) << "NVMDB Finish initialize undo segments.";
     // the recycle thread will do the recovery first
+    g_undoRecovered.store(false, std::memory_order_relaxed);
+    g_doRecycle = true;
     g_undoRecycle = std::thread(UndoBGRecovery);
 }
 
 void UndoSegmentUnmount() {
     g_doRecycle = false;
     g_undoRecycle.join();
-    for (int i = 0; i < NVMDB_UNDO_SEGMENT_NUM; i++) {
-        DCHECK(g_undoSegmentAllocated[i] != 1);
+    for (uint32 i = 0; i < GetUndoSegmentNum(); i++) {
+        DCHECK(g_undoSegmentAllocated[i] != UNDO_SEGMENT_HELD);
         g_undo_segments[i]->unmount();
         delete g_undo_segments[i];
         g_undo_segments[i] = nullptr;
     }
-    clock_sweep = 0;
+    g_undoSegmentNum.store(0, std::memory_order_release);
+    DestroyUndoSegmentFreeList();
+    UnmountUndoSpaceHeader();
 }
 
 UndoSegment *GetUndoSegment(int segId) {
     return g_undo_segments[segId];
 }
 
+/*
+ * 所有 segment 都在使用中时, 在线增加 g_dir_config->size() 个 segment, 每个目录一个.
+ * 先创建 segment 文件, 再更新 undo space header, 最后发布给其他线程;
+ * 如果在更新 header 前崩溃, 重启后多出来的文件会在下次扩展时被重新初始化.
+ */
+static bool GrowUndoSegments(uint32 numaNodeId) {
+    std::lock_guard<std::mutex> lockGuard(g_undoSegmentGrowLock);
+    if (!g_undoSegmentFreeList[numaNodeId]->empty()) {
+        return true;    // 其他线程已经扩展过了
+    }
+    const uint32 oldNum = GetUndoSegmentNum();
+    const uint32 newNum = oldNum + g_dir_config->size();
+    if (newNum > NVMDB_UNDO_MAX_SEGMENT_NUM) {
+        return false;
+    }
+    for (uint32 i = oldNum; i < newNum; i++) {
+        g_undo_segments[i] = new UndoSegment(g_dir_config->getDirPathByIndex(i), i, g_undoSpaceConfig);
+        g_undo_segments[i]->create();
+        g_undoSegmentAllocated[i].store(UNDO_SEGMENT_HELD, std::memory_order_relaxed);
+    }
+    // 新的 segment 头已经持久化, 持久化 header 之后重启才会恢复这些 segment 中的事务
+    g_undoSpaceHeader->m_segmentNum = newNum;
+    NVMPersist(&g_undoSpaceHeader->m_segmentNum, sizeof(g_undoSpaceHeader->m_segmentNum));
+    g_undoSpaceConfig.segmentNum = newNum;
+    g_undoSegmentNum.store(newNum, std::memory_order_release);
+    for (uint32 i = oldNum; i < newNum; i++) {
+        ReleaseUndoSegment(i);
+    }
+    LOG(INFO) << "Grow undo segments from " << oldNum << " to " << newNum;
+    return true;
+}
+
 void InitLocalUndoSegment() {
-    if (t_undo_segment == nullptr) {   // thread local undo segment
-        g_undoSegmentLock.lock();
-        static thread_local bool t_undoSegmentInit = false;
-        static thread_local uint32 t_numaNodeId = 0;
-        static uint32 g_counter = 0;
-        // 绑核相关，只进行一次
-        if (!t_undoSegmentInit) {
-            t_numaNodeId = g_counter % g_dir_config->size();
-            g_counter += 1;
-            if (NumaBinding::bindThreadToNode((int)t_numaNodeId)) {
-                LOG(INFO) << "success binding " << g_counter << " to numa node " << t_numaNodeId << " " << g_dir_config->getDirPathByIndex(t_numaNodeId);
-            } else {
-                LOG(ERROR) << "failed to bind " << g_counter << " to numa node " << t_numaNodeId;
-            }
-            t_undoSegmentInit = true;
+    if (t_undo_segment != nullptr) {   // thread local undo segment
+        return;
+    }
+    static thread_local bool t_undoSegmentInit = false;
+    static thread_local uint32 t_numaNodeId = 0;
+    static std::atomic<uint32> g_counter {0};
+    // 绑核相关，只进行一次
+    if (!t_undoSegmentInit) {
+        auto counter = g_counter.fetch_add(1, std::memory_order_relaxed);
+        t_numaNodeId = counter % g_dir_config->size();
+        const int nodeId = g_dir_config->getNumaNodeByIndex(t_numaNodeId);
+        if (NumaBinding::bindThreadToNode(nodeId, (int)t_numaNodeId)) {
+            LOG(INFO) << "success binding " << counter + 1 << " to numa node " << nodeId << " " << g_dir_config->getDirPathByIndex(t_numaNodeId);
+        } else {
+            LOG(ERROR) << "failed to bind " << counter + 1 << " to numa node " << nodeId;
         }
-
-        while (true) {
-            clock_sweep++;
-            t_undo_segment_index = clock_sweep % NVMDB_UNDO_SEGMENT_NUM;
-            // retry until finding a new unallocated undo segment
-            if (g_undoSegmentAllocated[t_undo_segment_index] != 0) {
-                continue;
-            }
-            t_undo_segment = g_undo_segments[t_undo_segment_index];
-            if (g_dir_config->getDirPathIdByIndex(t_undo_segment_index) != t_numaNodeId) {
-                continue;   // the numa node where the thread is running must be the same as the numa node where the storage is.
-            }
-            if (t_undo_segment->isFull()) {    // skip full segment
-                continue;
+        t_undoSegmentInit = true;
+    }
+    // the numa node where the thread is running must be the same as the numa node where the storage is.
+    auto& freeList = g_undoSegmentFreeList[t_numaNodeId];
+    uint32 index = 0;
+    while (true) {
+        // retry until finding a new unallocated undo segment
+        if (!freeList->try_pop(index)) {
+            // 所有 segment 都在使用中或者已满, 在线扩展
+            if (!GrowUndoSegments(t_numaNodeId)) {
+                std::this_thread::yield();
             }
-            g_undoSegmentAllocated[t_undo_segment_index] = 1;
-            // mark the segment as occupied.
-            // g_undoSegmentAllocated is in memory!
-            break;
+            continue;
         }
-        g_undoSegmentLock.unlock();
+        DCHECK(g_undoSegmentAllocated[index].load(std::memory_order_relaxed) == UNDO_SEGMENT_FREE);
+        // mark the segment as occupied.
+        // g_undoSegmentAllocated is in memory!
+        g_undoSegmentAllocated[index].store(UNDO_SEGMENT_HELD, std::memory_order_relaxed);
+        if (g_undo_segments[index]->isFull()) {    // skip full segment, wait for recycling
+            ReleaseUndoSegment(index);
+            continue;
+        }
+        break;
     }
+    t_undo_segment_index = index;
+    t_undo_segment = g_undo_segments[index];
 }
 
 void DestroyLocalUndoSegment() {
     if (t_undo_segment != nullptr) {
-        /* todo: undo_segment can be reused by other threads */
+        // hand the segment over to the free list, so any new thread on the same node can adopt it
         t_undo_segment = nullptr;
-        g_undoSegmentAllocated[t_undo_segment_index] = 0;
-        // free the current undo segment
-        // g_undoSegmentAllocated is in memory!
+        ReleaseUndoSegment(t_undo_segment_index);
     }
 }
 
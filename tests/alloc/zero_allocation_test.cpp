@@ -0,0 +1,106 @@
+#include "common/pactree/pactree_impl.h"
+#include "common/test_declare.h"
+#include "index/nvm_index.h"
+#include "nvmdb_thread.h"
+#include "nvm_init.h"
+#include <gtest/gtest.h>
+#include <new>
+
+using namespace NVMDB;
+
+/*
+ * 测试钩子: 统计当前线程打开计数期间的堆分配次数, 用来验证索引的快速路径不分配内存.
+ * 替换全局 operator new 会影响同一个可执行文件中的所有测试, 所以这里的测试单独编译成 ReviveDBAllocTests
+ */
+static thread_local bool g_countAllocation = false;
+static thread_local uint64 g_allocationCount = 0;
+
+void *operator new(size_t size) {
+    if (g_countAllocation) {
+        g_allocationCount++;
+    }
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace zero_allocation_test {
+
+ColumnDesc TestColDesc[] = {InitColDesc(COL_TYPE_INT)};
+IndexColumnDesc TestIndexDesc[] = {{0}};
+
+class ZeroAllocationTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        uint64 rowLen = 0;
+        InitColumnDesc(&TestColDesc[0], 1, rowLen);
+        InitIndexDesc(&TestIndexDesc[0], &TestColDesc[0], 1, m_indexLen);
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+    }
+
+    void TearDown() override {
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+    }
+
+    const std::string m_dir = "/mnt/pmem0/alloc;/mnt/pmem1/alloc";
+    uint64 m_indexLen = 0;
+};
+
+/* 预热之后, 更新已有 key, 点查和复用迭代器的范围扫描都不分配内存 */
+TEST_F(ZeroAllocationTest, IndexFastPathTest) {
+    NVMIndex idx(1);
+    static const int TEST_NUM = 1000;
+    static const int SCAN_LEN = 20;
+    DRAMIndexTuple tuple(&TestColDesc[0], &TestIndexDesc[0], 1, m_indexLen);
+    DRAMIndexTuple end(&TestColDesc[0], &TestIndexDesc[0], 1, m_indexLen);
+    for (int i = 0; i < TEST_NUM; i++) {
+        tuple.SetCol(0, (char *)&i);
+        idx.Insert(&tuple, i);
+    }
+    LookupSnapshot snapshot = {0, 0};
+    NVMIndexIter iter;
+    auto scan = [&](int si, bool reverse) {
+        int ei = si + SCAN_LEN - 1;
+        tuple.SetCol(0, (char *)&si);
+        end.SetCol(0, (char *)&ei);
+        idx.GenerateIter(&tuple, &end, snapshot, 0, reverse, &iter);
+        int count = 0;
+        for (; iter.Valid(); iter.Next()) {
+            count++;
+        }
+        return count;
+    };
+    ASSERT_EQ(scan(0, false), SCAN_LEN);
+
+    g_allocationCount = 0;
+    g_countAllocation = true;
+    int scanned = 0;
+    for (int i = 0; i < TEST_NUM; i++) {
+        tuple.SetCol(0, (char *)&i);
+        idx.Insert(&tuple, i);
+        bool found = false;
+        Key_t key;
+        idx.Encode(&tuple, &key, i);
+        GetTreeById(idx.TreeId())->Lookup(key, &found);
+        if (found && i + SCAN_LEN <= TEST_NUM) {
+            scanned += scan(i, i % 2 == 0);
+        }
+    }
+    g_countAllocation = false;
+    ASSERT_EQ(g_allocationCount, 0);
+    ASSERT_EQ(scanned, (TEST_NUM - SCAN_LEN + 1) * SCAN_LEN);
+}
+
+}  // namespace zero_allocation_test
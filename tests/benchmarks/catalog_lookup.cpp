@@ -0,0 +1,119 @@
+#include "nvm_init.h"
+#include "nvm_catalog.h"
+#include "nvm_access.h"
+#include "nvmdb_thread.h"
+#include "heap/nvm_heap.h"
+#include "common/test_declare.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <string>
+
+using namespace NVMDB;
+
+/*
+ * 大量表时的建表和查表开销.
+ * 表目录 (oid -> segment head) 直接建 100K 张表; 每张表需要一个 2M 的 heap segment,
+ * 所以通过 catalog 按名字建表和打开的部分只用 10K 张表.
+ */
+class CatalogLookupBench : public ::testing::Test {
+protected:
+    static constexpr uint32 DIRECTORY_TABLES = 100000;
+    static constexpr uint32 CATALOG_TABLES = 10000;
+    static constexpr uint32 LOOKUPS = 1000000;
+    static constexpr TableId FIRST_OID = 1000;
+
+    void SetUp() override {
+        InitColumnDesc(m_colDesc, 2, m_rowLen);
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+    }
+
+    void TearDown() override {
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+    }
+
+    template <typename Func>
+    static double TimeUs(Func &&func) {
+        auto begin = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(end - begin).count();
+    }
+
+    static std::string TableName(uint32 i) {
+        return "table_" + std::to_string(i);
+    }
+
+    std::string m_dir = "/mnt/pmem0/catalog_lookup;/mnt/pmem1/catalog_lookup";
+    ColumnDesc m_colDesc[2] = {InitColDesc(COL_TYPE_INT), InitVarColDesc(COL_TYPE_VARCHAR, 32)};
+    uint64 m_rowLen = 0;
+};
+
+TEST_F(CatalogLookupBench, TableDirectory) {
+    // 只测表目录, segment head 不需要真实存在
+    double us = TimeUs([&]() {
+        for (uint32 i = 0; i < DIRECTORY_TABLES; i++) {
+            g_heapSpace->CreateTable(FIRST_OID + i, i + 2);
+        }
+    });
+    LOG(INFO) << "Create " << DIRECTORY_TABLES << " tables: " << us / DIRECTORY_TABLES << " us/table";
+
+    std::mt19937 rng(0);
+    uint64 found = 0;
+    us = TimeUs([&]() {
+        for (uint32 i = 0; i < LOOKUPS; i++) {
+            found += NVMPageIdIsValid(g_heapSpace->SearchTable(FIRST_OID + rng() % DIRECTORY_TABLES));
+        }
+    });
+    ASSERT_EQ(found, LOOKUPS);
+    LOG(INFO) << "Search " << LOOKUPS << " times: " << us * 1000 / LOOKUPS << " ns/lookup";
+
+    us = TimeUs([&]() {
+        for (uint32 i = 0; i < DIRECTORY_TABLES; i++) {
+            g_heapSpace->DropTable(FIRST_OID + i);
+        }
+    });
+    LOG(INFO) << "Drop " << DIRECTORY_TABLES << " tables: " << us / DIRECTORY_TABLES << " us/table";
+}
+
+TEST_F(CatalogLookupBench, OpenByName) {
+    Transaction *tx = GetCurrentTxContext();
+    TableDesc desc{m_colDesc, 2, m_rowLen};
+    double us = TimeUs([&]() {
+        for (uint32 i = 0; i < CATALOG_TABLES; i++) {
+            tx->Begin();
+            ASSERT_NE(CatalogCreateTable(tx, TableName(i).c_str(), FIRST_OID + i, desc), nullptr);
+            tx->Commit();
+        }
+    });
+    LOG(INFO) << "Create " << CATALOG_TABLES << " tables by name: " << us / CATALOG_TABLES << " us/table";
+
+    std::vector<std::string> names;
+    std::mt19937 rng(0);
+    for (uint32 i = 0; i < LOOKUPS; i++) {
+        names.push_back(TableName(rng() % CATALOG_TABLES));
+    }
+    tx->Begin();
+    us = TimeUs([&]() {
+        for (const auto &name : names) {
+            ASSERT_NE(CatalogOpenTable(tx, name.c_str()), nullptr);
+        }
+    });
+    tx->Commit();
+    LOG(INFO) << "Open " << LOOKUPS << " times: " << us * 1000 / LOOKUPS << " ns/lookup";
+
+    /* 重启后第一次访问时重建 DRAM 索引 */
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+    BootStrap(m_dir);
+    InitThreadLocalVariables();
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    us = TimeUs([&]() { ASSERT_NE(CatalogOpenTable(tx, names[0].c_str()), nullptr); });
+    tx->Commit();
+    LOG(INFO) << "Rebuild catalog index after restart: " << us / 1000 << " ms";
+    WaitUndoRecovery();
+}
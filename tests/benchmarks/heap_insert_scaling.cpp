@@ -0,0 +1,82 @@
+#include "nvm_init.h"
+#include "nvm_access.h"
+#include "nvmdb_thread.h"
+#include "common/test_declare.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace NVMDB;
+
+/*
+ * 只插入的负载 (类似 TPC-C 的 order-line/history), 线程数从 1 增加到所有核,
+ * 每个线程都在不断申请新的 extent, 用来观察分配路径上是否还有全局的锁.
+ */
+class HeapInsertScalingBench : public ::testing::Test {
+protected:
+    static constexpr int DURATION_SEC = 5;
+
+    void SetUp() override {
+        InitColumnDesc(m_colDesc, 2, m_rowLen);
+    }
+
+    double RunInsert(int threads) {
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+        ResetPersistStats();
+        Table table(0, m_rowLen);
+        table.CreateSegment();
+        std::atomic<bool> onWorking {true};
+        std::vector<uint64> inserted(threads, 0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                InitThreadLocalVariables();
+                RAMTuple tuple(m_colDesc, m_rowLen);
+                tuple.SetCol(0, (char *)&t);
+                Transaction *tx = GetCurrentTxContext();
+                uint64 count = 0;
+                while (onWorking.load(std::memory_order_relaxed)) {
+                    tx->Begin();
+                    HeapInsert(tx, &table, &tuple);
+                    tx->Commit();
+                    count++;
+                }
+                inserted[t] = count;
+                DestroyThreadLocalVariables();
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(DURATION_SEC));
+        onWorking = false;
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        uint64 total = 0;
+        for (auto count : inserted) {
+            total += count;
+        }
+        if (PersistStatsEnabled()) {
+            LOG(INFO) << "NVM writes of " << threads << " threads:\n" << PersistStatsReport(total);
+        }
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+        return total * 1.0 / DURATION_SEC / 1000000;
+    }
+
+    std::string m_dir = "/mnt/pmem0/heap_insert;/mnt/pmem1/heap_insert";
+    ColumnDesc m_colDesc[2] = {InitColDesc(COL_TYPE_INT), InitVarColDesc(COL_TYPE_VARCHAR, 128)};
+    uint64 m_rowLen = 0;
+};
+
+TEST_F(HeapInsertScalingBench, InsertOnly) {
+    const int maxThreads = static_cast<int>(std::min<unsigned>(std::thread::hardware_concurrency(),
+                                                               NVMDB_MAX_THREAD_NUM - 1));
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+    for (int threads : threadCounts) {
+        LOG(INFO) << "Insert threads: " << threads << ", throughput: " << RunInsert(threads) << " M rows/s";
+    }
+}
@@ -0,0 +1,82 @@
+#include "nvm_init.h"
+#include "nvm_access.h"
+#include "nvmdb_thread.h"
+#include "heap/nvm_heap.h"
+#include "common/test_declare.h"
+#include "common/latency_stat.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+using namespace NVMDB;
+
+/*
+ * 懒挂载下的启动时间: 构造不同大小的 heap, 重启后统计从 BootStrap 到第一个事务提交的时间.
+ * segment 在后台 prefault 或者第一次访问时才映射, 启动时间不应随 heap 大小增长.
+ */
+class HeapMountBench : public ::testing::Test {
+protected:
+    void SetUp() override {
+        InitColumnDesc(m_colDesc, 2, m_rowLen);
+    }
+
+    // 创建一张只有一行的表, 再分配空的 2M extent 直到 heap 达到 heapSizeGB
+    void BuildHeap(uint64 heapSizeGB) {
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+        Table table(0, m_rowLen);
+        m_segHead = table.CreateSegment();
+        RAMTuple tuple(m_colDesc, m_rowLen);
+        int value = 42;
+        tuple.SetCol(0, (char *)&value);
+        Transaction *tx = GetCurrentTxContext();
+        tx->Begin();
+        m_rowId = HeapInsert(tx, &table, &tuple);
+        tx->Commit();
+
+        const uint64 extents = heapSizeGB * 1024 / 2;
+        const auto dirNum = static_cast<uint32>(g_dir_config->size());
+        for (uint64 i = 0; i < extents; i++) {
+            g_heapSpace->fastAllocNewExtent(EXT_SIZE_2M, NVMInvalidPageId, i % dirNum);
+        }
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+    }
+
+    int64_t TimeToFirstTxn() {
+        TestTimer timer;
+        BootStrap(m_dir);
+        InitThreadLocalVariables();
+        Table table(0, m_rowLen);
+        table.Mount(m_segHead);
+        RAMTuple tuple(m_colDesc, m_rowLen);
+        Transaction *tx = GetCurrentTxContext();
+        tx->Begin();
+        CHECK(HeapRead(tx, &table, m_rowId, &tuple) == HamStatus::OK);
+        tx->Commit();
+        auto duration = timer.getDurationUs();
+        int value = 0;
+        tuple.GetCol(0, (char *)&value);
+        CHECK(value == 42);
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+        return duration;
+    }
+
+    std::string m_dir = "/mnt/pmem0/heap_mount;/mnt/pmem1/heap_mount";
+    ColumnDesc m_colDesc[2] = {InitColDesc(COL_TYPE_INT), InitVarColDesc(COL_TYPE_VARCHAR, 64)};
+    uint64 m_rowLen = 0;
+    uint32 m_segHead = 0;
+    RowId m_rowId = 0;
+};
+
+TEST_F(HeapMountBench, TimeToFirstTxn) {
+    for (uint64 heapSizeGB : {10, 100, 1000}) {
+        BuildHeap(heapSizeGB);
+        for (bool prefault : {false, true}) {
+            FLAGS_heap_prefault = prefault;
+            LOG(INFO) << "Heap size: " << heapSizeGB << " GB, background prefault: " << (prefault ? "on" : "off")
+                      << ", time to first txn: " << TimeToFirstTxn() << " us";
+        }
+    }
+    FLAGS_heap_prefault = true;
+}
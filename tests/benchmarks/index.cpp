@@ -184,7 +184,8 @@ public:
         DestroyThreadLocalVariables();
     }
 
-    void LookupFunc(int tid, int maxIdx) {
+    /* pointLookup 为 true 时用 NVMIndex::Lookup, 否则构造 [key, key] 的迭代器 */
+    void LookupFunc(int tid, int maxIdx, bool pointLookup) {
         int rid = tid;
         InitThreadLocalVariables();
         DRAMIndexTuple tuple(TestDesc.col_desc, TestPKDesc.index_col_desc, TestPKDesc.index_col_cnt,
@@ -198,6 +199,14 @@ public:
         while (onWorking) {
             int temp = rdm.Next() % maxIdx;
             tuple.SetCol(0, (char *)&temp);
+            if (pointLookup) {
+                if (idx->Lookup(tx, &tuple) != (RowId)temp) {
+                    LOG(ERROR) << "lookup rowid failed";
+                    return;
+                }
+                k++;
+                continue;
+            }
             auto iter = idx->GenerateIter(&tuple, &tuple, snapshot, 0, false);
             if (!iter->Valid() || iter->Curr() != temp) {
                 LOG(ERROR) << "lookup rowid failed";
@@ -245,11 +254,57 @@ public:
         statistics[tid] = k;
     }
 
+    /*
+     * 取一个区间内最大的 LAST_N 个 key ("最近的 N 条记录"), reverse 为 true 时逆序扫描,
+     * 否则正序扫描整个区间并保留最后 LAST_N 个
+     */
+    void LastNFunc(int tid, int maxIdx, bool reverse) {
+        int k = 0;
+        static const int RANGE_LEN = 100;
+        static const int LAST_N = 10;
+        InitThreadLocalVariables();
+        auto tx = GetCurrentTxContext();
+        tx->Begin();
+        RandomGenerator rdm;
+        RowId lastN[LAST_N];
+
+        while (onWorking) {
+            DRAMIndexTuple start(TestDesc.col_desc, TestPKDesc.index_col_desc, TestPKDesc.index_col_cnt,
+                                 TestPKDesc.index_len);
+            DRAMIndexTuple end(TestDesc.col_desc, TestPKDesc.index_col_desc, TestPKDesc.index_col_cnt,
+                               TestPKDesc.index_len);
+            int temp = rdm.Next() % (maxIdx - RANGE_LEN);
+            start.SetCol(0, (char *)&temp);
+            temp += RANGE_LEN - 1;
+            end.SetCol(0, (char *)&temp);
+            auto ss = tx->GetIndexLookupSnapshot();
+            auto iter = idx->GenerateIter(&start, &end, ss, reverse ? LAST_N : 0, reverse);
+            int count = 0;
+            for (; iter->Valid(); iter->Next()) {
+                lastN[count % LAST_N] = iter->Curr();
+                count++;
+            }
+            delete iter;
+            int expect = reverse ? LAST_N : RANGE_LEN;
+            if (count != expect || lastN[(count - 1) % LAST_N] != (reverse ? temp - LAST_N + 1 : temp)) {
+                LOG(ERROR) << "last n scan wrong result";
+                return;
+            }
+            k++;
+        }
+        tx->Commit();
+        statistics[tid] = k;
+        DestroyThreadLocalVariables();
+    }
+
     enum BENCH_TYPE {
         INSERT,
         MIX,
         LOOKUP,
         SCAN,
+        REVERSE_LAST_N,
+        FORWARD_LAST_N,
+        POINT_LOOKUP,
         BENCH_NUM,
     };
 
@@ -258,6 +313,9 @@ public:
         "mixed test",
         "lookup",
         "scan",
+        "last n (reverse scan)",
+        "last n (forward scan and keep last)",
+        "point lookup (NVMIndex::Lookup)",
     };
 
     void WarmUp() {
@@ -274,6 +332,7 @@ public:
     }
 
     void Run(BENCH_TYPE type) {
+        ResetPersistStats();
         onWorking = true;
         std::thread workerTids[workers];
         for (int i = 0; i < workers; i++) {
@@ -285,11 +344,20 @@ public:
                     workerTids[i] = std::thread(&IndexBench::InsertRemoveFunc, this, i);
                     break;
                 case LOOKUP:
-                    workerTids[i] = std::thread(&IndexBench::LookupFunc, this, i, warmup);
+                    workerTids[i] = std::thread(&IndexBench::LookupFunc, this, i, warmup, false);
                     break;
                 case SCAN:
                     workerTids[i] = std::thread(&IndexBench::ScanFunc, this, i, warmup);
                     break;
+                case POINT_LOOKUP:
+                    workerTids[i] = std::thread(&IndexBench::LookupFunc, this, i, warmup, true);
+                    break;
+                case REVERSE_LAST_N:
+                    workerTids[i] = std::thread(&IndexBench::LastNFunc, this, i, warmup, true);
+                    break;
+                case FORWARD_LAST_N:
+                    workerTids[i] = std::thread(&IndexBench::LastNFunc, this, i, warmup, false);
+                    break;
                 default:
                     exit(0);
             }
@@ -304,6 +372,9 @@ public:
 
         LOG(INFO) << "Finish test " << testName[type] << " ops: " << total <<
             " (" << total * 1.0 / runTime / SUBTLE_SECOND << " MQPS)";
+        if (PersistStatsEnabled()) {
+            LOG(INFO) << "NVM writes:\n" << PersistStatsReport(total);
+        }
     }
 
     ~IndexBench() {
@@ -330,6 +401,9 @@ TEST_F(IndexBenchTest, IndexBenchMain) {
         bench.Run(IndexBench::MIX);
         bench.Run(IndexBench::LOOKUP);
         bench.Run(IndexBench::SCAN);
+        bench.Run(IndexBench::REVERSE_LAST_N);
+        bench.Run(IndexBench::FORWARD_LAST_N);
+        bench.Run(IndexBench::POINT_LOOKUP);
     } else {
         bench.Run(static_cast<IndexBench::BENCH_TYPE>(opt.type));
     }
@@ -0,0 +1,105 @@
+#include "nvm_init.h"
+#include "nvm_catalog.h"
+#include "nvm_access.h"
+#include "nvm_index_rebuild.h"
+#include "nvmdb_thread.h"
+#include "common/test_declare.h"
+#include "common/latency_stat.h"
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace NVMDB;
+
+/*
+ * 易失索引的重建时间: 用 NVMDB_BENCH_ROWS 行构造一张有一个易失主键的表, 重启后统计打开表 (从 heap 重建索引) 的时间,
+ * 按扫描的 heap 大小折算成每 GB 的秒数, 分别使用每个 NUMA 组 1, 2, 4 个重建线程.
+ */
+class IndexRebuildBench : public ::testing::Test {
+protected:
+    void SetUp() override {
+        InitColumnDesc(m_colDesc, 2, m_rowLen);
+        m_rows = gflags::Int64FromEnv("NVMDB_BENCH_ROWS", 10000000);
+    }
+
+    void Load() {
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+        Transaction *tx = GetCurrentTxContext();
+        tx->Begin();
+        TableDesc desc{m_colDesc, 2, m_rowLen};
+        Table *table = CatalogCreateTable(tx, "rebuild", 1, desc);
+        IndexColumnDesc pkDesc[] = {{0}};
+        CHECK(CatalogCreateIndex(tx, table, 1, pkDesc, 1, nullptr, 0, IndexType::VOLATILE) != nullptr);
+        tx->Commit();
+        DestroyThreadLocalVariables();
+
+        const int threadNum = static_cast<int>(std::thread::hardware_concurrency());
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threadNum; t++) {
+            workers.emplace_back([&, t]() {
+                InitThreadLocalVariables();
+                Transaction *tx = GetCurrentTxContext();
+                NVMIndex *index = table->GetIndex(0);
+                RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+                DRAMIndexTuple key(table->GetColDesc(), index->GetIndexDesc(), index->GetColCount(),
+                                   index->GetRowLen());
+                const int batch = 100;
+                for (int64 i = t; i < m_rows; i += threadNum * batch) {
+                    tx->Begin();
+                    for (int64 j = i; j < m_rows && j < i + threadNum * batch; j += threadNum) {
+                        auto value = static_cast<int>(j);
+                        tuple.SetCol(0, (char *)&value);
+                        RowId rowId = HeapInsert(tx, table, &tuple);
+                        key.ExtractFromTuple(&tuple);
+                        tx->IndexInsert(index, &key, rowId);
+                    }
+                    tx->Commit();
+                }
+                DestroyThreadLocalVariables();
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        ExitDBProcess();
+    }
+
+    // 重启并打开表, 返回打开表用的秒数, heapBytes 为扫描的 heap 大小
+    double Reopen(uint64 *heapBytes) {
+        BootStrap(m_dir);
+        InitThreadLocalVariables();
+        Transaction *tx = GetCurrentTxContext();
+        TestTimer timer;
+        tx->Begin();
+        Table *table = CatalogOpenTable(tx, "rebuild");
+        CHECK(table != nullptr);
+        tx->Commit();
+        double seconds = static_cast<double>(timer.getDurationUs()) / 1e6;
+        *heapBytes = static_cast<uint64>(HeapUpperRowId(table)) * table->m_rowIdMap->GetSlotLen();
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+        return seconds;
+    }
+
+    std::string m_dir = "/mnt/pmem0/index_rebuild;/mnt/pmem1/index_rebuild";
+    ColumnDesc m_colDesc[2] = {InitColDesc(COL_TYPE_INT), InitVarColDesc(COL_TYPE_VARCHAR, 64)};
+    uint64 m_rowLen = 0;
+    int64 m_rows = 0;
+};
+
+TEST_F(IndexRebuildBench, SecondsPerGB) {
+    Load();
+    int32 savedThreads = FLAGS_index_rebuild_threads_per_group;
+    for (int32 threads : {1, 2, 4}) {
+        FLAGS_index_rebuild_threads_per_group = threads;
+        uint64 heapBytes = 0;
+        double seconds = Reopen(&heapBytes);
+        double heapGB = static_cast<double>(heapBytes) / (1024.0 * 1024 * 1024);
+        LOG(INFO) << "Threads per group: " << threads << ", heap: " << heapGB << " GB, open table: " << seconds
+                  << " s, " << seconds / heapGB << " s/GB";
+    }
+    FLAGS_index_rebuild_threads_per_group = savedThreads;
+}
@@ -0,0 +1,109 @@
+#include "common/pactree/pactree.h"
+#include "common/test_declare.h"
+#include "nvmdb_thread.h"
+#include "random_generator.h"
+#include <experimental/filesystem>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace NVMDB;
+
+/*
+ * PACTree 点查: 比较 ListNode 中逐个比较 fingerprint 和 SIMD 一次比较 32/64 个 fingerprint.
+ * 默认 1M 个 key, 设置 NVMDB_BENCH_KEYS=100000000 在 100M 个 key 上测试.
+ */
+class PACTreeLookupBench : public ::testing::Test {
+protected:
+    static constexpr int WORKERS = 16;
+    static constexpr int DURATION_SEC = 10;
+
+    void SetUp() override {
+        m_keys = gflags::Int64FromEnv("NVMDB_BENCH_KEYS", 1000000);
+        g_dir_config = std::make_shared<NVMDB::DirectoryConfig>(m_dir, true);
+        InitGlobalThreadStorageMgr();
+        InitThreadLocalStorage();
+        m_pt = new PACTree();
+        m_pt->registerThread();
+    }
+
+    void TearDown() override {
+        m_pt->unregisterThread();
+        delete m_pt;
+        DestroyThreadLocalStorage();
+        for (const auto &it : g_dir_config->getDirPaths()) {
+            std::experimental::filesystem::remove_all(it);
+        }
+    }
+
+    void Load() {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < WORKERS; t++) {
+            workers.emplace_back([this, t]() {
+                InitThreadLocalStorage();
+                m_pt->registerThread();
+                for (int64 i = t; i < m_keys; i += WORKERS) {
+                    Key_t key((int)i);
+                    m_pt->Insert(key, INVALID_CSN);
+                }
+                m_pt->unregisterThread();
+                DestroyThreadLocalStorage();
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        LOG(INFO) << "loaded " << m_keys << " keys";
+    }
+
+    double RunLookup() {
+        std::atomic<bool> onWorking {true};
+        std::vector<uint64> finished(WORKERS, 0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < WORKERS; t++) {
+            workers.emplace_back([&, t]() {
+                InitThreadLocalStorage();
+                m_pt->registerThread();
+                RandomGenerator rnd;
+                uint64 count = 0;
+                while (onWorking.load(std::memory_order_relaxed)) {
+                    Key_t key((int)(rnd.Next() % m_keys));
+                    bool found;
+                    m_pt->lookup(key, &found);
+                    CHECK(found);
+                    count++;
+                }
+                finished[t] = count;
+                m_pt->unregisterThread();
+                DestroyThreadLocalStorage();
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(DURATION_SEC));
+        onWorking = false;
+        uint64 total = 0;
+        for (int t = 0; t < WORKERS; t++) {
+            workers[t].join();
+            total += finished[t];
+        }
+        return (double)total / DURATION_SEC;
+    }
+
+    const std::string m_dir = "/mnt/pmem0/bench;/mnt/pmem1/bench";
+    int64 m_keys = 0;
+    PACTree *m_pt = nullptr;
+};
+
+TEST_F(PACTreeLookupBench, FingerprintProbe) {
+    static const char *names[] = {"scalar", "avx2", "avx512"};
+    const auto saved = CurrentFingerprintProbe();
+    Load();
+    for (auto kind : {FingerprintProbe::SCALAR, FingerprintProbe::AVX2, FingerprintProbe::AVX512}) {
+        if (!SetFingerprintProbe(kind)) {
+            LOG(INFO) << names[static_cast<int>(kind)] << " is not supported";
+            continue;
+        }
+        double qps = RunLookup();
+        LOG(INFO) << names[static_cast<int>(kind)] << ": " << qps / 1000000 << " M lookups/s";
+    }
+    SetFingerprintProbe(saved);
+}
@@ -0,0 +1,111 @@
+#include "common/pactree/pactree.h"
+#include "common/test_declare.h"
+#include "nvmdb_thread.h"
+#include "random_generator.h"
+#include <experimental/filesystem>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace NVMDB;
+
+/*
+ * PACTree oplog 处理: 不同的 combiner 数和每组 worker 数下, 顺序 key 和随机 key 的插入吞吐,
+ * 以及插入期间 search layer 落后的 oplog 个数 (每毫秒采样一次的平均值和最大值) 和插入结束后追上所用的时间.
+ * 默认插入 10M 个 key, 设置 NVMDB_BENCH_KEYS 修改.
+ */
+class PACTreeOplogBench : public ::testing::Test {
+protected:
+    static constexpr int WORKERS = 16;
+
+    void SetUp() override {
+        m_keys = gflags::Int64FromEnv("NVMDB_BENCH_KEYS", 10000000);
+        m_savedCombiners = FLAGS_pactree_combiner_threads;
+        m_savedWorkers = FLAGS_pactree_workers_per_group;
+        g_dir_config = std::make_shared<NVMDB::DirectoryConfig>(m_dir, true);
+        InitGlobalThreadStorageMgr();
+        InitThreadLocalStorage();
+    }
+
+    void TearDown() override {
+        DestroyThreadLocalStorage();
+        FLAGS_pactree_combiner_threads = m_savedCombiners;
+        FLAGS_pactree_workers_per_group = m_savedWorkers;
+    }
+
+    void Run(int combiners, int workersPerGroup, bool sequential) {
+        FLAGS_pactree_combiner_threads = combiners;
+        FLAGS_pactree_workers_per_group = workersPerGroup;
+        // 每次都从空的内存池开始
+        g_dir_config = std::make_shared<NVMDB::DirectoryConfig>(m_dir, true);
+        auto *pt = new PACTree();
+        pt->registerThread();
+
+        std::atomic<int64> next{0};
+        std::atomic<bool> onWorking{true};
+        uint64 lagSum = 0;
+        uint64 lagMax = 0;
+        uint64 samples = 0;
+        std::thread sampler([&]() {
+            while (onWorking.load(std::memory_order_relaxed)) {
+                uint64 lag = PendingOplogCount();
+                lagSum += lag;
+                lagMax = std::max(lagMax, lag);
+                samples++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < WORKERS; t++) {
+            workers.emplace_back([&]() {
+                InitThreadLocalStorage();
+                pt->registerThread();
+                RandomGenerator rnd;
+                // 顺序 key 由所有线程共同递增, 分裂总是发生在链表的尾部
+                for (int64 i = next++; i < m_keys; i = next++) {
+                    Key_t key(sequential ? static_cast<int>(i) : rnd.randomInt());
+                    pt->Insert(key, INVALID_CSN);
+                }
+                pt->unregisterThread();
+                DestroyThreadLocalStorage();
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        onWorking = false;
+        sampler.join();
+        uint64 lagAtEnd = PendingOplogCount();
+        auto catchUpStart = std::chrono::steady_clock::now();
+        while (PendingOplogCount() != 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        double catchUpMs =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - catchUpStart).count();
+        LOG(INFO) << (sequential ? "sequential" : "random") << " keys, " << combiners << " combiners, "
+                  << workersPerGroup << " workers per group: " << m_keys / seconds / 1000000 << " M inserts/s, "
+                  << "pending oplogs avg " << (samples == 0 ? 0 : lagSum / samples) << " max " << lagMax
+                  << ", " << lagAtEnd << " left after load caught up in " << catchUpMs << " ms";
+
+        pt->unregisterThread();
+        delete pt;
+        for (const auto &it : g_dir_config->getDirPaths()) {
+            std::experimental::filesystem::remove_all(it);
+        }
+    }
+
+    const std::string m_dir = "/mnt/pmem0/bench;/mnt/pmem1/bench";
+    int64 m_keys = 0;
+    int32 m_savedCombiners = 1;
+    int32 m_savedWorkers = 1;
+};
+
+TEST_F(PACTreeOplogBench, InsertAndLag) {
+    for (bool sequential : {true, false}) {
+        for (auto config : {std::make_pair(1, 1), std::make_pair(2, 1), std::make_pair(2, 2), std::make_pair(4, 4)}) {
+            Run(config.first, config.second, sequential);
+        }
+    }
+}
@@ -172,6 +172,7 @@ public:
     }
 
     void Run() {
+        ResetPersistStats();
         if (type == SPINLOCK_TYPE) {
             locks = new RowIdMapEntry[accounts];
             memset((char *)locks, 0, sizeof(RowIdMapEntry) * accounts);
@@ -213,6 +214,9 @@ public:
         LOG(INFO) << "Finish test, total commit " << total_commit << " (" <<
             total_commit * 1.0 / runTime / 1000000 << " MQPS) total abort " <<
             total_abort << " (" << total_abort * 1.0 / runTime / 1000000 << " MQPS)";
+        if (PersistStatsEnabled()) {
+            LOG(INFO) << "NVM writes:\n" << PersistStatsReport(total_commit);
+        }
     }
 };
 
@@ -1,5 +1,6 @@
 #include "tpcc.h"
 #include "nvm_init.h"
+#include "nvm_catalog.h"
 #include "nvm_access.h"
 #include "nvmdb_thread.h"
 #include "index/index_test.h"
@@ -7,20 +8,39 @@
 #include <gtest/gtest.h>
 #include <x86intrin.h>
 #include <getopt.h>
+#include <sstream>
 #include <thread>
 #include <unordered_set>
+#include <experimental/filesystem>
 
 #define  TPCC_OP_ONLY
 
 namespace NVMDB {
 namespace TPCC {
 
-/* hardwired. */
-#ifdef NDEBUG
-static const uint32_t Heap_SegHead[] = {2, 258, 514, 770, 1026, 1282, 1538, 1794, 2050};
-#else
-static const uint32_t Heap_SegHead[] = {2, 258, 514, 770, 2560, 2816, 3072, 3328, 3584};
-#endif
+/* table names in catalog, indexed by TABLE_OFFSET. */
+static const char *TableNames[TABLE_NUM] = {"warehouse", "district",  "stock",      "item",   "customer",
+                                            "orders",    "new_order", "order_line", "history"};
+
+/*
+ * NVMDB_TPCC_HASH_INDEXES: 逗号分隔的表名, 这些表的主键索引使用哈希索引 (IndexType::HASH), 例如
+ * "warehouse,district,stock,item,customer". orders, new_order 和 order_line 需要范围扫描, 不能使用哈希索引.
+ * 重启 (-T 1/2) 时要和建库时的设置相同
+ */
+static IndexType PrimaryIndexType(uint32_t offset) {
+    std::string tables = gflags::StringFromEnv("NVMDB_TPCC_HASH_INDEXES", "");
+    std::stringstream ss(tables);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name == TableNames[offset]) {
+            CHECK(offset != TABLE_OFFSET(TABLE_ORDER) && offset != TABLE_OFFSET(TABLE_NEWORDER) &&
+                  offset != TABLE_OFFSET(TABLE_ORDERLINE))
+                << name << " needs range scans";
+            return IndexType::HASH;
+        }
+    }
+    return IndexType::PACTREE;
+}
 
 static struct option opts[] = {
     {"help", no_argument, nullptr, 'h'},           {"threads", required_argument, nullptr, 't'},
@@ -160,16 +180,22 @@ public:
         }
         idxs = new NVMIndex *[TABLE_NUM];
         tables = new Table *[TABLE_NUM];
+        /* tables are created in / reopened from the catalog, owned by it. */
+        InitThreadLocalVariables();
+        Transaction *tx = GetCurrentTxContext();
+        tx->Begin();
         for (uint32_t i = 0; i < TABLE_NUM; i++) {
             uint32_t table_type = TABLE_FIRST + i;
-            idxs[i] = new NVMIndex(table_type);
-            tables[i] = new Table(table_type, TABLE_ROW_LEN(table_type));
+            idxs[i] = new NVMIndex(table_type, PrimaryIndexType(i));
             if (is_init) {
-                tables[i]->CreateSegment();
+                tables[i] = CatalogCreateTable(tx, TableNames[i], table_type, TableDescArr[i]);
             } else {
-                tables[i]->Mount(Heap_SegHead[i]);
+                tables[i] = CatalogOpenTable(tx, TableNames[i]);
             }
+            CHECK(tables[i] != nullptr) << TableNames[i];
         }
+        tx->Commit();
+        DestroyThreadLocalVariables();
         cus_sec_idx = new NVMIndex(SECOND_INDEX(TABLE_CUSTOMER));
         ord_sec_idx = new NVMIndex(SECOND_INDEX(TABLE_ORDER));
     }
@@ -178,7 +204,6 @@ public:
         delete ord_sec_idx;
         delete cus_sec_idx;
         for (uint32_t i = 0; i < TABLE_NUM; i++) {
-            delete tables[i];
             delete idxs[i];
         }
         delete[] tables;
@@ -1966,9 +1991,13 @@ public:
             LOG(INFO) << "Warming up (10 sec).";
             statusFunc(10);
             LOG(INFO) << "Start TPC-C Benchmark.";
+            ResetPersistStats();
             statusFunc(l_runTime);
             LOG(INFO) << "Final results.";
             printTpccStat();
+            if (PersistStatsEnabled()) {
+                printf("NVM writes:\n%s\n", PersistStatsReport(getRunStat().nTotalCommitted_).c_str());
+            }
             on_working = false;
             for (int i = 0; i < workers; i++) {
                 worker_tids[i].join();
@@ -1997,6 +2026,55 @@ TEST_F(TPCCTest, TPCCTestMain) {
     bench.RunBench();
     bench.EndBench();
 }
+
+// 对比按原始行长和按 XPLine 对齐存储 TPC-C 各表时, 每次持久化一行写到介质的 XPLine 数和空间开销
+TEST_F(TPCCTest, TuplePlacement) {
+    InitTableDesc();
+    g_dir_config = std::make_shared<DirectoryConfig>("/mnt/pmem0/placement", true);
+    InitGlobalThreadStorageMgr();
+    InitThreadLocalStorage();
+    auto *space = new TableSpace(g_dir_config);
+    space->create();
+    const auto savedPadding = FLAGS_heap_slot_max_padding;
+    const bool savedStats = PersistStatsEnabled();
+    SetPersistStatsEnabled(true);
+    const RowId rows = 100000;
+    printf("%-12s %8s %8s %12s %8s %12s %10s\n", "table", "tuple", "raw", "XPLines/row", "aligned", "XPLines/row",
+           "space");
+    for (uint32 i = 0; i < TABLE_NUM; i++) {
+        const uint32 tupleLen = NVMTupleHeadSize + TableDescArr[i].row_len;
+        uint32 slotLen[2];
+        double xplines[2];
+        for (int aligned = 0; aligned < 2; aligned++) {
+            FLAGS_heap_slot_max_padding = aligned ? savedPadding : 0;
+            RowIDMgr mgr(space, space->allocNewExtent(EXT_SIZE_2M), TableDescArr[i].row_len);
+            slotLen[aligned] = mgr.getSlotLen();
+            // 先分配好页, 只统计写行的开销
+            for (RowId rowId = 0; rowId < rows; rowId++) {
+                mgr.getNVMTupleByRowId(rowId, true);
+            }
+            ResetPersistStats();
+            {
+                PersistTagScope tag(PersistTag::HEAP);
+                for (RowId rowId = 0; rowId < rows; rowId++) {
+                    NVMPersist(mgr.getNVMTupleByRowId(rowId, false), tupleLen);
+                }
+            }
+            xplines[aligned] =
+                (double)CollectPersistStats()[static_cast<size_t>(PersistTag::HEAP)].m_xplines / (double)rows;
+        }
+        printf("%-12s %8u %8u %12.3f %8u %12.3f %9.1f%%\n", TableNames[i], tupleLen, slotLen[0], xplines[0],
+               slotLen[1], xplines[1], 100.0 * (slotLen[1] - slotLen[0]) / slotLen[0]);
+        ASSERT_LE(xplines[1], xplines[0]);
+    }
+    SetPersistStatsEnabled(savedStats);
+    FLAGS_heap_slot_max_padding = savedPadding;
+    space->unmount();
+    DestroyThreadLocalStorage();
+    for (const auto &it : g_dir_config->getDirPaths()) {
+        std::experimental::filesystem::remove_all(it);
+    }
+}
 // backup
 // cp -r /mnt/pmem0/bench2 /mnt/pmem0/bench3& cp -r /mnt/pmem1/bench2 /mnt/pmem1/bench3& cp -r /mnt/pmem2/bench2 /mnt/pmem2/bench3& cp -r /mnt/pmem3/bench2 /mnt/pmem3/bench3
 // restore
@@ -0,0 +1,117 @@
+#include "nvm_init.h"
+#include "nvm_access.h"
+#include "nvmdb_thread.h"
+#include "undo/nvm_undo_segment.h"
+#include "common/test_declare.h"
+#include "common/latency_stat.h"
+#include "random_generator.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace NVMDB;
+
+/*
+ * 回收线程打洞对前台事务尾延迟的影响:
+ * 多个线程持续更新一个大字段, 产生大量 undo, 分别在关闭和开启打洞时统计事务延迟的 p50/p99/p99.9.
+ */
+class UndoPunchBench : public ::testing::Test {
+protected:
+    static constexpr int ACCOUNTS = 100000;
+    static constexpr int WORKERS = 32;
+    static constexpr int DURATION_SEC = 20;
+    using Stat = LatencyStat<4096, 1>;
+
+    void SetUp() override {
+        InitColumnDesc(m_colDesc, 2, m_rowLen);
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+        m_table = new Table(0, m_rowLen);
+        m_table->CreateSegment();
+
+        RAMTuple tuple(m_colDesc, m_rowLen);
+        int balance = 0;
+        tuple.SetCol(0, (char *)&balance);
+        Transaction *tx = GetCurrentTxContext();
+        for (int i = 0; i < ACCOUNTS; i++) {
+            tx->Begin();
+            HeapInsert(tx, m_table, &tuple);
+            tx->Commit();
+        }
+    }
+
+    void TearDown() override {
+        delete m_table;
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+    }
+
+    void UpdateFunc(Stat *stat, uint64 *commit) {
+        InitThreadLocalVariables();
+        RandomGenerator rnd;
+        RAMTuple tuple(m_colDesc, m_rowLen);
+        char payload[256];
+        auto tx = GetCurrentTxContext();
+        while (m_onWorking.load(std::memory_order_relaxed)) {
+            auto rowId = (RowId)(rnd.Next() % ACCOUNTS);
+            TestTimer timer;
+            tx->Begin();
+            HamStatus status = HeapRead(tx, m_table, rowId, &tuple);
+            DCHECK(status == HamStatus::OK);
+            memset(payload, (int)(rowId & 0x7F), sizeof(payload));
+            tuple.UpdateCol(1, payload);
+            status = HeapUpdate(tx, m_table, rowId, &tuple);
+            if (status != HamStatus::OK) {
+                tx->Abort();
+                continue;
+            }
+            tx->Commit();
+            stat->insert(timer.getDurationUs());
+            (*commit)++;
+        }
+        DestroyThreadLocalVariables();
+    }
+
+    void RunAndReport(bool punch) {
+        FLAGS_undo_punch_hole = punch;
+        auto *stats = makeAlignedArray<Stat>(WORKERS);
+        std::vector<uint64> commits(WORKERS, 0);
+        auto punchedBefore = GetUndoBytesPunched();
+        m_onWorking = true;
+        std::vector<std::thread> workers;
+        for (int i = 0; i < WORKERS; i++) {
+            workers.emplace_back(&UndoPunchBench::UpdateFunc, this, stats + i, &commits[i]);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(DURATION_SEC));
+        m_onWorking = false;
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        Stat total;
+        Stat::sumUp(total, stats, WORKERS);
+        uint64 totalCommit = 0;
+        for (auto commit : commits) {
+            totalCommit += commit;
+        }
+        LOG(INFO) << "punch hole: " << (punch ? "on" : "off") << ", throughput: "
+                  << totalCommit * 1.0 / DURATION_SEC / 1000000 << " MQPS, avg: " << total.avg()
+                  << " us, p50: " << total.percentile(50) << " us, p99: " << total.percentile(99)
+                  << " us, p99.9: " << total.permille(999) << " us, punched: "
+                  << (GetUndoBytesPunched() - punchedBefore) / 1024 / 1024 << " MB";
+        deleteAlignedArray(stats, WORKERS);
+    }
+
+    std::string m_dir = "/mnt/pmem0/undo_punch;/mnt/pmem1/undo_punch";
+    ColumnDesc m_colDesc[2] = {InitColDesc(COL_TYPE_INT), InitVarColDesc(COL_TYPE_VARCHAR, 256)};
+    uint64 m_rowLen = 0;
+    Table *m_table = nullptr;
+    std::atomic<bool> m_onWorking {false};
+};
+
+TEST_F(UndoPunchBench, TailLatencyWithoutPunch) {
+    RunAndReport(false);
+}
+
+TEST_F(UndoPunchBench, TailLatencyWithPunch) {
+    RunAndReport(true);
+}
@@ -160,7 +160,6 @@ public:
             tableDesc.row_len += tableParam.BytePerColumn;
         }
         CHECK(tableDesc.row_len == tableParam.BytePerColumn * ColumnCount);
-        tableDesc.row_len = BestTupleLenCalculator::g_btc.getBestAlignment(tableDesc.row_len + NVMTupleHeadSize) - NVMTupleHeadSize;
         m_table = std::make_unique<Table>(YcsbTableId, tableDesc);
         if (isInit) {
             const uint32 tableSegHead = m_table->CreateSegment();
@@ -176,6 +175,11 @@ public:
         LOG(INFO) << "Table Check Finish.";
     }
 
+    [[nodiscard]] Table *getTable() const
+    {
+        return m_table.get();
+    }
+
     BenchResult *runBench(const YcsbRunParam &runParam)
     {
         if (runParam.SkewOpPerTxn == 0 || runParam.Theta == 0) {
@@ -57,6 +57,19 @@ public:
         txn->PrepareIndexDeleteUndo(pacKey);
         GetGlobalPACTree()->Insert(pacKey, txn->GetTxSlotLocation());  // see NVMIndex::Delete()
     }
+    // see NVMIndex::Lookup(), 不构造结果数组, 只取第一个没有被删除的 RowId
+    static RowId Lookup(RowId pKey, Transaction *txn)
+    {
+        Key_t kb;
+        Key_t ke;
+        Key_t key;
+        encode(kb, pKey, 0);
+        encode(ke, pKey, 0xffffffff);
+        if (!IndexLookupVisible(GetTreeById(PACTREE_DEFAULT_TREE), txn, kb, ke, &key)) {
+            return InvalidRowId;
+        }
+        return decode(key, pKey);
+    }
     static void Get(RowId pKey, Transaction *txn, std::vector<RowId> &rids)
     {
         // see NVMIndex::GenerateIter()
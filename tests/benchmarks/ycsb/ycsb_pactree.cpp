@@ -36,10 +36,9 @@ public:
 private:
     RowId getRowId(Transaction *txn, RowId key) const
     {
-        std::vector<RowId> rids;
-        PacTreeIndex::Get(key, txn, rids);
-        CHECK(rids.size() == 1);
-        return rids.front();
+        RowId rowId = PacTreeIndex::Lookup(key, txn);
+        CHECK(rowId != InvalidRowId);
+        return rowId;
     }
 };
 using PacTreeYcsbTable = YcsbTable<PacTreeYcsbDB>;
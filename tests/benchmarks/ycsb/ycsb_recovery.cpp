@@ -0,0 +1,119 @@
+#include "ycsb.h"
+#include "ycsb_def.h"
+#include "common/nvm_types.h"
+#include "heap/nvm_tuple.h"
+#include "nvm_access.h"
+#include "nvm_init.h"
+#include "nvm_table.h"
+#include "transaction/nvm_transaction.h"
+#include "undo/nvm_undo_segment.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <thread>
+namespace NVMDB {
+namespace YCSB {
+namespace Recovery {
+class RecoveryYcsbDB {
+public:
+    void read(Transaction *txn, Table *table, RowId key, RAMTuple *tuple) const
+    {
+        CHECK(HeapRead(txn, table, key, tuple) == HamStatus::OK) << key;
+    }
+    bool write(Transaction *txn, Table *table, RowId key, RAMTuple *tuple, ColumnIdx colIdx, char *colValue) const
+    {
+        tuple->UpdateCol(colIdx, colValue);
+        return HeapUpdate2(txn, table, key, tuple) == HamStatus::OK;
+    }
+    RowId insert(Transaction *txn, Table *table, RAMTuple *tuple) const
+    {
+        return HeapInsert(txn, table, tuple);
+    }
+};
+using RecoveryYcsbTable = YcsbTable<RecoveryYcsbDB>;
+
+constexpr size_t CrashTerminal = 48;        // 崩溃时正在执行的事务数
+constexpr size_t CrashWritePerTxn = 10000;  // 每个未提交事务写的行数
+
+/*
+ * 崩溃注入: CrashTerminal 个线程各自开启一个事务, 写 CrashWritePerTxn 行后不提交直接退出,
+ * 对应的 tx slot 停留在 IN_PROGRESS, 与进程崩溃时 NVM 上的状态一致.
+ * 之后重启, 统计不同恢复线程数下后台 undo 恢复完成的时间.
+ */
+class YcsbRecoveryTest : public testing::Test {
+protected:
+    static void SetUpTestSuite()
+    {
+        InitDB(dirConfig);
+        ycsbTable = std::make_unique<RecoveryYcsbTable>(tableParam, true);
+    }
+    static void TearDownTestSuite()
+    {
+        ycsbTable = nullptr;
+        ExitDBProcess();
+    }
+
+    static void InjectCrash()
+    {
+        Table *table = ycsbTable->getTable();
+        const size_t rowsPerThread = tableParam.Items / CrashTerminal;
+        std::vector<std::thread> workers;
+        workers.reserve(CrashTerminal);
+        for (size_t threadId = 0; threadId < CrashTerminal; threadId++) {
+            workers.emplace_back([table, threadId, rowsPerThread] {
+                RecoveryYcsbDB db{};
+                InitThreadLocalVariables();
+                Transaction *txn = GetCurrentTxContext();
+                RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+                std::array<char, MaxColumnSize> colValue{};
+                colValue.fill(static_cast<char>(threadId));
+                txn->Begin();
+                // 每个线程写不相交的行, 避免写冲突
+                const RowId begin = threadId * rowsPerThread;
+                for (size_t i = 0; i < std::min(rowsPerThread, CrashWritePerTxn); i++) {
+                    db.read(txn, table, begin + i, &tuple);
+                    CHECK(db.write(txn, table, begin + i, &tuple, i % ColumnCount, colValue.data()));
+                }
+                // 不提交, 直接退出
+                DestroyThreadLocalVariables();
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    static void CrashAndRecover(int recoveryThreads)
+    {
+        InjectCrash();
+        ycsbTable = nullptr;
+        ExitDBProcess();
+
+        FLAGS_undo_recovery_threads = recoveryThreads;
+        TestTimer timer;
+        BootStrap(dirConfig);
+        WaitUndoRecovery();
+        const auto duration = timer.getDurationUs();
+        LOG(INFO) << "Recovery threads: " << recoveryThreads << ", time to recovered: " << duration << " us, "
+                  << CrashTerminal * CrashWritePerTxn * 1.0 / duration << " M rows/s";
+        // 检查表完整性
+        ycsbTable = std::make_unique<RecoveryYcsbTable>(tableParam, false);
+    }
+
+    static std::unique_ptr<RecoveryYcsbTable> ycsbTable;
+    static const std::string dirConfig;
+    static const YcsbTableParam tableParam;
+};
+std::unique_ptr<RecoveryYcsbTable> YcsbRecoveryTest::ycsbTable{nullptr};
+const std::string YcsbRecoveryTest::dirConfig = genTestDir<2>("ycsb_recovery");
+const YcsbTableParam YcsbRecoveryTest::tableParam = YcsbTableParam(100, 4800000);
+}  // namespace Recovery
+}  // namespace YCSB
+}  // namespace NVMDB
+using NVMDB::YCSB::Recovery::YcsbRecoveryTest;
+
+TEST_F(YcsbRecoveryTest, TimeToRecovered)
+{
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        CrashAndRecover(threads);
+    }
+}
@@ -0,0 +1,366 @@
+#include "nvm_init.h"
+#include "nvm_catalog.h"
+#include "nvm_access.h"
+#include "nvmdb_thread.h"
+#include "undo/nvm_undo_segment.h"
+#include "heap/nvm_heap.h"
+#include "common/test_declare.h"
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace NVMDB;
+
+namespace {
+constexpr uint32 COL_COUNT = 3;
+constexpr int ROW_COUNT = 100;
+}  // namespace
+
+class CatalogTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        InitColumnDesc(m_colDesc, COL_COUNT, m_rowLen);
+        errno_t ret = strcpy_s(m_colDesc[0].m_colName, NVM_MAX_COLUMN_NAME_LEN, "w_id");
+        SecureRetCheck(ret);
+        ret = strcpy_s(m_colDesc[1].m_colName, NVM_MAX_COLUMN_NAME_LEN, "w_ytd");
+        SecureRetCheck(ret);
+        ret = strcpy_s(m_colDesc[2].m_colName, NVM_MAX_COLUMN_NAME_LEN, "w_name");
+        SecureRetCheck(ret);
+        m_colDesc[0].m_isNotNull = true;
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+    }
+
+    void TearDown() override {
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+    }
+
+    // 建表并写入 ROW_COUNT 行, 第 i 行的 w_id 为 i
+    Table *CreateTable(Transaction *tx, const char *name, TableId tid, std::vector<RowId> *rowIds) {
+        TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+        Table *table = CatalogCreateTable(tx, name, tid, desc);
+        if (table == nullptr) {
+            return nullptr;
+        }
+        // 主键是包含 w_ytd 的覆盖索引
+        IndexColumnDesc pkDesc[] = {{0}};
+        IndexColumnDesc pkInclude[] = {{1}};
+        CatalogCreateIndex(tx, table, tid, pkDesc, 1, pkInclude, 1);
+        IndexColumnDesc skDesc[] = {{2}, {0}};
+        CatalogCreateIndex(tx, table, tid + 100, skDesc, 2);
+        RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+        for (int i = 0; i < ROW_COUNT; i++) {
+            tuple.SetCol(0, (char *)&i);
+            RowId rowId = HeapInsert(tx, table, &tuple);
+            if (rowIds != nullptr) {
+                rowIds->push_back(rowId);
+            }
+        }
+        return table;
+    }
+
+    // 所有目录的水位线之和
+    static uint64 UsedPages() {
+        uint64 pages = 0;
+        for (uint32 i = 0; i < g_dir_config->size(); i++) {
+            pages += g_heapSpace->getUsedPageCount(i);
+        }
+        return pages;
+    }
+
+    void CheckTable(Table *table, TableId tid, const std::vector<RowId> &rowIds) {
+        ASSERT_NE(table, nullptr);
+        ASSERT_EQ(table->Id(), tid);
+        ASSERT_EQ(table->GetRowLen(), m_rowLen);
+        ASSERT_EQ(table->GetColCount(), COL_COUNT);
+        for (uint32 i = 0; i < COL_COUNT; i++) {
+            const ColumnDesc *col = table->GetColDesc(i);
+            ASSERT_EQ(col->m_colType, m_colDesc[i].m_colType);
+            ASSERT_EQ(col->m_colLen, m_colDesc[i].m_colLen);
+            ASSERT_EQ(col->m_colOffset, m_colDesc[i].m_colOffset);
+            ASSERT_EQ(col->m_isNotNull, m_colDesc[i].m_isNotNull);
+            ASSERT_STREQ(col->m_colName, m_colDesc[i].m_colName);
+        }
+        ASSERT_EQ(table->GetColIdByName("w_name"), 2U);
+
+        ASSERT_EQ(table->GetIndexCount(), 2U);
+        NVMIndex *pk = table->GetIndex(0);
+        NVMIndex *sk = table->GetIndex(1);
+        if (pk->Id() != tid) {
+            std::swap(pk, sk);
+        }
+        ASSERT_EQ(pk->Id(), tid);
+        ASSERT_EQ(pk->GetColCount(), 1U);
+        ASSERT_EQ(pk->GetRowLen(), m_colDesc[0].m_colLen);
+        ASSERT_TRUE(pk->IsFieldPresent(0));
+        ASSERT_FALSE(pk->IsFieldPresent(1));
+        ASSERT_TRUE(pk->IsCovering());
+        ASSERT_EQ(pk->KeySuffixLen(), sizeof(uint64) + m_colDesc[1].m_colLen);
+        ASSERT_FALSE(sk->IsCovering());
+        ASSERT_EQ(sk->Id(), tid + 100);
+        ASSERT_EQ(sk->GetColCount(), 2U);
+        ASSERT_EQ(sk->GetIndexDesc()[0].m_colId, 2U);
+        ASSERT_EQ(sk->GetIndexDesc()[1].m_colOffset, m_colDesc[2].m_colLen);
+
+        Transaction *tx = GetCurrentTxContext();
+        RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+        tx->Begin();
+        for (int i = 0; i < ROW_COUNT; i++) {
+            ASSERT_EQ(HeapRead(tx, table, rowIds[i], &tuple), HamStatus::OK);
+            ASSERT_TRUE(tuple.ColEqual(0, (char *)&i));
+        }
+        tx->Commit();
+    }
+
+    const std::string m_dir = "/mnt/pmem0/catalog;/mnt/pmem1/catalog";
+    ColumnDesc m_colDesc[COL_COUNT] = {InitColDesc(COL_TYPE_INT), InitColDesc(COL_TYPE_DOUBLE),
+                                       InitVarColDesc(COL_TYPE_VARCHAR, 16)};
+    uint64 m_rowLen = 0;
+};
+
+TEST_F(CatalogTest, CreateAndOpenTest) {
+    Transaction *tx = GetCurrentTxContext();
+    std::vector<RowId> rowIds;
+    tx->Begin();
+    Table *table = CreateTable(tx, "warehouse", 1, &rowIds);
+    ASSERT_NE(table, nullptr);
+    // 同名的表对当前事务可见
+    TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+    ASSERT_EQ(CatalogCreateTable(tx, "warehouse", 2, desc), nullptr);
+    ASSERT_EQ(CatalogOpenTable(tx, "warehouse"), table);
+    tx->Commit();
+    CheckTable(table, 1, rowIds);
+
+    tx->Begin();
+    ASSERT_EQ(CatalogOpenTable(tx, "district"), nullptr);
+    ASSERT_TRUE(CatalogDropTable(tx, "warehouse"));
+    ASSERT_EQ(CatalogOpenTable(tx, "warehouse"), nullptr);
+    tx->Abort();
+
+    tx->Begin();
+    ASSERT_EQ(CatalogOpenTable(tx, "warehouse"), table);
+    tx->Commit();
+}
+
+TEST_F(CatalogTest, CrashAndReopenTest) {
+    Transaction *tx = GetCurrentTxContext();
+    std::vector<RowId> warehouseRows;
+    std::vector<RowId> districtRows;
+    tx->Begin();
+    ASSERT_NE(CreateTable(tx, "warehouse", 1, &warehouseRows), nullptr);
+    ASSERT_NE(CreateTable(tx, "district", 2, &districtRows), nullptr);
+    tx->Commit();
+
+    /* 回滚的建表和删表 */
+    tx->Begin();
+    ASSERT_NE(CreateTable(tx, "aborted", 3, nullptr), nullptr);
+    tx->Abort();
+    tx->Begin();
+    ASSERT_TRUE(CatalogDropTable(tx, "district"));
+    tx->Abort();
+
+    /* 模拟崩溃: 建表和删表的事务没有提交也没有回滚 */
+    tx->Begin();
+    ASSERT_NE(CreateTable(tx, "crashed", 4, nullptr), nullptr);
+    ASSERT_TRUE(CatalogDropTable(tx, "warehouse"));
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+
+    BootStrap(m_dir);
+    InitThreadLocalVariables();
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    Table *warehouse = CatalogOpenTable(tx, "warehouse");
+    Table *district = CatalogOpenTable(tx, "district");
+    ASSERT_EQ(CatalogOpenTable(tx, "aborted"), nullptr);
+    ASSERT_EQ(CatalogOpenTable(tx, "crashed"), nullptr);
+    tx->Commit();
+    CheckTable(warehouse, 1, warehouseRows);
+    CheckTable(district, 2, districtRows);
+    WaitUndoRecovery();
+
+    /* 重启后打开的表可以继续写入, 再次重启后依然可见 */
+    tx->Begin();
+    RAMTuple tuple(warehouse->GetColDesc(), warehouse->GetRowLen());
+    int value = ROW_COUNT;
+    tuple.SetCol(0, (char *)&value);
+    RowId rowId = HeapInsert(tx, warehouse, &tuple);
+    tx->Commit();
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+
+    BootStrap(m_dir);
+    InitThreadLocalVariables();
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    warehouse = CatalogOpenTable(tx, "warehouse");
+    ASSERT_NE(warehouse, nullptr);
+    ASSERT_EQ(HeapRead(tx, warehouse, rowId, &tuple), HamStatus::OK);
+    ASSERT_TRUE(tuple.ColEqual(0, (char *)&value));
+    tx->Commit();
+}
+
+/* 并发的事务不能创建同名的表和同 id 的索引, 创建者回滚之后可以创建 */
+TEST_F(CatalogTest, ConcurrentCreateTest) {
+    Transaction *tx = GetCurrentTxContext();
+    tx->Begin();
+    ASSERT_NE(CreateTable(tx, "warehouse", 1, nullptr), nullptr);
+    TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+    std::thread([&]() {
+        InitThreadLocalVariables();
+        Transaction *other = GetCurrentTxContext();
+        other->Begin();
+        ASSERT_EQ(CatalogCreateTable(other, "warehouse", 2, desc), nullptr);
+        Table *table = CatalogCreateTable(other, "district", 2, desc);
+        ASSERT_NE(table, nullptr);
+        IndexColumnDesc pkDesc[] = {{0}};
+        ASSERT_EQ(CatalogCreateIndex(other, table, 1, pkDesc, 1), nullptr);
+        ASSERT_NE(CatalogCreateIndex(other, table, 2, pkDesc, 1), nullptr);
+        other->Commit();
+        DestroyThreadLocalVariables();
+    }).join();
+    tx->Abort();
+
+    std::thread([&]() {
+        InitThreadLocalVariables();
+        Transaction *other = GetCurrentTxContext();
+        other->Begin();
+        ASSERT_NE(CreateTable(other, "warehouse", 1, nullptr), nullptr);
+        other->Commit();
+        DestroyThreadLocalVariables();
+    }).join();
+    tx->Begin();
+    Table *warehouse = CatalogOpenTable(tx, "warehouse");
+    ASSERT_NE(warehouse, nullptr);
+    ASSERT_EQ(warehouse->GetIndexCount(), 2U);
+    ASSERT_EQ(CatalogCreateTable(tx, "district", 3, desc), nullptr);
+    tx->Commit();
+}
+
+/* 回滚和崩溃的建表回收 segment, 回滚的建索引从表中移除 */
+TEST_F(CatalogTest, AbortCreateReclaimTest) {
+    Transaction *tx = GetCurrentTxContext();
+    TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+    IndexColumnDesc pkDesc[] = {{0}};
+    tx->Begin();
+    ASSERT_NE(CatalogCreateIndex(tx, CatalogCreateTable(tx, "aborted", 1, desc), 1, pkDesc, 1), nullptr);
+    tx->Abort();
+    uint64 usedPages = UsedPages();
+    for (int i = 0; i < 5; i++) {
+        tx->Begin();
+        ASSERT_NE(CatalogCreateIndex(tx, CatalogCreateTable(tx, "aborted", 1, desc), 1, pkDesc, 1), nullptr);
+        tx->Abort();
+        ASSERT_EQ(UsedPages(), usedPages);
+    }
+
+    tx->Begin();
+    Table *table = CatalogCreateTable(tx, "warehouse", 2, desc);
+    ASSERT_NE(table, nullptr);
+    tx->Commit();
+    tx->Begin();
+    ASSERT_NE(CatalogCreateIndex(tx, table, 2, pkDesc, 1), nullptr);
+    ASSERT_EQ(table->GetIndexCount(), 1U);
+    tx->Abort();
+    ASSERT_EQ(table->GetIndexCount(), 0U);
+    tx->Begin();
+    ASSERT_NE(CatalogCreateIndex(tx, table, 2, pkDesc, 1), nullptr);
+    tx->Commit();
+
+    /* 模拟崩溃: 建表的事务没有提交也没有回滚, 恢复后 segment 被回收 */
+    tx->Begin();
+    ASSERT_NE(CatalogCreateIndex(tx, CatalogCreateTable(tx, "crashed", 3, desc), 3, pkDesc, 1), nullptr);
+    usedPages = UsedPages();
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+    BootStrap(m_dir);
+    InitThreadLocalVariables();
+    WaitUndoRecovery();
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    ASSERT_EQ(CatalogOpenTable(tx, "crashed"), nullptr);
+    ASSERT_NE(CatalogCreateIndex(tx, CatalogCreateTable(tx, "crashed", 3, desc), 3, pkDesc, 1), nullptr);
+    tx->Commit();
+    // 挂载时归还的预留可能回退水位线
+    ASSERT_LE(UsedPages(), usedPages);
+}
+
+/* 删表提交之后回收 segment 和索引, 回收之前 index id 不能再使用; 没有回收的表在重启时回收 */
+TEST_F(CatalogTest, DropAndPurgeTest) {
+    Transaction *tx = GetCurrentTxContext();
+    TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+    IndexColumnDesc pkDesc[] = {{0}};
+    tx->Begin();
+    ASSERT_NE(CreateTable(tx, "warehouse", 1, nullptr), nullptr);
+    Table *district = CatalogCreateTable(tx, "district", 2, desc);
+    ASSERT_NE(district, nullptr);
+    tx->Commit();
+    uint64 usedPages = UsedPages();
+
+    tx->Begin();
+    ASSERT_TRUE(CatalogDropTable(tx, "warehouse"));
+    tx->Commit();
+    tx->Begin();
+    ASSERT_EQ(CatalogCreateIndex(tx, district, 1, pkDesc, 1), nullptr);
+    tx->Commit();
+    ASSERT_EQ(CatalogPurgeDroppedTables(), 1U);
+    ASSERT_EQ(CatalogPurgeDroppedTables(), 0U);
+    tx->Begin();
+    ASSERT_NE(CatalogCreateIndex(tx, district, 1, pkDesc, 1), nullptr);
+    ASSERT_NE(CreateTable(tx, "warehouse", 3, nullptr), nullptr);
+    tx->Commit();
+    ASSERT_EQ(UsedPages(), usedPages);
+
+    /* 模拟崩溃: 删表的事务提交之后没有回收 */
+    tx->Begin();
+    ASSERT_TRUE(CatalogDropTable(tx, "warehouse"));
+    tx->Commit();
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+    BootStrap(m_dir);
+    InitThreadLocalVariables();
+    ASSERT_EQ(CatalogPurgeDroppedTables(), 0U);
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    ASSERT_EQ(CatalogOpenTable(tx, "warehouse"), nullptr);
+    ASSERT_NE(CreateTable(tx, "warehouse", 3, nullptr), nullptr);
+    tx->Commit();
+    // 挂载时归还的预留可能回退水位线
+    ASSERT_LE(UsedPages(), usedPages);
+}
+
+/* 截断中途崩溃, 重启时打开表重新截断 */
+TEST_F(CatalogTest, TruncateResumeTest) {
+    Transaction *tx = GetCurrentTxContext();
+    std::vector<RowId> rowIds;
+    tx->Begin();
+    Table *table = CreateTable(tx, "warehouse", 1, &rowIds);
+    ASSERT_NE(table, nullptr);
+    tx->Commit();
+
+    /* 模拟崩溃: 已经登记截断, 还没有清空索引和 segment head */
+    ASSERT_THROW(g_heapSpace->truncateSegment(table->SegmentHead(), []() { throw std::runtime_error("crash"); }),
+                 std::runtime_error);
+    ASSERT_EQ(g_heapSpace->pendingTruncateSegment(), table->SegmentHead());
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+    BootStrap(m_dir);
+    InitThreadLocalVariables();
+    ASSERT_EQ(g_heapSpace->pendingTruncateSegment(), NVMInvalidPageId);
+
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    table = CatalogOpenTable(tx, "warehouse");
+    ASSERT_NE(table, nullptr);
+    RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+    for (auto rowId : rowIds) {
+        ASSERT_EQ(HeapRead(tx, table, rowId, &tuple), HamStatus::READ_ROW_NOT_USED);
+    }
+    int value = ROW_COUNT;
+    tuple.SetCol(0, (char *)&value);
+    RowId rowId = HeapInsert(tx, table, &tuple);
+    ASSERT_EQ(HeapRead(tx, table, rowId, &tuple), HamStatus::OK);
+    tx->Commit();
+}
@@ -75,6 +75,15 @@ public:
                (_mm512_sumup_epi64(totalTxnsVec) + m_overflowCnt);
     }
     int64_t percentile(size_t p = 95) const
+    {
+        return quantile(p, 100);
+    }
+    // 千分位, 例如 permille(999) 为 p99.9
+    int64_t permille(size_t p = 999) const
+    {
+        return quantile(p, 1000);
+    }
+    int64_t quantile(size_t p, size_t base) const
     {
         __m512i totalTxnsVec = _mm512_set1_epi64(0);
         for (int64_t latencyUs = 0; latencyUs < BucketNum; latencyUs += BatchSize) {
@@ -85,7 +94,7 @@ public:
         if (totalTxns == 0) {
             return 0;
         }
-        int64_t ith = totalTxns * p / 100;
+        int64_t ith = totalTxns * p / base;
         int64_t preffixTotalTxns = 0;
         for (int64_t latencyUs = 0; latencyUs < BucketNum; latencyUs++) {
             if (preffixTotalTxns <= ith && ith < preffixTotalTxns + m_data[latencyUs]) {
@@ -186,6 +186,132 @@ TEST_F(PACTreeTest, PACTreeTest) {
     delete pt;
 }
 
+/* 每种 fingerprint 比较实现都能找到已有的 key, 硬件不支持的实现不能切换 */
+TEST_F(PACTreeTest, FingerprintProbeTest) {
+    const auto saved = CurrentFingerprintProbe();
+    ASSERT_TRUE(FingerprintProbeSupported(FingerprintProbe::SCALAR));
+    ASSERT_EQ(saved, BestFingerprintProbe());
+    auto *pt = new PACTree();
+    pt->registerThread();
+    int si = 1;
+    for (auto kind : {FingerprintProbe::SCALAR, FingerprintProbe::AVX2, FingerprintProbe::AVX512}) {
+        if (!FingerprintProbeSupported(kind)) {
+            ASSERT_FALSE(SetFingerprintProbe(kind));
+            continue;
+        }
+        ASSERT_TRUE(SetFingerprintProbe(kind));
+        BasicTestUnit(pt, si, si + 1000);
+        // 之前的实现插入的 key 也都能找到
+        for (int i = 1; i < si + 1000; i++) {
+            Key_t key;
+            key.setFromString(GenerateKey(i));
+            bool found;
+            pt->lookup(key, &found);
+            ASSERT_TRUE(found);
+        }
+        si += 2000;
+    }
+    ASSERT_TRUE(SetFingerprintProbe(saved));
+    pt->unregisterThread();
+    delete pt;
+}
+
+static int ScanKeys(PACTree *pt, int si, int ei, int batch, LookupSnapshot snapshot, bool reverse, ScanCursor *cursor,
+                    std::vector<std::pair<Key_t, Val_t>> &result) {
+    Key_t start, end;
+    start.setFromString(GenerateKey(si));
+    end.setFromString(GenerateKey(ei));
+    pt->scan(start, end, batch, snapshot, reverse, result, cursor);
+    return (int)result.size();
+}
+
+/* 分批扫描时游标跨过并发的分裂, 以及游标所在节点被合并之后都能从正确的位置继续 */
+TEST_F(PACTreeTest, ScanCursorTest) {
+    auto *pt = new PACTree();
+    pt->registerThread();
+    const int numData = 4000;
+    Key_t key;
+    // 偶数 key 一直存在, 并发线程插入奇数 key 引起分裂
+    for (int i = 0; i < numData; i += 2) {
+        key.setFromString(GenerateKey(i));
+        pt->Insert(key, INVALID_CSN);
+    }
+    std::thread writer([pt]() {
+        pt->registerThread();
+        Key_t k;
+        for (int i = 1; i < numData; i += 2) {
+            k.setFromString(GenerateKey(i));
+            pt->Insert(k, INVALID_CSN);
+        }
+        pt->unregisterThread();
+    });
+    LookupSnapshot snapshot{};
+    std::vector<std::pair<Key_t, Val_t>> result;
+    for (bool reverse : {false, true}) {
+        for (int round = 0; round < 5; round++) {
+            ScanCursor cursor;
+            Key_t start, end;
+            start.setFromString(GenerateKey(0));
+            end.setFromString(GenerateKey(numData));
+            int expected = reverse ? numData - 2 : 0;
+            while (true) {
+                pt->scan(start, end, 7, snapshot, reverse, result, &cursor);
+                for (int i = 0; i < result.size(); i++) {
+                    if (i > 0) {
+                        ASSERT_TRUE(reverse ? result[i].first < result[i - 1].first
+                                            : result[i - 1].first < result[i].first);
+                    }
+                    if (expected < 0 || expected >= numData) {
+                        continue;
+                    }
+                    key.setFromString(GenerateKey(expected));
+                    if (result[i].first == key) {
+                        expected += reverse ? -2 : 2;
+                    }
+                }
+                if (result.size() < 7) {
+                    break;
+                }
+                if (reverse) {
+                    end = result.back().first;
+                } else {
+                    start = result.back().first;
+                    start.next();
+                }
+            }
+            // 所有偶数 key 都按顺序扫描到
+            ASSERT_EQ(expected, reverse ? -2 : numData);
+        }
+    }
+    writer.join();
+
+    // 游标停在前面的节点上, 之后删除并回收 [0, numData / 2), 空节点被合并
+    ScanCursor cursor;
+    ASSERT_EQ(ScanKeys(pt, 0, numData, 10, snapshot, false, &cursor, result), 10);
+    for (int i = 0; i < numData / 2; i++) {
+        key.setFromString(GenerateKey(i));
+        pt->Insert(key, MIN_TX_CSN);
+    }
+    LookupSnapshot pruneSnapshot{MIN_TX_CSN + 1, MIN_TX_CSN + 1};
+    ASSERT_EQ(ScanKeys(pt, 0, numData, numData, pruneSnapshot, false, nullptr, result), numData / 2);
+    ASSERT_EQ(ScanKeys(pt, 10, numData, 10, pruneSnapshot, false, &cursor, result), 10);
+    key.setFromString(GenerateKey(numData / 2));
+    ASSERT_TRUE(result.front().first == key);
+
+    // 逆序时同理, 游标停在最后的节点上, 之后只留下 [numData / 2, numData / 2 + 20)
+    ASSERT_EQ(ScanKeys(pt, 0, numData, 10, pruneSnapshot, true, &cursor, result), 10);
+    for (int i = numData / 2 + 20; i < numData; i++) {
+        key.setFromString(GenerateKey(i));
+        pt->Insert(key, MIN_TX_CSN);
+    }
+    ASSERT_EQ(ScanKeys(pt, 0, numData, numData, pruneSnapshot, true, nullptr, result), 20);
+    ASSERT_EQ(ScanKeys(pt, 0, numData - 10, 10, pruneSnapshot, true, &cursor, result), 10);
+    key.setFromString(GenerateKey(numData / 2 + 19));
+    ASSERT_TRUE(result.front().first == key);
+    pt->unregisterThread();
+    delete pt;
+}
+
 TEST_F(PACTreeTest, RecoveryTest) {
     auto *pt = new PACTree();
     int si = 1, ed = 1000, bp = si;
@@ -221,6 +347,32 @@ TEST_F(PACTreeTest, RecoveryTest) {
     delete pt;
 }
 
+/* ADR 下数据节点的写入和分裂的 oplog 都会刷出并用 fence 排序 */
+TEST_F(PACTreeTest, PersistWritesTest) {
+    const int keyNum = 1000;
+    auto *pt = new PACTree();
+    pt->registerThread();
+    SetPersistMode(PersistMode::ADR);
+    SetPersistStatsEnabled(true);
+    ResetPersistStats();
+    for (int i = 1; i <= keyNum; i++) {
+        Key_t key;
+        key.setFromString(GenerateKey(i));
+        pt->Insert(key, INVALID_CSN);
+    }
+    auto stats = CollectPersistStats();
+    SetPersistStatsEnabled(false);
+    const auto &index = stats[static_cast<size_t>(PersistTag::INDEX)];
+    // 每次插入至少刷出 KV item, permutation 和 currPerm, 并在切换 currPerm 前后各 fence 一次
+    ASSERT_GE(index.m_flushCalls, 3U * keyNum);
+    ASSERT_GE(index.m_fences, 2U * keyNum);
+    const auto &oplog = stats[static_cast<size_t>(PersistTag::OPLOG)];
+    ASSERT_GT(oplog.m_flushCalls, 0);
+    ASSERT_GT(oplog.m_fences, 0);
+    pt->unregisterThread();
+    delete pt;
+}
+
 static void workload(PACTree *pt, int wid, int nthreads, const volatile int *on_working) {
     pt->registerThread();
     std::vector<std::pair<Key_t, Val_t>> result;
@@ -256,6 +408,101 @@ TEST_F(PACTreeTest, ConcurrentTest) {
     delete pt;
 }
 
+// 测试中修改 combiner 和 worker 的个数, 离开作用域时恢复, 断言失败提前返回时也不影响之后的测试
+class CombinerFlagsGuard {
+public:
+    CombinerFlagsGuard(int32_t combiners, int32_t workers)
+        : m_combiners(FLAGS_pactree_combiner_threads), m_workers(FLAGS_pactree_workers_per_group) {
+        FLAGS_pactree_combiner_threads = combiners;
+        FLAGS_pactree_workers_per_group = workers;
+    }
+
+    ~CombinerFlagsGuard() {
+        FLAGS_pactree_combiner_threads = m_combiners;
+        FLAGS_pactree_workers_per_group = m_workers;
+    }
+
+private:
+    int32_t m_combiners;
+    int32_t m_workers;
+};
+
+// 每个组的 search layer 都追上了数据层: 每个 key 的 jump node 就是包含它的节点, 只有比第一个分裂 key 小的 key 没有 jump node
+static void CheckSearchLayers(PACTreeImpl *tree, int nkeys) {
+    for (int grp = 0; grp < PMem::GetPoolNum(); grp++) {
+        SearchLayer *sl = tree->GetSearchLayer(grp);
+        ASSERT_GE(sl->Size(), static_cast<uint32_t>(nkeys / MAX_ENTRIES));
+        bool jumped = false;
+        for (int i = 0; i < nkeys; i++) {
+            Key_t key(i);
+            auto *jumpNode = reinterpret_cast<ListNode *>(sl->lookup(key));
+            if (jumpNode == nullptr) {
+                ASSERT_FALSE(jumped) << "group " << grp << " key " << i;
+                continue;
+            }
+            jumped = true;
+            ASSERT_TRUE(jumpNode->CheckRange(key)) << "group " << grp << " key " << i;
+        }
+        ASSERT_TRUE(jumped);
+    }
+}
+
+/* 多个 combiner 和每组多个 worker: 并发插入后每个组的 search layer 追上数据层, 换成单个 combiner 重启后数据不变 */
+TEST_F(PACTreeTest, ShardedCombinerTest) {
+    static const uint32_t idxId = 7;
+    static const int nthreads = 4;
+    static const int nkeys = 100000;
+    {
+        CombinerFlagsGuard flags(3, 2);
+        auto *pt = new PACTree();
+        pt->registerThread();
+        PACTreeImpl *tree = pt->openIndexTree(idxId);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < nthreads; t++) {
+            workers.emplace_back([pt, tree, t]() {
+                InitThreadLocalStorage();
+                pt->registerThread();
+                for (int i = t; i < nkeys; i += nthreads) {
+                    Key_t key(i);
+                    tree->Insert(key, i);
+                }
+                pt->unregisterThread();
+                DestroyThreadLocalStorage();
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        while (PendingOplogCount() != 0) {
+            usleep(100);
+        }
+        ASSERT_EQ(PendingOplogCount(), 0U);
+        CheckSearchLayers(tree, nkeys);
+        for (int i = 0; i < nkeys; i++) {
+            bool found;
+            Key_t key(i);
+            ASSERT_EQ(tree->Lookup(key, &found), i);
+            ASSERT_TRUE(found);
+        }
+        pt->unregisterThread();
+        delete pt;
+    }
+
+    CombinerFlagsGuard flags(1, 1);
+    auto *pt = new PACTree();
+    pt->registerThread();
+    PACTreeImpl *tree = pt->openIndexTree(idxId);
+    CheckSearchLayers(tree, nkeys);
+    for (int i = 0; i < nkeys; i++) {
+        bool found;
+        Key_t key(i);
+        ASSERT_EQ(tree->Lookup(key, &found), i);
+        ASSERT_TRUE(found);
+    }
+    pt->unregisterThread();
+    delete pt;
+}
+
 TEST_F(PACTreeTest, Example) {
     const auto NUM_DATA = 1000;
     std::experimental::filesystem::remove_all(space_dir);
@@ -0,0 +1,207 @@
+#include "common/nvm_cfg.h"
+#include "common/nvm_persist.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace NVMDB;
+
+namespace {
+constexpr size_t BUFFER_SIZE = 8192;
+const CopyKernel ALL_COPY_KERNELS[] = {CopyKernel::MEMCPY, CopyKernel::SSE2, CopyKernel::AVX2, CopyKernel::AVX512};
+const FlushKernel ALL_FLUSH_KERNELS[] = {FlushKernel::NONE, FlushKernel::CLFLUSH, FlushKernel::CLFLUSHOPT,
+                                         FlushKernel::CLWB};
+}  // namespace
+
+class PersistKernelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        m_saved = g_persistKernels;
+        m_src = static_cast<char *>(aligned_alloc(64, BUFFER_SIZE));
+        m_dest = static_cast<char *>(aligned_alloc(64, BUFFER_SIZE));
+        for (size_t i = 0; i < BUFFER_SIZE; i++) {
+            m_src[i] = static_cast<char>(i * 131 + 7);
+        }
+    }
+
+    void TearDown() override {
+        g_persistKernels = m_saved;
+        free(m_src);
+        free(m_dest);
+    }
+
+    // 拷贝 [srcOff, srcOff + n) 到 dest + destOff, 检查拷贝的字节和前后没有被改写的字节
+    void CheckCopy(size_t destOff, size_t srcOff, size_t n) {
+        memset(m_dest, 0x5a, BUFFER_SIZE);
+        ASSERT_EQ(memcpy_no_flush_nt(m_dest + destOff, BUFFER_SIZE - destOff, m_src + srcOff, n), 0);
+        NVMPersist(m_dest + destOff, n);
+        for (size_t i = 0; i < BUFFER_SIZE; i++) {
+            char expected = (i >= destOff && i < destOff + n) ? m_src[srcOff + i - destOff] : 0x5a;
+            ASSERT_EQ(m_dest[i], expected) << "dest offset " << destOff << ", src offset " << srcOff
+                                           << ", len " << n << ", byte " << i;
+        }
+    }
+
+    PersistKernels m_saved{};
+    char *m_src = nullptr;
+    char *m_dest = nullptr;
+};
+
+TEST_F(PersistKernelTest, DetectTest) {
+    ASSERT_TRUE(CopyKernelSupported(CopyKernel::SSE2));
+    ASSERT_TRUE(FlushKernelSupported(FlushKernel::CLFLUSH));
+    ASSERT_TRUE(CopyKernelSupported(BestCopyKernel()));
+    ASSERT_TRUE(FlushKernelSupported(BestFlushKernel()));
+    // 默认使用最快的实现, eADR 的 NONE 需要显式指定
+    ASSERT_EQ(m_saved.m_copyKind, BestCopyKernel());
+    ASSERT_EQ(m_saved.m_flushKind, BestFlushKernel());
+    ASSERT_NE(BestFlushKernel(), FlushKernel::NONE);
+}
+
+TEST_F(PersistKernelTest, ForceEachKernelTest) {
+    const size_t lengths[] = {0, 1, 31, 63, 64, 65, 127, 200, 256, 1000, 4096, 4097};
+    const size_t offsets[] = {0, 1, 17, 63};
+    for (auto copyKind : ALL_COPY_KERNELS) {
+        for (auto flushKind : ALL_FLUSH_KERNELS) {
+            if (!CopyKernelSupported(copyKind) || !FlushKernelSupported(flushKind)) {
+                // 硬件不支持时不能切换
+                ASSERT_FALSE(SetPersistKernels(copyKind, flushKind));
+                continue;
+            }
+            ASSERT_TRUE(SetPersistKernels(copyKind, flushKind));
+            ASSERT_EQ(g_persistKernels.m_copyKind, copyKind);
+            ASSERT_EQ(g_persistKernels.m_flushKind, flushKind);
+            SCOPED_TRACE(std::string(CopyKernelName(copyKind)) + "/" + FlushKernelName(flushKind));
+            for (auto n : lengths) {
+                for (auto destOff : offsets) {
+                    for (auto srcOff : offsets) {
+                        CheckCopy(destOff, srcOff, n);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_F(PersistKernelTest, StreamCopyTest) {
+    for (auto copyKind : ALL_COPY_KERNELS) {
+        if (!SetPersistKernels(copyKind, BestFlushKernel())) {
+            continue;
+        }
+        SCOPED_TRACE(CopyKernelName(copyKind));
+        for (size_t srcOff : {0, 8, 33}) {
+            memset(m_dest, 0, BUFFER_SIZE);
+            NVMStreamCopy(m_dest, m_src + srcOff, BUFFER_SIZE - 64);
+            NVMFence();
+            ASSERT_EQ(memcmp(m_dest, m_src + srcOff, BUFFER_SIZE - 64), 0);
+            for (size_t i = BUFFER_SIZE - 64; i < BUFFER_SIZE; i++) {
+                ASSERT_EQ(m_dest[i], 0);
+            }
+        }
+    }
+}
+
+TEST_F(PersistKernelTest, PersistModeTest) {
+    SetPersistMode(PersistMode::ADR);
+    ASSERT_EQ(GetPersistMode(), PersistMode::ADR);
+    ASSERT_EQ(g_persistKernels.m_flushKind, BestFlushKernel());
+    ASSERT_TRUE(g_persistKernels.m_fence);
+    CheckCopy(17, 1, 1000);
+
+    SetPersistMode(PersistMode::EADR);
+    ASSERT_EQ(GetPersistMode(), PersistMode::EADR);
+    ASSERT_EQ(g_persistKernels.m_copyKind, BestCopyKernel());
+    ASSERT_EQ(g_persistKernels.m_flushKind, FlushKernel::NONE);
+    ASSERT_TRUE(g_persistKernels.m_fence);
+    CheckCopy(17, 1, 1000);
+
+    SetPersistMode(PersistMode::DRAM);
+    ASSERT_EQ(GetPersistMode(), PersistMode::DRAM);
+    ASSERT_EQ(g_persistKernels.m_copyKind, CopyKernel::MEMCPY);
+    ASSERT_FALSE(g_persistKernels.m_fence);
+    CheckCopy(17, 1, 1000);
+
+    FLAGS_persist_mode = "eadr";
+    InitPersistMode();
+    ASSERT_EQ(GetPersistMode(), PersistMode::EADR);
+    FLAGS_persist_mode = "adr";
+    InitPersistMode();
+    ASSERT_EQ(GetPersistMode(), PersistMode::ADR);
+}
+
+TEST_F(PersistKernelTest, NVMDelayTest) {
+    ASSERT_FALSE(g_nvmDelay.m_enabled);
+    // 每个 cache line 读 1us, 写 1us, 带宽 1000 MB/s (每字节 1ns)
+    SetNVMDelay(1000, 1000, 1000);
+    ASSERT_TRUE(g_nvmDelay.m_enabled);
+    const size_t lines = BUFFER_SIZE / 64;
+    auto begin = std::chrono::steady_clock::now();
+    NVMReadDelay(m_src, BUFFER_SIZE);
+    auto readNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+    ASSERT_GE(readNs.count(), lines * 1000);
+
+    begin = std::chrono::steady_clock::now();
+    NVMStreamCopy(m_dest, m_src, BUFFER_SIZE);
+    NVMPersist(m_dest, BUFFER_SIZE);
+    auto writeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+    ASSERT_GE(writeNs.count(), 2 * (lines * 1000 + BUFFER_SIZE));
+    ASSERT_EQ(memcmp(m_dest, m_src, BUFFER_SIZE), 0);
+
+    FLAGS_nvm_read_latency_ns = 0;
+    FLAGS_nvm_write_latency_ns = 0;
+    FLAGS_nvm_write_bandwidth_mbps = 0;
+    InitPersistMode();
+    ASSERT_FALSE(g_nvmDelay.m_enabled);
+}
+
+TEST_F(PersistKernelTest, PersistStatsTest) {
+    SetPersistStatsEnabled(true);
+    ResetPersistStats();
+    auto *buffer = static_cast<char *>(aligned_alloc(256, 1024));
+    {
+        PersistTagScope tag(PersistTag::HEAP);
+        // 同一个 fence 窗口内重复写同一个 XPLine 只计一次
+        NVMFlush(buffer, 300);
+        NVMFlush(buffer + 8, 8);
+        NVMFence();
+        NVMFlush(buffer + 8, 8);
+        {
+            PersistTagScope undoTag(PersistTag::UNDO);
+            NVMStreamCopy(buffer + 512, m_src, 256);
+            NVMFence();
+        }
+        ASSERT_EQ(t_persistTag, PersistTag::HEAP);
+    }
+    ASSERT_EQ(t_persistTag, PersistTag::OTHER);
+    // 退出的线程的统计也会被汇总
+    std::thread([buffer]() {
+        PersistTagScope tag(PersistTag::INDEX);
+        NVMWritten(buffer + 240, 24);
+    }).join();
+
+    auto stats = CollectPersistStats();
+    const auto &heap = stats[static_cast<size_t>(PersistTag::HEAP)];
+    ASSERT_EQ(heap.m_flushCalls, 3);
+    ASSERT_EQ(heap.m_flushBytes, 316);
+    ASSERT_EQ(heap.m_fences, 1);
+    ASSERT_EQ(heap.m_xplines, 3);
+    const auto &undo = stats[static_cast<size_t>(PersistTag::UNDO)];
+    ASSERT_EQ(undo.m_streamBytes, 256);
+    ASSERT_EQ(undo.m_fences, 1);
+    ASSERT_EQ(undo.m_xplines, 1);
+    const auto &index = stats[static_cast<size_t>(PersistTag::INDEX)];
+    ASSERT_EQ(index.m_storeBytes, 24);
+    ASSERT_EQ(index.m_xplines, 2);
+    ASSERT_NE(PersistStatsReport(1).find("heap"), std::string::npos);
+
+    // memcpy_no_flush_nt 的目的地址可能是 DRAM, 不计入统计
+    ASSERT_EQ(memcpy_no_flush_nt(m_dest, BUFFER_SIZE, m_src, BUFFER_SIZE), 0);
+    ResetPersistStats();
+    for (const auto &it : CollectPersistStats()) {
+        ASSERT_EQ(it.LogicalBytes(), 0);
+    }
+    SetPersistStatsEnabled(false);
+    free(buffer);
+}
@@ -42,7 +42,8 @@ inline void InitColumnDesc(ColumnDesc *const rowDes, const uint32 &colCnt, uint6
         rowDes[i].m_colOffset = offset;
         offset += rowDes[i].m_colLen;
     }
-    rowLen = BestTupleLenCalculator::g_btc.getBestAlignment(offset + NVMTupleHeadSize) - NVMTupleHeadSize;
+    // heap 在建表时按 --heap_slot_max_padding 对齐 slot 长度
+    rowLen = offset;
 }
 
 }
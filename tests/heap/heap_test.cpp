@@ -1,5 +1,6 @@
 #include "nvm_init.h"
 #include "nvm_table.h"
+#include "heap/nvm_heap.h"
 #include "transaction/nvm_transaction.h"
 #include "nvm_access.h"
 #include "nvmdb_thread.h"
@@ -152,6 +153,59 @@ TEST_F(HeapTest, BasicTest) {
     ins_set.clear();
 }
 
+/* 事务执行到一半崩溃, 重启后立即更新同一批行, 不应因崩溃事务产生冲突 */
+TEST_F(HeapTest, CrashedTxOnDemandRollBackTest) {
+    Table table(0, row_len);
+    uint32 segHead = table.CreateSegment();
+    ASSERT_EQ(NVMPageIdIsValid(segHead), true);
+
+    std::vector<RowId> rowIds;
+    Transaction *tx = GetCurrentTxContext();
+    tx->Begin();
+    for (int i = 0; i < 100; i++) {
+        RAMTuple *srcTuple = GenRow(true, i, i);
+        rowIds.push_back(HeapInsert(tx, &table, srcTuple));
+        delete srcTuple;
+    }
+    tx->Commit();
+
+    /* 更新前一半, 删除后一半, 不提交 */
+    tx->Begin();
+    RAMTuple *tuple = GenRow();
+    for (int i = 0; i < 100; i++) {
+        if (i < 50) {
+            ASSERT_EQ(UpdateRow(tx, &table, rowIds[i], tuple, -1, -1), HamStatus::OK);
+            ASSERT_EQ(UpdateRow(tx, &table, rowIds[i], tuple, -2, -2), HamStatus::OK);
+        } else {
+            ASSERT_EQ(HeapDelete(tx, &table, rowIds[i]), HamStatus::OK);
+        }
+    }
+    /* 模拟崩溃: 事务没有提交也没有回滚 */
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+    BootStrap(space_dir);
+    table.Mount(segHead);
+    InitThreadLocalVariables();
+
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(UpdateRow(tx, &table, rowIds[i], tuple, i + 1, i + 1), HamStatus::OK);
+    }
+    tx->Commit();
+    WaitUndoRecovery();
+
+    /* 后台恢复不能覆盖已经被按需回滚并重新写入的行 */
+    tx->Begin();
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(HeapRead(tx, &table, rowIds[i], tuple), HamStatus::OK);
+        ASSERT_EQ(ColEqual(tuple, 0, i + 1), true);
+        ASSERT_EQ(ColEqual(tuple, 1, i + 1), true);
+    }
+    tx->Commit();
+    delete tuple;
+}
+
 class ThreadSync {
     volatile int curr_step;
 
@@ -626,4 +680,91 @@ TEST_F(HeapTest, ConcurrentPressureTest) {
     PressureScanAll(&table, &table_cnt, cnt_rowid, success_update);
 }
 
+/* 反复建表, 插入, 清空和删除, 回收的 extent 被复用, heap 的水位线不再增长; 清空和删除之后索引项失效 */
+TEST_F(HeapTest, DropAndTruncateTest) {
+    const int LOOPS = 20;
+    const int ROWS = 200;
+    IndexColumnDesc indexDesc[] = {{0}};
+    uint64 indexLen = 0;
+    InitIndexDesc(&indexDesc[0], &TestColDesc[0], 1, indexLen);
+    const auto dirCount = g_heapSpace->getDirConfig()->size();
+    std::vector<uint32> hwm(dirCount);
+    Transaction *tx = GetCurrentTxContext();
+
+    for (int loop = 0; loop < LOOPS; loop++) {
+        Table table(loop, row_len);
+        table.CreateSegment();
+        auto *index = new NVMIndex(loop + 1);
+        table.AddIndex(index);
+        auto insertRows = [&]() {
+            std::vector<RowId> rowIds;
+            tx->Begin();
+            for (int i = 0; i < ROWS; i++) {
+                RAMTuple *tuple = GenRow(true, i, loop);
+                RowId rowId = HeapInsert(tx, &table, tuple);
+                DRAMIndexTuple key(&TestColDesc[0], &indexDesc[0], 1, indexLen);
+                key.SetCol(0, (char *)&i);
+                index->Insert(&key, rowId);
+                rowIds.push_back(rowId);
+                delete tuple;
+            }
+            tx->Commit();
+            return rowIds;
+        };
+        auto countIndexRows = [&](NVMIndex *index) {
+            int lower = 0;
+            int upper = ROWS;
+            DRAMIndexTuple begin(&TestColDesc[0], &indexDesc[0], 1, indexLen);
+            DRAMIndexTuple end(&TestColDesc[0], &indexDesc[0], 1, indexLen);
+            begin.SetCol(0, (char *)&lower);
+            end.SetCol(0, (char *)&upper);
+            tx->Begin();
+            auto *iter = index->GenerateIter(&begin, &end, tx->GetIndexLookupSnapshot(), 0, false);
+            int count = 0;
+            for (; iter->Valid(); iter->Next()) {
+                count++;
+            }
+            delete iter;
+            tx->Commit();
+            return count;
+        };
+
+        auto rowIds = insertRows();
+        ASSERT_EQ(countIndexRows(index), ROWS);
+        table.TruncateSegment();
+        ASSERT_EQ(countIndexRows(index), 0);
+        RAMTuple *tuple = GenRow();
+        tx->Begin();
+        for (auto rowId : rowIds) {
+            ASSERT_EQ(HeapRead(tx, &table, rowId, tuple), HamStatus::READ_ROW_NOT_USED);
+        }
+        tx->Commit();
+        // 清空之后可以继续插入
+        rowIds = insertRows();
+        ASSERT_EQ(countIndexRows(index), ROWS);
+        tx->Begin();
+        for (auto rowId : rowIds) {
+            ASSERT_EQ(HeapRead(tx, &table, rowId, tuple), HamStatus::OK);
+            ASSERT_TRUE(ColEqual(tuple, 1, loop));
+        }
+        tx->Commit();
+        delete tuple;
+
+        table.DropSegment();
+        ASSERT_EQ(table.SegmentHead(), NVMInvalidPageId);
+        delete index;
+        // 索引的树已经删除, 用同一个 id 重新打开是空树
+        index = new NVMIndex(loop + 1);
+        ASSERT_EQ(countIndexRows(index), 0);
+        index->Drop();
+        delete index;
+        for (uint32 i = 0; i < dirCount; i++) {
+            if (loop == 0) {
+                hwm[i] = g_heapSpace->getUsedPageCount(i);
+            }
+            ASSERT_EQ(g_heapSpace->getUsedPageCount(i), hwm[i]);
+        }
+    }
+}
+
 }  // namespace heap_test
\ No newline at end of file
@@ -92,3 +92,30 @@ TEST_F(RowIdMapTest, BasicTest) {
         worker.join();
     }
 }
+
+TEST_F(RowIdMapTest, SlotAlignmentTest) {
+    space->create();
+    const auto savedPadding = FLAGS_heap_slot_max_padding;
+    // 200B 的 slot 有一部分跨 XPLine, 对齐到 256B 后都不跨
+    const uint32 rowLen = 200 - NVMTupleHeadSize;
+    const uint32 alignedSeg = space->allocNewExtent(EXT_SIZE_2M);
+    ASSERT_EQ((new RowIdMap(space, alignedSeg, rowLen))->GetSlotLen(), 256);
+
+    FLAGS_heap_slot_max_padding = 0;
+    const uint32 rawSeg = space->allocNewExtent(EXT_SIZE_2M);
+    ASSERT_EQ((new RowIdMap(space, rawSeg, rowLen))->GetSlotLen(), 200);
+    // 已经建好的表沿用持久化的 slot 长度
+    ASSERT_EQ((new RowIdMap(space, alignedSeg, rowLen))->GetSlotLen(), 256);
+
+    // 旧格式的表没有记录 slot 长度, 已有数据时按原始行长访问
+    FLAGS_heap_slot_max_padding = savedPadding;
+    InitThreadLocalStorage();
+    const uint32 legacySeg = space->allocNewExtent(EXT_SIZE_2M);
+    auto *legacy = new RowIdMap(space, legacySeg, rowLen);
+    auto *tuple = legacy->getNextEmptyRow(InvalidRowId).second;
+    reinterpret_cast<NVMTuple *>(tuple)->m_isUsed = true;
+    char *segHead = GetExtentAddr(space->getNvmAddrByPageId(legacySeg));
+    *(reinterpret_cast<uint32 *>(segHead + GetExtentSize(HEAP_EXTENT_SIZE)) - 1) = 0;
+    ASSERT_EQ((new RowIdMap(space, legacySeg, rowLen))->GetSlotLen(), 200);
+    DestroyThreadLocalStorage();
+}
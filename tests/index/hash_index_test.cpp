@@ -0,0 +1,266 @@
+#include "index/nvm_index.h"
+#include "transaction/nvm_transaction.h"
+#include "common/test_declare.h"
+#include "nvmdb_thread.h"
+#include "nvm_init.h"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace NVMDB;
+
+namespace hash_index_test {
+
+ColumnDesc TestColDesc[] = {
+    InitColDesc(COL_TYPE_INT), /* col_1 */
+    InitColDesc(COL_TYPE_INT), /* col_2 */
+};
+
+IndexColumnDesc TestIndexDesc[] = {{0}};
+
+uint64 row_len = 0;
+uint64 index_len = 0;
+
+class HashIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        InitColumnDesc(&TestColDesc[0], sizeof(TestColDesc) / sizeof(ColumnDesc), row_len);
+        InitIndexDesc(&TestIndexDesc[0], &TestColDesc[0], 1, index_len);
+        InitDB(space_dir);
+        ExitDBProcess();
+        BootStrap(space_dir);
+        InitThreadLocalVariables();
+    }
+
+    void TearDown() override {
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+    }
+
+    void Restart() {
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+        BootStrap(space_dir);
+        InitThreadLocalVariables();
+    }
+
+    static DRAMIndexTuple *GenIndexTuple(int col1) {
+        auto *tuple = new DRAMIndexTuple(&TestColDesc[0], &TestIndexDesc[0], 1, index_len);
+        tuple->SetCol(0, (char *)&col1);
+        return tuple;
+    }
+
+    // key 为 col1 的所有 RowId, 按迭代器返回的顺序
+    static std::vector<RowId> Collect(NVMIndex *idx, int col1, int maxRange = 0, bool reverse = false) {
+        DRAMIndexTuple *tuple = GenIndexTuple(col1);
+        Transaction *tx = GetCurrentTxContext();
+        tx->Begin();
+        std::vector<RowId> rows;
+        auto *iter = idx->GenerateIter(tuple, tuple, tx->GetIndexLookupSnapshot(), maxRange, reverse);
+        for (; iter->Valid(); iter->Next()) {
+            rows.push_back(iter->Curr());
+        }
+        delete iter;
+        tx->Commit();
+        delete tuple;
+        return rows;
+    }
+
+    static RowId Lookup(NVMIndex *idx, int col1) {
+        DRAMIndexTuple *tuple = GenIndexTuple(col1);
+        Transaction *tx = GetCurrentTxContext();
+        tx->Begin();
+        RowId rowId = idx->Lookup(tx, tuple);
+        tx->Commit();
+        delete tuple;
+        return rowId;
+    }
+
+    const std::string space_dir = "/mnt/pmem0/bench;/mnt/pmem1/bench";
+};
+
+/* 唯一 key: 桶装满后分裂, 目录多次扩容, 每个 key 仍然能找到 */
+TEST_F(HashIndexTest, UniqueKeyTest) {
+    const int TEST_NUM = 20000;
+    auto *idx = new NVMIndex(20, IndexType::HASH);
+    ASSERT_TRUE(idx->IsHash());
+    DRAMIndexTuple *tuple = GenIndexTuple(0);
+    for (int i = 0; i < TEST_NUM; i++) {
+        tuple->SetCol(0, (char *)&i);
+        idx->Insert(tuple, i);
+    }
+    delete tuple;
+    for (int i = 0; i < TEST_NUM; i++) {
+        ASSERT_EQ(Lookup(idx, i), i);
+        auto rows = Collect(idx, i);
+        ASSERT_EQ(rows.size(), 1);
+        ASSERT_EQ(rows[0], i);
+    }
+    ASSERT_EQ(Lookup(idx, TEST_NUM), InvalidRowId);
+    ASSERT_TRUE(Collect(idx, -1).empty());
+    idx->Drop();
+    delete idx;
+}
+
+/* 同一个 key 的 RowId 超过一个桶, 挂到溢出桶上; 按 RowId 排序返回 */
+TEST_F(HashIndexTest, DuplicateKeyTest) {
+    const int DUP_NUM = 100;
+    const int KEY_NUM = 200;
+    auto *idx = new NVMIndex(21, IndexType::HASH);
+    DRAMIndexTuple *tuple = GenIndexTuple(0);
+    for (int i = 0; i < KEY_NUM * DUP_NUM; i++) {
+        int col1 = i % KEY_NUM;
+        tuple->SetCol(0, (char *)&col1);
+        idx->Insert(tuple, i);
+    }
+    delete tuple;
+    for (int k = 0; k < KEY_NUM; k++) {
+        auto rows = Collect(idx, k);
+        ASSERT_EQ(rows.size(), DUP_NUM);
+        for (int i = 0; i < DUP_NUM; i++) {
+            ASSERT_EQ(rows[i], i * KEY_NUM + k);
+        }
+        auto last = Collect(idx, k, 3, true);
+        ASSERT_EQ(last.size(), 3);
+        ASSERT_EQ(last[0], (DUP_NUM - 1) * KEY_NUM + k);
+        ASSERT_EQ(last[2], (DUP_NUM - 3) * KEY_NUM + k);
+    }
+    idx->DeleteAll();
+    ASSERT_TRUE(Collect(idx, 0).empty());
+    ASSERT_EQ(Lookup(idx, 1), InvalidRowId);
+    idx->Drop();
+    delete idx;
+}
+
+/* 溢出桶被删空后摘下释放: 反复插入删除同一批 key, 空间不会增长 */
+TEST_F(HashIndexTest, DeleteReinsertTest) {
+    const int DUP_NUM = 100;
+    const int ROUNDS = 5;
+    auto *idx = new NVMIndex(27, IndexType::HASH);
+    DRAMIndexTuple *tuple = GenIndexTuple(0);
+    size_t firstRound = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < DUP_NUM; i++) {
+            int col1 = i % 2;
+            tuple->SetCol(0, (char *)&col1);
+            idx->Insert(tuple, r * DUP_NUM + i);
+        }
+        auto rows = Collect(idx, 0);
+        ASSERT_EQ(rows.size(), DUP_NUM / 2);
+        ASSERT_EQ(rows[0], r * DUP_NUM);
+        idx->DeleteAll();
+        ASSERT_TRUE(Collect(idx, 0).empty());
+        ASSERT_TRUE(Collect(idx, 1).empty());
+        if (r == 0) {
+            firstRound = PMem::UsedBytes();
+        }
+    }
+    delete tuple;
+    ASSERT_LE(PMem::UsedBytes(), firstRound);
+    idx->Drop();
+    delete idx;
+}
+
+/* 事务中的删除: 自己看不到, 回滚后恢复; 提交后其他事务也看不到 */
+TEST_F(HashIndexTest, TransactionTest) {
+    auto *idx = new NVMIndex(22, IndexType::HASH);
+    DRAMIndexTuple *tuple = GenIndexTuple(7);
+    Transaction *tx = GetCurrentTxContext();
+    tx->Begin();
+    tx->IndexInsert(idx, tuple, 70);
+    tx->IndexInsert(idx, tuple, 71);
+    tx->Commit();
+    ASSERT_EQ(Lookup(idx, 7), 70);
+
+    tx->Begin();
+    tx->IndexDelete(idx, tuple, 70);
+    ASSERT_EQ(idx->Lookup(tx, tuple), 71);
+    tx->Abort();
+    ASSERT_EQ(Lookup(idx, 7), 70);
+
+    tx->Begin();
+    tx->IndexDelete(idx, tuple, 70);
+    tx->Commit();
+    ASSERT_EQ(Lookup(idx, 7), 71);
+    ASSERT_EQ(Collect(idx, 7), std::vector<RowId>{71});
+    delete tuple;
+    idx->Drop();
+    delete idx;
+}
+
+/* 重启后从注册表打开, 内容不变; 删除后空间回到建索引之前 */
+TEST_F(HashIndexTest, RestartAndDropTest) {
+    const int TEST_NUM = 20000;
+    auto insert = [](NVMIndex *idx) {
+        DRAMIndexTuple *tuple = GenIndexTuple(0);
+        for (int i = 0; i < TEST_NUM; i++) {
+            tuple->SetCol(0, (char *)&i);
+            idx->Insert(tuple, i);
+        }
+        delete tuple;
+    };
+    auto *other = new NVMIndex(23, IndexType::HASH);
+    auto *idx = new NVMIndex(24, IndexType::HASH);
+    ASSERT_NE(other->TreeId(), idx->TreeId());
+    insert(other);
+    insert(idx);
+    delete other;
+    delete idx;
+
+    Restart();
+    other = new NVMIndex(23, IndexType::HASH);
+    idx = new NVMIndex(24, IndexType::HASH);
+    for (int i = 0; i < TEST_NUM; i++) {
+        ASSERT_EQ(Lookup(other, i), i);
+        ASSERT_EQ(Lookup(idx, i), i);
+    }
+    idx->Drop();
+    delete idx;
+
+    size_t before = PMem::UsedBytes();
+    idx = new NVMIndex(25, IndexType::HASH);
+    insert(idx);
+    size_t loaded = PMem::UsedBytes();
+    ASSERT_GT(loaded, before);
+    idx->Drop();
+    delete idx;
+    size_t after = PMem::UsedBytes();
+    ASSERT_LT(after, before + (loaded - before) / 10);
+
+    idx = new NVMIndex(25, IndexType::HASH);
+    ASSERT_EQ(Lookup(idx, 0), InvalidRowId);
+    idx->Drop();
+    delete idx;
+    ASSERT_EQ(Lookup(other, TEST_NUM - 1), TEST_NUM - 1);
+    other->Drop();
+    delete other;
+}
+
+/* 多线程并发插入不同的 key, 分裂和扩容与插入并发 */
+TEST_F(HashIndexTest, ConcurrentInsertTest) {
+    const int WORKERS = 8;
+    const int PER_WORKER = 5000;
+    auto *idx = new NVMIndex(26, IndexType::HASH);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < WORKERS; w++) {
+        workers.emplace_back([idx, w] {
+            InitThreadLocalVariables();
+            DRAMIndexTuple *tuple = GenIndexTuple(0);
+            for (int i = w * PER_WORKER; i < (w + 1) * PER_WORKER; i++) {
+                tuple->SetCol(0, (char *)&i);
+                idx->Insert(tuple, i);
+            }
+            delete tuple;
+            DestroyThreadLocalVariables();
+        });
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+    for (int i = 0; i < WORKERS * PER_WORKER; i++) {
+        ASSERT_EQ(Lookup(idx, i), i);
+    }
+    idx->Drop();
+    delete idx;
+}
+
+}  // namespace hash_index_test
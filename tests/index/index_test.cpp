@@ -183,6 +183,414 @@ TEST_F(IndexTest, ConcurrentTest) {
     }
 }
 
+static std::vector<RowId> ScanAll(NVMIndex &idx, int si, int ei, LookupSnapshot snapshot, int maxRange,
+                                  bool reverse) {
+    DRAMIndexTuple *start = GenIndexTuple2();
+    DRAMIndexTuple *end = GenIndexTuple2();
+    start->SetCol(0, (char *)&si);
+    end->SetCol(0, (char *)&ei);
+    auto iter = idx.GenerateIter(start, end, snapshot, maxRange, reverse);
+    std::vector<RowId> result;
+    while (iter->Valid()) {
+        result.push_back(iter->Curr());
+        iter->Next();
+    }
+    delete iter;
+    delete start;
+    delete end;
+    return result;
+}
+
+TEST_F(IndexTest, ReverseScanTest) {
+    NVMIndex idx(1);
+    static const int TEST_NUM = 1000;
+    auto tx = GetCurrentTxContext();
+    tx->Begin();
+    tx->PrepareUndo();
+    for (int i = 0; i < TEST_NUM; i++) {
+        DRAMIndexTuple *tuple = GenIndexTuple2();
+        tuple->SetCol(0, (char *)&i);
+        idx.Insert(tuple, i);
+        delete tuple;
+    }
+    tx->Commit();
+    LookupSnapshot snapshot = {0, 0};
+
+    /* 跨越多个节点, 每次取一批 */
+    auto result = ScanAll(idx, 0, TEST_NUM - 1, snapshot, 0, true);
+    ASSERT_EQ(result.size(), TEST_NUM);
+    for (int i = 0; i < TEST_NUM; i++) {
+        ASSERT_EQ(result[i], TEST_NUM - 1 - i);
+    }
+
+    /* 子区间和 range 限制 */
+    result = ScanAll(idx, 100, 199, snapshot, 0, true);
+    ASSERT_EQ(result.size(), 100);
+    ASSERT_EQ(result.front(), 199);
+    ASSERT_EQ(result.back(), 100);
+    result = ScanAll(idx, 100, 199, snapshot, 10, true);
+    ASSERT_EQ(result.size(), 10);
+    ASSERT_EQ(result.front(), 199);
+    ASSERT_EQ(result.back(), 190);
+
+    /* 删除的 key 不可见 */
+    tx->Begin();
+    tx->PrepareUndo();
+    for (int i = 0; i < TEST_NUM; i += 2) {
+        DRAMIndexTuple *tuple = GenIndexTuple2();
+        tuple->SetCol(0, (char *)&i);
+        idx.Delete(tuple, i, tx->GetTxSlotLocation());
+        delete tuple;
+    }
+    tx->Commit();
+    tx->Begin();
+    snapshot.snapshot = tx->GetSnapshot();
+    result = ScanAll(idx, 0, TEST_NUM - 1, snapshot, 0, true);
+    tx->Commit();
+    ASSERT_EQ(result.size(), TEST_NUM / 2);
+    for (int i = 0; i < TEST_NUM / 2; i++) {
+        ASSERT_EQ(result[i], TEST_NUM - 1 - 2 * i);
+    }
+}
+
+/* 逆序扫描的同时并发插入, 节点不断分裂, 扫描结果必须有序并且包含所有事先插入的 key */
+TEST_F(IndexTest, ConcurrentReverseScanTest) {
+    NVMIndex idx(1);
+    static const int TEST_NUM = 10000;
+    static const int INSERT_WORKERS = 8;
+    static const int SCAN_WORKERS = 4;
+    volatile bool on_working = true;
+
+    auto tx = GetCurrentTxContext();
+    tx->Begin();
+    tx->PrepareUndo();
+    for (int i = 0; i < TEST_NUM; i += 2) {
+        DRAMIndexTuple *tuple = GenIndexTuple2();
+        tuple->SetCol(0, (char *)&i);
+        idx.Insert(tuple, i);
+        delete tuple;
+    }
+    tx->Commit();
+
+    std::thread inserters[INSERT_WORKERS];
+    for (int t = 0; t < INSERT_WORKERS; t++) {
+        inserters[t] = std::thread(
+            [&](int tid) {
+                InitThreadLocalVariables();
+                for (int i = 2 * tid + 1; i < TEST_NUM && on_working; i += 2 * INSERT_WORKERS) {
+                    DRAMIndexTuple *tuple = GenIndexTuple2();
+                    tuple->SetCol(0, (char *)&i);
+                    idx.Insert(tuple, i);
+                    delete tuple;
+                }
+                DestroyThreadLocalVariables();
+            },
+            t);
+    }
+    std::atomic<int> failed {0};
+    std::thread scanners[SCAN_WORKERS];
+    for (int t = 0; t < SCAN_WORKERS; t++) {
+        scanners[t] = std::thread([&]() {
+            InitThreadLocalVariables();
+            LookupSnapshot snapshot = {0, 0};
+            while (on_working) {
+                auto result = ScanAll(idx, 0, TEST_NUM, snapshot, 0, true);
+                int expect = TEST_NUM - 2;
+                RowId last = TEST_NUM + 1;
+                for (auto rowId : result) {
+                    if (rowId >= last) {
+                        failed++;
+                    }
+                    if ((int)rowId == expect) {
+                        expect -= 2;
+                    }
+                    last = rowId;
+                }
+                if (expect != -2) {
+                    failed++;
+                }
+            }
+            DestroyThreadLocalVariables();
+        });
+    }
+    sleep(1);
+    on_working = false;
+    for (auto &worker : inserters) {
+        worker.join();
+    }
+    for (auto &worker : scanners) {
+        worker.join();
+    }
+    ASSERT_EQ(failed.load(), 0);
+}
+
+/* 点查按事务的快照判断删除标记: 并发删除进行中, 快照之后提交, 自己删除, 回滚 */
+TEST_F(IndexTest, LookupVisibilityTest) {
+    NVMIndex idx(1);
+    DRAMIndexTuple tuple(&TestColDesc[0], &TestIndexDesc2[0], index_col_cnt2, index_len2);
+    int key = 10;
+    tuple.SetCol(0, (char *)&key);
+    const RowId oldRowId = 100;
+    const RowId newRowId = 200;
+
+    auto tx = GetCurrentTxContext();
+    tx->Begin();
+    ASSERT_EQ(idx.Lookup(tx, &tuple), InvalidRowId);
+    tx->IndexInsert(&idx, &tuple, oldRowId);
+    ASSERT_EQ(idx.Lookup(tx, &tuple), oldRowId);
+    tx->Commit();
+
+    std::atomic<int> step {0};
+    auto waitStep = [&step](int s) {
+        while (step.load() != s) {
+            std::this_thread::yield();
+        }
+    };
+    std::thread reader([&]() {
+        InitThreadLocalVariables();
+        auto rtx = GetCurrentTxContext();
+        rtx->Begin();
+        step = 1;
+        // 删除还没有提交
+        waitStep(2);
+        EXPECT_EQ(idx.Lookup(rtx, &tuple), oldRowId);
+        step = 3;
+        // 删除和重新插入在快照之后提交, 仍然看到旧的 RowId, 新的 RowId 由 heap 判断不可见
+        waitStep(4);
+        EXPECT_EQ(idx.Lookup(rtx, &tuple), oldRowId);
+        EXPECT_EQ(idx.Lookup(rtx, &tuple, oldRowId + 1), newRowId);
+        rtx->Commit();
+        // 新的快照看不到旧的 RowId
+        rtx->Begin();
+        EXPECT_EQ(idx.Lookup(rtx, &tuple), newRowId);
+        rtx->Commit();
+        DestroyThreadLocalVariables();
+        step = 5;
+    });
+
+    waitStep(1);
+    tx->Begin();
+    tx->IndexDelete(&idx, &tuple, oldRowId);
+    // 自己的删除对自己可见
+    ASSERT_EQ(idx.Lookup(tx, &tuple), InvalidRowId);
+    step = 2;
+    waitStep(3);
+    tx->IndexInsert(&idx, &tuple, newRowId);
+    ASSERT_EQ(idx.Lookup(tx, &tuple), newRowId);
+    tx->Commit();
+    step = 4;
+    waitStep(5);
+    reader.join();
+
+    // 回滚的删除不生效
+    tx->Begin();
+    tx->IndexDelete(&idx, &tuple, newRowId);
+    ASSERT_EQ(idx.Lookup(tx, &tuple), InvalidRowId);
+    tx->Abort();
+    tx->Begin();
+    ASSERT_EQ(idx.Lookup(tx, &tuple), newRowId);
+    tx->Commit();
+}
+
+/* 并发地删除旧 RowId 并插入新 RowId, 点查总能找到, 且不早于开始事务之前已经提交的版本 */
+TEST_F(IndexTest, ConcurrentLookupTest) {
+    NVMIndex idx(1);
+    static const int KEY_NUM = 16;
+    static const int READERS = 4;
+    std::atomic<RowId> committed[KEY_NUM];
+
+    auto tx = GetCurrentTxContext();
+    tx->Begin();
+    for (int i = 0; i < KEY_NUM; i++) {
+        DRAMIndexTuple tuple(&TestColDesc[0], &TestIndexDesc2[0], index_col_cnt2, index_len2);
+        tuple.SetCol(0, (char *)&i);
+        tx->IndexInsert(&idx, &tuple, 0);
+        committed[i] = 0;
+    }
+    tx->Commit();
+
+    volatile bool on_working = true;
+    std::thread writer([&]() {
+        InitThreadLocalVariables();
+        auto wtx = GetCurrentTxContext();
+        DRAMIndexTuple tuple(&TestColDesc[0], &TestIndexDesc2[0], index_col_cnt2, index_len2);
+        RowId version = 0;
+        while (on_working) {
+            int i = (int)(version % KEY_NUM);
+            RowId oldRowId = committed[i].load();
+            tuple.SetCol(0, (char *)&i);
+            wtx->Begin();
+            wtx->IndexDelete(&idx, &tuple, oldRowId);
+            wtx->IndexInsert(&idx, &tuple, oldRowId + 1);
+            wtx->Commit();
+            committed[i] = oldRowId + 1;
+            version++;
+        }
+        DestroyThreadLocalVariables();
+    });
+    std::atomic<int> failed {0};
+    std::thread readers[READERS];
+    for (auto &reader : readers) {
+        reader = std::thread([&]() {
+            InitThreadLocalVariables();
+            auto rtx = GetCurrentTxContext();
+            DRAMIndexTuple tuple(&TestColDesc[0], &TestIndexDesc2[0], index_col_cnt2, index_len2);
+            RowId lowerBound[KEY_NUM];
+            while (on_working) {
+                for (int i = 0; i < KEY_NUM; i++) {
+                    lowerBound[i] = committed[i].load();
+                }
+                rtx->Begin();
+                for (int i = 0; i < KEY_NUM; i++) {
+                    tuple.SetCol(0, (char *)&i);
+                    RowId rowId = idx.Lookup(rtx, &tuple);
+                    if (rowId == InvalidRowId || rowId < lowerBound[i]) {
+                        failed++;
+                    }
+                }
+                rtx->Commit();
+            }
+            DestroyThreadLocalVariables();
+        });
+    }
+    sleep(1);
+    on_working = false;
+    writer.join();
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(failed.load(), 0);
+}
+
+/* 覆盖索引: 不回表读出包含列, 更新包含列后按插入事务和删除标记判断可见的版本 */
+TEST_F(IndexTest, CoveringIndexTest) {
+    Table table(0, row_len);
+    ASSERT_TRUE(NVMPageIdIsValid(table.CreateSegment()));
+    NVMIndex idx(1);
+    // key 为 col_1, 包含 col_2
+    IndexColumnDesc *includeDesc = IndexDescCreate(1);
+    includeDesc[0].m_colId = 1;
+    uint64 includeLen = 0;
+    InitIndexDesc(includeDesc, &TestColDesc[0], 1, includeLen);
+    idx.SetIncludeDesc(includeDesc, 1, includeLen);
+    ASSERT_TRUE(idx.IsCovering());
+
+    static const int ROW_NUM = 100;
+    DRAMIndexTuple key(&TestColDesc[0], &TestIndexDesc2[0], index_col_cnt2, index_len2);
+    std::unique_ptr<RAMTuple> row(GenRow());
+    RowId rowIds[ROW_NUM];
+    auto tx = GetCurrentTxContext();
+    tx->Begin();
+    for (int i = 0; i < ROW_NUM; i++) {
+        row.reset(GenRow(true, i, i + 1));
+        rowIds[i] = HeapInsert(tx, &table, row.get());
+        key.SetCol(0, (char *)&i);
+        tx->IndexInsert(&idx, &key, rowIds[i], row.get());
+    }
+    tx->Commit();
+
+    // 从索引中读出包含列, 和回表读的结果相同
+    tx->Begin();
+    for (int i = 0; i < ROW_NUM; i++) {
+        key.SetCol(0, (char *)&i);
+        row.reset(GenRow());
+        ASSERT_EQ(IndexUniqueRead(tx, &idx, &table, &key, row.get()), rowIds[i]);
+        ASSERT_TRUE(ColEqual(row.get(), 1, i + 1));
+        ASSERT_EQ(idx.Lookup(tx, &key), rowIds[i]);
+    }
+    tx->Commit();
+
+    int target = 7;
+    key.SetCol(0, (char *)&target);
+    auto update = [&](int value) {
+        std::unique_ptr<RAMTuple> tuple(GenRow());
+        ASSERT_EQ(HeapRead(tx, &table, rowIds[target], tuple.get()), HamStatus::OK);
+        tuple->UpdateCol(1, (char *)&value);
+        ASSERT_EQ(HeapUpdate(tx, &table, rowIds[target], tuple.get()), HamStatus::OK);
+        tx->IndexUpdate(&idx, &key, rowIds[target], tuple.get());
+    };
+    // 其他线程中的事务读到的包含列
+    auto readInOtherThread = [&](bool *found, int *value) {
+        std::thread reader([&]() {
+            InitThreadLocalVariables();
+            auto rtx = GetCurrentTxContext();
+            rtx->Begin();
+            std::unique_ptr<RAMTuple> tuple(GenRow());
+            *found = IndexUniqueRead(rtx, &idx, &table, &key, tuple.get()) == rowIds[target];
+            tuple->GetCol(1, (char *)value);
+            rtx->Commit();
+            DestroyThreadLocalVariables();
+        });
+        reader.join();
+    };
+
+    tx->Begin();
+    update(1000);
+    // 两次更新, 自己看到最新的值
+    update(2000);
+    row.reset(GenRow());
+    ASSERT_EQ(IndexUniqueRead(tx, &idx, &table, &key, row.get()), rowIds[target]);
+    ASSERT_TRUE(ColEqual(row.get(), 1, 2000));
+    // 没有提交的更新对其他事务不可见
+    bool found = false;
+    int value = 0;
+    readInOtherThread(&found, &value);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(value, target + 1);
+    tx->Commit();
+    readInOtherThread(&found, &value);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(value, 2000);
+
+    // 回滚的更新
+    tx->Begin();
+    update(3000);
+    tx->Abort();
+    readInOtherThread(&found, &value);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(value, 2000);
+
+    // 包含列没有变化时不更新索引
+    tx->Begin();
+    update(2000);
+    tx->Commit();
+    readInOtherThread(&found, &value);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(value, 2000);
+
+    // 索引加入表之后, HeapUpdate 和只带更新列的 HeapUpdate2 自动同步包含列
+    table.AddIndex(&idx);
+    tx->Begin();
+    std::unique_ptr<RAMTuple> tuple(GenRow());
+    ASSERT_EQ(HeapRead(tx, &table, rowIds[target], tuple.get()), HamStatus::OK);
+    value = 4000;
+    tuple->UpdateCol(1, (char *)&value);
+    ASSERT_EQ(HeapUpdate(tx, &table, rowIds[target], tuple.get()), HamStatus::OK);
+    tx->Commit();
+    readInOtherThread(&found, &value);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(value, 4000);
+    tx->Begin();
+    tuple.reset(GenRow());
+    value = 5000;
+    tuple->UpdateCol(1, (char *)&value);
+    ASSERT_EQ(HeapUpdate2(tx, &table, rowIds[target], tuple.get()), HamStatus::OK);
+    tx->Commit();
+    readInOtherThread(&found, &value);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(value, 5000);
+
+    // 删除之后读不到
+    tx->Begin();
+    ASSERT_EQ(HeapDelete(tx, &table, rowIds[target]), HamStatus::OK);
+    tx->IndexDelete(&idx, &key, rowIds[target]);
+    row.reset(GenRow());
+    ASSERT_EQ(IndexUniqueRead(tx, &idx, &table, &key, row.get()), InvalidRowId);
+    tx->Commit();
+    readInOtherThread(&found, &value);
+    ASSERT_FALSE(found);
+}
+
 TEST_F(IndexTest, TransactionTest) {
     Table table(0, row_len);
     NVMIndex idx(1);
@@ -261,4 +669,79 @@ TEST_F(IndexTest, TransactionTest) {
     delete idx_end;
 }
 
+/* 每个索引是单独的一棵树: 互不影响, 重启后各自恢复, 删除索引回收它的所有空间 */
+TEST_F(IndexTest, DropIndexTest) {
+    const int OTHER_NUM = 100;
+    const int TEST_NUM = 20000;
+    auto insert = [](NVMIndex *idx, int num) {
+        DRAMIndexTuple *tuple = GenIndexTuple2();
+        for (int i = 0; i < num; i++) {
+            tuple->SetCol(0, (char *)&i);
+            idx->Insert(tuple, i);
+        }
+        delete tuple;
+    };
+    auto count = [](NVMIndex *idx) {
+        DRAMIndexTuple *begin = GenIndexTuple2();
+        DRAMIndexTuple *end = GenIndexTuple2();
+        int lower = 0;
+        int upper = TEST_NUM;
+        begin->SetCol(0, (char *)&lower);
+        end->SetCol(0, (char *)&upper);
+        Transaction *tx = GetCurrentTxContext();
+        tx->Begin();
+        auto *iter = idx->GenerateIter(begin, end, tx->GetIndexLookupSnapshot(), 0, false);
+        int result = 0;
+        for (; iter->Valid(); iter->Next()) {
+            result++;
+        }
+        delete iter;
+        tx->Commit();
+        delete begin;
+        delete end;
+        return result;
+    };
+
+    auto *other = new NVMIndex(10);
+    auto *idx = new NVMIndex(11);
+    ASSERT_NE(other->TreeId(), idx->TreeId());
+    insert(other, OTHER_NUM);
+    insert(idx, TEST_NUM);
+    ASSERT_EQ(count(other), OTHER_NUM);
+    ASSERT_EQ(count(idx), TEST_NUM);
+    delete other;
+    delete idx;
+
+    // 重启之后每棵树各自恢复
+    DestroyThreadLocalVariables();
+    ExitDBProcess();
+    BootStrap(space_dir);
+    InitThreadLocalVariables();
+    other = new NVMIndex(10);
+    idx = new NVMIndex(11);
+    ASSERT_EQ(count(other), OTHER_NUM);
+    ASSERT_EQ(count(idx), TEST_NUM);
+    idx->Drop();
+    delete idx;
+    ASSERT_EQ(count(other), OTHER_NUM);
+
+    // 删除一个装满的索引, 空间回到建索引之前
+    size_t before = PMem::UsedBytes();
+    idx = new NVMIndex(12);
+    insert(idx, TEST_NUM);
+    size_t loaded = PMem::UsedBytes();
+    ASSERT_GT(loaded, before);
+    idx->Drop();
+    delete idx;
+    size_t after = PMem::UsedBytes();
+    ASSERT_LT(after, before + (loaded - before) / 10);
+
+    idx = new NVMIndex(12);
+    ASSERT_EQ(count(idx), 0);
+    idx->Drop();
+    delete idx;
+    ASSERT_EQ(count(other), OTHER_NUM);
+    delete other;
+}
+
 }  // namespace index_test
@@ -14,19 +14,16 @@ inline RowId UniqueSearch(Transaction *tx,
                           DRAMIndexTuple *index_tuple,
                           RAMTuple *res,
                           bool assert = false) {
-    auto ss = tx->GetIndexLookupSnapshot();
-    auto iter = index->GenerateIter(index_tuple, index_tuple, ss, 1, false);
-    while (iter->Valid()) {
-        RowId row_id = iter->Curr();
+    RowId row_id = index->Lookup(tx, index_tuple);
+    while (row_id != InvalidRowId) {
         HamStatus status = HeapRead(tx, tbl, row_id, res);
         if (status == HamStatus::OK) {
-            delete iter;
             return row_id;
         }
-        iter->Next();
+        // 插入对自己不可见, 继续找同一个 key 的下一个 RowId
+        row_id = index->Lookup(tx, index_tuple, row_id + 1);
     }
     CHECK(!assert);
-    delete iter;
     return InvalidRowId;
 }
 
@@ -59,22 +56,20 @@ inline RowId RangeSearchMax(Transaction *tx,
                             DRAMIndexTuple *idx_end,
                             RAMTuple *res) {
     auto ss = tx->GetIndexLookupSnapshot();
-    auto iter = index->GenerateIter(idx_begin, idx_end, ss, 0, false);
+    // 逆序扫描, 第一个可见的行就是最大的
+    auto iter = index->GenerateIter(idx_begin, idx_end, ss, 0, true);
     RowId max_rid = InvalidRowId;
     while (iter->Valid()) {
         RowId row_id = iter->Curr();
         HamStatus status = HeapRead(tx, tbl, row_id, res);
         if (status == HamStatus::OK) {
             max_rid = row_id;
+            break;
         }
         iter->Next();
     }
 
-    if (RowIdIsValid(max_rid)) {
-        HamStatus status = HeapRead(tx, tbl, max_rid, res);
-        DCHECK(status == HamStatus::OK);
-    }
-
+    delete iter;
     return max_rid;
 }
 
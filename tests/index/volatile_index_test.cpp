@@ -0,0 +1,247 @@
+#include "nvm_init.h"
+#include "nvm_catalog.h"
+#include "nvm_access.h"
+#include "nvm_index_rebuild.h"
+#include "nvmdb_thread.h"
+#include "common/test_declare.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace NVMDB;
+
+namespace volatile_index_test {
+
+constexpr uint32 COL_COUNT = 2;
+constexpr TableId TABLE_ID = 30;
+constexpr IndexId PK_ID = 30;
+constexpr IndexId SK_ID = 31;
+
+class VolatileIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        InitColumnDesc(m_colDesc, COL_COUNT, m_rowLen);
+        InitDB(m_dir);
+        InitThreadLocalVariables();
+    }
+
+    void TearDown() override {
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+    }
+
+    void Restart() {
+        DestroyThreadLocalVariables();
+        ExitDBProcess();
+        BootStrap(m_dir);
+        InitThreadLocalVariables();
+    }
+
+    // 主键 (c0) 和二级索引 (c1) 都是易失索引
+    Table *CreateTable(Transaction *tx) {
+        TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+        Table *table = CatalogCreateTable(tx, "volatile", TABLE_ID, desc);
+        IndexColumnDesc pkDesc[] = {{0}};
+        IndexColumnDesc skDesc[] = {{1}};
+        IndexColumnDesc include[] = {{1}};
+        EXPECT_EQ(CatalogCreateIndex(tx, table, PK_ID, pkDesc, 1, include, 1, IndexType::VOLATILE), nullptr);
+        EXPECT_NE(CatalogCreateIndex(tx, table, PK_ID, pkDesc, 1, nullptr, 0, IndexType::VOLATILE), nullptr);
+        EXPECT_NE(CatalogCreateIndex(tx, table, SK_ID, skDesc, 1, nullptr, 0, IndexType::VOLATILE), nullptr);
+        return table;
+    }
+
+    static NVMIndex *GetIndex(Table *table, IndexId id) {
+        for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+            if (table->GetIndex(i)->Id() == id) {
+                return table->GetIndex(i);
+            }
+        }
+        return nullptr;
+    }
+
+    // 插入一行 (c0, c1) 并维护两个索引
+    static RowId InsertRow(Transaction *tx, Table *table, int c0, int c1) {
+        RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+        tuple.SetCol(0, (char *)&c0);
+        tuple.SetCol(1, (char *)&c1);
+        RowId rowId = HeapInsert(tx, table, &tuple);
+        for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+            NVMIndex *index = table->GetIndex(i);
+            DRAMIndexTuple key(table->GetColDesc(), index->GetIndexDesc(), index->GetColCount(), index->GetRowLen());
+            key.ExtractFromTuple(&tuple);
+            tx->IndexInsert(index, &key, rowId);
+        }
+        return rowId;
+    }
+
+    static void DeleteRow(Transaction *tx, Table *table, RowId rowId) {
+        RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+        ASSERT_EQ(HeapRead(tx, table, rowId, &tuple), HamStatus::OK);
+        ASSERT_EQ(HeapDelete(tx, table, rowId), HamStatus::OK);
+        for (uint32 i = 0; i < table->GetIndexCount(); i++) {
+            NVMIndex *index = table->GetIndex(i);
+            DRAMIndexTuple key(table->GetColDesc(), index->GetIndexDesc(), index->GetColCount(), index->GetRowLen());
+            key.ExtractFromTuple(&tuple);
+            tx->IndexDelete(index, &key, rowId);
+        }
+    }
+
+    // 通过 id 索引找 value 为 col 的行, 返回 c0, 没有时返回 -1
+    static int Find(Transaction *tx, Table *table, IndexId id, int col) {
+        NVMIndex *index = GetIndex(table, id);
+        DRAMIndexTuple key(table->GetColDesc(), index->GetIndexDesc(), index->GetColCount(), index->GetRowLen());
+        key.SetCol(0, (char *)&col);
+        RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+        if (IndexUniqueRead(tx, index, table, &key, &tuple) == InvalidRowId) {
+            return -1;
+        }
+        int c0;
+        tuple.GetCol(0, (char *)&c0);
+        return c0;
+    }
+
+    const std::string m_dir = "/mnt/pmem0/volatile;/mnt/pmem1/volatile";
+    ColumnDesc m_colDesc[COL_COUNT] = {InitColDesc(COL_TYPE_INT), InitColDesc(COL_TYPE_INT)};
+    uint64 m_rowLen = 0;
+};
+
+/* 重启后打开表时从 heap 重建: 已提交的行可以找到, 已删除的行和崩溃事务插入的行找不到 */
+TEST_F(VolatileIndexTest, RebuildTest) {
+    const int ROW_NUM = 5000;
+    Transaction *tx = GetCurrentTxContext();
+    tx->Begin();
+    Table *table = CreateTable(tx);
+    ASSERT_NE(table, nullptr);
+    std::vector<RowId> rowIds;
+    for (int i = 0; i < ROW_NUM; i++) {
+        rowIds.push_back(InsertRow(tx, table, i, i + ROW_NUM));
+    }
+    tx->Commit();
+
+    tx->Begin();
+    for (int i = 0; i < ROW_NUM; i += 10) {
+        DeleteRow(tx, table, rowIds[i]);
+    }
+    tx->Commit();
+
+    // 回滚的删除和插入
+    tx->Begin();
+    DeleteRow(tx, table, rowIds[1]);
+    InsertRow(tx, table, -2, -2);
+    ASSERT_EQ(Find(tx, table, PK_ID, 1), -1);
+    ASSERT_EQ(Find(tx, table, PK_ID, -2), -2);
+    tx->Abort();
+    tx->Begin();
+    ASSERT_EQ(Find(tx, table, PK_ID, 1), 1);
+    ASSERT_EQ(Find(tx, table, PK_ID, -2), -1);
+    tx->Commit();
+
+    /* 模拟崩溃: 插入的事务没有提交也没有回滚 */
+    tx->Begin();
+    InsertRow(tx, table, -1, -1);
+    Restart();
+
+    tx = GetCurrentTxContext();
+    tx->Begin();
+    table = CatalogOpenTable(tx, "volatile");
+    ASSERT_NE(table, nullptr);
+    ASSERT_EQ(table->GetIndexCount(), 2U);
+    ASSERT_TRUE(GetIndex(table, PK_ID)->IsVolatile());
+    ASSERT_TRUE(GetIndex(table, PK_ID)->GetVolatileIndex()->Ready());
+    for (int i = 0; i < ROW_NUM; i++) {
+        int expect = i % 10 == 0 ? -1 : i;
+        ASSERT_EQ(Find(tx, table, PK_ID, i), expect);
+        ASSERT_EQ(Find(tx, table, SK_ID, i + ROW_NUM), expect);
+    }
+    ASSERT_EQ(Find(tx, table, PK_ID, -1), -1);
+    tx->Commit();
+
+    /* 重建之后可以继续写, 已经重建的索引不会再重建 */
+    tx->Begin();
+    InsertRow(tx, table, ROW_NUM, 0);
+    tx->Commit();
+    ASSERT_EQ(RebuildVolatileIndexes(table).m_indexes, 0U);
+    tx->Begin();
+    ASSERT_EQ(Find(tx, table, PK_ID, ROW_NUM), ROW_NUM);
+    ASSERT_EQ(Find(tx, table, SK_ID, 0), ROW_NUM);
+    tx->Commit();
+}
+
+/* 在已经有数据的表上建易失索引, 多个线程按 extent 并行建立 */
+TEST_F(VolatileIndexTest, CreateOnExistingRowsTest) {
+    const int ROW_NUM = 20000;
+    Transaction *tx = GetCurrentTxContext();
+    tx->Begin();
+    TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+    Table *table = CatalogCreateTable(tx, "existing", TABLE_ID, desc);
+    ASSERT_NE(table, nullptr);
+    tx->Commit();
+    tx->Begin();
+    RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+    for (int i = 0; i < ROW_NUM; i++) {
+        tuple.SetCol(0, (char *)&i);
+        tuple.SetCol(1, (char *)&i);
+        HeapInsert(tx, table, &tuple);
+    }
+    tx->Commit();
+
+    int32 savedThreads = FLAGS_index_rebuild_threads_per_group;
+    FLAGS_index_rebuild_threads_per_group = 4;
+    tx->Begin();
+    IndexColumnDesc pkDesc[] = {{0}};
+    ASSERT_NE(CatalogCreateIndex(tx, table, PK_ID, pkDesc, 1, nullptr, 0, IndexType::VOLATILE), nullptr);
+    tx->Commit();
+    FLAGS_index_rebuild_threads_per_group = savedThreads;
+
+    tx->Begin();
+    for (int i = 0; i < ROW_NUM; i++) {
+        ASSERT_EQ(Find(tx, table, PK_ID, i), i);
+    }
+    ASSERT_EQ(Find(tx, table, PK_ID, ROW_NUM), -1);
+    tx->Commit();
+}
+
+/* 在写过这张表的事务中建易失索引: 这个事务插入, 修改和删除的行按它看到的版本建立 */
+TEST_F(VolatileIndexTest, CreateInWritingTxTest) {
+    const int ROW_NUM = 1000;
+    Transaction *tx = GetCurrentTxContext();
+    tx->Begin();
+    TableDesc desc{m_colDesc, COL_COUNT, m_rowLen};
+    Table *table = CatalogCreateTable(tx, "writing", TABLE_ID, desc);
+    ASSERT_NE(table, nullptr);
+    tx->Commit();
+    tx->Begin();
+    RAMTuple tuple(table->GetColDesc(), table->GetRowLen());
+    std::vector<RowId> rowIds;
+    for (int i = 0; i < ROW_NUM; i++) {
+        tuple.SetCol(0, (char *)&i);
+        tuple.SetCol(1, (char *)&i);
+        rowIds.push_back(HeapInsert(tx, table, &tuple));
+    }
+    tx->Commit();
+
+    tx->Begin();
+    for (int i = ROW_NUM; i < 2 * ROW_NUM; i++) {
+        tuple.SetCol(0, (char *)&i);
+        tuple.SetCol(1, (char *)&i);
+        HeapInsert(tx, table, &tuple);
+    }
+    int updated = 2 * ROW_NUM;
+    tuple.SetCol(0, (char *)&updated);
+    tuple.SetCol(1, (char *)&updated);
+    ASSERT_EQ(HeapUpdate(tx, table, rowIds[0], &tuple), HamStatus::OK);
+    ASSERT_EQ(HeapDelete(tx, table, rowIds[1]), HamStatus::OK);
+    IndexColumnDesc pkDesc[] = {{0}};
+    ASSERT_NE(CatalogCreateIndex(tx, table, PK_ID, pkDesc, 1, nullptr, 0, IndexType::VOLATILE), nullptr);
+    tx->Commit();
+
+    tx->Begin();
+    for (int i = 2; i < 2 * ROW_NUM; i++) {
+        ASSERT_EQ(Find(tx, table, PK_ID, i), i);
+    }
+    ASSERT_EQ(Find(tx, table, PK_ID, 2 * ROW_NUM), 2 * ROW_NUM);
+    ASSERT_EQ(Find(tx, table, PK_ID, 0), -1);
+    ASSERT_EQ(Find(tx, table, PK_ID, 1), -1);
+    tx->Commit();
+}
+
+}  // namespace volatile_index_test
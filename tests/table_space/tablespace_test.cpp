@@ -1,7 +1,9 @@
 #include "table_space/nvm_table_space.h"
+#include "common/nvm_storage_backend.h"
 #include "common/test_declare.h"
 #include <experimental/filesystem>
 #include <gtest/gtest.h>
+#include <thread>
 
 using namespace NVMDB;
 
@@ -81,6 +83,11 @@ TEST_F(TableSpaceTest, TestAllocPage) {
 
     /* delete all segments */
     uint32 old_hwm = space->getUsedPageCount();
+    std::set<uint32> freedSet(std::begin(tables->segments), std::end(tables->segments));
+    for (unsigned int segment : tables->segments) {
+        auto *segHead = (SegmentHead *)GetExtentAddr(space->getNvmAddrByPageId(segment));
+        freedSet.insert(std::begin(segHead->pages), std::end(segHead->pages));
+    }
     for (unsigned int & segment : tables->segments) {
         space->freeSegment(&segment);
     }
@@ -97,8 +104,8 @@ TEST_F(TableSpaceTest, TestAllocPage) {
         auto *segHead = (SegmentHead *)GetExtentAddr(space->getNvmAddrByPageId(i));
         for (unsigned int & j : segHead->pages) {
             j = space->allocNewExtent(EXT_SIZE_2M, i);
-            /* ensure all extents are re-used */
-            ASSERT_LE(j, old_hwm);
+            /* ensure all extents are re-used (多个目录时全局页号会大于目录内的水位线) */
+            ASSERT_EQ(freedSet.count(j), 1);
 
             ASSERT_EQ(segSet.count(j), 0);
             segSet.insert(j);
@@ -119,14 +126,14 @@ TEST_F(TableSpaceTest, TestFreeExtent) {
     // only one extent
     extent[0] = space->allocNewExtent(EXT_SIZE_2M, segment);
     segSet.insert(extent[0]);
-    space->freeExtent(&extent[0]);
+    space->freeExtent(&extent[0], segment);
     // two extents
     extent[0] = space->allocNewExtent(EXT_SIZE_2M, segment);
     CHECK(segSet.count(extent[0]));
     extent[1] = space->allocNewExtent(EXT_SIZE_2M, segment);
     segSet.insert(extent[1]);
-    space->freeExtent(&extent[0]);
-    space->freeExtent(&extent[1]);
+    space->freeExtent(&extent[0], segment);
+    space->freeExtent(&extent[1], segment);
     // three extents
     extent[0] = space->allocNewExtent(EXT_SIZE_2M, segment);
     CHECK(segSet.count(extent[0]));
@@ -134,9 +141,9 @@ TEST_F(TableSpaceTest, TestFreeExtent) {
     CHECK(segSet.count(extent[1]));
     extent[2] = space->allocNewExtent(EXT_SIZE_2M, segment);
     segSet.insert(extent[2]);
-    space->freeExtent(&extent[0]);
-    space->freeExtent(&extent[1]);
-    space->freeExtent(&extent[2]);
+    space->freeExtent(&extent[0], segment);
+    space->freeExtent(&extent[1], segment);
+    space->freeExtent(&extent[2], segment);
 }
 
 TEST_F(TableSpaceTest, TestFreeExtentMulti) {
@@ -150,15 +157,15 @@ TEST_F(TableSpaceTest, TestFreeExtentMulti) {
     // only one extent
     extent[0] = space->allocNewExtent(EXT_SIZE_2M, segment, 1);
     segSet.insert(extent[0]);
-    space->freeExtent(&extent[0]);
+    space->freeExtent(&extent[0], segment);
     // two extents
     extent[0] = space->allocNewExtent(EXT_SIZE_2M, segment, 0);
     CHECK(segSet.count(extent[0]) == 0);
     segSet.insert(extent[0]);
     extent[1] = space->allocNewExtent(EXT_SIZE_2M, segment, 1);
     CHECK(segSet.count(extent[1]));
-    space->freeExtent(&extent[0]);
-    space->freeExtent(&extent[1]);
+    space->freeExtent(&extent[0], segment);
+    space->freeExtent(&extent[1], segment);
     // three extents
     extent[0] = space->allocNewExtent(EXT_SIZE_2M, segment, 0);
     CHECK(segSet.count(extent[0]));
@@ -168,8 +175,242 @@ TEST_F(TableSpaceTest, TestFreeExtentMulti) {
     segSet.insert(extent[2]);
     extent[3] = space->allocNewExtent(EXT_SIZE_2M, segment, 1);
     segSet.insert(extent[3]);
-    space->freeExtent(&extent[0]);
-    space->freeExtent(&extent[1]);
-    space->freeExtent(&extent[2]);
-    space->freeExtent(&extent[3]);
+    space->freeExtent(&extent[0], segment);
+    space->freeExtent(&extent[1], segment);
+    space->freeExtent(&extent[2], segment);
+    space->freeExtent(&extent[3], segment);
+}
+
+/* 重启后只映射元数据所在的 segment, 其他 segment 在第一次访问或 prefault 时映射 */
+TEST_F(TableSpaceTest, TestLazyMount) {
+    space->create();
+    const int EXTENTS = 64;
+    std::vector<uint32> extents;
+    for (int i = 0; i < EXTENTS; i++) {
+        auto pageId = space->allocNewExtent(EXT_SIZE_2M, NVMInvalidPageId, i);
+        *reinterpret_cast<int *>(GetExtentAddr(space->getNvmAddrByPageId(pageId))) = i;
+        extents.push_back(pageId);
+    }
+    const auto segmentCount = space->getLogicFile().segmentCount();
+    ASSERT_GT(segmentCount, 2);
+    space->unmount();
+    delete space;
+
+    space = new TableSpace(g_dir_config);
+    space->mount();
+    ASSERT_EQ(space->getLogicFile().segmentCount(), 1);
+    /* 第一次访问时映射 */
+    for (int i = 0; i < EXTENTS; i++) {
+        ASSERT_EQ(*reinterpret_cast<int *>(GetExtentAddr(space->getNvmAddrByPageId(extents[i]))), i);
+    }
+    space->unmount();
+    delete space;
+
+    space = new TableSpace(g_dir_config);
+    space->mount();
+    std::atomic<bool> stop {false};
+    space->prefault(stop);
+    ASSERT_GT(space->getLogicFile().segmentCount(), 2);
+    for (int i = 0; i < EXTENTS; i++) {
+        ASSERT_EQ(*reinterpret_cast<int *>(GetExtentAddr(space->getNvmAddrByPageId(extents[i]))), i);
+    }
+}
+
+/* 多线程无锁分配 extent 不会重复, 线程退出时没有归还的预留在重启后被回收 */
+TEST_F(TableSpaceTest, TestExtentReservation) {
+    space->create();
+    const int THREADS = 16;
+    const int EXTENTS = 20;
+    std::vector<std::vector<uint32>> pages(THREADS);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < THREADS; t++) {
+        workers.emplace_back([&, t]() {
+            for (int i = 0; i < EXTENTS; i++) {
+                pages[t].push_back(space->fastAllocNewExtent(EXT_SIZE_2M, NVMInvalidPageId, t));
+            }
+            space->releaseThreadReservations();
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    std::set<uint32> segSet;
+    for (const auto &threadPages : pages) {
+        for (auto pageId : threadPages) {
+            ASSERT_EQ(segSet.count(pageId), 0);
+            segSet.insert(pageId);
+        }
+    }
+
+    /* 线程预留了一批 extent, 只用了一个就退出 */
+    auto hwm = space->getUsedPageCount(0);
+    std::thread([&]() {
+        segSet.insert(space->fastAllocNewExtent(EXT_SIZE_2M, NVMInvalidPageId, 0));
+    }).join();
+    auto leakedHwm = space->getUsedPageCount(0);
+    ASSERT_GE(leakedHwm, hwm + GetPageCountPerExtent(EXT_SIZE_2M));
+    space->unmount();
+    delete space;
+
+    space = new TableSpace(g_dir_config);
+    space->mount();
+    /* segment 剩余空间足够时一次预留多个 extent, 没用完的部分在 mount 时退回水位线 */
+    if (leakedHwm - hwm >= 2 * GetPageCountPerExtent(EXT_SIZE_2M)) {
+        ASSERT_LT(space->getUsedPageCount(0), leakedHwm);
+    }
+    for (int i = 0; i < TableSpace::EXTENT_RESERVATION_BATCH; i++) {
+        auto pageId = space->allocNewExtent(EXT_SIZE_2M, NVMInvalidPageId, 0);
+        ASSERT_EQ(segSet.count(pageId), 0);
+        segSet.insert(pageId);
+    }
+}
+
+/* 预留跨过 segment 末尾时, segment 尾部跳过的 page 放回空闲链表, 之后分配 EXT_SIZE_8K 时复用 */
+TEST_F(TableSpaceTest, TestReservationSkippedPages) {
+    space->create();
+    const auto pagesPerSegment = space->getLogicFile().getPagesPerSegment();
+    // 目录 0 的水位线从 2 开始, 按 EXT_SIZE_2M 预留会在 segment 末尾剩下不足一个 extent 的 page
+    ASSERT_NE((pagesPerSegment - 2) % GetPageCountPerExtent(EXT_SIZE_2M), 0U);
+    std::thread([&]() {
+        while (space->getUsedPageCount(0) <= pagesPerSegment) {
+            space->fastAllocNewExtent(EXT_SIZE_2M, NVMInvalidPageId, 0);
+        }
+        space->releaseThreadReservations();
+    }).join();
+    auto pageId = space->allocNewExtent(EXT_SIZE_8K, NVMInvalidPageId, 0);
+    ASSERT_LT(pageId, pagesPerSegment);
+}
+
+/* 表目录在重启后重建 oid 索引, 删除的槽位按空闲链表复用 */
+TEST_F(TableSpaceTest, TestTableDirectory) {
+    space->create();
+    const uint32 TABLES = 100000;
+    for (uint32 oid = 0; oid < TABLES; oid++) {
+        space->CreateTable(oid, oid + 2);
+    }
+    for (uint32 oid = 0; oid < TABLES; oid += 2) {
+        space->DropTable(oid);
+    }
+    ASSERT_EQ(space->GetTableNum(), TABLES / 2);
+    space->unmount();
+    delete space;
+
+    space = new TableSpace(g_dir_config);
+    space->mount();
+    ASSERT_EQ(space->GetTableNum(), TABLES / 2);
+    for (uint32 oid = 0; oid < TABLES; oid++) {
+        ASSERT_EQ(space->SearchTable(oid), oid % 2 == 0 ? NVMInvalidPageId : oid + 2);
+    }
+    /* 复用删除的槽位, 不会再分配新的 extent */
+    auto hwm = space->getUsedPageCount(0);
+    for (uint32 oid = TABLES; oid < TABLES + TABLES / 2; oid++) {
+        space->CreateTable(oid, oid + 2);
+    }
+    ASSERT_EQ(space->getUsedPageCount(0), hwm);
+    ASSERT_EQ(space->GetTableNum(), TABLES);
+    ASSERT_EQ(space->SearchTable(TABLES), TABLES + 2);
+}
+
+/* 反复创建和回收 segment, 回收的 extent 被 allocNewExtent 和 fastAllocNewExtent 复用, 水位线不再增长 */
+TEST_F(TableSpaceTest, TestFreeSegmentLoop) {
+    space->create();
+    const int LOOPS = 20;
+    const int EXTENTS = 6;
+    const auto dirCount = g_dir_config->size();
+    std::vector<uint32> hwm(dirCount);
+    for (int loop = 0; loop < LOOPS; loop++) {
+        uint32 root = space->allocNewExtent(EXT_SIZE_2M, NVMInvalidPageId, loop);
+        std::set<uint32> extents {root};
+        for (int i = 0; i < EXTENTS; i++) {
+            auto pageId = space->fastAllocNewExtent(EXT_SIZE_2M, root, i);
+            ASSERT_EQ(extents.count(pageId), 0);
+            extents.insert(pageId);
+            // 复用的 extent 已经清零
+            ASSERT_EQ(*reinterpret_cast<uint64 *>(GetExtentAddr(space->getNvmAddrByPageId(pageId))), 0);
+            *reinterpret_cast<uint64 *>(GetExtentAddr(space->getNvmAddrByPageId(pageId))) = pageId;
+        }
+        if (loop % 2 == 0) {
+            // truncate 之后 root 仍然可以继续分配
+            space->truncateSegment(root);
+            for (int i = 0; i < EXTENTS; i++) {
+                extents.insert(space->fastAllocNewExtent(EXT_SIZE_2M, root, i));
+            }
+            ASSERT_EQ(extents.size(), EXTENTS + 1);
+        }
+        space->freeSegment(&root);
+        ASSERT_EQ(root, NVMInvalidPageId);
+        for (uint32 i = 0; i < dirCount; i++) {
+            if (loop == 0) {
+                hwm[i] = space->getUsedPageCount(i);
+            }
+            ASSERT_EQ(space->getUsedPageCount(i), hwm[i]);
+        }
+    }
+    space->releaseThreadReservations();
+    space->unmount();
+    delete space;
+
+    /* 空闲链表是持久化的, 重启之后继续复用 */
+    space = new TableSpace(g_dir_config);
+    space->mount();
+    uint32 root = space->allocNewExtent(EXT_SIZE_2M);
+    for (int i = 0; i < EXTENTS; i++) {
+        space->fastAllocNewExtent(EXT_SIZE_2M, root, i);
+    }
+    for (uint32 i = 0; i < dirCount; i++) {
+        ASSERT_LE(space->getUsedPageCount(i), hwm[i]);
+    }
+}
+
+TEST(TableSpaceBackendTest, TestAnonBackend) {
+    const auto savedBackend = FLAGS_nvm_backend;
+    FLAGS_nvm_backend = "anon";
+    auto dirConfig = std::make_shared<NVMDB::DirectoryConfig>("/mnt/pmem0/anon;/mnt/pmem1/anon", true);
+    for (const auto &it : dirConfig->getDirPaths()) {
+        ASSERT_EQ(it.compare(0, FLAGS_nvm_emulate_dir.size(), FLAGS_nvm_emulate_dir), 0);
+    }
+    auto *space = new TableSpace(dirConfig);
+    space->create();
+    auto *root = static_cast<unsigned char *>(space->getTableMetadataPage());
+    for (int i = 0; i < 100; i++) {
+        root[i] = (unsigned char)(i + 1);
+    }
+    space->unmount();
+    delete space;
+
+    /* 进程内 unmount 后再 mount, 匿名内存的内容不变 */
+    space = new TableSpace(dirConfig);
+    space->mount();
+    root = static_cast<unsigned char *>(space->getTableMetadataPage());
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(root[i], i + 1);
+    }
+    space->unmount();
+    delete space;
+
+    /* 重新初始化目录时释放所有 segment */
+    dirConfig = std::make_shared<NVMDB::DirectoryConfig>("/mnt/pmem0/anon;/mnt/pmem1/anon", true);
+    space = new TableSpace(dirConfig);
+    root = static_cast<unsigned char *>(space->getTableMetadataPage());
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(root[i], 0);
+    }
+    space->unmount();
+    delete space;
+    for (const auto &it : dirConfig->getDirPaths()) {
+        std::experimental::filesystem::remove_all(it);
+    }
+    FLAGS_nvm_backend = savedBackend;
+}
+
+/* 目录路径可以用 "@节点号" 指定所在的 NUMA 节点, 不影响目录本身 */
+TEST(DirectoryConfigTest, TestNumaNodeSuffix) {
+    auto dirConfig = std::make_shared<NVMDB::DirectoryConfig>("/mnt/pmem0/numa@1;/mnt/pmem1/numa@0", true);
+    ASSERT_EQ(dirConfig->size(), 2U);
+    ASSERT_EQ(dirConfig->getNumaNodeByIndex(0), 1);
+    ASSERT_EQ(dirConfig->getNumaNodeByIndex(1), 0);
+    for (const auto &it : dirConfig->getDirPaths()) {
+        ASSERT_EQ(it.find('@'), std::string::npos);
+        std::experimental::filesystem::remove_all(it);
+    }
 }
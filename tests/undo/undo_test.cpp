@@ -3,8 +3,11 @@
 #include "transaction/nvm_transaction.h"
 #include "nvmdb_thread.h"
 #include "common/test_declare.h"
+#include <algorithm>
 #include <experimental/filesystem>
 #include <gtest/gtest.h>
+#include <mutex>
+#include <thread>
 
 using namespace NVMDB;
 
@@ -140,4 +143,326 @@ TEST_F(UndoTest, UndoRecoveryTest) {
     DestroyLocalUndoSegment();
     UndoExitProcess();
     delete[] record_cache;
-}
\ No newline at end of file
+}
+
+/* 恢复线程少于目录数时, 每个目录中崩溃事务的 tx slot 仍然都会被回滚 */
+TEST_F(UndoTest, RecoveryFewerThreadsThanDirsTest) {
+    UndoCreate();
+    UndoExitProcess();
+    UndoBootStrap();
+    WaitUndoRecovery();
+
+    /* 相邻创建的线程绑定到不同的目录, 各自留下一个没有结束的事务 */
+    const auto dirNum = g_dir_config->size();
+    std::vector<std::pair<uint32, uint64>> crashedSlots;
+    for (size_t t = 0; t < dirNum; t++) {
+        std::thread worker([&]() {
+            InitLocalUndoSegment();
+            UndoSegment *undo_segment = GetThreadLocalUndoSegment();
+            uint64 slotId = undo_segment->getNextTxSlot();
+            // 占用 slotId 并置为进行中, 线程退出时不结束这个事务
+            AllocUndoContext();
+            crashedSlots.emplace_back(undo_segment->getSegmentId(), slotId);
+        });
+        worker.join();
+    }
+    std::vector<bool> dirUsed(dirNum, false);
+    for (auto &slot : crashedSlots) {
+        dirUsed[g_dir_config->getDirPathIdByIndex(slot.first)] = true;
+    }
+    ASSERT_EQ(std::count(dirUsed.begin(), dirUsed.end(), true), static_cast<long>(dirNum));
+    UndoExitProcess();
+
+    const int32 savedThreads = FLAGS_undo_recovery_threads;
+    FLAGS_undo_recovery_threads = 1;
+    UndoBootStrap();
+    WaitUndoRecovery();
+    FLAGS_undo_recovery_threads = savedThreads;
+    for (auto &slot : crashedSlots) {
+        TxSlotStatus status = GetUndoSegment(static_cast<int>(slot.first))->getTxSlot(slot.second)->status;
+        ASSERT_EQ(status, TxSlotStatus::ROLL_BACKED) << "segment " << slot.first;
+    }
+    UndoExitProcess();
+}
+
+/* 线程频繁创建和销毁时, 释放的 undo segment 能被同一节点上的新线程复用, 且不会被两个线程同时持有 */
+TEST_F(UndoTest, SegmentReuseStressTest) {
+    UndoCreate();
+
+    constexpr int ROUNDS = 64;
+    constexpr int THREADS_PER_ROUND = 64;
+    constexpr int TXS_PER_THREAD = 16;
+    std::vector<std::atomic<int>> holders(NVMDB_UNDO_MAX_SEGMENT_NUM);
+    for (auto &holder : holders) {
+        holder.store(0);
+    }
+    std::atomic<int> failed{0};
+    uint64 TEST_CSN = MIN_TX_CSN;
+    for (int round = 0; round < ROUNDS; round++) {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < THREADS_PER_ROUND; t++) {
+            workers.emplace_back([&]() {
+                InitLocalUndoSegment();
+                auto segId = GetThreadLocalUndoSegment()->getSegmentId();
+                if (holders[segId].fetch_add(1) != 0) {
+                    failed++;
+                }
+                for (int i = 0; i < TXS_PER_THREAD; i++) {
+                    /* segment 满了之后会被交还并切换到新的 segment */
+                    bool switched = GetThreadLocalUndoSegment()->isFull();
+                    if (switched) {
+                        holders[segId].fetch_sub(1);
+                    }
+                    auto undoTxCtx = AllocUndoContext();
+                    undoTxCtx->UpdateTxSlotStatus(TxSlotStatus::COMMITTED);
+                    undoTxCtx->UpdateTxSlotCSN(TEST_CSN);
+                    if (switched) {
+                        segId = GetThreadLocalUndoSegment()->getSegmentId();
+                        if (holders[segId].fetch_add(1) != 0) {
+                            failed++;
+                        }
+                    }
+                }
+                holders[segId].fetch_sub(1);
+                DestroyLocalUndoSegment();
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+    ASSERT_EQ(failed.load(), 0);
+
+    for (uint32 i = 0; i < GetUndoSegmentNum(); i++) {
+        ASSERT_EQ(holders[i].load(), 0);
+    }
+    /* 所有 segment 都已交还, 新线程仍然可以拿到 segment */
+    InitLocalUndoSegment();
+    ASSERT_EQ(GetThreadLocalUndoSegment()->isFull(), false);
+    DestroyLocalUndoSegment();
+    UndoExitProcess();
+}
+
+/* undo 空间的配置在 InitDB 时指定, 重启后从 undo space header 中恢复; segment 不够时在线扩展 */
+TEST_F(UndoTest, ConfigurableCapacityTest) {
+    UndoSpaceConfig config;
+    config.segmentNum = 2;
+    config.txSlotsPerSegment = 64;
+    config.segmentFileSize = 1024 * 1024;
+    config.maxFilesPerSegment = 8;
+    ASSERT_TRUE(config.isValid());
+    UndoCreate(config);
+    UndoExitProcess();
+
+    UndoBootStrap();
+    WaitUndoRecovery();
+    ASSERT_EQ(GetUndoSegmentNum(), 2);
+    ASSERT_EQ(GetUndoSpaceConfig().txSlotsPerSegment, 64);
+    ASSERT_EQ(GetUndoSpaceConfig().segmentFileSize, 1024 * 1024);
+
+    /* 同时持有 segment 的线程数多于 segment 数量 */
+    constexpr int THREADS = 8;
+    std::atomic<int> ready{0};
+    std::atomic<bool> release{false};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < THREADS; t++) {
+        workers.emplace_back([&]() {
+            InitLocalUndoSegment();
+            ready++;
+            while (!release.load()) {
+                std::this_thread::yield();
+            }
+            DestroyLocalUndoSegment();
+        });
+    }
+    while (ready.load() != THREADS) {
+        std::this_thread::yield();
+    }
+    const auto grownNum = GetUndoSegmentNum();
+    ASSERT_GE(grownNum, THREADS);
+    release = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    /* tx slot 数量使用配置中的值 */
+    InitLocalUndoSegment();
+    UndoSegment *undo_segment = GetThreadLocalUndoSegment();
+    ASSERT_EQ(undo_segment->getTxSlotNum(), 64);
+    for (int i = 0; i < 64; i++) {
+        ASSERT_FALSE(undo_segment->isFull());
+        auto undoTxCtx = AllocUndoContext();
+        undoTxCtx->UpdateTxSlotStatus(TxSlotStatus::COMMITTED);
+        undoTxCtx->UpdateTxSlotCSN(MIN_TX_CSN + i);
+    }
+    ASSERT_TRUE(undo_segment->isFull());
+    DestroyLocalUndoSegment();
+    UndoExitProcess();
+
+    /* 扩展后的 segment 数量是持久的 */
+    UndoBootStrap();
+    WaitUndoRecovery();
+    ASSERT_EQ(GetUndoSegmentNum(), grownNum);
+
+    /* 崩溃时扩展出来的 segment 中未结束的事务, 重启后同样会被回滚 */
+    std::mutex slotsLock;
+    std::vector<std::pair<uint32, uint64>> crashedSlots;
+    ready = 0;
+    release = false;
+    workers.clear();
+    for (int t = 0; t < THREADS; t++) {
+        workers.emplace_back([&]() {
+            InitLocalUndoSegment();
+            UndoSegment *segment = GetThreadLocalUndoSegment();
+            if (!segment->isFull()) {
+                uint64 slotId = segment->getNextTxSlot();
+                auto undoTxCtx = AllocUndoContext();
+                std::lock_guard<std::mutex> guard(slotsLock);
+                crashedSlots.emplace_back(segment->getSegmentId(), slotId);
+            }
+            ready++;
+            while (!release.load()) {
+                std::this_thread::yield();
+            }
+            DestroyLocalUndoSegment();
+        });
+    }
+    while (ready.load() != THREADS) {
+        std::this_thread::yield();
+    }
+    release = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    ASSERT_TRUE(std::any_of(crashedSlots.begin(), crashedSlots.end(),
+                            [](const std::pair<uint32, uint64> &slot) { return slot.first >= 2; }));
+    UndoExitProcess();
+
+    UndoBootStrap();
+    WaitUndoRecovery();
+    ASSERT_GE(GetUndoSegmentNum(), grownNum);
+    for (auto &slot : crashedSlots) {
+        TxSlotStatus status = GetUndoSegment(static_cast<int>(slot.first))->getTxSlot(slot.second)->status;
+        ASSERT_EQ(status, TxSlotStatus::ROLL_BACKED) << "segment " << slot.first;
+    }
+    UndoExitProcess();
+}
+
+/* 大配置: segment 数量多于默认值和线程数上限, 每个 segment 的 tx slot 多于测试构建的默认值 */
+TEST_F(UndoTest, LargeCapacityTest) {
+    constexpr uint32 LARGE_SLOTS = 32 * 1024;
+    constexpr uint64 LARGE_FILE_SIZE = 2 * 1024 * 1024;
+    UndoSpaceConfig config;
+    config.segmentNum = 1024;
+    config.txSlotsPerSegment = LARGE_SLOTS;
+    config.segmentFileSize = LARGE_FILE_SIZE;
+    config.maxFilesPerSegment = 8;
+    ASSERT_TRUE(config.isValid());
+    UndoCreate(config);
+    UndoExitProcess();
+
+    UndoBootStrap();
+    WaitUndoRecovery();
+    ASSERT_EQ(GetUndoSegmentNum(), 1024);
+    ASSERT_EQ(GetUndoSpaceConfig().txSlotsPerSegment, LARGE_SLOTS);
+    ASSERT_EQ(GetUndoSpaceConfig().segmentFileSize, LARGE_FILE_SIZE);
+
+    /* 同时持有 segment 的线程数超过默认的 segment 数量, 不需要扩展 */
+    constexpr int THREADS = NVMDB_UNDO_SEGMENT_NUM + 100;
+    std::atomic<int> ready{0};
+    std::atomic<bool> release{false};
+    std::vector<std::atomic<int>> holders(NVMDB_UNDO_MAX_SEGMENT_NUM);
+    for (auto &holder : holders) {
+        holder.store(0);
+    }
+    std::atomic<int> failed{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < THREADS; t++) {
+        workers.emplace_back([&]() {
+            InitLocalUndoSegment();
+            if (holders[GetThreadLocalUndoSegment()->getSegmentId()].fetch_add(1) != 0) {
+                failed++;
+            }
+            ready++;
+            while (!release.load()) {
+                std::this_thread::yield();
+            }
+            DestroyLocalUndoSegment();
+        });
+    }
+    while (ready.load() != THREADS) {
+        std::this_thread::yield();
+    }
+    ASSERT_EQ(GetUndoSegmentNum(), 1024);
+    release = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    ASSERT_EQ(failed.load(), 0);
+
+    /* 一个 segment 可以容纳 LARGE_SLOTS 个事务 */
+    InitLocalUndoSegment();
+    UndoSegment *undo_segment = GetThreadLocalUndoSegment();
+    ASSERT_EQ(undo_segment->getTxSlotNum(), LARGE_SLOTS);
+    for (uint32 i = 0; i < LARGE_SLOTS; i++) {
+        ASSERT_FALSE(undo_segment->isFull());
+        auto undoTxCtx = AllocUndoContext();
+        undoTxCtx->UpdateTxSlotStatus(TxSlotStatus::COMMITTED);
+        undoTxCtx->UpdateTxSlotCSN(MIN_TX_CSN + i);
+    }
+    ASSERT_TRUE(undo_segment->isFull());
+    DestroyLocalUndoSegment();
+    UndoExitProcess();
+
+    UndoBootStrap();
+    WaitUndoRecovery();
+    ASSERT_EQ(GetUndoSegmentNum(), 1024);
+    ASSERT_EQ(GetUndoSpaceConfig().txSlotsPerSegment, LARGE_SLOTS);
+    UndoExitProcess();
+}
+
+/* 回收后的 undo 空间通过打洞释放, 未回收的 undo record 不受影响 */
+TEST_F(UndoTest, PunchRecycledUndoTest) {
+    UndoCreate();
+    FLAGS_undo_punch_mb_per_sec = 0;
+    InitLocalUndoSegment();
+
+    std::string data(200, 'x');
+    uint64 TEST_CSN = MIN_TX_CSN + 1;
+    char *record_cache = new char[MAX_UNDO_RECORD_CACHE_SIZE];
+    auto head = (UndoRecord *)record_cache;
+    UndoSegment *undo_segment = GetThreadLocalUndoSegment();
+    /* 写满至少 UNDO_PUNCH_UNIT 的 undo 空间 */
+    const int MAX_TXS = 2 * (UNDO_SEGMENT_SIZE + 2 * UNDO_PUNCH_UNIT) / (20 * data.length()) + 1;
+    ASSERT_LT(MAX_TXS, UNDO_TX_SLOTS);
+    for (int i = 0; i < MAX_TXS; i++) {
+        auto undoTxCtx = AllocUndoContext();
+        for (int j = 0; j < 20; j++) {
+            head->m_undoType = InvalidUndoRecordType;
+            head->m_payload = data.length();
+            memcpy(head->data, data.c_str(), data.length());
+            undoTxCtx->insertUndoRecord(head);
+        }
+        undoTxCtx->UpdateTxSlotStatus(TxSlotStatus::COMMITTED);
+        undoTxCtx->UpdateTxSlotCSN(TEST_CSN);
+    }
+    auto punchedBefore = GetUndoBytesPunched();
+    undo_segment->recycleTxSlot(TEST_CSN + 1);
+    ASSERT_GE(GetUndoBytesPunched() - punchedBefore, UNDO_PUNCH_UNIT);
+
+    /* 打洞之后仍然可以继续写入和读取新的 undo record */
+    auto undoTxCtx = AllocUndoContext();
+    head->m_payload = data.length();
+    UndoRecPtr undo_ptr = undoTxCtx->insertUndoRecord(head);
+    undoTxCtx->UpdateTxSlotStatus(TxSlotStatus::COMMITTED);
+    undoTxCtx->UpdateTxSlotCSN(TEST_CSN);
+    memset(record_cache, 0, MAX_UNDO_RECORD_CACHE_SIZE);
+    GetUndoRecord(undo_ptr, head);
+    ASSERT_EQ(head->m_payload, data.length());
+    ASSERT_EQ(std::string(head->data, head->m_payload), data);
+
+    DestroyLocalUndoSegment();
+    UndoExitProcess();
+    FLAGS_undo_punch_mb_per_sec = 1024;
+    delete[] record_cache;
+}